@@ -0,0 +1,97 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pager/constants.h"
+#include "pager/pager.h"
+#include "pager/pager_format.h"
+#include "pager/db/free_space.h"
+
+// Page allocation - how often page 0 gets written. Allocating and freeing only change pager->header, which goes to page 0
+// once per commit that changed it. Before that every allocation that grew the file rewrote page 0 on the spot
+// Each round grows the DB by allocs_per_txn pages a transaction, then frees them all and takes them back off the free list
+
+#define BENCH_DB_FILE "bench_alloc.pseql"
+#define TOTAL_ALLOCS 16384
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void cleanup_files() {
+    unlink(BENCH_DB_FILE);
+    unlink(BENCH_DB_FILE WAL_FILE_EXTENSION);
+    unlink(BENCH_DB_FILE JOURNAL_FILE_EXTENSION);
+}
+
+static void commit(Pager* pager) {
+    if (pager_commit(pager) != PSQL_OK) {
+        fprintf(stderr, "Commit failed\n");
+        exit(1);
+    }
+}
+
+// allocs_per_txn pages at a time until there are TOTAL_ALLOCS of them - from the free list if reuse, off the end otherwise
+static double allocate_all(Pager* pager, uint32_t allocs_per_txn, uint32_t* pages) {
+    double start = now_seconds();
+    for (uint32_t done = 0; done < TOTAL_ALLOCS;) {
+        pager_begin_transaction(pager);
+        for (uint32_t i = 0; i < allocs_per_txn && done < TOTAL_ALLOCS; i++, done++) {
+            pages[done] = get_free_page(pager);
+            DBPage* page = init_data_page(pager, pages[done]);
+            if (!page) {
+                fprintf(stderr, "Allocation failed\n");
+                exit(1);
+            }
+            pager_unpin_page(pager, page);
+        }
+        commit(pager);
+    }
+    return now_seconds() - start;
+}
+
+static void bench_alloc(const char* name, uint32_t flags, uint32_t allocs_per_txn) {
+    cleanup_files();
+    Pager* pager = init_pager(BENCH_DB_FILE, PAGER_WRITEABLE | PAGER_OVERWRITE | flags);
+    if (!pager || pager_init_new_db(pager) != PSQL_OK) {
+        fprintf(stderr, "Failed to create %s\n", BENCH_DB_FILE);
+        exit(1);
+    }
+    pager_flush_cache(pager);
+    uint32_t* pages = (uint32_t*)malloc(TOTAL_ALLOCS * sizeof(uint32_t));
+
+    uint64_t before = pager_get_io_stats(pager).header_writes;
+    double grow_s = allocate_all(pager, allocs_per_txn, pages);
+    uint64_t grow_writes = pager_get_io_stats(pager).header_writes - before;
+
+    pager_begin_transaction(pager);
+    for (uint32_t i = 0; i < TOTAL_ALLOCS; i++) mark_page_free(pager, pages[i]);
+    commit(pager);
+
+    before = pager_get_io_stats(pager).header_writes;
+    double reuse_s = allocate_all(pager, allocs_per_txn, pages);
+    uint64_t reuse_writes = pager_get_io_stats(pager).header_writes - before;
+
+    printf("%-12s %5u allocs/txn  grow %10.0f allocs/s %6lu header writes (was >= %d)  reuse %10.0f allocs/s %6lu header writes\n",
+           name, allocs_per_txn, TOTAL_ALLOCS / grow_s, (unsigned long)grow_writes, TOTAL_ALLOCS,
+           TOTAL_ALLOCS / reuse_s, (unsigned long)reuse_writes);
+    free(pages);
+    pager_close_db(pager);
+    cleanup_files();
+}
+
+int main() {
+    uint32_t sizes[] = { 1, 16, 256, 4096 };
+    printf("Page allocation - %d allocations per run, page 0 writes counted by pager_get_io_stats()\n", TOTAL_ALLOCS);
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        bench_alloc("mmap", 0, sizes[i]);
+        bench_alloc("buffer pool", PAGER_BUFFER_POOL, sizes[i]);
+        bench_alloc("memory", PAGER_MEMORY_DB, sizes[i]);
+    }
+    return 0;
+}
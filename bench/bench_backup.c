@@ -0,0 +1,113 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pager/constants.h"
+#include "pager/pager.h"
+#include "pager/pager_format.h"
+#include "pager/backup.h"
+
+// Online backup - a full backup against an incremental one after a few percent of the pages changed,
+// and a full backup taken a step at a time while a writer keeps committing in between
+
+#define BENCH_DB_FILE "bench_backup.pseql"
+#define BENCH_BACKUP_FILE "bench_backup_copy.pseql"
+#define DB_PAGES 16384  // 64MB with 4KB pages
+#define STEP_PAGES 256
+#define TXN_PAGES 8
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void cleanup_files() {
+    unlink(BENCH_DB_FILE);
+    unlink(BENCH_DB_FILE WAL_FILE_EXTENSION);
+    unlink(BENCH_DB_FILE JOURNAL_FILE_EXTENSION);
+    unlink(BENCH_BACKUP_FILE);
+    unlink(BENCH_BACKUP_FILE BACKUP_FILE_EXTENSION);
+}
+
+static void write_random_pages(Pager* pager, uint32_t first, uint32_t count, unsigned int* seed) {
+    pager_begin_transaction(pager);
+    for (uint32_t i = 0; i < count; i++) {
+        DBPage* page = pager_get_page(pager, first + rand_r(seed) % DB_PAGES);
+        memset(page->data, (int)rand_r(seed), 256);
+        pager_write_page(pager, page);
+        pager_unpin_page(pager, page);
+    }
+    if (pager_commit(pager) != PSQL_OK) {
+        fprintf(stderr, "Commit failed\n");
+        exit(1);
+    }
+}
+
+// Steps of STEP_PAGES until done, with a transaction from writer_txns in between each
+static void run_backup(const char* name, Pager* pager, bool incremental, uint32_t first, int writer_txns) {
+    unsigned int seed = 7;
+    double start = now_seconds();
+    PagerBackup* backup = pager_backup_init(pager, BENCH_BACKUP_FILE, incremental);
+    if (!backup) {
+        fprintf(stderr, "Backup init failed\n");
+        exit(1);
+    }
+    int txns = 0;
+    while (pager_backup_remaining(backup) > 0) {
+        if (pager_backup_step(backup, STEP_PAGES) != PSQL_OK) {
+            fprintf(stderr, "Backup step failed\n");
+            exit(1);
+        }
+        if (txns < writer_txns) {
+            write_random_pages(pager, first, TXN_PAGES, &seed);
+            txns++;
+        }
+    }
+    BackupStats stats = pager_backup_stats(backup);
+    if (pager_backup_finish(backup) != PSQL_OK) {
+        fprintf(stderr, "Backup finish failed\n");
+        exit(1);
+    }
+    double elapsed = now_seconds() - start;
+    printf("%-24s %8.2f ms  %6lu pages copied (%lu recopied, %lu skipped)  %8.2f MB written  %4lu steps\n", name,
+           elapsed * 1e3, (unsigned long)stats.pages_copied, (unsigned long)stats.pages_recopied,
+           (unsigned long)stats.pages_skipped, stats.bytes_written / (1024.0 * 1024.0), (unsigned long)stats.steps);
+}
+
+int main() {
+    cleanup_files();
+    Pager* pager = init_pager(BENCH_DB_FILE, PAGER_WRITEABLE | PAGER_OVERWRITE);
+    if (!pager || pager_init_new_db(pager) != PSQL_OK) {
+        fprintf(stderr, "Failed to create %s\n", BENCH_DB_FILE);
+        return 1;
+    }
+    uint32_t first = allocate_new_db_pages(pager, DB_PAGES) - (DB_PAGES - 1);
+    for (uint32_t i = 0; i < DB_PAGES; i++) {
+        DBPage* page = init_data_page(pager, first + i);
+        memset(page->data, (int)i, 256);
+        pager_write_page(pager, page);
+    }
+    pager_flush_cache(pager);
+
+    printf("Online backup - %d page DB, %d page steps\n", DB_PAGES, STEP_PAGES);
+    run_backup("full, idle", pager, false, first, 0);
+    run_backup("full, writer between", pager, false, first, DB_PAGES / STEP_PAGES);
+
+    int percents[] = { 1, 5, 10 };
+    unsigned int seed = 1;
+    for (size_t i = 0; i < sizeof(percents) / sizeof(percents[0]); i++) {
+        uint32_t changed = DB_PAGES * percents[i] / 100;
+        for (uint32_t n = 0; n < changed; n += TXN_PAGES) write_random_pages(pager, first, TXN_PAGES, &seed);
+        char name[32];
+        snprintf(name, sizeof(name), "incremental, %d%% written", percents[i]);
+        run_backup(name, pager, true, first, 0);
+    }
+
+    pager_close_db(pager);
+    cleanup_files();
+    return 0;
+}
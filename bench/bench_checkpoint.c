@@ -0,0 +1,92 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pager/constants.h"
+#include "pager/pager.h"
+#include "pager/pager_format.h"
+
+// Commit latency in WAL mode with automatic checkpoints run
+// 1) inline - on the committing thread, whichever commit crosses the threshold pays for the copy
+// 2) background - on the checkpointer thread, in each mode
+// Prints the checkpoint lag/duration stats next to it, to tune the thresholds against foreground latency
+
+#define BENCH_DB_FILE "bench_checkpoint.pseql"
+#define DEFAULT_COMMITS 4000
+#define DB_PAGES 2048
+#define PAGES_PER_COMMIT 4
+#define CHECKPOINT_FRAMES 256
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_policy(const char* name, CheckpointPolicy policy, size_t num_commits) {
+    unlink(BENCH_DB_FILE);
+    unlink(BENCH_DB_FILE WAL_FILE_EXTENSION);
+    Pager* pager = init_pager(BENCH_DB_FILE, PAGER_WRITEABLE | PAGER_OVERWRITE | PAGER_WAL);
+    if (!pager || pager_init_new_db(pager) != PSQL_OK) {
+        fprintf(stderr, "Failed to create %s\n", BENCH_DB_FILE);
+        exit(1);
+    }
+
+    uint32_t first = allocate_new_db_pages(pager, DB_PAGES) - (DB_PAGES - 1);
+    for (uint32_t i = 0; i < DB_PAGES; i++) init_data_page(pager, first + i);
+    pager_flush_cache(pager);
+    pager_checkpoint(pager, CHECKPOINT_TRUNCATE);
+    pager_set_checkpoint_policy(pager, policy);
+
+    double* latencies = (double*)malloc(num_commits * sizeof(double));
+    unsigned int seed = 42;
+    double start = now_seconds();
+    for (size_t i = 0; i < num_commits; i++) {
+        double commit_start = now_seconds();
+        for (int j = 0; j < PAGES_PER_COMMIT; j++) {
+            DBPage* page = pager_get_page(pager, first + rand_r(&seed) % DB_PAGES);
+            memset(page->data, (int)i, 128);
+            pager_write_page(pager, page);
+        }
+        if (pager_flush_cache(pager) != PSQL_OK) {
+            fprintf(stderr, "Commit %zu failed\n", i);
+            exit(1);
+        }
+        latencies[i] = now_seconds() - commit_start;
+    }
+    double elapsed = now_seconds() - start;
+
+    CheckpointStats stats = pager_checkpoint_stats(pager);
+    pager_close_db(pager);
+    unlink(BENCH_DB_FILE);
+
+    qsort(latencies, num_commits, sizeof(double), compare_doubles);
+    printf("%-22s %8.0f commits/s  p50 %7.1f us  p99 %7.1f us  max %8.1f us\n", name, num_commits / elapsed,
+           latencies[num_commits / 2] * 1e6, latencies[num_commits * 99 / 100] * 1e6, latencies[num_commits - 1] * 1e6);
+    printf("%-22s %8lu checkpoints (%lu resets)  lag max %lu frames / %lu us  duration avg %lu us max %lu us\n", "",
+           (unsigned long)stats.checkpoints, (unsigned long)stats.resets, (unsigned long)stats.max_lag_frames,
+           (unsigned long)stats.max_lag_us, (unsigned long)(stats.checkpoints ? stats.total_duration_us / stats.checkpoints : 0),
+           (unsigned long)stats.max_duration_us);
+    free(latencies);
+}
+
+int main(int argc, char** argv) {
+    size_t num_commits = DEFAULT_COMMITS;
+    if (argc > 1) num_commits = strtoul(argv[1], NULL, 10);
+    if (num_commits == 0) num_commits = DEFAULT_COMMITS;
+
+    printf("WAL commit latency - %d random pages per commit, checkpoint every %d frames\n", PAGES_PER_COMMIT, CHECKPOINT_FRAMES);
+    bench_policy("inline passive", (CheckpointPolicy){ CHECKPOINT_PASSIVE, CHECKPOINT_FRAMES, 0, false }, num_commits);
+    bench_policy("background passive", (CheckpointPolicy){ CHECKPOINT_PASSIVE, CHECKPOINT_FRAMES, 0, true }, num_commits);
+    bench_policy("background full", (CheckpointPolicy){ CHECKPOINT_FULL, CHECKPOINT_FRAMES, 0, true }, num_commits);
+    bench_policy("background truncate", (CheckpointPolicy){ CHECKPOINT_TRUNCATE, CHECKPOINT_FRAMES, 0, true }, num_commits);
+    return 0;
+}
@@ -0,0 +1,187 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "pager/constants.h"
+#include "pager/pager.h"
+#include "pager/pager_format.h"
+#include "pager/readahead.h"
+
+// Cold cache range scans - the file's pages are dropped from the page cache before every run, so each page the
+// scan touches comes off the disk. The leaf chain is laid out in a shuffled order like a tree after many splits,
+// each leaf pointing at rows in data pages that sit in key order after it (a heap filled by inserts).
+// The scan covers the first SCAN_FRACTION of the keys, so reading a whole file region in is not a free win.
+// 1) no hints - the kernel reads around every fault, which helps the data pages but mostly reads leaves out of range
+// 2) random advice (MADV_RANDOM / POSIX_FADV_RANDOM) - one page per miss, what point lookups get
+// 3) read-ahead window - PagerReadahead keeps the next READAHEAD_WINDOW_LEAVES leaves and their data pages coming in
+
+#define BENCH_DB_FILE "bench_cold_scan.pseql"
+#define DEFAULT_LEAVES 16384  // 64MB of leaves and 128MB of data pages with 4KB pages
+#define DATA_PAGES_PER_LEAF 2
+#define SCAN_FRACTION 8       // Scan 1/8 of the leaf chain
+
+typedef struct {
+    uint64_t key;
+    uint32_t data_page;
+    uint32_t data_offset;
+} Row;
+
+// Leaf layout in page->data - row count, then the rows from LEAF_ROWS
+#define LEAF_ROWS 8
+#define LEAF_COUNT(page) (*(const uint32_t*)(page)->data)
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+    uint32_t first_leaf;  // Head of the chain - not the lowest page number
+    uint32_t scan_leaves; // Leaves a scan walks
+    size_t rows_per_leaf;
+} Table;
+
+static Table build_table(Pager* pager, uint32_t num_leaves) {
+    Table table = {0};
+    uint32_t rows_per_leaf = (PAGER_USABLE_SIZE(pager) - sizeof(DBPageHeader) - LEAF_ROWS) / sizeof(Row);
+    uint32_t rows_per_data_page = (rows_per_leaf + DATA_PAGES_PER_LEAF - 1) / DATA_PAGES_PER_LEAF;
+    uint32_t row_size = (PAGER_USABLE_SIZE(pager) - sizeof(DBPageHeader)) / rows_per_data_page;
+    uint32_t first = allocate_new_db_pages(pager, num_leaves) - (num_leaves - 1);
+    uint32_t data_first = allocate_new_db_pages(pager, (size_t)num_leaves * DATA_PAGES_PER_LEAF) - (num_leaves * DATA_PAGES_PER_LEAF - 1);
+
+    // Chain position -> page, shuffled
+    uint32_t* order = (uint32_t*)malloc(num_leaves * sizeof(uint32_t));
+    for (uint32_t i = 0; i < num_leaves; i++) order[i] = first + i;
+    unsigned int seed = 7;
+    for (uint32_t i = num_leaves - 1; i > 0; i--) {
+        uint32_t j = rand_r(&seed) % (i + 1);
+        uint32_t tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    uint64_t key = 0;
+    for (uint32_t i = 0; i < num_leaves; i++) {
+        DBPage* leaf = init_index_leaf_page(pager, order[i]);
+        Row* rows = (Row*)(leaf->data + LEAF_ROWS);
+        for (uint32_t r = 0; r < rows_per_leaf; r++, key++) {
+            uint32_t data_page = data_first + i * DATA_PAGES_PER_LEAF + r / rows_per_data_page;
+            rows[r] = (Row){ key, data_page, sizeof(DBPageHeader) + (r % rows_per_data_page) * row_size };
+        }
+        *(uint32_t*)leaf->data = rows_per_leaf;
+        leaf->header.right_sibling_page_id = i + 1 < num_leaves ? order[i + 1] : 0;
+        pager_write_page(pager, leaf);
+        pager_unpin_page(pager, leaf);
+
+        for (uint32_t d = 0; d < DATA_PAGES_PER_LEAF; d++) {
+            DBPage* data = init_data_page(pager, data_first + i * DATA_PAGES_PER_LEAF + d);
+            memset(data->data, (int)(i + d), PAGER_USABLE_SIZE(pager) - sizeof(DBPageHeader));
+            pager_write_page(pager, data);
+            pager_unpin_page(pager, data);
+        }
+    }
+    table.first_leaf = order[0];
+    table.scan_leaves = num_leaves / SCAN_FRACTION ? num_leaves / SCAN_FRACTION : 1;
+    table.rows_per_leaf = rows_per_leaf;
+    free(order);
+    return table;
+}
+
+// Write everything out and throw the file's pages out of the page cache - it must not be mapped at this point
+static void drop_page_cache() {
+    int fd = open(BENCH_DB_FILE, O_RDONLY);
+    if (fd < 0 || fdatasync(fd) != 0 || posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) != 0) {
+        perror("drop page cache");
+        exit(1);
+    }
+    close(fd);
+}
+
+// ReadaheadVisit - the data pages behind a leaf's rows
+static void prefetch_rows(Pager* pager, const DBPage* leaf) {
+    const Row* rows = (const Row*)(leaf->data + LEAF_ROWS);
+    uint32_t data_pages[1024];
+    uint32_t count = LEAF_COUNT(leaf) < 1024 ? LEAF_COUNT(leaf) : 1024;
+    for (uint32_t i = 0; i < count; i++) data_pages[i] = rows[i].data_page;
+    readahead_pages(pager, data_pages, count);
+}
+
+typedef enum { SCAN_NO_HINTS, SCAN_RANDOM, SCAN_WINDOW } ScanMode;
+
+static double bench_scan(Pager* pager, const Table* table, ScanMode mode) {
+    pager_set_access_pattern(pager, mode == SCAN_RANDOM ? PAGER_ACCESS_RANDOM : PAGER_ACCESS_NORMAL);
+    PagerReadahead readahead;
+    if (mode == SCAN_WINDOW) readahead_start(pager, &readahead, table->first_leaf, prefetch_rows);
+
+    uint64_t checksum = 0;
+    size_t seen = 0;
+    uint32_t leaves = 0;
+    double start = now_seconds();
+    for (uint32_t page_no = table->first_leaf; page_no && leaves < table->scan_leaves; leaves++) {
+        DBPage* leaf = pager_get_page(pager, page_no);
+        const Row* rows = (const Row*)(leaf->data + LEAF_ROWS);
+        uint32_t count = LEAF_COUNT(leaf);
+        for (uint32_t i = 0; i < count; i++) {
+            DBPage* data = pager_get_page(pager, rows[i].data_page);
+            checksum += rows[i].key + ((const uint8_t*)data)[rows[i].data_offset];
+            pager_unpin_page(pager, data);
+        }
+        seen += count;
+        page_no = leaf->header.right_sibling_page_id;
+        pager_unpin_page(pager, leaf);
+        if (mode == SCAN_WINDOW && page_no) readahead_advance(pager, &readahead, page_no);
+    }
+    double elapsed = now_seconds() - start;
+    if (seen != table->scan_leaves * table->rows_per_leaf) {
+        fprintf(stderr, "Scan saw %zu rows, expected %zu\n", seen, table->scan_leaves * table->rows_per_leaf);
+        exit(1);
+    }
+    if (checksum == 1) printf(" ");  // Keep the loop from being optimized out
+    return elapsed;
+}
+
+int main(int argc, char** argv) {
+    uint32_t num_leaves = DEFAULT_LEAVES;
+    if (argc > 1) num_leaves = (uint32_t)strtoul(argv[1], NULL, 10);
+    if (num_leaves == 0) num_leaves = DEFAULT_LEAVES;
+
+    unlink(BENCH_DB_FILE);
+    Pager* pager = init_pager(BENCH_DB_FILE, PAGER_WRITEABLE | PAGER_OVERWRITE);
+    if (!pager || pager_init_new_db(pager) != PSQL_OK) {
+        fprintf(stderr, "Failed to create %s\n", BENCH_DB_FILE);
+        return 1;
+    }
+    Table table = build_table(pager, num_leaves);
+    pager_close_db(pager);
+
+    size_t rows = table.scan_leaves * table.rows_per_leaf;
+    double mb = (double)table.scan_leaves * (1 + DATA_PAGES_PER_LEAF) * DEFAULT_PAGE_SIZE / (1024 * 1024);
+    printf("%u shuffled leaves (%.0f MB file), scanning %u of them - %zu rows, %.0f MB of pages - page cache dropped before every scan\n",
+           num_leaves, (double)num_leaves * (1 + DATA_PAGES_PER_LEAF) * DEFAULT_PAGE_SIZE / (1024 * 1024), table.scan_leaves, rows, mb);
+
+    const char* pagers[] = { "mmap", "buffer pool" };
+    const char* modes[] = { "no hints", "random advice", "read-ahead window" };
+    for (int p = 0; p < 2; p++) {
+        for (int m = SCAN_NO_HINTS; m <= SCAN_WINDOW; m++) {
+            drop_page_cache();
+            pager = init_pager(BENCH_DB_FILE, PAGER_READONLY | (p ? PAGER_BUFFER_POOL : 0));
+            if (!pager) {
+                fprintf(stderr, "Failed to open %s\n", BENCH_DB_FILE);
+                return 1;
+            }
+            double elapsed = bench_scan(pager, &table, (ScanMode)m);
+            PagerIOStats stats = pager_get_io_stats(pager);
+            printf("%-12s %-18s %8.3f s  %7.1f M rows/s  %7.1f MB/s  %7lu prefetch calls\n", pagers[p], modes[m], elapsed,
+                   rows / elapsed / 1e6, mb / elapsed, (unsigned long)stats.prefetch_calls);
+            pager_close_db(pager);
+        }
+    }
+    unlink(BENCH_DB_FILE);
+    unlink(BENCH_DB_FILE JOURNAL_FILE_EXTENSION);
+    return 0;
+}
@@ -0,0 +1,105 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "pager/constants.h"
+#include "pager/pager.h"
+#include "pager/pager_format.h"
+
+// Commits per second against the number of concurrent writers sharing one pager
+// Each writer loops begin -> touch a few of its own pages -> commit. Without group commit every commit
+// pays for its own fsync, with it the commits that land together share one
+
+#define BENCH_DB_FILE "bench_group_commit.pseql"
+#define DEFAULT_SECONDS 1.0
+#define PAGES_PER_WRITER 64
+#define PAGES_PER_COMMIT 2
+#define MAX_WRITERS 16
+
+typedef struct {
+    Pager* pager;
+    uint32_t first_page;
+    double deadline;
+    unsigned int seed;
+    uint64_t commits;
+} Writer;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void* writer_main(void* arg) {
+    Writer* writer = (Writer*)arg;
+    while (now_seconds() < writer->deadline) {
+        if (pager_begin_transaction(writer->pager) != PSQL_OK) break;
+        for (int i = 0; i < PAGES_PER_COMMIT; i++) {
+            DBPage* page = pager_get_page(writer->pager, writer->first_page + rand_r(&writer->seed) % PAGES_PER_WRITER);
+            memcpy(page->data, &writer->commits, sizeof(writer->commits));
+            pager_write_page(writer->pager, page);
+        }
+        if (pager_commit(writer->pager) != PSQL_OK) {
+            fprintf(stderr, "Commit failed\n");
+            exit(1);
+        }
+        writer->commits++;
+    }
+    return NULL;
+}
+
+static void bench_writers(const char* name, uint32_t flags, uint32_t window_us, int num_writers, double seconds) {
+    unlink(BENCH_DB_FILE);
+    unlink(BENCH_DB_FILE WAL_FILE_EXTENSION);
+    Pager* pager = init_pager(BENCH_DB_FILE, PAGER_WRITEABLE | PAGER_OVERWRITE | flags);
+    if (!pager || pager_init_new_db(pager) != PSQL_OK) {
+        fprintf(stderr, "Failed to create %s\n", BENCH_DB_FILE);
+        exit(1);
+    }
+
+    uint32_t first = allocate_new_db_pages(pager, PAGES_PER_WRITER * num_writers) - (PAGES_PER_WRITER * num_writers - 1);
+    for (int i = 0; i < PAGES_PER_WRITER * num_writers; i++) init_data_page(pager, first + i);
+    pager_flush_cache(pager);
+    pager_set_group_commit(pager, window_us, GROUP_COMMIT_MAX_BATCH);
+
+    Writer writers[MAX_WRITERS];
+    pthread_t threads[MAX_WRITERS];
+    double start = now_seconds();
+    for (int i = 0; i < num_writers; i++) {
+        writers[i] = (Writer){ pager, (uint32_t)(first + i * PAGES_PER_WRITER), start + seconds, (unsigned int)i + 1, 0 };
+        pthread_create(&threads[i], NULL, writer_main, &writers[i]);
+    }
+
+    uint64_t commits = 0;
+    for (int i = 0; i < num_writers; i++) {
+        pthread_join(threads[i], NULL);
+        commits += writers[i].commits;
+    }
+    double elapsed = now_seconds() - start;
+
+    GroupCommitStats stats = pager_group_commit_stats(pager);
+    pager_close_db(pager);
+    unlink(BENCH_DB_FILE);
+
+    printf("%-16s %2d writers  %9.0f commits/s  %6.2f commits/fsync  (largest batch %lu)\n", name, num_writers,
+           commits / elapsed, stats.syncs ? (double)stats.commits / stats.syncs : 0.0, (unsigned long)stats.max_batch);
+}
+
+int main(int argc, char** argv) {
+    double seconds = DEFAULT_SECONDS;
+    if (argc > 1) seconds = atof(argv[1]);
+    if (seconds <= 0) seconds = DEFAULT_SECONDS;
+
+    int writer_counts[] = { 1, 2, 4, 8, 16 };
+    size_t num_counts = sizeof(writer_counts) / sizeof(writer_counts[0]);
+
+    printf("Group commit - %d pages per commit, %.1fs per run\n", PAGES_PER_COMMIT, seconds);
+    for (size_t i = 0; i < num_counts; i++) bench_writers("wal, no window", PAGER_WAL, 0, writer_counts[i], seconds);
+    for (size_t i = 0; i < num_counts; i++) bench_writers("wal", PAGER_WAL, GROUP_COMMIT_WINDOW_US, writer_counts[i], seconds);
+    for (size_t i = 0; i < num_counts; i++) bench_writers("mmap", 0, GROUP_COMMIT_WINDOW_US, writer_counts[i], seconds);
+    return 0;
+}
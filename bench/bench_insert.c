@@ -0,0 +1,111 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "pager/constants.h"
+#include "pager/pager.h"
+#include "pager/pager_format.h"
+
+// Insert throughput when every insert needs a fresh page
+// 1) legacy - what allocate_new_db_page used to do: ftruncate + munmap + mmap for every page
+// 2) pager - reserved address space + geometric extents, mapping grows in place
+
+#define BENCH_DB_FILE "bench_insert.pseql"
+#define DEFAULT_PAGES 20000
+#define ROW_SIZE 128  // Bytes written into each new page - stand in for a row
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double bench_legacy_remap(size_t num_pages) {
+    unlink(BENCH_DB_FILE);
+    int fd = open(BENCH_DB_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("open");
+        exit(1);
+    }
+
+    uint8_t row[ROW_SIZE];
+    memset(row, 0xAB, sizeof(row));
+
+    size_t size = DEFAULT_PAGE_SIZE;
+    if (ftruncate(fd, size) != 0) perror("ftruncate");
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    double start = now_seconds();
+    for (size_t i = 0; i < num_pages; i++) {
+        size_t new_size = size + DEFAULT_PAGE_SIZE;
+        if (ftruncate(fd, new_size) != 0 || munmap(map, size) != 0) {
+            perror("legacy grow");
+            exit(1);
+        }
+        map = mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            perror("mmap");
+            exit(1);
+        }
+        memcpy((uint8_t*)map + size, row, sizeof(row));
+        size = new_size;
+    }
+    double elapsed = now_seconds() - start;
+
+    munmap(map, size);
+    close(fd);
+    unlink(BENCH_DB_FILE);
+    return elapsed;
+}
+
+static double bench_pager(size_t num_pages, uint32_t flags) {
+    unlink(BENCH_DB_FILE);
+    Pager* pager = init_pager(BENCH_DB_FILE, PAGER_WRITEABLE | PAGER_OVERWRITE | flags);
+    if (!pager || pager_init_new_db(pager) != PSQL_OK) {
+        fprintf(stderr, "Failed to create %s\n", BENCH_DB_FILE);
+        exit(1);
+    }
+
+    uint8_t row[ROW_SIZE];
+    memset(row, 0xAB, sizeof(row));
+
+    double start = now_seconds();
+    for (size_t i = 0; i < num_pages; i++) {
+        uint32_t page_id = allocate_new_db_page(pager);
+        DBPage* page = pager_get_page(pager, page_id);
+        if (!page_id || !page) {
+            fprintf(stderr, "Allocation failed at page %zu\n", i);
+            exit(1);
+        }
+        memcpy(page->data, row, sizeof(row));
+        pager_write_page(pager, page);
+        pager_unpin_page(pager, page);
+    }
+    double elapsed = now_seconds() - start;
+
+    pager_close_db(pager);
+    unlink(BENCH_DB_FILE);
+    unlink(BENCH_DB_FILE JOURNAL_FILE_EXTENSION);
+    return elapsed;
+}
+
+static void report(const char* name, size_t num_pages, double elapsed) {
+    printf("%-28s %8zu pages  %8.3f ms  %12.0f pages/s\n", name, num_pages, elapsed * 1000, num_pages / elapsed);
+}
+
+int main(int argc, char** argv) {
+    size_t num_pages = DEFAULT_PAGES;
+    if (argc > 1) num_pages = strtoul(argv[1], NULL, 10);
+    if (num_pages == 0 || num_pages > MAX_PAGES - 8) num_pages = DEFAULT_PAGES;
+
+    printf("Insert benchmark - one new page per insert\n");
+    report("legacy remap per page", num_pages, bench_legacy_remap(num_pages));
+    report("reserved mmap + extents", num_pages, bench_pager(num_pages, 0));
+    report("buffer pool + extents", num_pages, bench_pager(num_pages, PAGER_BUFFER_POOL));
+    return 0;
+}
@@ -0,0 +1,156 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "pager/constants.h"
+#include "pager/pager.h"
+#include "pager/pager_format.h"
+
+// Transactions per second with the rollback journal (PAGER_JOURNALING_ENABLED), by transaction size
+// Each transaction rewrites random pages and commits or rolls back. The journal's cost is the before-image copies,
+// a pwritev() per JOURNAL_BUFFER_PAGES of them and one fdatasync() - the writes/txn and syncs/txn columns show both
+// Each update changes 256 bytes of the page, so records still buffered at commit go out as deltas - KB/txn is the
+// journal write volume that leaves
+// The hot runs update the same HOT_PAGES over and over, like index roots and the header - only the first write of a page
+// in a transaction is journaled, the skipped/txn column is the rest
+// The recovery runs kill a transaction half way through and time the next open - the hot journal is rolled back on
+// several threads before init_pager() returns
+
+#define BENCH_DB_FILE "bench_journal.pseql"
+#define DEFAULT_SECONDS 1.0
+#define DB_PAGES 4096  // 16MB with 4KB pages
+#define HOT_PAGES 8
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void cleanup_files() {
+    unlink(BENCH_DB_FILE);
+    unlink(BENCH_DB_FILE WAL_FILE_EXTENSION);
+    unlink(BENCH_DB_FILE JOURNAL_FILE_EXTENSION);
+}
+
+static Pager* open_db(uint32_t flags, uint32_t* first) {
+    cleanup_files();
+    Pager* pager = init_pager(BENCH_DB_FILE, PAGER_WRITEABLE | PAGER_OVERWRITE | flags);
+    if (!pager || pager_init_new_db(pager) != PSQL_OK) {
+        fprintf(stderr, "Failed to create %s\n", BENCH_DB_FILE);
+        exit(1);
+    }
+    *first = allocate_new_db_pages(pager, DB_PAGES) - (DB_PAGES - 1);
+    for (uint32_t i = 0; i < DB_PAGES; i++) {
+        DBPage* page = init_data_page(pager, *first + i);
+        pager_write_page(pager, page);
+        pager_unpin_page(pager, page);
+    }
+    pager_flush_cache(pager);
+    return pager;
+}
+
+static void bench_transactions(const char* name, uint32_t flags, int pages_per_txn, uint32_t spread, bool rollback, double seconds) {
+    uint32_t first;
+    Pager* pager = open_db(flags, &first);
+
+    unsigned int seed = 1;
+    uint64_t txns = 0;
+    double start = now_seconds();
+    double deadline = start + seconds;
+    while (now_seconds() < deadline) {
+        pager_begin_transaction(pager);
+        for (int i = 0; i < pages_per_txn; i++) {
+            DBPage* page = pager_get_page(pager, first + rand_r(&seed) % spread);
+            memset(page->data, (int)txns, 256);
+            pager_write_page(pager, page);
+            pager_unpin_page(pager, page);
+        }
+        PSqlStatus status = rollback ? pager_rollback(pager) : pager_commit(pager);
+        if (status != PSQL_OK) {
+            fprintf(stderr, "%s failed\n", rollback ? "Rollback" : "Commit");
+            exit(1);
+        }
+        txns++;
+    }
+    double elapsed = now_seconds() - start;
+
+    JournalStats stats = pager_journal_stats(pager);
+    pager_close_db(pager);
+    cleanup_files();
+    printf("%-6s %-4s %4d pages/txn  %-8s %8.0f txns/s  %9.2f us/txn  %6.1f records/txn  %6.1f skipped/txn  %5.1f deltas/txn  %8.1f KB/txn  %5.2f writes/txn  %5.2f syncs/txn\n",
+           name, spread == HOT_PAGES ? "hot" : "", pages_per_txn, rollback ? "rollback" : "commit", txns / elapsed,
+           elapsed * 1e6 / txns, (double)stats.records / txns, (double)stats.skipped / txns, (double)stats.deltas / txns,
+           stats.bytes_written / 1024.0 / txns, (double)stats.writes / txns,
+           (double)stats.syncs / txns);
+}
+
+// A child rewrites pages pages, gets them into the file mid-transaction and dies - then the next open recovers
+static void bench_recovery(const char* name, uint32_t flags, uint32_t pages) {
+    uint32_t first;
+    Pager* pager = open_db(flags, &first);
+    pager_close_db(pager);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        Pager* child = init_pager(BENCH_DB_FILE, PAGER_WRITEABLE | flags);
+        if (!child || pager_begin_transaction(child) != PSQL_OK) _exit(1);
+        for (uint32_t i = 0; i < pages; i++) {
+            DBPage* page = pager_get_page(child, first + i);
+            memset(page->data, 0xAB, 256);
+            pager_write_page(child, page);
+            pager_unpin_page(child, page);
+        }
+        pager_flush_cache(child);
+        _exit(0);
+    }
+    waitpid(pid, NULL, 0);
+
+    double start = now_seconds();
+    pager = init_pager(BENCH_DB_FILE, PAGER_WRITEABLE | flags);
+    double elapsed = now_seconds() - start;
+    if (!pager) {
+        fprintf(stderr, "Failed to reopen %s\n", BENCH_DB_FILE);
+        exit(1);
+    }
+    JournalRecoveryStats stats = pager_recovery_stats(pager);
+    printf("  %-4s recovery %5u pages: %8.2f ms to open, %8.2f ms restoring, %u pages restored on %u threads\n",
+           name, pages, elapsed * 1e3, stats.duration_ns / 1e6, stats.pages_restored, stats.threads);
+    pager_close_db(pager);
+    cleanup_files();
+}
+
+int main(int argc, char** argv) {
+    double seconds = DEFAULT_SECONDS;
+    if (argc > 1) seconds = atof(argv[1]);
+    if (seconds <= 0) seconds = DEFAULT_SECONDS;
+
+    int sizes[] = { 1, 8, 64, 256 };
+    printf("Rollback journal - %d page DB, %.1fs per run\n", DB_PAGES, seconds);
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        bench_transactions("mmap", PAGER_JOURNALING_ENABLED, sizes[i], DB_PAGES, false, seconds);
+        bench_transactions("mmap", PAGER_JOURNALING_ENABLED, sizes[i], DB_PAGES, true, seconds);
+        bench_transactions("pool", PAGER_JOURNALING_ENABLED | PAGER_BUFFER_POOL, sizes[i], DB_PAGES, false, seconds);
+        bench_transactions("pool", PAGER_JOURNALING_ENABLED | PAGER_BUFFER_POOL, sizes[i], DB_PAGES, true, seconds);
+    }
+    printf("\n");
+    for (size_t i = 1; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        bench_transactions("mmap", PAGER_JOURNALING_ENABLED, sizes[i], HOT_PAGES, false, seconds);
+        bench_transactions("pool", PAGER_JOURNALING_ENABLED | PAGER_BUFFER_POOL, sizes[i], HOT_PAGES, false, seconds);
+    }
+    printf("\n");
+    uint32_t crashed[] = { 64, 512, DB_PAGES };
+    for (size_t i = 0; i < sizeof(crashed) / sizeof(crashed[0]); i++) {
+        bench_recovery("mmap", PAGER_JOURNALING_ENABLED, crashed[i]);
+        bench_recovery("pool", PAGER_JOURNALING_ENABLED | PAGER_BUFFER_POOL, crashed[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,126 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pager/constants.h"
+#include "pager/pager.h"
+#include "pager/pager_format.h"
+
+// Transactions per second on an in-memory database (PAGER_MEMORY_DB) against the same workload on a file
+// Each transaction rewrites a few random pages and commits - or rolls back, which a file without PAGER_WAL can't do.
+// The file-backed runs pay for sync_file_range + fdatasync per commit, the memory DB for the before-images in its undo log
+
+#define BENCH_DB_FILE "bench_memory_db.pseql"
+#define BENCH_COPY_FILE "bench_memory_db_copy.pseql"
+#define DEFAULT_SECONDS 1.0
+#define DB_PAGES 4096  // 16MB with 4KB pages
+#define BULK_PAGES 1024
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void cleanup_files() {
+    unlink(BENCH_DB_FILE);
+    unlink(BENCH_DB_FILE WAL_FILE_EXTENSION);
+    unlink(BENCH_DB_FILE JOURNAL_FILE_EXTENSION);
+    unlink(BENCH_COPY_FILE);
+}
+
+static Pager* open_db(uint32_t flags, uint32_t* first) {
+    cleanup_files();
+    Pager* pager = init_pager(BENCH_DB_FILE, PAGER_WRITEABLE | PAGER_OVERWRITE | flags);
+    if (!pager || pager_init_new_db(pager) != PSQL_OK) {
+        fprintf(stderr, "Failed to create %s\n", BENCH_DB_FILE);
+        exit(1);
+    }
+    *first = allocate_new_db_pages(pager, DB_PAGES) - (DB_PAGES - 1);
+    for (uint32_t i = 0; i < DB_PAGES; i++) pager_write_page(pager, init_data_page(pager, *first + i));
+    pager_flush_cache(pager);
+    return pager;
+}
+
+static void bench_transactions(const char* name, uint32_t flags, int pages_per_txn, bool rollback, double seconds) {
+    uint32_t first;
+    Pager* pager = open_db(flags, &first);
+
+    unsigned int seed = 1;
+    uint64_t txns = 0;
+    double start = now_seconds();
+    double deadline = start + seconds;
+    while (now_seconds() < deadline) {
+        pager_begin_transaction(pager);
+        for (int i = 0; i < pages_per_txn; i++) {
+            DBPage* page = pager_get_page(pager, first + rand_r(&seed) % DB_PAGES);
+            memset(page->data, (int)txns, 256);
+            pager_write_page(pager, page);
+        }
+        PSqlStatus status = rollback ? pager_rollback(pager) : pager_commit(pager);
+        if (status != PSQL_OK) {
+            fprintf(stderr, "%s failed\n", rollback ? "Rollback" : "Commit");
+            exit(1);
+        }
+        txns++;
+    }
+    double elapsed = now_seconds() - start;
+
+    PagerIOStats stats = pager_get_io_stats(pager);
+    pager_close_db(pager);
+    cleanup_files();
+    printf("%-8s %3d pages/txn  %-8s %10.0f txns/s  %8.2f us/txn  (%lu before-images, %lu pages synced)\n", name,
+           pages_per_txn, rollback ? "rollback" : "commit", txns / elapsed, elapsed * 1e6 / txns,
+           (unsigned long)stats.undo_pages, (unsigned long)stats.pages_written);
+}
+
+// One big transaction that allocates and fills pages, then what pager_serialize() costs for the result
+static void bench_bulk(const char* name, uint32_t flags) {
+    uint32_t first;
+    Pager* pager = open_db(flags, &first);
+
+    double start = now_seconds();
+    pager_begin_transaction(pager);
+    uint32_t bulk = allocate_new_db_pages(pager, BULK_PAGES) - (BULK_PAGES - 1);
+    for (uint32_t i = 0; i < BULK_PAGES; i++) {
+        DBPage* page = init_data_page(pager, bulk + i);
+        memset(page->data, (int)i, PAGER_USABLE_SIZE(pager));
+        pager_write_page(pager, page);
+    }
+    pager_commit(pager);
+    double bulk_s = now_seconds() - start;
+
+    printf("%-8s bulk load %d pages  %8.2f ms", name, BULK_PAGES, bulk_s * 1e3);
+    if (flags & PAGER_MEMORY_DB) {
+        start = now_seconds();
+        if (pager_serialize(pager, BENCH_COPY_FILE) != PSQL_OK) {
+            fprintf(stderr, "\nSerialize failed\n");
+            exit(1);
+        }
+        printf("  serialize %u pages %8.2f ms", pager->db_pager.page_count, (now_seconds() - start) * 1e3);
+    }
+    printf("\n");
+    pager_close_db(pager);
+    cleanup_files();
+}
+
+int main(int argc, char** argv) {
+    double seconds = DEFAULT_SECONDS;
+    if (argc > 1) seconds = atof(argv[1]);
+    if (seconds <= 0) seconds = DEFAULT_SECONDS;
+
+    int sizes[] = { 1, 8, 64 };
+    printf("In-memory vs file-backed - %d page DB, %.1fs per run\n", DB_PAGES, seconds);
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        bench_transactions("file", 0, sizes[i], false, seconds);
+        bench_transactions("memory", PAGER_MEMORY_DB, sizes[i], false, seconds);
+        bench_transactions("memory", PAGER_MEMORY_DB, sizes[i], true, seconds);
+    }
+    printf("\n");
+    bench_bulk("file", 0);
+    bench_bulk("memory", PAGER_MEMORY_DB);
+    return 0;
+}
@@ -0,0 +1,214 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pager/constants.h"
+#include "pager/pager.h"
+#include "pager/pager_format.h"
+
+// Scans vs point lookups across page sizes
+// A B+ tree over sorted rows is bulk loaded bottom-up into a DB of each page size, then
+// 1) scan - walk the leaf level left to right through right_sibling_page_id
+// 2) lookup - random keys, binary search down from the root
+// Bigger pages mean a shallower tree and fewer page hops per scanned row, but every lookup touches more bytes.
+// Both run over mmap and over the buffer pool with the same cache budget in bytes, so bigger pages get fewer frames
+
+#define BENCH_DB_FILE "bench_page_size.pseql"
+#define DEFAULT_ROWS 1000000
+#define LOOKUPS 500000
+#define SCAN_PASSES 5
+#define CACHE_BUDGET (8 * 1024 * 1024)  // Buffer pool bytes - a quarter of the rows fit
+
+typedef struct {
+    uint64_t key;
+    uint8_t value[24];
+} Row;  // 32 bytes, about what a short row in a data page costs
+
+typedef struct {
+    uint64_t key;     // Smallest key under child
+    uint32_t child;
+    uint32_t unused;
+} Branch;
+
+// Node layout in page->data - entry count, then the entries from NODE_ENTRIES
+#define NODE_ENTRIES 8
+#define NODE_COUNT(page) (*(uint32_t*)(page)->data)
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Entries that fit in the usable part of a page
+static uint32_t node_capacity(Pager* pager, size_t entry_size) {
+    return (PAGER_USABLE_SIZE(pager) - sizeof(DBPageHeader) - NODE_ENTRIES) / entry_size;
+}
+
+typedef struct {
+    uint32_t root;
+    uint32_t first_leaf;
+    uint32_t height;
+    uint32_t pages;
+} Tree;
+
+// Fill each level completely, left to right, then build the level above from the first key of every node
+static Tree build_tree(Pager* pager, size_t num_rows) {
+    Tree tree = {0};
+    uint32_t per_leaf = node_capacity(pager, sizeof(Row));
+    uint32_t num_nodes = (num_rows + per_leaf - 1) / per_leaf;
+    uint32_t first = allocate_new_db_pages(pager, num_nodes) - (num_nodes - 1);
+
+    Branch* level = (Branch*)malloc(num_nodes * sizeof(Branch));
+    size_t row = 0;
+    for (uint32_t i = 0; i < num_nodes; i++) {
+        DBPage* page = init_index_leaf_page(pager, first + i);
+        Row* rows = (Row*)(page->data + NODE_ENTRIES);
+        uint32_t count = 0;
+        for (; count < per_leaf && row < num_rows; count++, row++) {
+            rows[count].key = row * 2;  // Only even keys - odd ones are misses
+            memset(rows[count].value, (int)row, sizeof(rows[count].value));
+        }
+        NODE_COUNT(page) = count;
+        page->header.right_sibling_page_id = i + 1 < num_nodes ? first + i + 1 : 0;
+        level[i] = (Branch){ rows[0].key, first + i, 0 };
+        pager_write_page(pager, page);
+    }
+    tree.first_leaf = first;
+    tree.height = 1;
+    tree.pages = num_nodes;
+
+    uint32_t per_branch = node_capacity(pager, sizeof(Branch));
+    while (num_nodes > 1) {
+        uint32_t parents = (num_nodes + per_branch - 1) / per_branch;
+        first = allocate_new_db_pages(pager, parents) - (parents - 1);
+        for (uint32_t i = 0; i < parents; i++) {
+            DBPage* page = init_index_internal_page(pager, first + i);
+            uint32_t count = num_nodes - i * per_branch < per_branch ? num_nodes - i * per_branch : per_branch;
+            memcpy(page->data + NODE_ENTRIES, level + i * per_branch, count * sizeof(Branch));
+            NODE_COUNT(page) = count;
+            level[i] = (Branch){ level[i * per_branch].key, first + i, 0 };
+            pager_write_page(pager, page);
+        }
+        num_nodes = parents;
+        tree.height++;
+        tree.pages += parents;
+    }
+    tree.root = level[0].child;
+    free(level);
+    return tree;
+}
+
+static double bench_scan(Pager* pager, const Tree* tree, size_t num_rows) {
+    uint64_t checksum = 0;
+    double start = now_seconds();
+    for (int pass = 0; pass < SCAN_PASSES; pass++) {
+        size_t seen = 0;
+        for (uint32_t page_no = tree->first_leaf; page_no;) {
+            DBPage* page = pager_get_page(pager, page_no);
+            const Row* rows = (const Row*)(page->data + NODE_ENTRIES);
+            uint32_t count = NODE_COUNT(page);
+            for (uint32_t i = 0; i < count; i++) checksum += rows[i].key + rows[i].value[0];
+            seen += count;
+            page_no = page->header.right_sibling_page_id;
+            pager_unpin_page(pager, page);
+        }
+        if (seen != num_rows) {
+            fprintf(stderr, "Scan saw %zu rows, expected %zu\n", seen, num_rows);
+            exit(1);
+        }
+    }
+    double elapsed = now_seconds() - start;
+    if (checksum == 1) printf(" ");  // Keep the loop from being optimized out
+    return (double)num_rows * SCAN_PASSES / elapsed;
+}
+
+static bool lookup(Pager* pager, const Tree* tree, uint64_t key) {
+    uint32_t page_no = tree->root;
+    for (uint32_t level = tree->height; level > 1; level--) {
+        DBPage* page = pager_get_page(pager, page_no);
+        const Branch* branches = (const Branch*)(page->data + NODE_ENTRIES);
+        // Last branch whose smallest key is <= key
+        uint32_t lo = 0, hi = NODE_COUNT(page);
+        while (hi - lo > 1) {
+            uint32_t mid = (lo + hi) / 2;
+            if (branches[mid].key <= key) lo = mid;
+            else hi = mid;
+        }
+        page_no = branches[lo].child;
+        pager_unpin_page(pager, page);
+    }
+
+    DBPage* page = pager_get_page(pager, page_no);
+    const Row* rows = (const Row*)(page->data + NODE_ENTRIES);
+    uint32_t lo = 0, hi = NODE_COUNT(page);
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (rows[mid].key < key) lo = mid + 1;
+        else hi = mid;
+    }
+    bool found = lo < NODE_COUNT(page) && rows[lo].key == key;
+    pager_unpin_page(pager, page);
+    return found;
+}
+
+static double bench_lookup(Pager* pager, const Tree* tree, size_t num_rows) {
+    unsigned int seed = 42;
+    size_t found = 0;
+    double start = now_seconds();
+    for (size_t i = 0; i < LOOKUPS; i++) found += lookup(pager, tree, (uint64_t)(rand_r(&seed) % (2 * num_rows)));
+    double elapsed = now_seconds() - start;
+    if (found == 0 || found == LOOKUPS) {
+        fprintf(stderr, "Lookups found %zu of %d - expected about half\n", found, LOOKUPS);
+        exit(1);
+    }
+    return LOOKUPS / elapsed;
+}
+
+static void bench_page_size(uint32_t page_size, size_t num_rows) {
+    unlink(BENCH_DB_FILE);
+    Pager* pager = init_pager_with_page_size(BENCH_DB_FILE, PAGER_WRITEABLE | PAGER_OVERWRITE, page_size);
+    if (!pager || pager_init_new_db(pager) != PSQL_OK) {
+        fprintf(stderr, "Failed to create %s\n", BENCH_DB_FILE);
+        exit(1);
+    }
+    Tree tree = build_tree(pager, num_rows);
+    pager_close_db(pager);
+
+    const char* modes[] = { "mmap", "buffer pool" };
+    for (int m = 0; m < 2; m++) {
+        pager = init_pager(BENCH_DB_FILE, PAGER_WRITEABLE | (m ? PAGER_BUFFER_POOL : 0));
+        if (!pager) {
+            fprintf(stderr, "Failed to open %s\n", BENCH_DB_FILE);
+            exit(1);
+        }
+        if (m) pager_set_cache_size(pager, CACHE_BUDGET / page_size);
+
+        double scan = bench_scan(pager, &tree, num_rows);
+        double lookups = bench_lookup(pager, &tree, num_rows);
+        printf("%5uK %-12s height %u  %7u pages  scan %8.1fM rows/s  lookup %8.0f /s", page_size / 1024, modes[m],
+               tree.height, tree.pages, scan / 1e6, lookups);
+        if (m) {
+            BufferPoolStats stats = pager_cache_stats(pager);
+            printf("  %5.1f%% hits", 100.0 * stats.hits / (stats.hits + stats.misses));
+        }
+        printf("\n");
+        pager_close_db(pager);
+    }
+    unlink(BENCH_DB_FILE);
+    unlink(BENCH_DB_FILE JOURNAL_FILE_EXTENSION);
+}
+
+int main(int argc, char** argv) {
+    size_t num_rows = DEFAULT_ROWS;
+    if (argc > 1) num_rows = strtoul(argv[1], NULL, 10);
+    if (num_rows == 0) num_rows = DEFAULT_ROWS;
+
+    printf("%zu rows of %zu bytes, %d scans, %d random lookups, %d MB buffer pool\n", num_rows, sizeof(Row),
+           SCAN_PASSES, LOOKUPS, CACHE_BUDGET / (1024 * 1024));
+    for (uint32_t page_size = MIN_PAGE_SIZE; page_size <= MAX_PAGE_SIZE; page_size *= 2) bench_page_size(page_size, num_rows);
+    return 0;
+}
@@ -0,0 +1,250 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "pager/constants.h"
+#include "pager/pager.h"
+#include "pager/pager_format.h"
+
+// Random point lookups over a B+ tree much bigger than the TLB reaches with 4KB pages, timed one at a time
+// Every config starts from a dropped page cache, then
+// 1) first pass - what a freshly opened DB sees, page faults included (PAGER_POPULATE pays those up front in the open)
+// 2) steady pass - everything is resident, what's left is mostly TLB misses (PAGER_HUGEPAGES goes after those)
+// Per-lookup percentiles show the tail, where the faults and page walks land. PAGER_MLOCK_CATALOG / pager_lock_pages
+// keep the top of the tree locked in memory - the internal levels are built last so they sit at the end of the file.
+// AnonHugePages / FilePmdMapped from smaps_rollup show whether huge pages were actually used - a shared file mapping
+// only gets them when the kernel and filesystem support it, buffer pool frames are anonymous memory and do
+
+#define BENCH_DB_FILE "bench_tlb.pseql"
+#define DEFAULT_ROWS (8 * 1024 * 1024)  // 256MB of leaves with 32 byte rows
+#define LOOKUPS 1000000
+
+typedef struct {
+    uint64_t key;
+    uint8_t value[24];
+} Row;
+
+typedef struct {
+    uint64_t key;     // Smallest key under child
+    uint32_t child;
+    uint32_t unused;
+} Branch;
+
+// Node layout in page->data - entry count, then the entries from NODE_ENTRIES
+#define NODE_ENTRIES 8
+#define NODE_COUNT(page) (*(uint32_t*)(page)->data)
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint32_t node_capacity(Pager* pager, size_t entry_size) {
+    return (PAGER_USABLE_SIZE(pager) - sizeof(DBPageHeader) - NODE_ENTRIES) / entry_size;
+}
+
+typedef struct {
+    uint32_t root;
+    uint32_t height;
+    uint32_t first_internal;  // Internal pages run from here to the root
+    uint32_t internal_pages;
+    uint32_t pages;
+} Tree;
+
+// Bottom-up bulk load - leaves first, then each level above from the first key of every node
+static Tree build_tree(Pager* pager, size_t num_rows) {
+    Tree tree = {0};
+    uint32_t per_leaf = node_capacity(pager, sizeof(Row));
+    uint32_t num_nodes = (num_rows + per_leaf - 1) / per_leaf;
+    uint32_t first = allocate_new_db_pages(pager, num_nodes) - (num_nodes - 1);
+
+    Branch* level = (Branch*)malloc(num_nodes * sizeof(Branch));
+    size_t row = 0;
+    for (uint32_t i = 0; i < num_nodes; i++) {
+        DBPage* page = init_index_leaf_page(pager, first + i);
+        Row* rows = (Row*)(page->data + NODE_ENTRIES);
+        uint32_t count = 0;
+        for (; count < per_leaf && row < num_rows; count++, row++) {
+            rows[count].key = row * 2;  // Only even keys - odd ones are misses
+            memset(rows[count].value, (int)row, sizeof(rows[count].value));
+        }
+        NODE_COUNT(page) = count;
+        page->header.right_sibling_page_id = i + 1 < num_nodes ? first + i + 1 : 0;
+        level[i] = (Branch){ rows[0].key, first + i, 0 };
+        pager_write_page(pager, page);
+        pager_unpin_page(pager, page);
+    }
+    tree.height = 1;
+    tree.pages = num_nodes;
+
+    uint32_t per_branch = node_capacity(pager, sizeof(Branch));
+    while (num_nodes > 1) {
+        uint32_t parents = (num_nodes + per_branch - 1) / per_branch;
+        first = allocate_new_db_pages(pager, parents) - (parents - 1);
+        if (!tree.first_internal) tree.first_internal = first;
+        for (uint32_t i = 0; i < parents; i++) {
+            DBPage* page = init_index_internal_page(pager, first + i);
+            uint32_t count = num_nodes - i * per_branch < per_branch ? num_nodes - i * per_branch : per_branch;
+            memcpy(page->data + NODE_ENTRIES, level + i * per_branch, count * sizeof(Branch));
+            NODE_COUNT(page) = count;
+            level[i] = (Branch){ level[i * per_branch].key, first + i, 0 };
+            pager_write_page(pager, page);
+            pager_unpin_page(pager, page);
+        }
+        num_nodes = parents;
+        tree.height++;
+        tree.pages += parents;
+        tree.internal_pages += parents;
+    }
+    tree.root = level[0].child;
+    free(level);
+    return tree;
+}
+
+static bool lookup(Pager* pager, const Tree* tree, uint64_t key) {
+    uint32_t page_no = tree->root;
+    for (uint32_t level = tree->height; level > 1; level--) {
+        DBPage* page = pager_get_page(pager, page_no);
+        const Branch* branches = (const Branch*)(page->data + NODE_ENTRIES);
+        uint32_t lo = 0, hi = NODE_COUNT(page);
+        while (hi - lo > 1) {
+            uint32_t mid = (lo + hi) / 2;
+            if (branches[mid].key <= key) lo = mid;
+            else hi = mid;
+        }
+        page_no = branches[lo].child;
+        pager_unpin_page(pager, page);
+    }
+
+    DBPage* page = pager_get_page(pager, page_no);
+    const Row* rows = (const Row*)(page->data + NODE_ENTRIES);
+    uint32_t lo = 0, hi = NODE_COUNT(page);
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (rows[mid].key < key) lo = mid + 1;
+        else hi = mid;
+    }
+    bool found = lo < NODE_COUNT(page) && rows[lo].key == key;
+    pager_unpin_page(pager, page);
+    return found;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Time every lookup on its own and print the percentiles
+static void bench_lookups(Pager* pager, const Tree* tree, size_t num_rows, unsigned int seed, const char* pass) {
+    uint64_t* latency = (uint64_t*)malloc(LOOKUPS * sizeof(uint64_t));
+    size_t found = 0;
+    uint64_t total = 0;
+    for (size_t i = 0; i < LOOKUPS; i++) {
+        uint64_t key = (uint64_t)(rand_r(&seed) % (2 * num_rows));
+        uint64_t start = now_ns();
+        found += lookup(pager, tree, key);
+        latency[i] = now_ns() - start;
+        total += latency[i];
+    }
+    if (found == 0 || found == LOOKUPS) {
+        fprintf(stderr, "Lookups found %zu of %d - expected about half\n", found, LOOKUPS);
+        exit(1);
+    }
+    qsort(latency, LOOKUPS, sizeof(uint64_t), compare_u64);
+    printf("    %-7s mean %6.0f ns  p50 %6lu  p90 %6lu  p99 %7lu  p99.9 %8lu  max %9lu\n", pass, (double)total / LOOKUPS,
+           (unsigned long)latency[LOOKUPS / 2], (unsigned long)latency[LOOKUPS * 9 / 10],
+           (unsigned long)latency[LOOKUPS * 99 / 100], (unsigned long)latency[LOOKUPS * 999 / 1000],
+           (unsigned long)latency[LOOKUPS - 1]);
+    free(latency);
+}
+
+// Huge page and locked memory use of the whole process, in kB
+static void print_smaps() {
+    FILE* f = fopen("/proc/self/smaps_rollup", "r");
+    if (!f) return;
+    char line[256];
+    unsigned long anon_huge = 0, file_pmd = 0, locked = 0, value;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "AnonHugePages: %lu kB", &value) == 1) anon_huge = value;
+        else if (sscanf(line, "FilePmdMapped: %lu kB", &value) == 1) file_pmd = value;
+        else if (sscanf(line, "Locked: %lu kB", &value) == 1) locked = value;
+    }
+    fclose(f);
+    printf("    AnonHugePages %lu kB  FilePmdMapped %lu kB  Locked %lu kB\n", anon_huge, file_pmd, locked);
+}
+
+static void drop_page_cache() {
+    int fd = open(BENCH_DB_FILE, O_RDONLY);
+    if (fd < 0 || fdatasync(fd) != 0 || posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) != 0) {
+        perror("drop page cache");
+        exit(1);
+    }
+    close(fd);
+}
+
+typedef struct {
+    const char* name;
+    int flags;
+    bool lock_internal;  // pager_lock_pages over the internal levels on top of the catalog
+} Config;
+
+int main(int argc, char** argv) {
+    size_t num_rows = DEFAULT_ROWS;
+    if (argc > 1) num_rows = strtoul(argv[1], NULL, 10);
+    if (num_rows == 0) num_rows = DEFAULT_ROWS;
+
+    unlink(BENCH_DB_FILE);
+    Pager* pager = init_pager(BENCH_DB_FILE, PAGER_WRITEABLE | PAGER_OVERWRITE);
+    if (!pager || pager_init_new_db(pager) != PSQL_OK) {
+        fprintf(stderr, "Failed to create %s\n", BENCH_DB_FILE);
+        return 1;
+    }
+    Tree tree = build_tree(pager, num_rows);
+    size_t file_size = pager->db_pager.file_size;
+    pager_close_db(pager);
+    printf("%zu rows, height %u, %u pages (%u internal), %.0f MB file, %d random lookups per pass\n", num_rows,
+           tree.height, tree.pages, tree.internal_pages, (double)file_size / (1024 * 1024), LOOKUPS);
+
+    Config configs[] = {
+        { "mmap", 0, false },
+        { "mmap hugepages", PAGER_HUGEPAGES, false },
+        { "mmap populate", PAGER_POPULATE, false },
+        { "mmap hugepages+populate", PAGER_HUGEPAGES | PAGER_POPULATE, false },
+        { "mmap all + mlock internal", PAGER_HUGEPAGES | PAGER_POPULATE | PAGER_MLOCK_CATALOG, true },
+        { "buffer pool", PAGER_BUFFER_POOL, false },
+        { "buffer pool hugepages+populate", PAGER_BUFFER_POOL | PAGER_HUGEPAGES | PAGER_POPULATE, false },
+    };
+    for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+        drop_page_cache();
+        uint64_t start = now_ns();
+        pager = init_pager(BENCH_DB_FILE, PAGER_READONLY | configs[c].flags);
+        if (!pager) {
+            fprintf(stderr, "Failed to open %s\n", BENCH_DB_FILE);
+            return 1;
+        }
+        if (configs[c].flags & PAGER_BUFFER_POOL) {
+            // Room for the whole tree, so both pools measure the frames rather than eviction - populate refills the new pool
+            pager_set_cache_size(pager, tree.pages + DB_CATALOG_PAGES);
+        }
+        double open_ms = (now_ns() - start) / 1e6;
+
+        const char* lock = "";
+        if (configs[c].lock_internal) {
+            lock = pager_lock_pages(pager, tree.first_internal, tree.internal_pages) == PSQL_OK
+                   ? ", internal pages locked" : ", internal pages not locked (RLIMIT_MEMLOCK)";
+        }
+        printf("%s - open %.1f ms%s\n", configs[c].name, open_ms, lock);
+        bench_lookups(pager, &tree, num_rows, 42, "first");
+        bench_lookups(pager, &tree, num_rows, 43, "steady");
+        print_smaps();
+        pager_close_db(pager);
+    }
+    unlink(BENCH_DB_FILE);
+    unlink(BENCH_DB_FILE JOURNAL_FILE_EXTENSION);
+    return 0;
+}
@@ -0,0 +1,111 @@
+// bitmap.c
+#include <string.h>
+#include "bitmap.h"
+
+#define WORD_BITS 64
+#define WORDS_FOR(bits) (((bits) + WORD_BITS - 1) / WORD_BITS)
+
+bool bitmap_init(Bitmap* bitmap, size_t num_bits) {
+    bitmap->num_bits = 0;
+    bitmap->count = 0;
+    bitmap->words = NULL;
+    return bitmap_resize(bitmap, num_bits);
+}
+
+void bitmap_free(Bitmap* bitmap) {
+    if (!bitmap) return;
+    free(bitmap->words);
+    bitmap->words = NULL;
+    bitmap->num_bits = 0;
+    bitmap->count = 0;
+}
+
+bool bitmap_resize(Bitmap* bitmap, size_t num_bits) {
+    size_t old_words = WORDS_FOR(bitmap->num_bits);
+    size_t new_words = WORDS_FOR(num_bits);
+
+    // Shrinking - drop the bits past the new end from the count first
+    for (size_t bit = bitmap_next_set(bitmap, num_bits); bit < bitmap->num_bits; bit = bitmap_next_set(bitmap, bit + 1)) {
+        bitmap_clear(bitmap, bit);
+    }
+
+    if (new_words != old_words) {
+        if (new_words == 0) {
+            free(bitmap->words);
+            bitmap->words = NULL;
+        } else {
+            uint64_t* words = (uint64_t*)realloc(bitmap->words, new_words * sizeof(uint64_t));
+            if (!words) return false;
+            if (new_words > old_words) {
+                memset(words + old_words, 0, (new_words - old_words) * sizeof(uint64_t));
+            }
+            bitmap->words = words;
+        }
+    }
+
+    bitmap->num_bits = num_bits;
+    return true;
+}
+
+bool bitmap_set(Bitmap* bitmap, size_t bit) {
+    if (bit >= bitmap->num_bits) return false;
+    uint64_t mask = 1ULL << (bit % WORD_BITS);
+    uint64_t* word = &bitmap->words[bit / WORD_BITS];
+    if (*word & mask) return false;
+    *word |= mask;
+    bitmap->count++;
+    return true;
+}
+
+bool bitmap_clear(Bitmap* bitmap, size_t bit) {
+    if (bit >= bitmap->num_bits) return false;
+    uint64_t mask = 1ULL << (bit % WORD_BITS);
+    uint64_t* word = &bitmap->words[bit / WORD_BITS];
+    if (!(*word & mask)) return false;
+    *word &= ~mask;
+    bitmap->count--;
+    return true;
+}
+
+bool bitmap_test(const Bitmap* bitmap, size_t bit) {
+    if (bit >= bitmap->num_bits) return false;
+    return (bitmap->words[bit / WORD_BITS] >> (bit % WORD_BITS)) & 1;
+}
+
+void bitmap_clear_all(Bitmap* bitmap) {
+    if (bitmap->words) memset(bitmap->words, 0, WORDS_FOR(bitmap->num_bits) * sizeof(uint64_t));
+    bitmap->count = 0;
+}
+
+// Skip whole empty words, then find the lowest set bit in the word with __builtin_ctzll
+size_t bitmap_next_set(const Bitmap* bitmap, size_t from) {
+    if (from >= bitmap->num_bits) return bitmap->num_bits;
+
+    size_t w = from / WORD_BITS;
+    uint64_t word = bitmap->words[w] & (~0ULL << (from % WORD_BITS));
+    size_t num_words = WORDS_FOR(bitmap->num_bits);
+
+    while (!word) {
+        if (++w >= num_words) return bitmap->num_bits;
+        word = bitmap->words[w];
+    }
+
+    size_t bit = w * WORD_BITS + __builtin_ctzll(word);
+    return bit < bitmap->num_bits ? bit : bitmap->num_bits;
+}
+
+size_t bitmap_next_clear(const Bitmap* bitmap, size_t from) {
+    if (from >= bitmap->num_bits) return bitmap->num_bits;
+
+    size_t w = from / WORD_BITS;
+    uint64_t word = ~bitmap->words[w] & (~0ULL << (from % WORD_BITS));
+    size_t num_words = WORDS_FOR(bitmap->num_bits);
+
+    while (!word) {
+        if (++w >= num_words) return bitmap->num_bits;
+        word = ~bitmap->words[w];
+    }
+
+    size_t bit = w * WORD_BITS + __builtin_ctzll(word);
+    return bit < bitmap->num_bits ? bit : bitmap->num_bits;
+}
@@ -0,0 +1,32 @@
+#ifndef BITMAP_ALGORITHM_H
+#define BITMAP_ALGORITHM_H
+// Growable bitmap - one bit per page
+// Used where we need a flag per page and want to walk the set pages in page order
+// e.g dirty pages waiting for a flush, so adjacent ones can be coalesced into one sync range
+// Unlike the Radix Tree this is dense - 8KB covers 65535 pages - but finding the next set bit skips 64 pages at a time
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    uint64_t* words;
+    size_t num_bits;   // Bits addressable - set/test past this are ignored
+    size_t count;      // Number of bits set
+} Bitmap;
+
+bool bitmap_init(Bitmap* bitmap, size_t num_bits);
+void bitmap_free(Bitmap* bitmap);
+bool bitmap_resize(Bitmap* bitmap, size_t num_bits);  // Grow or shrink - new bits start cleared
+
+// Set/clear return whether the bit actually changed
+bool bitmap_set(Bitmap* bitmap, size_t bit);
+bool bitmap_clear(Bitmap* bitmap, size_t bit);
+bool bitmap_test(const Bitmap* bitmap, size_t bit);
+void bitmap_clear_all(Bitmap* bitmap);
+
+// Scan from `from` - returns num_bits if there is no such bit
+size_t bitmap_next_set(const Bitmap* bitmap, size_t from);
+size_t bitmap_next_clear(const Bitmap* bitmap, size_t from);
+
+#endif
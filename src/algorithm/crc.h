@@ -2,8 +2,24 @@
 #define CRC_ALGORITHM_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <unistd.h>
 
+/* CRC-32 (ZIP polynomial) - what every checksum on disk uses: DB header, WAL header and frames */
 uint32_t calculate_crc32(const void *data, size_t length);
+uint32_t crc32_update(uint32_t crc, const void *data, size_t length);  // Continue a CRC - crc32_update(0, ...) == calculate_crc32(...)
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, size_t length2);  // CRC of A then B, from the CRCs of A and B and B's length
+
+/* CRC-32C (Castagnoli polynomial) - SSE4.2 has an instruction for it, so it is the faster one on x86 for new formats */
+uint32_t calculate_crc32c(const void *data, size_t length);
+uint32_t crc32c_update(uint32_t crc, const void *data, size_t length);
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t length2);
+
+/* The table-only versions the dispatch falls back to - exposed so the tests can check both paths on one machine */
+uint32_t crc32_update_slice8(uint32_t crc, const void *data, size_t length);
+uint32_t crc32c_update_slice8(uint32_t crc, const void *data, size_t length);
+
+bool crc32_accelerated();   // PCLMULQDQ folding in use
+bool crc32c_accelerated();  // SSE4.2 crc32 instruction in use
 
 #endif
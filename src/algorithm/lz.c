@@ -0,0 +1,164 @@
+#include <string.h>
+
+#include "lz.h"
+
+/* Every sequence is:
+ * [token] [literal length extra bytes] [literals] [offset lo] [offset hi] [match length extra bytes]
+ * The token's high nibble is the literal count, the low one the match length - LZ_MIN_MATCH. 15 means more follows, in
+ * bytes that keep adding up while they are 255. The last sequence stops after its literals.
+ */
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12  /* 8KB table - a page's worth of positions doesn't need more */
+#define LZ_MAX_OFFSET 65535
+#define LZ_SKIP_TRIGGER 6  /* Every 64 misses in a row the search steps one more byte - skims through incompressible runs */
+
+static uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));  // Unaligned
+    return v;
+}
+
+static uint32_t hash32(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);  // Knuth multiplicative hash, top bits
+}
+
+// 15 in the nibble, the rest as 255s and a remainder
+static uint8_t* put_length(uint8_t* op, size_t length) {
+    for (; length >= 255; length -= 255) *op++ = 255;
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+// Worst case bytes for one sequence - checked up front so the writes below never need to
+static size_t sequence_size(size_t literals, size_t match) {
+    size_t size = 1 + literals;
+    if (literals >= 15) size += (literals - 15) / 255 + 1;
+    if (match) {
+        size += 2;
+        if (match - LZ_MIN_MATCH >= 15) size += (match - LZ_MIN_MATCH - 15) / 255 + 1;
+    }
+    return size;
+}
+
+// match == 0 is the last sequence - literals only
+static uint8_t* put_sequence(uint8_t* op, const uint8_t* literals, size_t literal_count, size_t offset, size_t match) {
+    uint8_t* token = op++;
+    uint8_t lit_nibble = literal_count >= 15 ? 15 : (uint8_t)literal_count;
+    if (literal_count >= 15) op = put_length(op, literal_count - 15);
+    memcpy(op, literals, literal_count);
+    op += literal_count;
+
+    uint8_t match_nibble = 0;
+    if (match) {
+        *op++ = (uint8_t)offset;
+        *op++ = (uint8_t)(offset >> 8);
+        size_t extra = match - LZ_MIN_MATCH;
+        match_nibble = extra >= 15 ? 15 : (uint8_t)extra;
+        if (extra >= 15) op = put_length(op, extra - 15);
+    }
+    *token = (uint8_t)(lit_nibble << 4 | match_nibble);
+    return op;
+}
+
+size_t lz_compress(const void* src, size_t length, void* dst, size_t capacity) {
+    if (length > LZ_MAX_INPUT) return 0;
+    const uint8_t* in = (const uint8_t*)src;
+    uint8_t* out = (uint8_t*)dst;
+    uint8_t* op = out;
+
+    // Positions fit in 16 bits - 0 for "nothing yet" is fine, a candidate is checked against the input anyway
+    uint16_t table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    size_t anchor = 0;  // Start of the literals not written yet
+    size_t ip = 1;      // Position 0 has nothing before it to match
+    size_t misses = 0;
+    if (length >= LZ_MIN_MATCH) table[hash32(read32(in))] = 0;
+
+    while (ip + LZ_MIN_MATCH <= length) {
+        uint32_t h = hash32(read32(in + ip));
+        size_t candidate = table[h];
+        table[h] = (uint16_t)ip;
+
+        if (candidate >= ip || ip - candidate > LZ_MAX_OFFSET || read32(in + candidate) != read32(in + ip)) {
+            ip += 1 + (misses++ >> LZ_SKIP_TRIGGER);
+            continue;
+        }
+        misses = 0;
+
+        // Grow the match both ways - back into the pending literals, forward as far as it goes
+        while (ip > anchor && candidate > 0 && in[ip - 1] == in[candidate - 1]) {
+            ip--;
+            candidate--;
+        }
+        size_t match = LZ_MIN_MATCH;
+        while (ip + match < length && in[candidate + match] == in[ip + match]) match++;
+
+        size_t literals = ip - anchor;
+        if ((size_t)(op - out) + sequence_size(literals, match) > capacity) return 0;
+        op = put_sequence(op, in + anchor, literals, ip - candidate, match);
+
+        ip += match;
+        anchor = ip;
+        // The position just before the next search - runs that continue right after a match get found again
+        if (ip >= 2 && ip - 2 + LZ_MIN_MATCH <= length) table[hash32(read32(in + ip - 2))] = (uint16_t)(ip - 2);
+    }
+
+    size_t literals = length - anchor;
+    if ((size_t)(op - out) + sequence_size(literals, 0) > capacity) return 0;
+    op = put_sequence(op, in + anchor, literals, 0, 0);
+    return (size_t)(op - out);
+}
+
+// Read the rest of a length whose nibble was 15 - false if it runs off the end of the input
+static bool get_length(const uint8_t** ip, const uint8_t* end, size_t* length) {
+    uint8_t byte;
+    do {
+        if (*ip >= end) return false;
+        byte = *(*ip)++;
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool lz_decompress(const void* src, size_t src_length, void* dst, size_t length) {
+    const uint8_t* ip = (const uint8_t*)src;
+    const uint8_t* end = ip + src_length;
+    uint8_t* out = (uint8_t*)dst;
+    size_t op = 0;
+
+    // Always ends on a literals-only sequence, even an empty one - so a stream cut off after a match doesn't pass for whole
+    for (;;) {
+        if (ip >= end) return false;
+        uint8_t token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15 && !get_length(&ip, end, &literals)) return false;
+        if (literals > (size_t)(end - ip) || literals > length - op) return false;
+        memcpy(out + op, ip, literals);
+        ip += literals;
+        op += literals;
+
+        if (ip == end) break;  // Last sequence - literals only
+
+        if (end - ip < 2) return false;
+        size_t offset = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        size_t match = (token & 15) + LZ_MIN_MATCH;
+        if ((token & 15) == 15 && !get_length(&ip, end, &match)) return false;
+        if (offset == 0 || offset > op || match > length - op) return false;
+
+        // Overlapping copies (offset < match) repeat the last offset bytes - every memcpy doubles how much of the
+        // pattern is behind us, so a run of zeroes is a handful of copies instead of one per byte
+        const uint8_t* from = out + op - offset;
+        uint8_t* to = out + op;
+        for (size_t left = match, span = offset; left > 0; span *= 2) {
+            size_t n = left < span ? left : span;
+            memcpy(to, from, n);
+            to += n;
+            left -= n;
+        }
+        op += match;
+    }
+    return op == length;
+}
@@ -0,0 +1,20 @@
+#ifndef LZ_ALGORITHM_H
+#define LZ_ALGORITHM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* LZ77 codec for pages - LZ4's block format (token, literals, 16-bit offset, match length), greedy matching off one
+ * hash table. No entropy coding: it is there to be cheap enough to run on every eviction, not to compress well.
+ * Inputs are up to LZ_MAX_INPUT bytes - a page. */
+#define LZ_MAX_INPUT 65536  /* MAX_PAGE_SIZE - offsets are 16-bit */
+#define LZ_COMPRESS_BOUND(length) ((length) + (length) / 255 + 16)  /* Worst case output - incompressible input grows a little */
+
+// Compress length bytes of src into dst - the compressed size, 0 if it doesn't fit in capacity (or length > LZ_MAX_INPUT)
+size_t lz_compress(const void* src, size_t length, void* dst, size_t capacity);
+
+// Decompress into dst - true only if src is well formed and comes out to exactly length bytes. Never reads or writes out of bounds
+bool lz_decompress(const void* src, size_t src_length, void* dst, size_t length);
+
+#endif
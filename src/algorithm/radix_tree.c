@@ -3,9 +3,30 @@
 #include "radix_tree.h"
 
 // Helper function for internal use on Radix Nodes
-// Uses 4 levels with 4 bits each for 16-bit page numbers (both db and journal have max page of 65535)
+// Uses 4 interior levels with 6 bits each (the top one only uses 2) and a 4096 bit leaf bitmap for 32-bit page numbers
 // Insert e.g when page is deleted, addition of a new page to be tracked
 
+// Child index of page_no at an interior level - level 0 is the root
+static inline int level_index(uint32_t page_no, int level) {
+    return (page_no >> (RADIX_LEAF_BITS + (RADIX_LEVELS - 1 - level) * RADIX_BITS)) & (RADIX_SIZE - 1);
+}
+
+static RadixNode* new_node(RadixTree* tree) {
+    RadixNode* node = tree->free_nodes;
+    if (node) {
+        tree->free_nodes = node->u.children[0];
+    } else {
+        node = arena_alloc(&tree->arena, sizeof(RadixNode));
+    }
+    memset(node, 0, sizeof(RadixNode));
+    return node;
+}
+
+// Arena memory can't be handed back one node at a time, so keep emptied nodes around for the next insert
+static void release_node(RadixTree* tree, RadixNode* node) {
+    node->u.children[0] = tree->free_nodes;
+    tree->free_nodes = node;
+}
 
 // Create a tree using Arena
 RadixTree* radix_tree_create() {
@@ -18,7 +39,7 @@ RadixTree* radix_tree_create() {
     return tree;
 }
 
-// Destroy tree using Arena 
+// Destroy tree using Arena
 // Easy non-recursive way by dumping the whole tree's arena
 void radix_tree_destroy(RadixTree *tree) {
     if (!tree) return;
@@ -26,191 +47,160 @@ void radix_tree_destroy(RadixTree *tree) {
     free(tree); // Free the tree struct
 }
 
-void radix_tree_insert(RadixTree *tree, uint16_t page_no) {
+void radix_tree_insert(RadixTree *tree, uint32_t page_no) {
     // if (page_no == 0) return;  // Page 0 is the base metadata - but just in case this introduces bugs, imma comment it out
 
     RadixNode *current = &tree->root;  // Start from root node
 
     // Create path to represent this page number
-    for (int level = 0; level < 4; level++) {
-        int idx = (page_no >> ((3 - level) * RADIX_BITS)) & (RADIX_SIZE - 1);
-        
-        if (!current->children[idx]) {
-            current->children[idx] = arena_alloc(&tree->arena, sizeof(RadixNode));
-            memset(current->children[idx], 0, sizeof(RadixNode));
+    for (int level = 0; level < RADIX_LEVELS; level++) {
+        int idx = level_index(page_no, level);
+
+        if (!current->u.children[idx]) {
+            current->u.children[idx] = new_node(tree);
+            current->summary |= 1ULL << idx;
         }
-        
-        current = current->children[idx];
+
+        current = current->u.children[idx];
     }
 
+    // Set the page's bit in the leaf bitmap
+    int word = (page_no >> RADIX_BITS) & (RADIX_SIZE - 1);
+    current->u.bits[word] |= 1ULL << (page_no & (RADIX_SIZE - 1));
+    current->summary |= 1ULL << word;
 }
 
-bool radix_tree_lookup(RadixTree *tree, uint16_t page_no) {
+bool radix_tree_lookup(RadixTree *tree, uint32_t page_no) {
     if (page_no == 0) return false;
-    
+
     RadixNode *current = &tree->root;
-    
+
     // Follow the path for this page number - check each level and find the idx to jump to next
-    for (int level = 0; level < 4; level++) {
-        int idx = (page_no >> ((3 - level) * RADIX_BITS)) & (RADIX_SIZE - 1);
-        
-        if (!current->children[idx]) {
+    for (int level = 0; level < RADIX_LEVELS; level++) {
+        int idx = level_index(page_no, level);
+
+        if (!current->u.children[idx]) {
             return false; // Path doesn't exist, page is not free
         }
-        
-        current = current->children[idx];
-    }
-    
-    return true; // Complete path exists, page is free
-}
 
-// Helper function check if node has children
-static bool has_children(RadixNode *node) {
-    for (int i = 0; i < RADIX_SIZE; i++) {
-        if (node->children[i]) return true;
+        current = current->u.children[idx];
     }
-    return false;
+
+    int word = (page_no >> RADIX_BITS) & (RADIX_SIZE - 1);
+    return (current->u.bits[word] >> (page_no & (RADIX_SIZE - 1))) & 1; // Bit set, page is free
 }
 
 // Delete e.g when page is reused, deletion of entry from radix tree
 // Idea is to find path to the page, then once leaf found,
 // Go back up the radix tree, updating/cleaning any parents with no children left after this deletion operation
-void radix_tree_delete(RadixTree *tree, uint16_t page_no) {
+void radix_tree_delete(RadixTree *tree, uint32_t page_no) {
     if (page_no == 0 || !tree) return;
-    
-    RadixNode* path[4] = {NULL};
-    int indices[4] = {0};
-    
+
+    RadixNode* path[RADIX_LEVELS] = {NULL};
+    int indices[RADIX_LEVELS] = {0};
+
     RadixNode *current = &tree->root;
-    
+
     // Find the path to the page
-    for (int level = 0; level < 4; level++) {
-        int idx = (page_no >> ((3 - level) * RADIX_BITS)) & (RADIX_SIZE - 1);
-        
-        if (!current->children[idx]) {
+    for (int level = 0; level < RADIX_LEVELS; level++) {
+        int idx = level_index(page_no, level);
+
+        if (!current->u.children[idx]) {
             return; // Page not in tree (not free)
         }
-        
+
         path[level] = current;
         indices[level] = idx;
-        current = current->children[idx];
+        current = current->u.children[idx];
     }
-    
-    // Remove leaf node and clean up any empty parents
+
+    // Clear the bit in the leaf, and its summary bit once the word is empty
+    int word = (page_no >> RADIX_BITS) & (RADIX_SIZE - 1);
+    current->u.bits[word] &= ~(1ULL << (page_no & (RADIX_SIZE - 1)));
+    if (current->u.bits[word]) return;
+    current->summary &= ~(1ULL << word);
+
+    // Remove empty nodes and clean up any empty parents
     // Start from the leaf and work backwards
-    for (int level = 3; level >= 0; level--) {
-        RadixNode *parent = path[level];
-        int idx = indices[level];
-        
-        if (level == 3 || !has_children(parent->children[idx])) {
-            // This node has no children, safe to remove
-            parent->children[idx] = NULL;
-        } else {
-            // This node has children, stop the cleanup
-            break;
-        }
+    for (int level = RADIX_LEVELS - 1; level >= 0; level--) {
+        RadixNode *child = path[level]->u.children[indices[level]];
+        if (child->summary) break; // This node still has children, stop the cleanup
+
+        // This node has no children, safe to remove
+        path[level]->u.children[indices[level]] = NULL;
+        path[level]->summary &= ~(1ULL << indices[level]);
+        release_node(tree, child);
     }
 }
 
 // Get the smallest page number in the tree without removing it
-uint16_t radix_tree_peek_min(RadixTree *tree) {
-    if (!tree) return 0;
-    
-    uint16_t page_num = 0;
+uint32_t radix_tree_peek_min(RadixTree *tree) {
+    if (!tree || !tree->root.summary) return 0; // No pages in tree
+
+    uint32_t page_num = 0;
     RadixNode *current = &tree->root;
-    
-    // Find the leftmost path (smallest page number)
-    for (int level = 0; level < 4; level++) {
-        int idx = 0;
-        while (idx < RADIX_SIZE && !current->children[idx]) {
-            idx++;
-        }
-        
-        if (idx == RADIX_SIZE) {
-            return 0; // No pages in tree
-        }
-        
+
+    // Find the leftmost path (smallest page number) - lowest set summary bit at every level
+    for (int level = 0; level < RADIX_LEVELS; level++) {
+        int idx = __builtin_ctzll(current->summary);
         page_num = (page_num << RADIX_BITS) | idx;
-        current = current->children[idx];
+        current = current->u.children[idx];
     }
-    
+
+    int word = __builtin_ctzll(current->summary);
+    page_num = (page_num << RADIX_BITS) | word;
+    page_num = (page_num << RADIX_BITS) | __builtin_ctzll(current->u.bits[word]);
     return page_num;
 }
 
 // Get and remove the smallest page number in the tree
 // Get the minimum entry at the head of the tree
-uint16_t radix_tree_pop_min(RadixTree *tree) {
-    if (!tree) return 0;
-    
-    uint16_t page_num = 0;
-    RadixNode *path[4] = {NULL};
-    int indices[4] = {0};
-    
-    RadixNode *current = &tree->root;
-    path[0] = current;
-    
-    // Find the leftmost path (smallest page number)
-    for (int level = 0; level < 4; level++) {
-        int idx = 0;
-        while (idx < RADIX_SIZE && !current->children[idx]) {
-            idx++;
-        }
-        
-        if (idx == RADIX_SIZE) {
-            return 0; // No pages in tree
-        }
-        
-        indices[level] = idx;
-        page_num = (page_num << RADIX_BITS) | idx;
-        
-        if (level < 3) {
-            path[level+1] = current->children[idx];
-            current = current->children[idx];
-        }
-    }
-    
+uint32_t radix_tree_pop_min(RadixTree *tree) {
+    uint32_t page_num = radix_tree_peek_min(tree);
+
     // Delete the path for this page
     radix_tree_delete(tree, page_num);
-    
+
     return page_num;
 }
 
 // Recursive function - Walk through radix tree and perform callback (e.g update free status, and building freelist to serialization to disk)
-static void walk_radix(RadixNode *node, uint16_t prefix, int depth, 
-                      void (*cb)(uint16_t page, void* user_data), void* user_data) {
-    if (!node) return;
-    
-    // If at leaf level, this is a free page
-    if (depth == 4) {
-        cb(prefix, user_data);
+static void walk_radix(RadixNode *node, uint32_t prefix, int depth,
+                      void (*cb)(uint32_t page, void* user_data), void* user_data) {
+    // If at leaf level, every set bit is a free page
+    if (depth == RADIX_LEVELS) {
+        for (uint64_t words = node->summary; words; words &= words - 1) {
+            int word = __builtin_ctzll(words);
+            for (uint64_t bits = node->u.bits[word]; bits; bits &= bits - 1) {
+                cb((((prefix << RADIX_BITS) | word) << RADIX_BITS) | __builtin_ctzll(bits), user_data);
+            }
+        }
         return;
     }
-    
+
     // Recurse through all children
-    for (int i = 0; i < RADIX_SIZE; i++) {
-        if (node->children[i]) {
-            uint16_t new_prefix = (prefix << RADIX_BITS) | i;
-            walk_radix(node->children[i], new_prefix, depth + 1, cb, user_data);
-        }
+    for (uint64_t children = node->summary; children; children &= children - 1) {
+        int i = __builtin_ctzll(children);
+        walk_radix(node->u.children[i], (prefix << RADIX_BITS) | i, depth + 1, cb, user_data);
     }
 }
 
 // Start walking through the tree and applying callback function
 // Callback function operates on a page no. a slot and user data that can be used to pass data from within the callback out to the calling function
-void radix_tree_walk(RadixTree *tree, void (*cb)(uint16_t page, void* user_data), void* user_data) {
+void radix_tree_walk(RadixTree *tree, void (*cb)(uint32_t page, void* user_data), void* user_data) {
     if (!tree) return;
     walk_radix(&tree->root, 0, 0, cb, user_data);
 }
 
 // Helper function for radix_to_freelist - takes freed pages stored in Radix Tree and puts it into a user_data field for us to extract later
 // We need this for serialization to disk header
-static void collect_pages(uint16_t page, void* user_data) {
+static void collect_pages(uint32_t page, void* user_data) {
     struct {
-        uint16_t* freelist;
+        uint32_t* freelist;
         size_t* count;
         size_t max_size;
     }* data = user_data;
-    
+
     if (*data->count < data->max_size) {
         data->freelist[(*data->count)++] = page;
     }
@@ -218,26 +208,26 @@ static void collect_pages(uint16_t page, void* user_data) {
 
 // Convert from radix tree to freelist
 // This is for serializing back to the Header on disk
-size_t radix_to_freelist(RadixTree* tree, uint16_t* freelist, size_t max_size) {
+size_t radix_to_freelist(RadixTree* tree, uint32_t* freelist, size_t max_size) {
     if (!tree || !freelist) return 0;
-    
+
     size_t count = 0;
-    
+
     struct {
-        uint16_t* freelist;
+        uint32_t* freelist;
         size_t* count;
         size_t max_size;
     } data = {freelist, &count, max_size};
-    
+
     radix_tree_walk(tree, collect_pages, &data);
     return count;
 }
 
 
 // Convert from freelist to radix tree
-void freelist_to_radix(RadixTree* tree, uint16_t* freelist, size_t count) {
+void freelist_to_radix(RadixTree* tree, uint32_t* freelist, size_t count) {
     if (!tree || !freelist) return;
-    
+
     for (size_t i = 0; i < count; i++) {
         if (freelist[i] != 0) {
             radix_tree_insert(tree, freelist[i]);
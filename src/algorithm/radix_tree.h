@@ -21,15 +21,24 @@
 
 #include "allocator/arena.h"
 
-#define RADIX_BITS 4
+// 32-bit page numbers: 4 levels of 64-way nodes (2 + 6 + 6 + 6 bits) above bitmap leaves that cover 4096 pages each (12 bits)
+// Every node keeps a 64-bit summary of which children are non-empty, so finding the minimum is a ctz per level
+#define RADIX_BITS 6
 #define RADIX_SIZE (1 << RADIX_BITS)
+#define RADIX_LEVELS 4  // Interior levels above the leaves
+#define RADIX_LEAF_BITS 12  // Page bits resolved inside a leaf bitmap (64 words x 64 bits)
 
 typedef struct RadixNode {
-    struct RadixNode *children[RADIX_SIZE];  // next level
+    uint64_t summary;  // Bit i set if children[i] (interior) or bits[i] (leaf) is non-empty
+    union {
+        struct RadixNode *children[RADIX_SIZE];  // next level
+        uint64_t bits[RADIX_SIZE];  // leaf level - one bit per page
+    } u;
 } RadixNode;
 
 typedef struct RadixTree {
     RadixNode root;
+    RadixNode* free_nodes;  // Emptied nodes kept for reuse, chained through u.children[0]
     Arena arena; // Per-tree arena for memory management
 } RadixTree;
 
@@ -37,16 +46,16 @@ RadixTree* radix_tree_create();
 void radix_tree_destroy(RadixTree* tree);
 
 // Basic Radix Tree operations
-void radix_tree_insert(RadixTree *tree, uint16_t page_no);
-void radix_tree_delete(RadixTree *tree, uint16_t page_no);
-uint16_t radix_tree_peek_min(RadixTree *tree);
-uint16_t radix_tree_pop_min(RadixTree *tree);
-bool radix_tree_lookup(RadixTree *tree, uint16_t page_no);
+void radix_tree_insert(RadixTree *tree, uint32_t page_no);
+void radix_tree_delete(RadixTree *tree, uint32_t page_no);
+uint32_t radix_tree_peek_min(RadixTree *tree);
+uint32_t radix_tree_pop_min(RadixTree *tree);
+bool radix_tree_lookup(RadixTree *tree, uint32_t page_no);
 
 // Walk while executing callback function - e.g., build freelist
-void radix_tree_walk(RadixTree *tree, void (*cb)(uint16_t page, void* user_data), void* user_data);
+void radix_tree_walk(RadixTree *tree, void (*cb)(uint32_t page, void* user_data), void* user_data);
 
 // Conversion between freelist and radix tree
-void freelist_to_radix(RadixTree* tree, uint16_t* freelist, size_t count);
-size_t radix_to_freelist(RadixTree* tree, uint16_t* freelist, size_t max_size);
+void freelist_to_radix(RadixTree* tree, uint32_t* freelist, size_t count);
+size_t radix_to_freelist(RadixTree* tree, uint32_t* freelist, size_t max_size);
 #endif
@@ -61,7 +61,13 @@ PSqlStatus psql_prepare(char *preseql_input, PSqlStatement *statement) {
         case STMT_BEGIN:
         case STMT_COMMIT:
         case STMT_ROLLBACK:
-            free(stmt);
+        case STMT_SAVEPOINT:
+        case STMT_RELEASE:
+        case STMT_ROLLBACK_TO:
+            free_control_statement((ControlStatement *)stmt);
+            break;
+        case STMT_VACUUM:
+            free_vacuum_statement((VacuumStatement *)stmt);
             break;
         }
     }
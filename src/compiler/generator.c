@@ -87,7 +87,7 @@ void generate_select(CompiledProgram *program, SelectStatement *stmt)
     emit_instruction(program, OP_HALT, 0, 0, NULL);
 }
 
-// Generate code for control statements (BEGIN, COMMIT)
+// Generate code for control statements (BEGIN, COMMIT, ROLLBACK and savepoints)
 void generate_control(CompiledProgram *program, ControlStatement *stmt)
 {
     if (stmt->type == STMT_BEGIN)
@@ -102,6 +102,18 @@ void generate_control(CompiledProgram *program, ControlStatement *stmt)
     {
         emit_instruction(program, OP_ROLLBACK, 0, 0, NULL);
     }
+    else if (stmt->type == STMT_SAVEPOINT)
+    {
+        emit_instruction(program, OP_SAVEPOINT, 0, 0, stmt->savepoint_name);
+    }
+    else if (stmt->type == STMT_RELEASE)
+    {
+        emit_instruction(program, OP_RELEASE, 0, 0, stmt->savepoint_name);
+    }
+    else if (stmt->type == STMT_ROLLBACK_TO)
+    {
+        emit_instruction(program, OP_ROLLBACK_TO, 0, 0, stmt->savepoint_name);
+    }
 
     // Halt execution
     emit_instruction(program, OP_HALT, 0, 0, NULL);
@@ -158,6 +170,15 @@ void generate_create(CompiledProgram *program, CreateStatement *stmt)
     emit_instruction(program, OP_HALT, 0, 0, NULL);
 }
 
+// Generate code for VACUUM INTO - runs on its own, outside any transaction
+void generate_vacuum(CompiledProgram *program, VacuumStatement *stmt)
+{
+    emit_instruction(program, OP_VACUUM_INTO, 0, 0, stmt->path);
+
+    // Halt execution
+    emit_instruction(program, OP_HALT, 0, 0, NULL);
+}
+
 // Main generator function that takes a parsed statement and generates code
 CompiledProgram *generate_code(void *stmt, int stmt_type)
 {
@@ -179,8 +200,14 @@ CompiledProgram *generate_code(void *stmt, int stmt_type)
     case STMT_BEGIN:
     case STMT_COMMIT:
     case STMT_ROLLBACK:
+    case STMT_SAVEPOINT:
+    case STMT_RELEASE:
+    case STMT_ROLLBACK_TO:
         generate_control(program, (ControlStatement *)stmt);
         break;
+    case STMT_VACUUM:
+        generate_vacuum(program, (VacuumStatement *)stmt);
+        break;
     default:
         fprintf(stderr, "Unsupported statement type for code generation.\n");
         free_program(program);
@@ -217,9 +244,10 @@ void print_program(CompiledProgram *program)
         "OP_CREATE_TABLE", "OP_OPEN_TABLE", "OP_DEFINE_SCHEMA", "OP_DROP_TABLE",
         "OP_INSERT", "OP_SEARCH", "OP_DELETE", "OP_UPDATE",
         "OP_DELETE_ROW", "OP_RETURN_ROW", "OP_COMPARE", "OP_JUMP_IF_FALSE", "OP_HALT",
-        "OP_BEGIN_TXN", "OP_COMMIT", "OP_ROLLBACK",
+        "OP_BEGIN_TXN", "OP_COMMIT", "OP_ROLLBACK", "OP_SAVEPOINT", "OP_RELEASE", "OP_ROLLBACK_TO",
         "OP_OUTER_JOIN", "OP_INNER_JOIN", "OP_SORT", "OP_SWAP_ROWS",
-        "OP_GET_SCHEMA", "OP_GET_LOGS", "OP_GET_BTREEINFO", "OP_GET_DBPAGE", "OP_GET_MEMSET"};
+        "OP_GET_SCHEMA", "OP_GET_LOGS", "OP_GET_BTREEINFO", "OP_GET_DBPAGE", "OP_GET_MEMSET",
+        "OP_VACUUM_INTO"};
 
     for (size_t i = 0; i < program->count; i++)
     {
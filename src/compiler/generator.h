@@ -33,6 +33,7 @@ void generate_select(CompiledProgram *program, SelectStatement *stmt);
 void generate_insert(CompiledProgram *program, InsertStatement *stmt);
 void generate_create(CompiledProgram *program, CreateStatement *stmt);
 void generate_control(CompiledProgram *program, ControlStatement *stmt);
+void generate_vacuum(CompiledProgram *program, VacuumStatement *stmt);
 
 // Main code generation function
 CompiledProgram *generate_code(void *stmt, int stmt_type);
@@ -321,6 +321,7 @@ ControlStatement *parse_begin(Parser *parser)
 
     ControlStatement *stmt = malloc(sizeof(ControlStatement));
     stmt->type = STMT_BEGIN;
+    stmt->savepoint_name = NULL;
     return stmt;
 }
 
@@ -333,6 +334,98 @@ ControlStatement *parse_commit(Parser *parser)
 
     ControlStatement *stmt = malloc(sizeof(ControlStatement));
     stmt->type = STMT_COMMIT;
+    stmt->savepoint_name = NULL;
+    return stmt;
+}
+
+// Copy of a savepoint name - strdup() isn't declared under -std=c99
+static char *copy_name(const char *name)
+{
+    size_t length = strlen(name) + 1;
+    char *copy = malloc(length);
+    if (copy)
+        memcpy(copy, name, length);
+    return copy;
+}
+
+// ROLLBACK [TRANSACTION]; or ROLLBACK [TRANSACTION] TO [SAVEPOINT] name;
+ControlStatement *parse_rollback(Parser *parser)
+{
+    if (!expect(parser, TOKEN_KEYWORD_ROLLBACK, "ROLLBACK"))
+        return NULL;
+    match(parser, TOKEN_KEYWORD_TRANSACTION);
+
+    Token *name = NULL;
+    if (match(parser, TOKEN_KEYWORD_TO))
+    {
+        match(parser, TOKEN_KEYWORD_SAVEPOINT);
+        name = expect(parser, TOKEN_IDENTIFIER, "savepoint name");
+        if (!name)
+            return NULL;
+    }
+    if (!expect(parser, TOKEN_END_OF_LINE, "';'"))
+        return NULL;
+
+    ControlStatement *stmt = malloc(sizeof(ControlStatement));
+    stmt->type = name ? STMT_ROLLBACK_TO : STMT_ROLLBACK;
+    stmt->savepoint_name = name ? copy_name(name->lexeme) : NULL;
+    return stmt;
+}
+
+// SAVEPOINT name;
+ControlStatement *parse_savepoint(Parser *parser)
+{
+    if (!expect(parser, TOKEN_KEYWORD_SAVEPOINT, "SAVEPOINT"))
+        return NULL;
+    Token *name = expect(parser, TOKEN_IDENTIFIER, "savepoint name");
+    if (!name)
+        return NULL;
+    if (!expect(parser, TOKEN_END_OF_LINE, "';'"))
+        return NULL;
+
+    ControlStatement *stmt = malloc(sizeof(ControlStatement));
+    stmt->type = STMT_SAVEPOINT;
+    stmt->savepoint_name = copy_name(name->lexeme);
+    return stmt;
+}
+
+// RELEASE [SAVEPOINT] name;
+ControlStatement *parse_release(Parser *parser)
+{
+    if (!expect(parser, TOKEN_KEYWORD_RELEASE, "RELEASE"))
+        return NULL;
+    match(parser, TOKEN_KEYWORD_SAVEPOINT);
+    Token *name = expect(parser, TOKEN_IDENTIFIER, "savepoint name");
+    if (!name)
+        return NULL;
+    if (!expect(parser, TOKEN_END_OF_LINE, "';'"))
+        return NULL;
+
+    ControlStatement *stmt = malloc(sizeof(ControlStatement));
+    stmt->type = STMT_RELEASE;
+    stmt->savepoint_name = copy_name(name->lexeme);
+    return stmt;
+}
+
+// VACUUM INTO 'path'; - rebuilds the DB compactly into a new file
+VacuumStatement *parse_vacuum(Parser *parser)
+{
+    if (!expect(parser, TOKEN_KEYWORD_VACUUM, "VACUUM"))
+        return NULL;
+    if (!expect(parser, TOKEN_KEYWORD_INTO, "INTO"))
+        return NULL;
+    Token *path = expect(parser, TOKEN_VARCHAR_LITERAL, "file path");
+    if (!path)
+        return NULL;
+    if (!expect(parser, TOKEN_END_OF_LINE, "';'"))
+        return NULL;
+
+    // Strip the quotes
+    size_t len = strlen(path->lexeme) - 2;
+    VacuumStatement *stmt = malloc(sizeof(VacuumStatement));
+    stmt->path = malloc(len + 1);
+    memcpy(stmt->path, path->lexeme + 1, len);
+    stmt->path[len] = '\0';
     return stmt;
 }
 
@@ -389,6 +482,22 @@ void free_create_statement(CreateStatement *stmt)
     free(stmt);
 }
 
+void free_vacuum_statement(VacuumStatement *stmt)
+{
+    if (!stmt)
+        return;
+    free(stmt->path);
+    free(stmt);
+}
+
+void free_control_statement(ControlStatement *stmt)
+{
+    if (!stmt)
+        return;
+    free(stmt->savepoint_name);
+    free(stmt);
+}
+
 void parse_tokens(Token **token_streams, size_t token_count)
 {
 
@@ -473,7 +582,7 @@ void parse_tokens(Token **token_streams, size_t token_count)
             return;
 
         printf("Parsed BEGIN TRANSACTION statement\n");
-        free(stmt);
+        free_control_statement(stmt);
     }
     else if (token->type == TOKEN_KEYWORD_COMMIT)
     {
@@ -482,7 +591,46 @@ void parse_tokens(Token **token_streams, size_t token_count)
             return;
 
         printf("Parsed COMMIT statement\n");
-        free(stmt);
+        free_control_statement(stmt);
+    }
+    else if (token->type == TOKEN_KEYWORD_ROLLBACK)
+    {
+        ControlStatement *stmt = parse_rollback(&parser);
+        if (!stmt)
+            return;
+
+        if (stmt->savepoint_name)
+            printf("Parsed ROLLBACK TO SAVEPOINT statement for %s\n", stmt->savepoint_name);
+        else
+            printf("Parsed ROLLBACK statement\n");
+        free_control_statement(stmt);
+    }
+    else if (token->type == TOKEN_KEYWORD_SAVEPOINT)
+    {
+        ControlStatement *stmt = parse_savepoint(&parser);
+        if (!stmt)
+            return;
+
+        printf("Parsed SAVEPOINT statement for %s\n", stmt->savepoint_name);
+        free_control_statement(stmt);
+    }
+    else if (token->type == TOKEN_KEYWORD_RELEASE)
+    {
+        ControlStatement *stmt = parse_release(&parser);
+        if (!stmt)
+            return;
+
+        printf("Parsed RELEASE statement for %s\n", stmt->savepoint_name);
+        free_control_statement(stmt);
+    }
+    else if (token->type == TOKEN_KEYWORD_VACUUM)
+    {
+        VacuumStatement *stmt = parse_vacuum(&parser);
+        if (!stmt)
+            return;
+
+        printf("Parsed VACUUM INTO statement with path %s\n", stmt->path);
+        free_vacuum_statement(stmt);
     }
     else
     {
@@ -534,6 +682,34 @@ void *parse_tokens_with_type(Token **token_streams, size_t token_count, int *out
             *out_stmt_type = STMT_COMMIT;
         return stmt;
     }
+    else if (token->type == TOKEN_KEYWORD_ROLLBACK)
+    {
+        ControlStatement *stmt = parse_rollback(&parser);
+        if (stmt && out_stmt_type)
+            *out_stmt_type = stmt->type;
+        return stmt;
+    }
+    else if (token->type == TOKEN_KEYWORD_SAVEPOINT)
+    {
+        ControlStatement *stmt = parse_savepoint(&parser);
+        if (stmt && out_stmt_type)
+            *out_stmt_type = STMT_SAVEPOINT;
+        return stmt;
+    }
+    else if (token->type == TOKEN_KEYWORD_RELEASE)
+    {
+        ControlStatement *stmt = parse_release(&parser);
+        if (stmt && out_stmt_type)
+            *out_stmt_type = STMT_RELEASE;
+        return stmt;
+    }
+    else if (token->type == TOKEN_KEYWORD_VACUUM)
+    {
+        VacuumStatement *stmt = parse_vacuum(&parser);
+        if (stmt && out_stmt_type)
+            *out_stmt_type = STMT_VACUUM;
+        return stmt;
+    }
     else
     {
         fprintf(stderr, "Unsupported Statement Starting with: %s\n", token->lexeme);
@@ -42,6 +42,10 @@ typedef enum
     STMT_BEGIN,
     STMT_COMMIT,
     STMT_ROLLBACK,
+    STMT_VACUUM,
+    STMT_SAVEPOINT,
+    STMT_RELEASE,
+    STMT_ROLLBACK_TO,
 } StatementType;
 
 typedef struct
@@ -77,8 +81,14 @@ typedef struct
 typedef struct
 {
     StatementType type;
+    char *savepoint_name; // SAVEPOINT, RELEASE and ROLLBACK TO - NULL for the rest
 } ControlStatement;
 
+typedef struct
+{
+    char *path; // VACUUM INTO 'path' - quotes stripped
+} VacuumStatement;
+
 Token *peek(Parser *parser);
 Token *advance(Parser *parser);
 bool match(Parser *parser, TokenType type);
@@ -87,6 +97,8 @@ ColumnType parse_column_type(Token *type_token, int *out_length);
 void free_select_statement(SelectStatement *stmt);
 void free_insert_statement(InsertStatement *stmt);
 void free_create_statement(CreateStatement *stmt);
+void free_vacuum_statement(VacuumStatement *stmt);
+void free_control_statement(ControlStatement *stmt);
 void parse_tokens(Token **tokens, size_t count);
 void *parse_tokens_with_type(Token **token_streams, size_t token_count, int *out_stmt_type);
 
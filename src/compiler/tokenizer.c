@@ -73,6 +73,11 @@ TokenType is_keyword_strcmp(const char *lexeme) {
         {"BEGIN", TOKEN_KEYWORD_BEGIN},
         {"TRANSACTION", TOKEN_KEYWORD_TRANSACTION},
         {"COMMIT", TOKEN_KEYWORD_COMMIT},
+        {"VACUUM", TOKEN_KEYWORD_VACUUM},
+        {"ROLLBACK", TOKEN_KEYWORD_ROLLBACK},
+        {"SAVEPOINT", TOKEN_KEYWORD_SAVEPOINT},
+        {"RELEASE", TOKEN_KEYWORD_RELEASE},
+        {"TO", TOKEN_KEYWORD_TO},
         {NULL, TOKEN_UNKNOWN},
     };
 
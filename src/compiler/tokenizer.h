@@ -15,18 +15,23 @@ typedef enum {
     TOKEN_KEYWORD_BEGIN,            // 7
     TOKEN_KEYWORD_COMMIT,           // 8
     TOKEN_KEYWORD_TRANSACTION,      // 9
-    TOKEN_TYPE_VARCHAR,             // 10
-    TOKEN_TYPE_INT,                 // 11
-    TOKEN_END_OF_LINE,              // 12
-    TOKEN_PUNC_COMMA,               // 13
-    TOKEN_PUNC_OPEN_PAREN,          // 14
-    TOKEN_PUNC_CLOSE_PAREN,         // 15
-    TOKEN_PUNC_QUOTE,               // 16
-    TOKEN_OP_STAR,                  // 17
-    TOKEN_IDENTIFIER,               // 18
-    TOKEN_VARCHAR_LITERAL,          // 19
-    TOKEN_INT_LITERAL,              // 20
-    TOKEN_UNKNOWN                   // 21
+    TOKEN_KEYWORD_VACUUM,           // 10
+    TOKEN_KEYWORD_ROLLBACK,         // 11
+    TOKEN_KEYWORD_SAVEPOINT,        // 12
+    TOKEN_KEYWORD_RELEASE,          // 13
+    TOKEN_KEYWORD_TO,               // 14
+    TOKEN_TYPE_VARCHAR,             // 15
+    TOKEN_TYPE_INT,                 // 16
+    TOKEN_END_OF_LINE,              // 17
+    TOKEN_PUNC_COMMA,               // 18
+    TOKEN_PUNC_OPEN_PAREN,          // 19
+    TOKEN_PUNC_CLOSE_PAREN,         // 20
+    TOKEN_PUNC_QUOTE,               // 21
+    TOKEN_OP_STAR,                  // 22
+    TOKEN_IDENTIFIER,               // 23
+    TOKEN_VARCHAR_LITERAL,          // 24
+    TOKEN_INT_LITERAL,              // 25
+    TOKEN_UNKNOWN                   // 26
 } TokenType;
 
 
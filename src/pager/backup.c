@@ -0,0 +1,285 @@
+#define _GNU_SOURCE  /* pread, fdatasync, strdup under -std=c99 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "backup.h"
+#include "pager/pager.h"
+#include "pager/file_io.h"
+#include "algorithm/bitmap.h"
+#include "algorithm/crc.h"
+
+struct PagerBackup {
+    Pager* source;
+    PagerBackup* next;      // Source pager's list of backups in progress
+    char* path;
+    char* tmp_filename;     // Full backups are written here and renamed to path - NULL for incremental ones
+    int fd;
+    uint32_t page_size;
+    uint32_t cursor;        // Pages below it have been copied or skipped
+    Bitmap recopy;          // Pages below the cursor written since
+    uint8_t* batch;         // BACKUP_BATCH_PAGES pages waiting for one pwrite()
+    uint32_t batch_first;
+    uint32_t batch_count;
+    BackupStats stats;
+};
+
+
+/* Change stamps */
+void page_set_change_stamp(DBPage* page, uint32_t page_size, uint64_t counter) {
+    memcpy((uint8_t*)page + PAGE_CHANGE_STAMP_OFFSET(page_size), &counter, PAGE_CHANGE_STAMP_SIZE);
+}
+
+uint64_t page_change_stamp(const DBPage* page, uint32_t page_size) {
+    uint64_t counter;
+    memcpy(&counter, (const uint8_t*)page + PAGE_CHANGE_STAMP_OFFSET(page_size), PAGE_CHANGE_STAMP_SIZE);
+    return counter;
+}
+
+// Only pages behind the cursor need to go again - the ones ahead get copied as they are when it gets there
+void backup_page_written(Pager* pager, DBPage* page, uint32_t page_no) {
+    page_set_change_stamp(page, pager->db_pager.page_size, pager->header.change_counter);
+    for (PagerBackup* backup = pager->backups; backup; backup = backup->next) {
+        if (page_no < backup->cursor) bitmap_set(&backup->recopy, page_no);
+    }
+}
+
+
+/* Writing to the backup */
+static PSqlStatus flush_batch(PagerBackup* backup) {
+    if (backup->batch_count == 0) return PSQL_OK;
+    size_t len = (size_t)backup->batch_count * backup->page_size;
+    PSqlStatus status = pwrite_all(backup->fd, backup->batch, len, (off_t)backup->batch_first * backup->page_size);
+    if (status == PSQL_OK) backup->stats.bytes_written += len;
+    backup->batch_count = 0;
+    return status;
+}
+
+// Copied the way a flush would write it - PAGE_PINNED is buffer pool memory only, the checksum may not be sealed yet
+// (the page can be dirty since the last flush), and page 0 gets pager->header, which only reaches it on the next flush
+static PSqlStatus copy_page(PagerBackup* backup, uint32_t page_no, const DBPage* page) {
+    if (backup->batch_count && (backup->batch_count == BACKUP_BATCH_PAGES || page_no != backup->batch_first + backup->batch_count)) {
+        PSqlStatus status = flush_batch(backup);
+        if (status != PSQL_OK) return status;
+    }
+    if (backup->batch_count == 0) backup->batch_first = page_no;
+
+    DBPage* copy = (DBPage*)(backup->batch + (size_t)backup->batch_count++ * backup->page_size);
+    memcpy(copy, page, backup->page_size);
+    copy->header.flag &= ~PAGE_PINNED;
+    if (page_no == 0) {
+        DatabaseHeader* header = (DatabaseHeader*)copy->data;
+        memcpy(header, &backup->source->header, sizeof(DatabaseHeader));
+        header->checksum = calculate_crc32(header, offsetof(DatabaseHeader, checksum));
+    }
+    if (backup->source->page_checksums) page_checksum_seal(copy, backup->page_size);
+    backup->stats.pages_copied++;
+    return PSQL_OK;
+}
+
+// Writers go on the writer lock for the length of a step - nobody is in the middle of a transaction while pages are read
+static bool lock_writers(Pager* pager) {
+    return pthread_mutex_lock(&pager->writer_lock) == 0;  // EDEADLK - this thread has a transaction open
+}
+
+static void unlock_writers(Pager* pager) {
+    pthread_mutex_unlock(&pager->writer_lock);
+}
+
+// n_pages copies at most - UINT32_MAX for everything left
+static PSqlStatus run_step(PagerBackup* backup, uint32_t n_pages) {
+    Pager* source = backup->source;
+    uint32_t page_count = source->db_pager.page_count;
+    backup->stats.page_count = page_count;
+    backup->stats.steps++;
+    if (backup->recopy.num_bits < page_count && !bitmap_resize(&backup->recopy, page_count)) return PSQL_NOMEM;
+    if (backup->cursor > page_count) backup->cursor = page_count;  // A vacuum cut the source down - the rest goes on finish
+
+    // Pages written since they were copied first, then on from the cursor
+    PSqlStatus status = PSQL_OK;
+    uint32_t copied = 0;
+    for (size_t page_no = bitmap_next_set(&backup->recopy, 0); page_no < page_count && copied < n_pages && status == PSQL_OK;
+         page_no = bitmap_next_set(&backup->recopy, page_no + 1)) {
+        DBPage* page = pager_get_page(source, (uint32_t)page_no);
+        if (!page) return PSQL_IOERR;
+        status = copy_page(backup, (uint32_t)page_no, page);
+        pager_unpin_page(source, page);
+        bitmap_clear(&backup->recopy, page_no);
+        backup->stats.pages_recopied++;
+        copied++;
+    }
+
+    uint64_t scan_budget = n_pages == UINT32_MAX ? UINT64_MAX : (uint64_t)n_pages * BACKUP_SCAN_PER_PAGE;
+    for (uint64_t scanned = 0; backup->cursor < page_count && copied < n_pages && scanned < scan_budget && status == PSQL_OK; scanned++) {
+        DBPage* page = pager_get_page(source, backup->cursor);
+        if (!page) return PSQL_IOERR;
+        if (backup->stats.incremental && page_change_stamp(page, backup->page_size) < backup->stats.since) {
+            backup->stats.pages_skipped++;
+        } else {
+            status = copy_page(backup, backup->cursor, page);
+            copied++;
+        }
+        pager_unpin_page(source, page);
+        backup->cursor++;
+    }
+    if (status == PSQL_OK) status = flush_batch(backup);
+    return status;
+}
+
+// Any other change counter already in the backup means it wasn't one of this DB's
+static bool read_backup_header(int fd, uint32_t page_size, DatabaseHeader* header) {
+    uint8_t buf[sizeof(DBPageHeader) + sizeof(DatabaseHeader)];
+    if (pread(fd, buf, sizeof(buf), 0) != (ssize_t)sizeof(buf)) return false;
+    memcpy(header, buf + sizeof(DBPageHeader), sizeof(*header));
+    return memcmp(header->magic, MAGIC_NUMBER, MAGIC_NUMBER_SIZE) == 0 && header->db_version == DB_FORMAT_VERSION &&
+           DB_PAGE_SIZE_DECODE(header->page_size) == page_size;
+}
+
+// Pages written from here on carry a stamp the backup's header doesn't - committed, so a crash can't hand the same value out again
+static PSqlStatus bump_change_counter(Pager* pager) {
+    if (pager->read_only) return PSQL_OK;  // Nothing gets written through this pager, the stamps can't move past it
+    PSqlStatus status = pager_begin_transaction(pager);
+    if (status != PSQL_OK) return status;
+    pager->header.change_counter++;
+    pager->header_dirty = true;
+    return pager_commit(pager);
+}
+
+static void free_backup(PagerBackup* backup) {
+    if (backup->fd >= 0) close(backup->fd);
+    bitmap_free(&backup->recopy);
+    free(backup->batch);
+    free(backup->path);
+    free(backup->tmp_filename);
+    free(backup);
+}
+
+PagerBackup* pager_backup_init(Pager* source, const char* path, bool incremental) {
+    if (!source || !path) return NULL;
+    PagerBackup* backup = (PagerBackup*)calloc(1, sizeof(PagerBackup));
+    if (!backup) return NULL;
+    backup->source = source;
+    backup->fd = -1;
+    backup->page_size = source->db_pager.page_size;
+    backup->path = strdup(path);
+    backup->batch = (uint8_t*)malloc((size_t)BACKUP_BATCH_PAGES * backup->page_size);
+    if (!backup->path || !backup->batch || !bitmap_init(&backup->recopy, source->db_pager.page_count)) {
+        free_backup(backup);
+        return NULL;
+    }
+
+    // Onto the earlier backup if there is one to go from, otherwise a fresh file
+    DatabaseHeader earlier;
+    if (incremental) {
+        backup->fd = open(path, O_RDWR);
+        if (backup->fd >= 0 && read_backup_header(backup->fd, backup->page_size, &earlier) &&
+            earlier.change_counter <= source->header.change_counter) {
+            backup->stats.incremental = true;
+            backup->stats.since = earlier.change_counter;
+        } else if (backup->fd >= 0) {
+            close(backup->fd);
+            backup->fd = -1;
+        }
+    }
+    if (!backup->stats.incremental) {
+        backup->tmp_filename = with_extension(path, BACKUP_FILE_EXTENSION);
+        if (!backup->tmp_filename) {
+            free_backup(backup);
+            return NULL;
+        }
+        backup->fd = open(backup->tmp_filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (backup->fd < 0) {
+            perror("open");
+            free_backup(backup);
+            return NULL;
+        }
+    }
+
+    if (bump_change_counter(source) != PSQL_OK || !lock_writers(source)) {
+        if (backup->tmp_filename) unlink(backup->tmp_filename);
+        free_backup(backup);
+        return NULL;
+    }
+    backup->stats.change_counter = source->header.change_counter;
+    backup->next = source->backups;
+    source->backups = backup;
+    unlock_writers(source);
+    return backup;
+}
+
+PSqlStatus pager_backup_step(PagerBackup* backup, uint32_t n_pages) {
+    if (!backup) return PSQL_ERROR;
+    if (!lock_writers(backup->source)) return PSQL_MISUSE;
+    PSqlStatus status = run_step(backup, n_pages);
+    unlock_writers(backup->source);
+    return status;
+}
+
+uint32_t pager_backup_remaining(PagerBackup* backup) {
+    if (!backup) return 0;
+    uint32_t page_count = backup->source->db_pager.page_count;
+    uint32_t recopy = 0;
+    for (size_t page_no = bitmap_next_set(&backup->recopy, 0); page_no < page_count; page_no = bitmap_next_set(&backup->recopy, page_no + 1)) {
+        recopy++;
+    }
+    return (backup->cursor < page_count ? page_count - backup->cursor : 0) + recopy;
+}
+
+BackupStats pager_backup_stats(PagerBackup* backup) {
+    BackupStats empty = {0};
+    if (!backup) return empty;
+    BackupStats stats = backup->stats;
+    stats.remaining = pager_backup_remaining(backup);
+    return stats;
+}
+
+static void unregister_backup(PagerBackup* backup) {
+    PagerBackup** link = &backup->source->backups;
+    while (*link != backup) link = &(*link)->next;
+    *link = backup->next;
+}
+
+// The last catch up holds writers off until the copy is complete - from then on the backup is the DB as of now.
+// Only the sync and rename happen after they are let go again
+PSqlStatus pager_backup_finish(PagerBackup* backup) {
+    if (!backup) return PSQL_ERROR;
+    Pager* source = backup->source;
+    if (!lock_writers(source)) return PSQL_MISUSE;
+    PSqlStatus status = run_step(backup, UINT32_MAX);
+    uint32_t page_count = source->db_pager.page_count;
+    unregister_backup(backup);
+    unlock_writers(source);
+
+    // An incremental backup of a DB that shrank since the earlier one
+    if (status == PSQL_OK && ftruncate(backup->fd, (off_t)page_count * backup->page_size) != 0) {
+        perror("ftruncate");
+        status = PSQL_IOERR;
+    }
+    if (status == PSQL_OK && fdatasync(backup->fd) != 0) {
+        perror("fdatasync");
+        status = PSQL_IOERR;
+    }
+    if (status == PSQL_OK && backup->tmp_filename) {
+        if (rename(backup->tmp_filename, backup->path) != 0) {
+            perror("rename");
+            status = PSQL_IOERR;
+        } else {
+            status = sync_parent_dir(backup->path);
+        }
+    }
+    if (status != PSQL_OK && backup->tmp_filename) unlink(backup->tmp_filename);
+    free_backup(backup);
+    return status;
+}
+
+void pager_backup_cancel(PagerBackup* backup) {
+    if (!backup) return;
+    bool locked = lock_writers(backup->source);
+    unregister_backup(backup);
+    if (locked) unlock_writers(backup->source);
+    if (backup->tmp_filename) unlink(backup->tmp_filename);
+    free_backup(backup);
+}
@@ -0,0 +1,71 @@
+/* Online backup - a consistent copy of the database while it stays writable
+ *
+ * pager_backup_init() opens the destination, pager_backup_step() copies the next n pages to it and pager_backup_finish()
+ * copies whatever is left and makes it durable. Each step holds writers off only for its own n pages, so a big database is
+ * copied a slice at a time between transactions instead of stopping writers for the whole copy.
+ *
+ * Pages written after they were copied have to go again. The backup hooks into pager_write_page() - the same place the
+ * dirty bitmap is kept - and marks every page behind its cursor that gets written. The next step copies those first, and
+ * finish catches up on the last ones with writers held off, so the finished backup is the database as of that moment.
+ *
+ * Incremental backups work off a change counter. The header has one, and pager_write_page() stamps it into the reserved
+ * tail of every page it writes (PAGE_CHANGE_STAMP_OFFSET, just before the checksum). A backup bumps the counter - in a
+ * commit of its own, so it is durable before any page is copied - and the header it copies carries the new value. An
+ * incremental backup onto an earlier backup reads that value back from it and only copies the pages stamped with it or
+ * later: everything written since the earlier backup started. The rest are only read to look at their stamp, nothing is
+ * written for them. A page that is never written through pager_write_page() is never stamped, like it never gets flushed.
+ *
+ * A full backup is built as "<path>.pseql-backup" and renamed to path once it is durable. An incremental one updates the
+ * earlier backup in place - if it is interrupted, that backup is only good for running the incremental again.
+ */
+
+#ifndef PRESEQL_PAGER_BACKUP_H
+#define PRESEQL_PAGER_BACKUP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pager/types.h"
+#include "pager/page_checksum.h"
+#include "status/db.h"
+
+#define PAGE_CHANGE_STAMP_SIZE sizeof(uint64_t)
+#define PAGE_CHANGE_STAMP_OFFSET(page_size) (PAGE_CHECKSUM_OFFSET(page_size) - PAGE_CHANGE_STAMP_SIZE)
+
+typedef struct {
+    bool incremental;         // Copying onto an earlier backup
+    uint64_t since;           // Incremental - the earlier backup's change counter, pages stamped below it are skipped
+    uint64_t change_counter;  // This backup's - an incremental onto it skips what is stamped below this
+    uint32_t page_count;      // Of the source, as of the last step
+    uint32_t remaining;       // Pages still to copy - ahead of the cursor, or written since they were copied
+    uint64_t steps;
+    uint64_t pages_copied;    // Including recopies
+    uint64_t pages_recopied;  // Written in the source after this backup had copied them
+    uint64_t pages_skipped;   // Incremental - unchanged since the earlier backup
+    uint64_t bytes_written;
+} BackupStats;
+
+/* Change stamps in the reserved tail */
+void page_set_change_stamp(DBPage* page, uint32_t page_size, uint64_t counter);
+uint64_t page_change_stamp(const DBPage* page, uint32_t page_size);
+
+/* Start a backup of source to path. incremental copies onto the backup already at path, if it is one of a DB with
+ * the same page size - otherwise it falls back to a full backup. NULL on failure, or if source is in a transaction
+ * on this thread */
+PagerBackup* pager_backup_init(Pager* source, const char* path, bool incremental);
+
+/* Copy up to n_pages more - pages written since they were copied first. PSQL_OK with nothing left to copy is
+ * possible before finish, writers can still add more */
+PSqlStatus pager_backup_step(PagerBackup* backup, uint32_t n_pages);
+uint32_t pager_backup_remaining(PagerBackup* backup);
+BackupStats pager_backup_stats(PagerBackup* backup);
+
+/* Copy the rest with writers held off, sync and (full backups) rename into place. Frees the backup either way */
+PSqlStatus pager_backup_finish(PagerBackup* backup);
+
+/* Give up - a full backup leaves path alone, an incremental one leaves it half updated. Frees the backup */
+void pager_backup_cancel(PagerBackup* backup);
+
+/* pager_write_page() - stamp the page and tell the backups in progress */
+void backup_page_written(Pager* pager, DBPage* page, uint32_t page_no);
+
+#endif /* PRESEQL_PAGER_BACKUP_H */
@@ -0,0 +1,616 @@
+#define _GNU_SOURCE  /* pread, pwrite, posix_memalign, MADV_HUGEPAGE under -std=c99 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "buffer_pool.h"
+
+#define NO_ENTRY (-1)
+
+typedef enum {
+    ENTRY_UNUSED = 0,
+    ENTRY_HOT,          // Resident, short reuse distance
+    ENTRY_COLD,         // Resident, candidate for eviction
+    ENTRY_NONRESIDENT,  // Evicted cold page still in its test period - metadata only, no frame
+} EntryState;
+
+// One entry on the clock ring - resident pages own a frame, non-resident ones don't
+typedef struct {
+    uint32_t page_no;
+    uint8_t state;        // EntryState
+    bool referenced;      // Reference bit - set on every hit, cleared by the hands
+    bool in_test;         // Cold page in its test period
+    bool dirty;           // Frame modified since it was read
+    uint32_t pin_count;   // Frame cannot be evicted while > 0
+    int32_t frame;        // Frame index, NO_ENTRY if non-resident
+    int32_t prev, next;   // Clock ring links
+    int32_t hash_next;    // Page table chain (also the free entry list)
+} ClockEntry;
+
+struct BufferPool {
+    int fd;
+    uint32_t page_size;       // Bytes per frame - the page size of the database
+    size_t capacity;          // Number of frames
+    size_t num_entries;       // Resident + non-resident entries (2 * capacity + 1)
+
+    uint8_t* frames;          // capacity * page_size bytes, page aligned
+    int32_t* frame_owner;     // frame index -> entry index
+    int32_t* free_frames;     // Stack of unused frames
+    size_t free_frame_count;
+
+    ClockEntry* entries;
+    int32_t free_entry;       // Head of the free entry list (chained through hash_next)
+    int32_t* buckets;         // Page table - page_no -> entry index
+    size_t bucket_mask;
+
+    int32_t hand_hot;
+    int32_t hand_cold;
+    int32_t hand_test;
+
+    size_t hot_count;         // Resident hot pages
+    size_t cold_count;        // Resident cold pages
+    size_t test_count;        // Non-resident pages in their test period
+    size_t cold_target;       // m_c in the paper - adapts between 1 and capacity - 1
+
+    BufferPoolWriteHook write_hook;  // NULL if there is nothing to do before a write back
+    void* write_hook_ctx;
+
+    CompressedCache* compressed;     // Second tier for evicted data/overflow pages - NULL without PAGER_COMPRESSION
+
+    BufferPoolStats stats;
+};
+
+
+/* Page table - chained hashing on page number */
+static size_t hash_page(BufferPool* pool, uint32_t page_no) {
+    return ((uint32_t)page_no * 2654435761u) & pool->bucket_mask;  // Knuth multiplicative hash
+}
+
+static int32_t hash_find(BufferPool* pool, uint32_t page_no) {
+    int32_t idx = pool->buckets[hash_page(pool, page_no)];
+    while (idx != NO_ENTRY && pool->entries[idx].page_no != page_no) {
+        idx = pool->entries[idx].hash_next;
+    }
+    return idx;
+}
+
+static void hash_insert(BufferPool* pool, int32_t idx) {
+    size_t bucket = hash_page(pool, pool->entries[idx].page_no);
+    pool->entries[idx].hash_next = pool->buckets[bucket];
+    pool->buckets[bucket] = idx;
+}
+
+static void hash_remove(BufferPool* pool, int32_t idx) {
+    int32_t* link = &pool->buckets[hash_page(pool, pool->entries[idx].page_no)];
+    while (*link != NO_ENTRY) {
+        if (*link == idx) {
+            *link = pool->entries[idx].hash_next;
+            return;
+        }
+        link = &pool->entries[*link].hash_next;
+    }
+}
+
+
+/* Clock ring - new entries go in at the "head" which is just behind hand_hot */
+static void ring_insert(BufferPool* pool, int32_t idx) {
+    ClockEntry* e = &pool->entries[idx];
+    if (pool->hand_hot == NO_ENTRY) {
+        e->prev = e->next = idx;
+        pool->hand_hot = pool->hand_cold = pool->hand_test = idx;
+        return;
+    }
+    int32_t head = pool->hand_hot;
+    int32_t tail = pool->entries[head].prev;
+    e->next = head;
+    e->prev = tail;
+    pool->entries[tail].next = idx;
+    pool->entries[head].prev = idx;
+}
+
+static void ring_remove(BufferPool* pool, int32_t idx) {
+    ClockEntry* e = &pool->entries[idx];
+    if (e->next == idx) {
+        pool->hand_hot = pool->hand_cold = pool->hand_test = NO_ENTRY;
+        return;
+    }
+    // Hands pointing at the removed entry move on to the next one
+    if (pool->hand_hot == idx) pool->hand_hot = e->next;
+    if (pool->hand_cold == idx) pool->hand_cold = e->next;
+    if (pool->hand_test == idx) pool->hand_test = e->next;
+    pool->entries[e->prev].next = e->next;
+    pool->entries[e->next].prev = e->prev;
+}
+
+static int32_t alloc_entry(BufferPool* pool) {
+    int32_t idx = pool->free_entry;
+    if (idx == NO_ENTRY) return NO_ENTRY;
+    pool->free_entry = pool->entries[idx].hash_next;
+    memset(&pool->entries[idx], 0, sizeof(ClockEntry));
+    pool->entries[idx].frame = NO_ENTRY;
+    return idx;
+}
+
+// Drop an entry completely - off the ring, out of the page table
+static void release_entry(BufferPool* pool, int32_t idx) {
+    ring_remove(pool, idx);
+    hash_remove(pool, idx);
+    pool->entries[idx].state = ENTRY_UNUSED;
+    pool->entries[idx].hash_next = pool->free_entry;
+    pool->free_entry = idx;
+}
+
+static uint8_t* frame_data(BufferPool* pool, int32_t frame) {
+    return pool->frames + (size_t)frame * pool->page_size;
+}
+
+static int32_t entry_of(BufferPool* pool, DBPage* page) {
+    uint8_t* p = (uint8_t*)page;
+    if (p < pool->frames || p >= pool->frames + pool->capacity * pool->page_size) return NO_ENTRY;
+    return pool->frame_owner[(p - pool->frames) / pool->page_size];
+}
+
+
+/* Disk I/O for frames */
+static PSqlStatus read_page(BufferPool* pool, uint32_t page_no, uint8_t* data) {
+    off_t offset = (off_t)page_no * pool->page_size;
+    size_t done = 0;
+    while (done < pool->page_size) {
+        ssize_t n = pread(pool->fd, data + done, pool->page_size - done, offset + done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("pread");
+            return PSQL_IOERR;
+        }
+        if (n == 0) break;  // Past the end of file - a freshly allocated page
+        done += n;
+    }
+    memset(data + done, 0, pool->page_size - done);
+    return PSQL_OK;
+}
+
+static PSqlStatus read_frame(BufferPool* pool, uint32_t page_no, int32_t frame) {
+    return read_page(pool, page_no, frame_data(pool, frame));
+}
+
+static PSqlStatus write_frame(BufferPool* pool, ClockEntry* e) {
+    DBPage* page = (DBPage*)frame_data(pool, e->frame);
+
+    // PAGE_PINNED only means something in memory - never let it reach the disk
+    uint8_t saved_flag = page->header.flag;
+    page->header.flag &= ~PAGE_PINNED;
+    PSqlStatus status = pool->write_hook ? pool->write_hook(pool->write_hook_ctx, e->page_no, page) : PSQL_OK;
+
+    const uint8_t* data = (const uint8_t*)page;
+    off_t offset = (off_t)e->page_no * pool->page_size;
+    size_t done = 0;
+    while (status == PSQL_OK && done < pool->page_size) {
+        ssize_t n = pwrite(pool->fd, data + done, pool->page_size - done, offset + done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("pwrite");
+            status = PSQL_IOERR;
+            break;
+        }
+        done += n;
+    }
+
+    page->header.flag = saved_flag;
+    if (status == PSQL_OK) {
+        e->dirty = false;
+        pool->stats.writebacks++;
+    }
+    return status;
+}
+
+
+/* CLOCK-Pro hands */
+static void cold_target_dec(BufferPool* pool) {
+    if (pool->cold_target > 1) pool->cold_target--;
+}
+
+static void cold_target_inc(BufferPool* pool) {
+    if (pool->cold_target + 1 < pool->capacity) pool->cold_target++;
+}
+
+// hand_test - ends test periods, removes one non-resident entry
+static void run_hand_test(BufferPool* pool) {
+    for (size_t steps = 0; steps < pool->num_entries && pool->hand_test != NO_ENTRY; steps++) {
+        int32_t idx = pool->hand_test;
+        ClockEntry* e = &pool->entries[idx];
+        pool->hand_test = e->next;
+
+        if (e->state == ENTRY_COLD && e->in_test) {
+            // Test period ran out without a re-access - cold pages deserve less space
+            e->in_test = false;
+            cold_target_dec(pool);
+        } else if (e->state == ENTRY_NONRESIDENT) {
+            release_entry(pool, idx);
+            pool->test_count--;
+            cold_target_dec(pool);
+            return;
+        }
+    }
+}
+
+// hand_hot - demotes one hot page that was not referenced since the last pass
+static void run_hand_hot(BufferPool* pool) {
+    // Two full turns is enough - the first one clears every reference bit
+    for (size_t steps = 0; steps < 2 * pool->num_entries && pool->hand_hot != NO_ENTRY; steps++) {
+        int32_t idx = pool->hand_hot;
+        ClockEntry* e = &pool->entries[idx];
+        pool->hand_hot = e->next;
+
+        if (e->state == ENTRY_HOT) {
+            if (e->referenced) {
+                e->referenced = false;
+            } else {
+                e->state = ENTRY_COLD;
+                e->in_test = false;
+                pool->hot_count--;
+                pool->cold_count++;
+                pool->stats.demotions++;
+                return;
+            }
+        } else if (e->state == ENTRY_COLD && e->in_test) {
+            // hand_hot also terminates test periods it passes over
+            e->in_test = false;
+            cold_target_dec(pool);
+        } else if (e->state == ENTRY_NONRESIDENT) {
+            release_entry(pool, idx);
+            pool->test_count--;
+            cold_target_dec(pool);
+        }
+    }
+}
+
+// Keep hot pages within their share of the frames
+static void balance_hot(BufferPool* pool) {
+    size_t guard = pool->num_entries;
+    while (pool->hot_count > 0 && pool->hot_count > pool->capacity - pool->cold_target && guard-- > 0) {
+        size_t before = pool->hot_count;
+        run_hand_hot(pool);
+        if (pool->hot_count == before) break;  // Nothing demotable
+    }
+}
+
+// hand_cold - evicts a cold resident page, returns its frame or NO_ENTRY if everything is pinned
+static int32_t evict_cold(BufferPool* pool) {
+    for (size_t steps = 0; steps < 4 * pool->num_entries && pool->hand_cold != NO_ENTRY; steps++) {
+        int32_t idx = pool->hand_cold;
+        ClockEntry* e = &pool->entries[idx];
+        pool->hand_cold = e->next;
+
+        if (e->state != ENTRY_COLD || e->pin_count > 0) {
+            // Nothing but hot pages left cold-side, or the only cold ones are pinned (a full turn found no victim) - make some cold
+            if (pool->cold_count == 0 || steps >= pool->num_entries) run_hand_hot(pool);
+            continue;
+        }
+
+        if (e->referenced) {
+            e->referenced = false;
+            if (e->in_test) {
+                // Re-accessed within its test period - reuse distance is short, make it hot
+                e->state = ENTRY_HOT;
+                e->in_test = false;
+                pool->cold_count--;
+                pool->hot_count++;
+                pool->stats.promotions++;
+                balance_hot(pool);
+            } else {
+                e->in_test = true;  // Give it another test period
+            }
+            continue;
+        }
+
+        // Found our victim
+        if (e->dirty && write_frame(pool, e) != PSQL_OK) continue;
+        if (pool->compressed) compressed_cache_put(pool->compressed, e->page_no, (DBPage*)frame_data(pool, e->frame));  // Clean now - same bytes as the file
+
+        int32_t frame = e->frame;
+        e->frame = NO_ENTRY;
+        pool->cold_count--;
+        pool->stats.evictions++;
+
+        if (e->in_test) {
+            // Remember it - if it comes back before its test ends, it comes back hot
+            e->state = ENTRY_NONRESIDENT;
+            pool->test_count++;
+            while (pool->test_count > pool->capacity) run_hand_test(pool);
+        } else {
+            release_entry(pool, idx);
+        }
+        return frame;
+    }
+    return NO_ENTRY;
+}
+
+
+/* Public API */
+BufferPool* buffer_pool_create(int fd, size_t capacity, uint32_t page_size) {
+    if (capacity < BUFFER_POOL_MIN_FRAMES) capacity = BUFFER_POOL_MIN_FRAMES;
+
+    BufferPool* pool = (BufferPool*)calloc(1, sizeof(BufferPool));
+    if (!pool) return NULL;
+
+    pool->fd = fd;
+    pool->page_size = page_size;
+    pool->capacity = capacity;
+    pool->num_entries = 2 * capacity + 1;
+    pool->cold_target = 1;
+    pool->hand_hot = pool->hand_cold = pool->hand_test = NO_ENTRY;
+
+    size_t buckets = 1;
+    while (buckets < pool->num_entries) buckets <<= 1;
+    pool->bucket_mask = buckets - 1;
+
+    // Pools of a huge page or more start on a huge page boundary, so buffer_pool_use_hugepages() can cover all of it
+    void* frames = NULL;
+    size_t align = capacity * page_size >= HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE : page_size;
+    if (posix_memalign(&frames, align, capacity * page_size) != 0) frames = NULL;
+    pool->frames = frames;
+    pool->frame_owner = (int32_t*)malloc(capacity * sizeof(int32_t));
+    pool->free_frames = (int32_t*)malloc(capacity * sizeof(int32_t));
+    pool->entries = (ClockEntry*)calloc(pool->num_entries, sizeof(ClockEntry));
+    pool->buckets = (int32_t*)malloc(buckets * sizeof(int32_t));
+
+    if (!pool->frames || !pool->frame_owner || !pool->free_frames || !pool->entries || !pool->buckets) {
+        buffer_pool_destroy(pool);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < buckets; i++) pool->buckets[i] = NO_ENTRY;
+
+    // Hand out low frames first
+    pool->free_frame_count = capacity;
+    for (size_t i = 0; i < capacity; i++) {
+        pool->free_frames[i] = (int32_t)(capacity - 1 - i);
+        pool->frame_owner[i] = NO_ENTRY;
+    }
+
+    pool->free_entry = NO_ENTRY;
+    for (size_t i = pool->num_entries; i-- > 0;) {
+        pool->entries[i].hash_next = pool->free_entry;
+        pool->free_entry = (int32_t)i;
+    }
+
+    return pool;
+}
+
+void buffer_pool_destroy(BufferPool* pool) {
+    if (!pool) return;
+    free(pool->frames);
+    free(pool->frame_owner);
+    free(pool->free_frames);
+    free(pool->entries);
+    free(pool->buckets);
+    free(pool);
+}
+
+PSqlStatus buffer_pool_copy_page(BufferPool* pool, uint32_t page_no, void* out) {
+    if (!pool) return PSQL_ERROR;
+    int32_t idx = hash_find(pool, page_no);
+    if (idx != NO_ENTRY && pool->entries[idx].state != ENTRY_NONRESIDENT) {
+        memcpy(out, frame_data(pool, pool->entries[idx].frame), pool->page_size);
+        ((DBPage*)out)->header.flag &= ~PAGE_PINNED;
+        return PSQL_OK;
+    }
+    return read_page(pool, page_no, (uint8_t*)out);
+}
+
+void buffer_pool_pin(BufferPool* pool, DBPage* page) {
+    int32_t idx = entry_of(pool, page);
+    if (idx == NO_ENTRY) return;
+    pool->entries[idx].pin_count++;
+    page->header.flag |= PAGE_PINNED;
+}
+
+void buffer_pool_unpin(BufferPool* pool, DBPage* page) {
+    int32_t idx = entry_of(pool, page);
+    if (idx == NO_ENTRY) return;
+    ClockEntry* e = &pool->entries[idx];
+    if (e->pin_count > 0) e->pin_count--;
+    if (e->pin_count == 0) page->header.flag &= ~PAGE_PINNED;
+}
+
+bool buffer_pool_is_pinned(BufferPool* pool, DBPage* page) {
+    int32_t idx = entry_of(pool, page);
+    return idx != NO_ENTRY && pool->entries[idx].pin_count > 0;
+}
+
+size_t buffer_pool_pinned_count(BufferPool* pool) {
+    size_t count = 0;
+    for (size_t frame = 0; frame < pool->capacity; frame++) {
+        int32_t idx = pool->frame_owner[frame];
+        if (idx != NO_ENTRY && pool->entries[idx].frame == (int32_t)frame && pool->entries[idx].pin_count > 0) count++;
+    }
+    return count;
+}
+
+DBPage* buffer_pool_fetch(BufferPool* pool, uint32_t page_no) {
+    if (!pool) return NULL;
+
+    int32_t idx = hash_find(pool, page_no);
+    if (idx != NO_ENTRY && pool->entries[idx].state != ENTRY_NONRESIDENT) {
+        // Hit - the only bookkeeping is the reference bit, the hands do the rest
+        ClockEntry* e = &pool->entries[idx];
+        e->referenced = true;
+        pool->stats.hits++;
+        DBPage* page = (DBPage*)frame_data(pool, e->frame);
+        buffer_pool_pin(pool, page);
+        return page;
+    }
+
+    pool->stats.misses++;
+
+    // Get a frame - a free one if any, otherwise evict a cold page
+    int32_t frame;
+    if (pool->free_frame_count > 0) {
+        frame = pool->free_frames[--pool->free_frame_count];
+    } else {
+        frame = evict_cold(pool);
+        if (frame == NO_ENTRY) return NULL;  // Every frame is pinned
+        // Eviction may have dropped the non-resident entry we found earlier
+        idx = hash_find(pool, page_no);
+    }
+
+    // A packed image is a decompress away - cheaper than going to the file
+    bool unpacked = pool->compressed && compressed_cache_get(pool->compressed, page_no, (DBPage*)frame_data(pool, frame));
+    if (!unpacked && read_frame(pool, page_no, frame) != PSQL_OK) {
+        pool->free_frames[pool->free_frame_count++] = frame;
+        return NULL;
+    }
+
+    DBPage* page = (DBPage*)frame_data(pool, frame);
+    ClockEntry* e;
+
+    if (idx != NO_ENTRY) {
+        // Page came back during its test period - it goes in hot, and cold pages get more room
+        pool->stats.test_hits++;
+        cold_target_inc(pool);
+        ring_remove(pool, idx);
+        pool->test_count--;
+        e = &pool->entries[idx];
+        e->state = ENTRY_HOT;
+        e->in_test = false;
+        pool->hot_count++;
+    } else {
+        idx = alloc_entry(pool);
+        if (idx == NO_ENTRY) {
+            run_hand_test(pool);
+            idx = alloc_entry(pool);
+        }
+        if (idx == NO_ENTRY) {
+            pool->free_frames[pool->free_frame_count++] = frame;
+            return NULL;
+        }
+        e = &pool->entries[idx];
+        e->page_no = page_no;
+        hash_insert(pool, idx);
+
+        // B+ Tree internal pages are on the path of every lookup - start them hot if there is room
+        if ((page->header.flag & PAGE_INDEX_INTERNAL) && pool->hot_count < pool->capacity - pool->cold_target) {
+            e->state = ENTRY_HOT;
+            pool->hot_count++;
+        } else {
+            e->state = ENTRY_COLD;
+            e->in_test = true;
+            pool->cold_count++;
+        }
+    }
+
+    e->frame = frame;
+    e->referenced = false;
+    e->dirty = false;
+    e->pin_count = 0;
+    pool->frame_owner[frame] = idx;
+    ring_insert(pool, idx);
+    balance_hot(pool);
+
+    page->header.flag &= ~PAGE_PINNED;  // Stale flag from the disk image, if someone leaked one
+    buffer_pool_pin(pool, page);
+    return page;
+}
+
+uint32_t buffer_pool_page_no(BufferPool* pool, DBPage* page) {
+    int32_t idx = entry_of(pool, page);
+    return idx == NO_ENTRY ? UINT32_MAX : pool->entries[idx].page_no;
+}
+
+void buffer_pool_mark_dirty(BufferPool* pool, DBPage* page) {
+    int32_t idx = entry_of(pool, page);
+    if (idx == NO_ENTRY) return;
+    pool->entries[idx].dirty = true;
+    compressed_cache_drop(pool->compressed, pool->entries[idx].page_no);  // Stale now - packed again on eviction
+}
+
+// Sort dirty frames by page number so write back is as sequential as we can make it
+static BufferPool* sort_pool;  // qsort has no user data argument in C99
+static int compare_dirty(const void* a, const void* b) {
+    uint32_t pa = sort_pool->entries[*(const int32_t*)a].page_no;
+    uint32_t pb = sort_pool->entries[*(const int32_t*)b].page_no;
+    return (pa > pb) - (pa < pb);
+}
+
+PSqlStatus buffer_pool_flush(BufferPool* pool) {
+    if (!pool) return PSQL_ERROR;
+
+    int32_t* dirty = (int32_t*)malloc(pool->capacity * sizeof(int32_t));
+    if (!dirty) return PSQL_NOMEM;
+
+    size_t count = 0;
+    for (size_t frame = 0; frame < pool->capacity; frame++) {
+        int32_t idx = pool->frame_owner[frame];
+        if (idx != NO_ENTRY && pool->entries[idx].frame == (int32_t)frame && pool->entries[idx].dirty) {
+            dirty[count++] = idx;
+        }
+    }
+
+    sort_pool = pool;
+    qsort(dirty, count, sizeof(int32_t), compare_dirty);
+
+    PSqlStatus status = PSQL_OK;
+    for (size_t i = 0; i < count; i++) {
+        if (write_frame(pool, &pool->entries[dirty[i]]) != PSQL_OK) status = PSQL_IOERR;
+    }
+
+    free(dirty);
+    return status;
+}
+
+// Pages at or past page_count no longer exist - their frames go back on the free stack unwritten, dirty or not
+void buffer_pool_truncate(BufferPool* pool, uint32_t page_count) {
+    if (!pool) return;
+    compressed_cache_truncate(pool->compressed, page_count);
+    for (size_t idx = 0; idx < pool->num_entries; idx++) {
+        ClockEntry* e = &pool->entries[idx];
+        if (e->state == ENTRY_UNUSED || e->page_no < page_count || e->pin_count > 0) continue;
+
+        if (e->state == ENTRY_NONRESIDENT) {
+            pool->test_count--;
+        } else {
+            if (e->state == ENTRY_HOT) pool->hot_count--;
+            else pool->cold_count--;
+            pool->frame_owner[e->frame] = NO_ENTRY;
+            pool->free_frames[pool->free_frame_count++] = e->frame;
+            e->frame = NO_ENTRY;
+        }
+        release_entry(pool, (int32_t)idx);
+    }
+}
+
+void buffer_pool_set_write_hook(BufferPool* pool, BufferPoolWriteHook hook, void* ctx) {
+    if (!pool) return;
+    pool->write_hook = hook;
+    pool->write_hook_ctx = ctx;
+}
+
+void buffer_pool_set_compressed_cache(BufferPool* pool, CompressedCache* cache) {
+    if (pool) pool->compressed = cache;
+}
+
+void buffer_pool_use_hugepages(BufferPool* pool) {
+    if (!pool) return;
+    size_t len = pool->capacity * pool->page_size / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;  // Whole huge pages only
+    if (len > 0 && madvise(pool->frames, len, MADV_HUGEPAGE) != 0) perror("madvise");
+}
+
+size_t buffer_pool_capacity(BufferPool* pool) {
+    return pool ? pool->capacity : 0;
+}
+
+size_t buffer_pool_resident(BufferPool* pool) {
+    return pool ? pool->hot_count + pool->cold_count : 0;
+}
+
+BufferPoolStats buffer_pool_get_stats(BufferPool* pool) {
+    BufferPoolStats empty = {0};
+    return pool ? pool->stats : empty;
+}
+
+void buffer_pool_reset_stats(BufferPool* pool) {
+    if (pool) memset(&pool->stats, 0, sizeof(BufferPoolStats));
+}
@@ -0,0 +1,92 @@
+/* Buffer pool - an explicit page cache for the database file as an alternative to `mmap`
+ *
+ * With `mmap` the kernel decides which pages stay resident, so we can't cap memory use,
+ * prioritize index pages or count hits and misses. The buffer pool instead reads pages into a
+ * bounded table of frames with `pread()` and writes dirty frames back with `pwrite()`.
+ *
+ * Eviction uses CLOCK-Pro (Jiang, Chen & Zhang - USENIX ATC 2005), which is a CLOCK
+ * approximation of LIRS. Resident pages are either hot or cold, and evicted cold pages are
+ * remembered for a while as non-resident "test" entries. A page that comes back during its
+ * test period has a short reuse distance, so it is promoted straight to hot - this is what
+ * stops one big range scan from flushing out the B+ Tree internal pages like plain LRU would.
+ *
+ * Three clock hands move around the same ring:
+ * 1) hand_cold - finds a cold resident page to evict
+ * 2) hand_hot - demotes hot pages that were not referenced since the last pass
+ * 3) hand_test - ends test periods and drops non-resident entries
+ *
+ * Frames handed out are pinned (PAGE_PINNED is set in the page header while pinned).
+ * A pinned frame is never evicted, so every buffer_pool_fetch() needs a buffer_pool_unpin().
+ */
+
+#ifndef PRESEQL_PAGER_CACHE_BUFFER_POOL_H
+#define PRESEQL_PAGER_CACHE_BUFFER_POOL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "pager/constants.h"
+#include "pager/db/base/page.h"
+#include "pager/cache/compressed_cache.h"
+#include "status/db.h"
+
+typedef struct {
+    uint64_t hits;             // Page found in a frame
+    uint64_t misses;           // Page had to be read from the file
+    uint64_t evictions;        // Cold pages evicted to make room
+    uint64_t writebacks;       // Dirty frames written back to the file (eviction or flush)
+    uint64_t test_hits;        // Misses on pages still in their test period - promoted straight to hot
+    uint64_t promotions;       // Cold pages promoted to hot
+    uint64_t demotions;        // Hot pages demoted to cold
+} BufferPoolStats;
+
+typedef struct BufferPool BufferPool;
+
+/* Create/destroy a buffer pool of `capacity` frames of `page_size` bytes over an open database file */
+BufferPool* buffer_pool_create(int fd, size_t capacity, uint32_t page_size);
+void buffer_pool_destroy(BufferPool* pool);
+
+/* Get a page - reads it from the file on a miss. The frame returned is pinned.
+ * Returns NULL if every frame is pinned or the read failed */
+DBPage* buffer_pool_fetch(BufferPool* pool, uint32_t page_no);
+
+/* Copy a page out as the pool has it - the frame if it is resident, otherwise the file's copy. Nothing is read into a
+ * frame or evicted, and the copy has PAGE_PINNED cleared */
+PSqlStatus buffer_pool_copy_page(BufferPool* pool, uint32_t page_no, void* out);
+
+/* Pin counting - a page can be pinned more than once (e.g nested fetches of the same page) */
+void buffer_pool_pin(BufferPool* pool, DBPage* page);
+void buffer_pool_unpin(BufferPool* pool, DBPage* page);
+bool buffer_pool_is_pinned(BufferPool* pool, DBPage* page);
+size_t buffer_pool_pinned_count(BufferPool* pool);
+
+/* Page number held in a frame - UINT32_MAX if page isn't one of the pool's frames */
+uint32_t buffer_pool_page_no(BufferPool* pool, DBPage* page);
+
+/* Mark a frame as modified - written back on eviction or buffer_pool_flush() */
+void buffer_pool_mark_dirty(BufferPool* pool, DBPage* page);
+
+/* Write all dirty frames back to the file (does not fsync) */
+PSqlStatus buffer_pool_flush(BufferPool* pool);
+
+/* Drop every unpinned page numbered page_count and up without writing it back - the file is about to be cut there */
+void buffer_pool_truncate(BufferPool* pool, uint32_t page_count);
+
+/* Called on each frame right before it is written back, with PAGE_PINNED already cleared - e.g to seal a page checksum,
+ * or to make a journal durable first. Anything but PSQL_OK leaves the frame dirty and fails the write back */
+typedef PSqlStatus (*BufferPoolWriteHook)(void* ctx, uint32_t page_no, DBPage* page);
+void buffer_pool_set_write_hook(BufferPool* pool, BufferPoolWriteHook hook, void* ctx);
+
+/* Keep LZ images of evicted data and overflow pages in cache and serve misses from them - NULL turns it off.
+ * The pool doesn't own it, so it outlives a resize */
+void buffer_pool_set_compressed_cache(BufferPool* pool, CompressedCache* cache);
+
+/* Ask for transparent huge pages behind the frames - a big pool otherwise costs a TLB entry per 4KB */
+void buffer_pool_use_hugepages(BufferPool* pool);
+
+size_t buffer_pool_capacity(BufferPool* pool);
+size_t buffer_pool_resident(BufferPool* pool);
+BufferPoolStats buffer_pool_get_stats(BufferPool* pool);
+void buffer_pool_reset_stats(BufferPool* pool);
+
+#endif /* PRESEQL_PAGER_CACHE_BUFFER_POOL_H */
@@ -0,0 +1,259 @@
+#define _GNU_SOURCE  /* clock_gettime under -std=c99 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "compressed_cache.h"
+#include "algorithm/lz.h"
+
+#define NO_IMAGE (-1)
+#define IMAGE_ALIGN 8  /* Images start 8 byte aligned - the decompressor's memcpys go faster */
+
+// Where a page's image sits - the chunk is offset / chunk_size
+typedef struct {
+    size_t offset;        // Byte offset into the arena
+    uint32_t page_no;
+    uint32_t size;        // Compressed bytes
+    uint8_t type;         // CompressedPageType
+    bool used;
+    int32_t hash_next;    // Page table chain (also the free image list)
+    int32_t chunk_prev;   // Images in the same chunk - all dropped together when it is recycled
+    int32_t chunk_next;
+} Image;
+
+struct CompressedCache {
+    uint32_t page_size;
+    size_t chunk_size;
+    size_t chunk_count;
+    uint8_t* arena;       // chunk_count * chunk_size
+    size_t* chunk_fill;   // Bytes handed out in each chunk
+    int32_t* chunk_images;  // First image in each chunk
+    size_t current;       // Chunk being filled
+
+    Image* images;
+    size_t image_count;
+    int32_t free_image;   // Head of the free image list (chained through hash_next)
+    int32_t* buckets;     // Page table - page_no -> image index
+    size_t bucket_mask;
+
+    uint8_t* scratch;     // Compressor output - only copied into a chunk once it is known to be worth keeping
+
+    CompressedCacheStats stats;
+};
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int page_type(const DBPage* page) {
+    if (page->header.flag & PAGE_DATA) return COMPRESSED_DATA_PAGE;
+    if (page->header.flag & PAGE_OVERFLOW) return COMPRESSED_OVERFLOW_PAGE;
+    return -1;
+}
+
+
+/* Page table - chained hashing on page number, same as the buffer pool's */
+static size_t hash_page(CompressedCache* cache, uint32_t page_no) {
+    return ((uint32_t)page_no * 2654435761u) & cache->bucket_mask;  // Knuth multiplicative hash
+}
+
+static int32_t find_image(CompressedCache* cache, uint32_t page_no) {
+    int32_t idx = cache->buckets[hash_page(cache, page_no)];
+    while (idx != NO_IMAGE && cache->images[idx].page_no != page_no) {
+        idx = cache->images[idx].hash_next;
+    }
+    return idx;
+}
+
+// Unlink an image from the page table and its chunk, and put it back on the free list
+static void release_image(CompressedCache* cache, int32_t idx) {
+    Image* image = &cache->images[idx];
+
+    int32_t* link = &cache->buckets[hash_page(cache, image->page_no)];
+    while (*link != idx) link = &cache->images[*link].hash_next;
+    *link = image->hash_next;
+
+    if (image->chunk_prev != NO_IMAGE) cache->images[image->chunk_prev].chunk_next = image->chunk_next;
+    else cache->chunk_images[image->offset / cache->chunk_size] = image->chunk_next;
+    if (image->chunk_next != NO_IMAGE) cache->images[image->chunk_next].chunk_prev = image->chunk_prev;
+
+    cache->stats.images--;
+    image->used = false;
+    image->hash_next = cache->free_image;
+    cache->free_image = idx;
+}
+
+// Move on to the next chunk round the ring, dropping everything packed in it
+static void recycle_next_chunk(CompressedCache* cache) {
+    cache->current = (cache->current + 1) % cache->chunk_count;
+    while (cache->chunk_images[cache->current] != NO_IMAGE) {
+        release_image(cache, cache->chunk_images[cache->current]);
+        cache->stats.evictions++;
+    }
+    cache->stats.bytes_used -= cache->chunk_fill[cache->current];
+    cache->chunk_fill[cache->current] = 0;
+}
+
+
+/* Public API */
+CompressedCache* compressed_cache_create(size_t capacity, uint32_t page_size) {
+    CompressedCache* cache = (CompressedCache*)calloc(1, sizeof(CompressedCache));
+    if (!cache) return NULL;
+
+    cache->page_size = page_size;
+    cache->chunk_size = (size_t)COMPRESSED_CACHE_CHUNK_PAGES * page_size;
+    cache->chunk_count = (capacity + cache->chunk_size - 1) / cache->chunk_size;
+    if (cache->chunk_count < 2) cache->chunk_count = 2;  // One to fill while the other still holds images
+    cache->image_count = cache->chunk_count * cache->chunk_size / COMPRESSED_CACHE_BYTES_PER_IMAGE;
+
+    size_t buckets = 1;
+    while (buckets < cache->image_count) buckets <<= 1;
+    cache->bucket_mask = buckets - 1;
+
+    cache->arena = (uint8_t*)malloc(cache->chunk_count * cache->chunk_size);
+    cache->chunk_fill = (size_t*)calloc(cache->chunk_count, sizeof(size_t));
+    cache->chunk_images = (int32_t*)malloc(cache->chunk_count * sizeof(int32_t));
+    cache->images = (Image*)calloc(cache->image_count, sizeof(Image));
+    cache->buckets = (int32_t*)malloc(buckets * sizeof(int32_t));
+    cache->scratch = (uint8_t*)malloc(COMPRESSED_CACHE_MAX_IMAGE(page_size));
+
+    if (!cache->arena || !cache->chunk_fill || !cache->chunk_images || !cache->images || !cache->buckets || !cache->scratch) {
+        compressed_cache_destroy(cache);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < buckets; i++) cache->buckets[i] = NO_IMAGE;
+    for (size_t i = 0; i < cache->chunk_count; i++) cache->chunk_images[i] = NO_IMAGE;
+    cache->free_image = NO_IMAGE;
+    for (size_t i = cache->image_count; i-- > 0;) {
+        cache->images[i].hash_next = cache->free_image;
+        cache->free_image = (int32_t)i;
+    }
+    cache->stats.capacity = cache->chunk_count * cache->chunk_size;
+    return cache;
+}
+
+void compressed_cache_destroy(CompressedCache* cache) {
+    if (!cache) return;
+    free(cache->arena);
+    free(cache->chunk_fill);
+    free(cache->chunk_images);
+    free(cache->images);
+    free(cache->buckets);
+    free(cache->scratch);
+    free(cache);
+}
+
+bool compressed_cache_put(CompressedCache* cache, uint32_t page_no, const DBPage* page) {
+    if (!cache) return false;
+    int type = page_type(page);
+    if (type < 0) return false;
+    if (find_image(cache, page_no) != NO_IMAGE) return true;  // Still clean since it was packed - same bytes
+
+    CompressedPageStats* stats = &cache->stats.types[type];
+    uint64_t start = now_ns();
+    size_t size = lz_compress(page, cache->page_size, cache->scratch, COMPRESSED_CACHE_MAX_IMAGE(cache->page_size));
+    stats->compress_ns += now_ns() - start;
+    if (size == 0) {
+        stats->pages_incompressible++;
+        return false;
+    }
+
+    // Room in the chunk being filled and an image slot - recycling a chunk frees both
+    size_t space = (size + IMAGE_ALIGN - 1) & ~(size_t)(IMAGE_ALIGN - 1);
+    if (cache->chunk_fill[cache->current] + space > cache->chunk_size) recycle_next_chunk(cache);
+    for (size_t i = 0; cache->free_image == NO_IMAGE && i < cache->chunk_count; i++) recycle_next_chunk(cache);
+    if (cache->free_image == NO_IMAGE) return false;
+
+    int32_t idx = cache->free_image;
+    Image* image = &cache->images[idx];
+    cache->free_image = image->hash_next;
+
+    image->page_no = page_no;
+    image->offset = cache->current * cache->chunk_size + cache->chunk_fill[cache->current];
+    image->size = (uint32_t)size;
+    image->type = (uint8_t)type;
+    image->used = true;
+    memcpy(cache->arena + image->offset, cache->scratch, size);
+    cache->chunk_fill[cache->current] += space;
+
+    size_t bucket = hash_page(cache, page_no);
+    image->hash_next = cache->buckets[bucket];
+    cache->buckets[bucket] = idx;
+    image->chunk_prev = NO_IMAGE;
+    image->chunk_next = cache->chunk_images[cache->current];
+    if (image->chunk_next != NO_IMAGE) cache->images[image->chunk_next].chunk_prev = idx;
+    cache->chunk_images[cache->current] = idx;
+
+    stats->pages_compressed++;
+    stats->bytes_in += cache->page_size;
+    stats->bytes_out += size;
+    cache->stats.images++;
+    cache->stats.bytes_used += space;
+    return true;
+}
+
+bool compressed_cache_get(CompressedCache* cache, uint32_t page_no, DBPage* page) {
+    if (!cache) return false;
+    int32_t idx = find_image(cache, page_no);
+    if (idx == NO_IMAGE) {
+        cache->stats.misses++;
+        return false;
+    }
+
+    Image* image = &cache->images[idx];
+    CompressedPageStats* stats = &cache->stats.types[image->type];
+    uint64_t start = now_ns();
+    bool ok = lz_decompress(cache->arena + image->offset, image->size, page, cache->page_size);
+    stats->decompress_ns += now_ns() - start;
+    if (!ok) {
+        // Only a bug gets here - the file still has the page
+        fprintf(stderr, "Compressed image of page %u doesn't decode - reading it from the file\n", page_no);
+        release_image(cache, idx);
+        cache->stats.misses++;
+        return false;
+    }
+
+    stats->pages_decompressed++;
+    cache->stats.hits++;
+    return true;
+}
+
+bool compressed_cache_contains(CompressedCache* cache, uint32_t page_no) {
+    return cache && find_image(cache, page_no) != NO_IMAGE;
+}
+
+void compressed_cache_drop(CompressedCache* cache, uint32_t page_no) {
+    if (!cache) return;
+    int32_t idx = find_image(cache, page_no);
+    if (idx == NO_IMAGE) return;
+    release_image(cache, idx);
+    cache->stats.invalidations++;
+}
+
+void compressed_cache_truncate(CompressedCache* cache, uint32_t page_count) {
+    if (!cache) return;
+    for (size_t idx = 0; idx < cache->image_count; idx++) {
+        if (!cache->images[idx].used || cache->images[idx].page_no < page_count) continue;
+        release_image(cache, (int32_t)idx);
+        cache->stats.invalidations++;
+    }
+}
+
+CompressedCacheStats compressed_cache_get_stats(CompressedCache* cache) {
+    CompressedCacheStats empty = {0};
+    return cache ? cache->stats : empty;
+}
+
+// Counters only - what is held right now stays
+void compressed_cache_reset_stats(CompressedCache* cache) {
+    if (!cache) return;
+    CompressedCacheStats held = {0};
+    held.images = cache->stats.images;
+    held.bytes_used = cache->stats.bytes_used;
+    held.capacity = cache->stats.capacity;
+    cache->stats = held;
+}
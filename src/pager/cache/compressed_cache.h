@@ -0,0 +1,78 @@
+/* Compressed page cache - a second tier behind the buffer pool for data and overflow pages (PAGER_COMPRESSION)
+ *
+ * Row data and overflow chunks are mostly text and zeroed free space, which compresses several times over with even a
+ * cheap LZ (algorithm/lz.h). Frames in the buffer pool stay uncompressed - that's the hot set, read in place by every
+ * lookup. When one of them is evicted its LZ image is kept here instead, so a page that comes back costs a decompress
+ * rather than a pread(), and the same memory holds several times the pages the frames would.
+ *
+ * Images are packed back to back into fixed size chunks, a bump pointer per chunk. When the one being filled runs out the
+ * next chunk round the ring is recycled whole - every image in it is dropped at once - so the space never fragments and
+ * there's nothing to search for a fit. That makes eviction FIFO by the time the image went in; a page still in use just
+ * comes back through the buffer pool and gets packed again when it is evicted next.
+ *
+ * Images are only ever of clean pages - the same bytes as the file - so dropping one never loses anything. A page written
+ * through the pool drops its image straight away (compressed_cache_drop()), it gets a new one when it's evicted again.
+ * Pages of other types are never packed, index pages are hot anyway and stay in the frames.
+ */
+
+#ifndef PRESEQL_PAGER_CACHE_COMPRESSED_CACHE_H
+#define PRESEQL_PAGER_CACHE_COMPRESSED_CACHE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "pager/constants.h"
+#include "pager/db/base/page.h"
+
+typedef enum {
+    COMPRESSED_DATA_PAGE,      // PAGE_DATA
+    COMPRESSED_OVERFLOW_PAGE,  // PAGE_OVERFLOW
+    COMPRESSED_PAGE_TYPES,
+} CompressedPageType;
+
+// Per page type - compression ratio is bytes_out / bytes_in, decode cost per page is decompress_ns / pages_decompressed
+typedef struct {
+    uint64_t pages_compressed;      // Images packed
+    uint64_t pages_incompressible;  // Didn't shrink past COMPRESSED_CACHE_MAX_IMAGE - left to the file
+    uint64_t bytes_in;              // Page bytes of the packed images
+    uint64_t bytes_out;             // What they compressed to
+    uint64_t compress_ns;           // Includes the incompressible tries
+    uint64_t pages_decompressed;    // Buffer pool misses served from an image instead of a pread()
+    uint64_t decompress_ns;
+} CompressedPageStats;
+
+typedef struct {
+    CompressedPageStats types[COMPRESSED_PAGE_TYPES];
+    uint64_t hits;           // Lookups that found an image
+    uint64_t misses;         // ...that didn't
+    uint64_t evictions;      // Images dropped when their chunk was recycled
+    uint64_t invalidations;  // Images dropped because the page was written or cut off the file
+    uint64_t images;         // Images held now
+    uint64_t bytes_used;     // Chunk space they take - holes left by invalidations count until their chunk is recycled
+    uint64_t capacity;       // Bytes of chunks
+} CompressedCacheStats;
+
+typedef struct CompressedCache CompressedCache;
+
+/* Create/destroy a cache of about capacity bytes for pages of page_size - rounded to whole chunks, at least two */
+CompressedCache* compressed_cache_create(size_t capacity, uint32_t page_size);
+void compressed_cache_destroy(CompressedCache* cache);
+
+/* Pack a clean page evicted from the buffer pool - false if it isn't a data or overflow page or doesn't compress well enough.
+ * A page already packed keeps its image */
+bool compressed_cache_put(CompressedCache* cache, uint32_t page_no, const DBPage* page);
+
+/* Fill page from its image - false if there is none (or it doesn't decode, it's dropped then) */
+bool compressed_cache_get(CompressedCache* cache, uint32_t page_no, DBPage* page);
+bool compressed_cache_contains(CompressedCache* cache, uint32_t page_no);
+
+/* The page changed - its image is stale */
+void compressed_cache_drop(CompressedCache* cache, uint32_t page_no);
+
+/* Drop the image of every page numbered page_count and up - the file is about to be cut there */
+void compressed_cache_truncate(CompressedCache* cache, uint32_t page_count);
+
+CompressedCacheStats compressed_cache_get_stats(CompressedCache* cache);
+void compressed_cache_reset_stats(CompressedCache* cache);
+
+#endif /* PRESEQL_PAGER_CACHE_COMPRESSED_CACHE_H */
@@ -5,17 +5,35 @@
 
 
 /* Page Sizes - Check OS setting */
-#define PAGE_SIZE 4096  /* Usually either 4KB or 8KB, but more commonly 4KB */
-#define MAX_PAGES 65535  /* 2^16 so all page counts are represented by uint_16 */
+#define DEFAULT_PAGE_SIZE 4096  /* Page size of a new database unless init_pager_with_page_size() picks another - an existing file keeps the one in its header */
+#define MIN_PAGE_SIZE 4096  /* The OS page - anything smaller breaks mmap/madvise alignment */
+#define MAX_PAGE_SIZE 65536  /* Slot offsets and free space in DBPageHeader are uint16_t */
+#define V1_PAGE_SIZE 4096  /* v1 files could only be 4KB */
+#define MAX_PAGES 0xFFFFFFFFu  /* 2^32 - 1 so all page counts are represented by uint32_t (v1 files stopped at 2^16 - 1) */
 #define ARCH_BITS 64  /* Assumes 64-bits is the case for all new hardware and OSes - this also means this might not build on some old RPis and Microcontrollers lol git guud */
 #define POINTER_SIZE (BIT_ARCH/8)  /* Assume 64-bit hardware and OS (use the right platform), this value will always be 8 bytes */
 
 
+/* File growth */
+#define DB_MMAP_RESERVE_SIZE ((size_t)1 << 40)  /* Address space reserved for the mapping so it never has to move - 1TB, the largest DB in mmap mode. 16TB for every possible page would use up the address space after a few pagers */
+#define DB_GROWTH_MIN_SIZE (64 * 1024)  /* Smallest extent the file grows by - rounded up to a whole page */
+#define DB_GROWTH_MAX_SIZE (16 * 1024 * 1024)  /* Growth doubles up to 16MB extents, then stays linear */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)  /* x86-64 PMD huge page - the mapping and the buffer pool frames are aligned to it so THP can back them */
+#define DB_CATALOG_PAGES 4  /* Header + the three catalog roots - what PAGER_MLOCK_CATALOG keeps resident */
+
+
 /* File names */
 #define DB_FILE_EXTENSION ".pseql"  /* Main DB file extension */
 #define JOURNAL_FILE_EXTENSION ".pseql-journal"  /* Journal file extension */
+#define JOURNAL_FAILED_SUFFIX "-failed"  /* Appended to a journal crash recovery couldn't fully undo - kept for inspection */
 #define DATABASE_NAME_LENGTH 6  /* .pseql including the dot */
 #define JOURNAL_NAME_LENGTH  14 /* .pseql-journal including the dot */
+#define WAL_FILE_EXTENSION ".pseql-wal"  /* Write-ahead log file extension (PAGER_WAL) */
+#define WAL_NAME_LENGTH 10  /* .pseql-wal including the dot */
+#define UPGRADE_FILE_EXTENSION ".pseql-upgrade"  /* Scratch copy while a v1 file is rewritten as v2 - renamed over the original when done */
+#define VACUUM_INTO_FILE_EXTENSION ".pseql-vacuum"  /* VACUUM INTO builds "<path>.pseql-vacuum" and renames it to path when done */
+#define SERIALIZE_FILE_EXTENSION ".pseql-serialize"  /* pager_serialize() writes "<path>.pseql-serialize" and renames it to path when done */
+#define BACKUP_FILE_EXTENSION ".pseql-backup"  /* A full backup is built as "<path>.pseql-backup" and renamed to path when it finishes */
 #define OS_MAX_FILE_NAME 255
 #define MAX_FILE_NAME (OS_MAX_FILE_NAME - JOURNAL_NAME_LENGTH) /* Max Database /Journal Name (minus the largest possible extension size which is .pseql-journal)*/
 
@@ -24,9 +42,9 @@
 #define MAX_PAGE_HEADER_SIZE 32  /* Max page header size in bytes - this makes it easier to know when the page data starts and ends. This affects the size of the union of headers */
 #define MAX_JOURNAL_HEADER_SIZE 32  /* Max Size of journal header in bytes 
                         - Fixed size to make it easier to ensure enough space is reserved to align to 4096B page */
-#define MAX_USABLE_PAGE_SIZE (PAGE_SIZE - MAX_PAGE_HEADER_SIZE - MAX_JOURNAL_HEADER_SIZE) /* Limit usable bytes for data in data pages, 
+#define USABLE_PAGE_SIZE(page_size) ((page_size) - MAX_PAGE_HEADER_SIZE - MAX_JOURNAL_HEADER_SIZE) /* Limit usable bytes for data in data pages, 
 excluding the overhead from header of DB page and journal page. 
-Aim for page alignment by padding. */
+Aim for page alignment by padding. 4032 bytes for 4KB pages */
 
 
 /* Base Metadata Page */
@@ -34,6 +52,8 @@ Aim for page alignment by padding. */
 #define MAGIC_NUMBER "SQLSHITE"  /* For magic number */
 #define FREE_PAGE_LIST_SIZE 32  /* number of pages that can be cached into the free page list - in practice, since free pages will be reused up first, its rare that this number will be hit */
 #define FREE_PAGE_LIST_BATCH_SIZE 10  /* the number of changes to Radix tree before flushing back to disk free page list */
+#define DB_FORMAT_VERSION 2  /* Stored in DatabaseHeader.db_version - v2 has 32-bit page numbers */
+#define DB_FORMAT_VERSION_V1 1  /* 16-bit page numbers - upgraded to v2 on open, see pager/upgrade.h */
 
 /* Generic Page flags */
 
@@ -41,19 +61,22 @@ Aim for page alignment by padding. */
 #define DB_READONLY 0x01
 #define DB_JOURNAL_ENABLED 0x02
 #define DB_CORRUPT 0x04
+#define DB_PAGE_CHECKSUMS 0x08  // Every page carries a CRC-32 in its reserved tail, see pager/page_checksum.h
+#define DB_AUTO_VACUUM 0x10  // Pointer map kept, tail pages relocated and the file truncated on every commit - see pager/db/vacuum.h
+#define DB_INCREMENTAL_VACUUM 0x20  // Pointer map kept, pages only relocated by pager_incremental_vacuum()
 
 // Page type flags
-#define PAGE_INDEX_INTERNAL  = 0x01  // 0000 0001 - B+ Root or Internal Node Page. Internal nodes point to other Internal nodes or Leaf nodes.
-#define PAGE_INDEX_LEAF      = 0x02  // 0000 0010 - B+ Leaf Node Page - We distinguish this to separate concerns since Leaf nodes point to Data Pages.
-#define PAGE_DATA            = 0x04  // 0000 0100 - Data Page
-#define PAGE_OVERFLOW        = 0x08  // 0000 1000 - Overflow Page
-#define PAGE_DIRTY           = 0x10  // 0001 0000 - Page has been modified since the last sync or commit. In practice, this isn't needed since `msync` is done after all modifications.
-#define PAGE_FREE            = 0x20  // 0010 0000 - Page is marked as free and can be reused. In practice, we don't use this since we have the Radix tree loaded in memory.
-#define PAGE_COMPACTIBLE     = 0x40  // 0100 0000 - This flag indicates whether the slots in the page is eligible for compaction. Set when changes are made to the page, but unset after VACCUM. Can hint to page begin as compacted as it can be and should be skipped over during VACCUM.
-#define PAGE_PINNED          = 0x80  // 1000 0000 - Page is pinned in memory can cannot be evicted - In practice, this isn't used since `mmap` deals with paging and caching on its own via the kernel.
+#define PAGE_INDEX_INTERNAL    0x01  // 0000 0001 - B+ Root or Internal Node Page. Internal nodes point to other Internal nodes or Leaf nodes.
+#define PAGE_INDEX_LEAF        0x02  // 0000 0010 - B+ Leaf Node Page - We distinguish this to separate concerns since Leaf nodes point to Data Pages.
+#define PAGE_DATA              0x04  // 0000 0100 - Data Page
+#define PAGE_OVERFLOW          0x08  // 0000 1000 - Overflow Page
+#define PAGE_DIRTY             0x10  // 0001 0000 - Page has been modified since the last sync or commit. In practice, this isn't needed since `msync` is done after all modifications.
+#define PAGE_FREE              0x20  // 0010 0000 - Page is marked as free and can be reused. In practice, we don't use this since we have the Radix tree loaded in memory.
+#define PAGE_COMPACTIBLE       0x40  // 0100 0000 - This flag indicates whether the slots in the page is eligible for compaction. Set when changes are made to the page, but unset after VACCUM. Can hint to page begin as compacted as it can be and should be skipped over during VACCUM.
+#define PAGE_PINNED            0x80  // 1000 0000 - Page is pinned in memory can cannot be evicted - Only used in buffer pool mode (PAGER_BUFFER_POOL), with `mmap` the kernel deals with paging and caching on its own.
 
 
-#define FREE_SLOT_LIST_SIZE 16  /* Logically I won't really need to exceed this value that much - if it gets reused */
+#define FREE_SLOT_LIST_SIZE 12  /* Logically I won't really need to exceed this value that much - if it gets reused. 12 so the v2 page header stays at 32 bytes with 32-bit page ids */
 
 
 /* B+ Tree Index Page */
@@ -65,9 +88,9 @@ Aim for page alignment by padding. */
                         INT (64-bit signed) will only use the first 8 bytes and leave the remaining 8 bytes blank. INTs are encoded to a positive range for lexicographic comparison in Index pages (though the true value in data page is still signed as twos complement).
                         - if size is exceeded in index page, it will go into an Overflow Page, and the pointer to overflow page will be set to the overflow page number and chunk.
                         */
-#define INDEX_FULL_OCCUPANCY 0.8 /* Split when used space exceeds 80% of MAX_USABLE_PAGE_SIZE */
-#define INDEX_MIN_OCCUPANCY 0.4 /* Rebalance when used space falls below 40% of MAX_USABLE_PAGE_SIZE */
-#define INDEX_SLOT_DATA_SIZE (MAX_DATA_PER_INDEX_SLOT + 7) /* Key (16) + next_page_id (2) + next_slot_id (1) + overflow (4) */
+#define INDEX_FULL_OCCUPANCY 0.8 /* Split when used space exceeds 80% of USABLE_PAGE_SIZE() */
+#define INDEX_MIN_OCCUPANCY 0.4 /* Rebalance when used space falls below 40% of USABLE_PAGE_SIZE() */
+#define INDEX_SLOT_DATA_SIZE (MAX_DATA_PER_INDEX_SLOT + 11) /* Key (16) + next_page_id (4) + next_slot_id (1) + overflow (6) */
 #define SLOT_ENTRY_SIZE (sizeof(SlotEntry)) /* Typically 16 bytes: slot_id (1) + offset (8) + size (8) */
 
 /* Data Page */
@@ -89,6 +112,48 @@ Aim for page alignment by padding. */
 /* Overflow Page */
 
 
+/* Buffer Pool - only used when the pager is opened with PAGER_BUFFER_POOL instead of the default mmap */
+#define BUFFER_POOL_DEFAULT_FRAMES 1024  /* 4MB of frames with 4KB pages - can be changed with pager_set_cache_size() */
+#define BUFFER_POOL_MIN_FRAMES 8  /* Need a few frames for a B+ Tree descent (root to leaf + data page) to all be pinned at once */
+
+
+/* Compressed page cache - behind the buffer pool with PAGER_COMPRESSION, see pager/cache/compressed_cache.h */
+#define COMPRESSED_CACHE_DEFAULT_SIZE (4 * 1024 * 1024)  /* Bytes of LZ images - can be changed with pager_set_compressed_cache_size() */
+#define COMPRESSED_CACHE_CHUNK_PAGES 16  /* Images are packed into chunks of 16 pages (64KB with 4KB pages) - recycled a chunk at a time */
+#define COMPRESSED_CACHE_MAX_IMAGE(page_size) ((page_size) - (page_size) / 8)  /* A page has to shrink by an eighth to be worth a decompress instead of a pread */
+#define COMPRESSED_CACHE_BYTES_PER_IMAGE 512  /* One image slot per 512 bytes of capacity - a cache full of smaller images recycles chunks before they fill */
+
+
+/* In-memory database (PAGER_MEMORY_DB) - see pager/memory_db.h */
+#define UNDO_LOG_KEEP_PAGES 64  /* Before-image slots kept between transactions - a log that grew past this is freed when its transaction ends */
+
+
+/* Rollback journal (PAGER_JOURNALING_ENABLED) - see pager/journal/journal.h */
+#define JOURNAL_BUFFER_PAGES 64  /* Before-images buffered per pwritev() - 256KB with 4KB pages. At most 511, a write takes two iovecs per record plus the header's */
+#define JOURNAL_DELTA_FRACTION 4  /* A delta bigger than 1/4 of the page goes out as the whole image instead */
+#define JOURNAL_DELTA_GAP 4       /* Changed ranges this close together are merged - a new range costs a 4 byte JournalDeltaRange */
+#define JOURNAL_RECOVERY_THREADS 4  /* Most threads crash recovery restores pages on */
+#define JOURNAL_RECOVERY_RECORDS_PER_THREAD 128  /* ...one per this many records - a small journal is quicker undone on one */
+
+
+/* Online backup - see pager/backup.h */
+#define BACKUP_BATCH_PAGES 64  /* Adjacent pages gathered into one pwrite() to the backup */
+#define BACKUP_SCAN_PER_PAGE 64  /* Unchanged pages an incremental step may look past for every page it is allowed to copy - bounds how long a step holds writers up */
+
+
+/* Write-ahead log - only used when the pager is opened with PAGER_WAL */
+#define WAL_AUTOCHECKPOINT_FRAMES 1000  /* Checkpoint once this many committed frames (~4MB) aren't in the main file yet - keeps reads from the WAL and recovery time bounded */
+#define WAL_AUTOCHECKPOINT_BYTES (16 * 1024 * 1024)  /* ...or once the WAL file passes this size, e.g passive checkpoints keep up but never get to reset it */
+
+/* Group commit - transactions committing together share one fsync */
+#define GROUP_COMMIT_WINDOW_US 200  /* How long a flush waits for transactions still in progress to catch up - a lone committer never waits */
+#define GROUP_COMMIT_MAX_BATCH 64   /* Flush without waiting out the window once this many commits are in */
+
+/* Read-ahead - telling the kernel which pages a B+ Tree walk needs next, see pager/readahead.h */
+#define READAHEAD_WINDOW_LEAVES 8  /* Sibling leaves kept on their way in ahead of an iterator */
+#define READAHEAD_STEPS_PER_LEAF 2  /* Sibling pointers followed each time the iterator moves a leaf - the window fills over the first few leaves instead of stalling on the first */
+
+
 /* Catalog Pages */
 #define MAX_TABLE_NAME_LENGTH 255  /* For Table catalog, Including null terminator */
 #define MAX_COLUMN_NAME_LENGTH 255  /* For Column catalog, Including null terminator */
@@ -23,19 +23,24 @@
 #include "pager/constants.h"
 
 // Database main header (Page 0)
+// Layout is file format v2 (DB_FORMAT_VERSION) - page numbers are 32-bit. v1 files are converted on open, see pager/upgrade.h
 typedef struct {
     char magic[MAGIC_NUMBER_SIZE];      // "SQLSHITE"
-    uint16_t page_size;                 // Usually 4096
-    uint16_t db_version;                // Schema version
-    uint16_t root_table_catalog;        // Page 1
-    uint16_t root_column_catalog;       // Page 2
-    uint16_t root_fk_catalog;           // Page 3
-    uint16_t free_page_list[FREE_PAGE_LIST_SIZE];       // Inline free page list
-    uint16_t free_page_count;           // Number of entries in free_page_list - this allows us to pull off queue operations as it acts as an index
-    uint16_t highest_page;              // Highest allocated page - allows for fall back if there are no free pages cached
+    uint16_t page_size;                 // Picked when the DB is created, MIN_PAGE_SIZE to MAX_PAGE_SIZE - 65536 doesn't fit so it is stored as 1, see DB_PAGE_SIZE_DECODE
+    uint16_t db_version;                // File format version - DB_FORMAT_VERSION
+    uint32_t root_table_catalog;        // Page 1
+    uint32_t root_column_catalog;       // Page 2
+    uint32_t root_fk_catalog;           // Page 3
+    uint32_t free_page_list[FREE_PAGE_LIST_SIZE];       // Inline free page list
+    uint32_t free_page_count;           // Number of entries in free_page_list - this allows us to pull off queue operations as it acts as an index
+    uint32_t highest_page;              // Highest allocated page - allows for fall back if there are no free pages cached
     uint16_t transaction_state;         // For crash recovery
     uint16_t flags;                     // DB flags
-    uint32_t checksum;                  // CRC-32 checksum
+    uint32_t free_trunk_page;           // First free list trunk page, 0 if the inline list holds every free page - see pager/db/free_space.c
+    uint32_t free_page_total;           // Free pages in the inline list and the trunks (trunks included)
+    uint32_t ptrmap_first;              // First pointer map page - only with DB_AUTO_VACUUM / DB_INCREMENTAL_VACUUM, see pager/db/vacuum.h
+    uint64_t change_counter;            // Stamped on every page written - bumped when a backup starts, see pager/backup.h
+    uint32_t checksum;                  // CRC-32 checksum of every field before it - no padding in between
 } DatabaseHeader;
 
 
@@ -44,14 +49,15 @@ typedef struct {
 // The only difference between page types is what is stored in each slot which does have some effect on compacting and accessing values in each type
 typedef struct {
     // Page related
-    uint16_t page_id;  // Max of 2^16 = 65535 pages
+    uint32_t page_id;  // Max of 2^32 - 1 pages
+    uint32_t right_sibling_page_id;  // B+ Tree specific - Page ID of right sibling page for PAGE_INDEX_LEAF - set to NULL or ignore for PAGE_INDEX_INTERNAL, PAGE_DATA and PAGE_OVERFLOW
     uint16_t ref_counter;  // To know when free can be done
-    uint8_t flag;  // See above for PAGE flags
 
     // Slot Related
-    uint16_t free_start;  // Start of free space - does not exceed 16 bits - 4096 is 12 bits only
+    uint16_t free_start;  // Start of free space - does not exceed 16 bits since MAX_PAGE_SIZE is 64KB
     uint16_t free_end;  // End of free space
     uint16_t free_total;  // Available free space to grow slots into
+    uint8_t flag;  // See above for PAGE flags
     uint8_t total_slots;  // How many slots are currently in use to now size of slot directory
 
     // For slot allocation
@@ -59,20 +65,25 @@ typedef struct {
     uint8_t free_slot_count;  // For queue operations
     uint8_t free_slot_list[FREE_SLOT_LIST_SIZE];  // Track and reuse free slots as much as possible
 
-    // B+ Tree specific 
-    uint16_t right_sibling_page_id;  // Page ID of right sibling page for PAGE_INDEX_LEAF - set to NULL or ignore for PAGE_INDEX_INTERNAL, PAGE_DATA and PAGE_OVERFLOW
-
-    // No need to pad to MAX_PAGE_HEADER_SIZE = 32 in bytes
+    // Exactly MAX_PAGE_HEADER_SIZE = 32 bytes - widest fields first so there is no padding
 } DBPageHeader;
 
-// Page Memory, aligned to PAGE_SIZE (4096 Bytes usually) 
-// The usable space is further capped to prevent journal from exceeding PAGE_SIZE
+// Page Memory, aligned to the page size of the DB (4096 Bytes by default)
+// The usable space is further capped to prevent journal from exceeding the page size
 // data includes Slot directory + slot data entries + free space
+// The page size is only known at runtime, so data is a flexible array - USABLE_PAGE_SIZE(page_size) bytes of it are usable,
+// and the last MAX_JOURNAL_HEADER_SIZE bytes of the page are reserved for Journal later (see DB_PAGE_RESERVED)
 typedef struct {
-    DBPageHeader header;  // Padded to 32 bytes
-    uint8_t data[MAX_USABLE_PAGE_SIZE];  // 4032 bytes - The data depends on the page type - its filled with SlotEntry and Index/Data/OverflowSlotData types
-    uint8_t reserved[MAX_JOURNAL_HEADER_SIZE];  // 32 bytes - reserved for Journal later
+    DBPageHeader header;  // 32 bytes
+    uint8_t data[];  // 4032 bytes for 4KB pages - The data depends on the page type - its filled with SlotEntry and Index/Data/OverflowSlotData types
 } DBPage;
 
+#define DB_PAGE_RESERVED(page, page_size) ((uint8_t*)(page) + (page_size) - MAX_JOURNAL_HEADER_SIZE)
+
+// page_size in DatabaseHeader is 16 bits - 65536 is stored as 1 like SQLite does
+#define DB_PAGE_SIZE_ENCODE(page_size) ((uint16_t)((page_size) == 65536 ? 1 : (page_size)))
+#define DB_PAGE_SIZE_DECODE(stored) ((stored) == 1 ? 65536u : (uint32_t)(stored))
+#define DB_PAGE_SIZE_VALID(page_size) ((page_size) >= MIN_PAGE_SIZE && (page_size) <= MAX_PAGE_SIZE && ((page_size) & ((page_size) - 1)) == 0)
+
 #endif /* PRESEQL_PAGER_DB_BASE_PAGE_H */
 
@@ -25,9 +25,9 @@ PSqlStatus init_column_catalog(DBPage* page);
 PSqlStatus init_fk_catalog(DBPage* page);
 
 // Table catalog operations
-PSqlStatus catalog_add_table(const char* table_name, uint16_t root_page, uint8_t index_type, uint8_t flags, uint16_t* out_table_id);
-PSqlStatus catalog_get_table_by_name(const char* table_name, uint16_t* out_table_id, uint16_t* out_root_page);
-PSqlStatus catalog_get_table_by_id(uint16_t table_id, char** out_table_name, uint16_t* out_root_page);
+PSqlStatus catalog_add_table(const char* table_name, uint32_t root_page, uint8_t index_type, uint8_t flags, uint16_t* out_table_id);
+PSqlStatus catalog_get_table_by_name(const char* table_name, uint16_t* out_table_id, uint32_t* out_root_page);
+PSqlStatus catalog_get_table_by_id(uint16_t table_id, char** out_table_name, uint32_t* out_root_page);
 PSqlStatus catalog_delete_table(uint16_t table_id);
 
 // Column catalog operations
@@ -24,9 +24,9 @@ typedef struct {
 
 uint8_t find_empty_data_slot(Pager* pager, uint64_t value_size);  // Finds a slot in data pages that can fit the value - i.e a row of data via searching the radix buckets
 // Data slots do not need to be ordered in any way, so any candidate with space will do
-void read_data_slot(Pager* pager, uint16_t page_id, uint8_t slot_id, Row *row);
+void read_data_slot(Pager* pager, uint32_t page_id, uint8_t slot_id, Row *row);
 void write_data_slot(Pager* pager, Row *row);  // Pager doesn't need to slot in any particular data slot - only condition is that the page has enough free space - yes this will lead to inefficiency of page accesses since i mix data but screw it
-void free_data_slot(Pager* pager, uint16_t page_id, uint8_t slot_id);
+void free_data_slot(Pager* pager, uint32_t page_id, uint8_t slot_id);
 
-DBPage* init_data_page(Pager* pager, uint16_t page_no);
+DBPage* init_data_page(Pager* pager, uint32_t page_no);
 void vaccum_data_pages(FreeSpaceTracker* tracker);  // Vaccum only on 4-bucket radix tree with tracker - this is done when the database is online - i.e only data and overflow pages get this treatment
@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "free_space.h"
+#include "pager/pager.h"
+#include "pager/pager_format.h"
+#include "algorithm/radix_tree.h"
+
+/* Free page list on disk
+ * The header's inline free_page_list holds up to FREE_PAGE_LIST_SIZE free pages, a chain of trunk pages the rest
+ * (header->free_trunk_page, then right_sibling_page_id). A trunk is itself one of the free pages, so storing the list costs
+ * no extra space - like SQLite's free-list trunks, minus the leaf/trunk split of the counts.
+ * The list is a stack, with the inline list at the bottom: a freed page goes onto the first trunk (the inline list while
+ * there is no trunk), and becomes the new first trunk once that one is full. get_free_page() takes from the same end, an
+ * emptied trunk last. So a commit only ever changes page 0 and the first trunk or two, however long the list is - and
+ * those pages go out in the same commit (WAL frames and journal records included) as the pages freed or reused.
+ * The header fields are kept in pager->header, which reaches page 0 in that same commit.
+ * The radix tree holds the same pages for lookups. Vacuum takes pages out of the middle of the list - after that the list
+ * is rewritten from the tree as a whole, by the next flush or commit.
+ */
+
+static void load_trunks(Pager* pager, const DatabaseHeader* header) {
+    PageTracker* map = pager->db_pager.free_page_map;
+    uint32_t page_count = pager->db_pager.page_count;
+    uint32_t capacity = FREE_TRUNK_CAPACITY(pager);
+
+    // Every trunk takes a free page, so a chain longer than the file is a loop
+    uint32_t trunk_no = header->free_trunk_page;
+    for (uint32_t trunks = 0; trunk_no && trunks < page_count; trunks++) {
+        if (trunk_no >= page_count) break;
+        DBPage* trunk = pager_get_page(pager, trunk_no);
+        if (!trunk) break;
+
+        // A trunk that got reused without the list being rewritten (a crash in mmap mode) ends the chain there -
+        // better to leak the rest than to hand out a live page
+        const FreeTrunk* entries = (const FreeTrunk*)trunk->data;
+        if (!(trunk->header.flag & PAGE_FREE) || trunk->header.page_id != trunk_no || entries->count > capacity) {
+            fprintf(stderr, "Free list trunk %u is not a trunk page - dropping the rest of the free list\n", trunk_no);
+            pager_unpin_page(pager, trunk);
+            map->rebuild = true;
+            return;
+        }
+
+        if (!radix_tree_lookup(&map->tree, trunk_no)) {
+            radix_tree_insert(&map->tree, trunk_no);
+            map->num_frees++;
+        } else {
+            map->rebuild = true;
+        }
+        for (uint32_t i = 0; i < entries->count; i++) {
+            uint32_t page_no = entries->pages[i];
+            if (page_no == 0 || page_no >= page_count || radix_tree_lookup(&map->tree, page_no)) {
+                map->rebuild = true;
+                continue;
+            }
+            radix_tree_insert(&map->tree, page_no);
+            map->num_frees++;
+        }
+        trunk_no = trunk->header.right_sibling_page_id;
+        pager_unpin_page(pager, trunk);
+    }
+    if (trunk_no) map->rebuild = true;
+}
+
+void init_free_page_map(Pager* pager) {
+    pager->db_pager.free_page_map = malloc(sizeof(PageTracker));
+    if (!pager->db_pager.free_page_map) return;
+
+    PageTracker* map = pager->db_pager.free_page_map;
+    map->num_frees = 0;
+    map->rebuild = false;
+    map->tree = *radix_tree_create();
+
+    DatabaseHeader* header = &pager->header;
+
+    // Load free pages from header into radix tree
+    if (header->free_page_count > FREE_PAGE_LIST_SIZE) {
+        header->free_page_count = FREE_PAGE_LIST_SIZE;
+        map->rebuild = true;
+    }
+    for (uint32_t i = 0; i < header->free_page_count; i++) {
+        uint32_t page_no = header->free_page_list[i];
+        if (page_no == 0 || page_no >= pager->db_pager.page_count || radix_tree_lookup(&map->tree, page_no)) {
+            map->rebuild = true;
+            continue;
+        }
+        radix_tree_insert(&map->tree, page_no);
+        map->num_frees++;
+    }
+
+    // Then everything that didn't fit
+    load_trunks(pager, header);
+
+    // Anything off about the list on disk - it gets rewritten from the tree before the stack ends are used
+    if (map->num_frees != header->free_page_total) map->rebuild = true;
+}
+
+// Write a trunk over a free page - the pin bit survives like in allocate_page()
+static PSqlStatus write_trunk(Pager* pager, uint32_t trunk_no, uint32_t next_trunk, const uint32_t* pages, uint32_t count) {
+    DBPage* trunk = pager_get_page(pager, trunk_no);
+    if (!trunk) return PSQL_ERROR;
+
+    uint8_t pinned = trunk->header.flag & PAGE_PINNED;
+    memset(trunk, 0, pager->db_pager.page_size);
+    trunk->header.page_id = trunk_no;
+    trunk->header.right_sibling_page_id = next_trunk;
+    trunk->header.flag = PAGE_FREE | pinned;
+
+    FreeTrunk* entries = (FreeTrunk*)trunk->data;
+    entries->count = count;
+    if (count) memcpy(entries->pages, pages, count * sizeof(uint32_t));
+    pager_write_page(pager, trunk);
+    pager_unpin_page(pager, trunk);
+    return PSQL_OK;
+}
+
+// Put a freed page on top of the list - false if the first trunk can't be read
+static bool push_free_page(Pager* pager, uint32_t page_no) {
+    DatabaseHeader* header = &pager->header;
+    if (header->free_trunk_page == 0 && header->free_page_count < FREE_PAGE_LIST_SIZE) {
+        header->free_page_list[header->free_page_count++] = page_no;
+        return true;
+    }
+
+    if (header->free_trunk_page) {
+        DBPage* trunk = pager_get_page(pager, header->free_trunk_page);
+        if (!trunk) return false;
+        FreeTrunk* entries = (FreeTrunk*)trunk->data;
+        bool added = (trunk->header.flag & PAGE_FREE) && entries->count < FREE_TRUNK_CAPACITY(pager);
+        if (added) {
+            entries->pages[entries->count++] = page_no;
+            pager_write_page(pager, trunk);
+        }
+        pager_unpin_page(pager, trunk);
+        if (added) return true;
+    }
+
+    // Full - the page becomes the new first trunk
+    if (write_trunk(pager, page_no, header->free_trunk_page, NULL, 0) != PSQL_OK) return false;
+    header->free_trunk_page = page_no;
+    return true;
+}
+
+// Take the page on top of the list off it - 0 if there is none, or the first trunk can't be read
+static uint32_t pop_free_page(Pager* pager) {
+    DatabaseHeader* header = &pager->header;
+    uint32_t trunk_no = header->free_trunk_page;
+    if (trunk_no == 0) {
+        if (header->free_page_count == 0) return 0;
+        uint32_t page_no = header->free_page_list[--header->free_page_count];
+        header->free_page_list[header->free_page_count] = 0;
+        return page_no;
+    }
+
+    DBPage* trunk = pager_get_page(pager, trunk_no);
+    if (!trunk) return 0;
+    FreeTrunk* entries = (FreeTrunk*)trunk->data;
+    uint32_t page_no = 0;
+    if (!(trunk->header.flag & PAGE_FREE) || entries->count > FREE_TRUNK_CAPACITY(pager)) {
+        page_no = 0;
+    } else if (entries->count > 0) {
+        page_no = entries->pages[--entries->count];
+        pager_write_page(pager, trunk);
+    } else {
+        // An empty trunk goes out itself, and the next one moves up - its caller formats it over
+        page_no = trunk_no;
+        header->free_trunk_page = trunk->header.right_sibling_page_id;
+    }
+    pager_unpin_page(pager, trunk);
+    return page_no;
+}
+
+// Mark a page number as free
+void mark_page_free(Pager* pager, uint32_t page_no) {
+    PageTracker* map = pager->db_pager.free_page_map;
+    if (page_no == 0 || radix_tree_lookup(&map->tree, page_no)) return;  // The header is never free, and a double free counts once
+
+    radix_tree_insert(&map->tree, page_no);
+    map->num_frees++;
+    if (!map->rebuild && !push_free_page(pager, page_no)) map->rebuild = true;
+    pager->header.free_page_total = map->num_frees;
+    pager->header_dirty = true;
+}
+
+// Mark a page number as allocated
+void mark_page_used(Pager* pager, uint32_t page_no) {
+    PageTracker* map = pager->db_pager.free_page_map;
+    if (radix_tree_lookup(&map->tree, page_no)) {
+        // Somewhere in the middle of the list - vacuum moving a page into a hole, or cutting a free page off the end
+        radix_tree_delete(&map->tree, page_no);
+        map->num_frees--;
+        map->rebuild = true;
+        pager->header.free_page_total = map->num_frees;
+        pager->header_dirty = true;
+    }
+
+    // Update highest page if necessary - page 0 catches up on the next commit
+    if (page_no > pager->header.highest_page) {
+        pager->header.highest_page = page_no;
+        pager->header_dirty = true;
+    }
+}
+
+// Get a free page number - the one on top of the list, the lowest one while the list is being rewritten anyway
+// If nothing is free the file grows by a page, 0 if it can't
+uint32_t get_free_page(Pager* pager) {
+    PageTracker* map = pager->db_pager.free_page_map;
+    if (map->num_frees > 0) {
+        uint32_t page_no = map->rebuild ? 0 : pop_free_page(pager);
+        if (page_no > 0 && radix_tree_lookup(&map->tree, page_no)) {
+            radix_tree_delete(&map->tree, page_no);
+        } else {
+            // The list doesn't match the tree - go by the tree, and the next sync rewrites the list
+            map->rebuild = true;
+            page_no = radix_tree_pop_min(&map->tree);
+        }
+        if (page_no > 0) {
+            map->num_frees--;
+            pager->header.free_page_total = map->num_frees;
+            pager->header_dirty = true;
+            return page_no;
+        }
+    }
+
+    return allocate_new_db_pages(pager, 1);
+}
+
+// Rewrite the header's free page list and the whole trunk chain from the tree - only needed once the list on disk stopped
+// matching it, the stack ends are kept up to date as pages come and go
+// The list is laid out so the pages come back off it lowest first: the first trunk holds the lowest pages (the trunk
+// itself the highest of its group, it goes out last), and the inline list at the bottom the highest
+PSqlStatus sync_free_page_list(Pager* pager) {
+    PageTracker* map = pager->db_pager.free_page_map;
+    if (!map->rebuild) return PSQL_OK;
+
+    uint32_t* pages = (uint32_t*)malloc(((size_t)map->num_frees + 1) * sizeof(uint32_t));
+    if (!pages) return PSQL_NOMEM;
+    size_t count = radix_to_freelist(&map->tree, pages, map->num_frees);
+
+    // Trunks go back to front, each pointing at the one written before it - only the first is needed at the end.
+    // Entries are written highest first, so the top of each trunk is its lowest page
+    uint32_t capacity = FREE_TRUNK_CAPACITY(pager);
+    size_t inline_count = count < FREE_PAGE_LIST_SIZE ? count : FREE_PAGE_LIST_SIZE;
+    size_t remaining = count - inline_count;
+    uint32_t* entries = (uint32_t*)malloc((size_t)capacity * sizeof(uint32_t));
+    if (!entries) {
+        free(pages);
+        return PSQL_NOMEM;
+    }
+    uint32_t next_trunk = 0;
+    while (remaining > 0) {
+        // Full trunks from the far end, the first one takes what is left - that's where freed pages go next
+        size_t group = remaining < (size_t)capacity + 1 ? remaining : (size_t)capacity + 1;
+        size_t start = remaining - group;
+        uint32_t trunk_no = pages[start + group - 1];
+        for (size_t i = 0; i + 1 < group; i++) entries[i] = pages[start + group - 2 - i];
+        if (write_trunk(pager, trunk_no, next_trunk, entries, (uint32_t)(group - 1)) != PSQL_OK) {
+            free(entries);
+            free(pages);
+            return PSQL_ERROR;
+        }
+        next_trunk = trunk_no;
+        remaining = start;
+    }
+    free(entries);
+
+    // The caller writes the header out after this
+    DatabaseHeader* header = &pager->header;
+    memset(header->free_page_list, 0, sizeof(header->free_page_list));
+    for (size_t i = 0; i < inline_count; i++) header->free_page_list[i] = pages[count - 1 - i];
+    header->free_page_count = (uint32_t)inline_count;
+    header->free_trunk_page = next_trunk;
+    header->free_page_total = (uint32_t)count;
+    pager->header_dirty = true;
+    free(pages);
+
+    map->rebuild = false;
+    return PSQL_OK;
+}
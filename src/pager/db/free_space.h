@@ -6,23 +6,33 @@
 
 /* Manage Free Pages via Radix Tree 
  * Loads the free list from disk and builds a representation in Pager object memory using Radix Trees
+ * On disk the list is the header's inline free_page_list, then a chain of trunk pages for whatever doesn't fit - see free_space.c
  */
+
+// Free list trunk page (flag PAGE_FREE) - a free page holding the numbers of other free pages
+// The next trunk is in right_sibling_page_id, and page->data holds this
+typedef struct {
+    uint32_t count;
+    uint32_t pages[];
+} FreeTrunk;
+
+#define FREE_TRUNK_CAPACITY(pager) ((PAGER_USABLE_SIZE(pager) - sizeof(uint32_t)) / sizeof(uint32_t))  // 1007 with 4KB pages
 void init_free_page_map(Pager* pager);
 void init_free_data_page_slots(Pager* pager);  // Variable size slots in Data Page
 void init_overflow_data_page_slots(Pager* pager);  // Variable sized chunks/slots in Overflow
 
 // Mark a page number as free
-void mark_page_free(Pager* pager, uint16_t page_no);
+void mark_page_free(Pager* pager, uint32_t page_no);
 
 // Mark a page number as allocated
-void mark_page_used(Pager* pager, uint16_t page_no);
+void mark_page_used(Pager* pager, uint32_t page_no);
 
-// Get a free page number, or return 0 if none 
-// if no free page then use the highest known page number + 1
-uint16_t get_free_page(Pager* pager);
+// Get a free page number - the one freed last, see free_space.c
+// if no free page then the file grows by one page - 0 if it can't
+uint32_t get_free_page(Pager* pager);
 
-// Sync free page map with the header's free page list
-// This is called every time threshold, FREE_PAGE_LIST_BATCH_SIZE is met 
+// Sync free page map with the header's free page list and trunk pages
+// Only does anything once vacuum took pages out of the middle of the list - called on every flush/commit, and on close
 PSqlStatus sync_free_page_list(Pager* pager);
 
 #endif
@@ -1,4 +1,6 @@
 #include "index_page.h"
+#include "pager/pager.h"
+#include "pager/db/vacuum.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -6,9 +8,10 @@
 // B+ tree has no fixed order - its an effective order based on size of slot data
 #define IS_LEAF(page) ((page)->header.flag & PAGE_INDEX_LEAF)
 #define IS_INTERNAL(page) ((page)->header.flag & PAGE_INDEX_INTERNAL)
-#define USED_SPACE(page) (MAX_USABLE_PAGE_SIZE - (page)->header.free_total)
-#define FULL_THRESHOLD (MAX_USABLE_PAGE_SIZE * INDEX_FULL_OCCUPANCY) // 80% of 4032 bytes
-#define MIN_THRESHOLD (MAX_USABLE_PAGE_SIZE * INDEX_MIN_OCCUPANCY)   // 40% of 4032 bytes
+// The page size is per database, so the thresholds are worked out from the pager - bigger pages fit more keys before a split
+#define USED_SPACE(page) (PAGER_USABLE_SIZE(pager) - (page)->header.free_total)
+#define FULL_THRESHOLD (PAGER_USABLE_SIZE(pager) * INDEX_FULL_OCCUPANCY) // 80% of 4032 bytes with 4KB pages
+#define MIN_THRESHOLD (PAGER_USABLE_SIZE(pager) * INDEX_MIN_OCCUPANCY)   // 40% of 4032 bytes with 4KB pages
 
 
 // Encode INTEGER key for lexicographic comparison
@@ -23,7 +26,7 @@ int compare_keys(const uint8_t* key1, const uint8_t* key2, size_t key_size) {
 }
 
 // Initialize an internal index page
-DBPage* init_index_internal_page(Pager* pager, uint16_t page_no) {
+DBPage* init_index_internal_page(Pager* pager, uint32_t page_no) {
     DBPage* page = pager_get_page(pager, page_no);
     if (!page) return NULL;
     
@@ -31,8 +34,8 @@ DBPage* init_index_internal_page(Pager* pager, uint16_t page_no) {
     page->header.page_id = page_no;
     page->header.flag = PAGE_INDEX_INTERNAL;
     page->header.free_start = sizeof(DBPageHeader);
-    page->header.free_end = MAX_USABLE_PAGE_SIZE;
-    page->header.free_total = MAX_USABLE_PAGE_SIZE - sizeof(DBPageHeader);
+    page->header.free_end = PAGER_USABLE_SIZE(pager);
+    page->header.free_total = PAGER_USABLE_SIZE(pager) - sizeof(DBPageHeader);
     page->header.right_sibling_page_id = 0;
     
     pager_write_page(pager, page);
@@ -40,7 +43,7 @@ DBPage* init_index_internal_page(Pager* pager, uint16_t page_no) {
 }
 
 // Initialize a leaf index page
-DBPage* init_index_leaf_page(Pager* pager, uint16_t page_no) {
+DBPage* init_index_leaf_page(Pager* pager, uint32_t page_no) {
     DBPage* page = pager_get_page(pager, page_no);
     if (!page) return NULL;
     
@@ -48,8 +51,8 @@ DBPage* init_index_leaf_page(Pager* pager, uint16_t page_no) {
     page->header.page_id = page_no;
     page->header.flag = PAGE_INDEX_LEAF;
     page->header.free_start = sizeof(DBPageHeader);
-    page->header.free_end = MAX_USABLE_PAGE_SIZE;
-    page->header.free_total = MAX_USABLE_PAGE_SIZE - sizeof(DBPageHeader);
+    page->header.free_end = PAGER_USABLE_SIZE(pager);
+    page->header.free_total = PAGER_USABLE_SIZE(pager) - sizeof(DBPageHeader);
     page->header.right_sibling_page_id = 0;
     
     pager_write_page(pager, page);
@@ -57,50 +60,65 @@ DBPage* init_index_leaf_page(Pager* pager, uint16_t page_no) {
 }
 
 // Find an empty slot in an index page
-uint8_t find_empty_index_slot(Pager* pager, uint16_t page_id, uint64_t key_size) {
+uint8_t find_empty_index_slot(Pager* pager, uint32_t page_id, uint64_t key_size) {
     DBPage* page = pager_get_page(pager, page_id);
-    if (!page || key_size > MAX_DATA_PER_INDEX_SLOT) return 0;
+    if (!page) return 0;
+    if (key_size > MAX_DATA_PER_INDEX_SLOT) {
+        pager_unpin_page(pager, page);
+        return 0;
+    }
     
+    uint8_t slot_id = 0;
     if (page->header.free_slot_count > 0) {
-        uint8_t slot_id = page->header.free_slot_list[page->header.free_slot_count - 1];
+        slot_id = page->header.free_slot_list[page->header.free_slot_count - 1];
         page->header.free_slot_count--;
-        return slot_id;
-    }
-    
-    // Check if there's enough space for a new slot
-    if (USED_SPACE(page) < FULL_THRESHOLD && page->header.free_total >= (INDEX_SLOT_DATA_SIZE + SLOT_ENTRY_SIZE)) {
+    } else if (USED_SPACE(page) < FULL_THRESHOLD && page->header.free_total >= (INDEX_SLOT_DATA_SIZE + SLOT_ENTRY_SIZE)) {
+        // Enough space for a new slot
         page->header.highest_slot++;
-        return page->header.highest_slot;
+        slot_id = page->header.highest_slot;
     }
     
-    return 0;
+    pager_unpin_page(pager, page);
+    return slot_id;
 }
 
 // Read an index slot
-void read_index_slot(Pager* pager, uint16_t page_id, uint8_t slot_id, IndexSlotData* slot) {
+void read_index_slot(Pager* pager, uint32_t page_id, uint8_t slot_id, IndexSlotData* slot) {
     DBPage* page = pager_get_page(pager, page_id);
-    if (!page || slot_id >= page->header.total_slots) return;
+    if (!page) return;
+    if (slot_id >= page->header.total_slots) {
+        pager_unpin_page(pager, page);
+        return;
+    }
     
     SlotEntry* entry = (SlotEntry*)(page->data + page->header.free_start);
     for (uint8_t i = 0; i < page->header.total_slots; i++) {
         if (entry[i].slot_id == slot_id) {
             memcpy(slot->key, page->data + entry[i].offset, entry[i].size);
-            slot->next_page_id = *(uint16_t*)(page->data + entry[i].offset + entry[i].size);
-            slot->next_slot_id = *(uint8_t*)(page->data + entry[i].offset + entry[i].size + 2);
-            slot->overflow.next_page_id = *(uint16_t*)(page->data + entry[i].offset + entry[i].size + 3);
-            slot->overflow.next_chunk_id = *(uint16_t*)(page->data + entry[i].offset + entry[i].size + 5);
+            slot->next_page_id = *(uint32_t*)(page->data + entry[i].offset + entry[i].size);
+            slot->next_slot_id = *(uint8_t*)(page->data + entry[i].offset + entry[i].size + 4);
+            slot->overflow.next_page_id = *(uint32_t*)(page->data + entry[i].offset + entry[i].size + 5);
+            slot->overflow.next_chunk_id = *(uint16_t*)(page->data + entry[i].offset + entry[i].size + 9);
             break;
         }
     }
+    
+    pager_unpin_page(pager, page);
 }
 
 // Write an index slot
-void write_index_slot(Pager* pager, uint16_t page_id, IndexSlotData* slot) {
+void write_index_slot(Pager* pager, uint32_t page_id, IndexSlotData* slot) {
     DBPage* page = pager_get_page(pager, page_id);
-    if (!page || USED_SPACE(page) >= FULL_THRESHOLD) return;
+    if (!page) return;
     
-    uint8_t slot_id = find_empty_index_slot(pager, page_id, MAX_DATA_PER_INDEX_SLOT);
-    if (slot_id == 0) return;
+    uint8_t slot_id = 0;
+    if (USED_SPACE(page) < FULL_THRESHOLD) {
+        slot_id = find_empty_index_slot(pager, page_id, MAX_DATA_PER_INDEX_SLOT);
+    }
+    if (slot_id == 0) {
+        pager_unpin_page(pager, page);
+        return;
+    }
     
     // Find insertion point for sorted order
     SlotEntry* entries = (SlotEntry*)(page->data + page->header.free_start);
@@ -122,10 +140,10 @@ void write_index_slot(Pager* pager, uint16_t page_id, IndexSlotData* slot) {
     // Write slot data
     uint64_t offset = page->header.free_end - INDEX_SLOT_DATA_SIZE;
     memcpy(page->data + offset, slot->key, MAX_DATA_PER_INDEX_SLOT);
-    *(uint16_t*)(page->data + offset + MAX_DATA_PER_INDEX_SLOT) = slot->next_page_id;
-    *(uint8_t*)(page->data + offset + MAX_DATA_PER_INDEX_SLOT + 2) = slot->next_slot_id;
-    *(uint16_t*)(page->data + offset + MAX_DATA_PER_INDEX_SLOT + 3) = slot->overflow.next_page_id;
-    *(uint16_t*)(page->data + offset + MAX_DATA_PER_INDEX_SLOT + 5) = slot->overflow.next_chunk_id;
+    *(uint32_t*)(page->data + offset + MAX_DATA_PER_INDEX_SLOT) = slot->next_page_id;
+    *(uint8_t*)(page->data + offset + MAX_DATA_PER_INDEX_SLOT + 4) = slot->next_slot_id;
+    *(uint32_t*)(page->data + offset + MAX_DATA_PER_INDEX_SLOT + 5) = slot->overflow.next_page_id;
+    *(uint16_t*)(page->data + offset + MAX_DATA_PER_INDEX_SLOT + 9) = slot->overflow.next_chunk_id;
     
     // Update slot entry
     entries[insert_pos].slot_id = slot_id;
@@ -138,15 +156,16 @@ void write_index_slot(Pager* pager, uint16_t page_id, IndexSlotData* slot) {
     page->header.free_total -= (INDEX_SLOT_DATA_SIZE + SLOT_ENTRY_SIZE);
     
     pager_write_page(pager, page);
+    pager_unpin_page(pager, page);
 }
 
 // Free an index slot
-void free_index_slot(Pager* pager, uint16_t page_id, uint8_t slot_id) {
+void free_index_slot(Pager* pager, uint32_t page_id, uint8_t slot_id) {
     DBPage* page = pager_get_page(pager, page_id);
-    if (!page || slot_id >= page->header.total_slots) return;
+    if (!page) return;
     
     SlotEntry* entries = (SlotEntry*)(page->data + page->header.free_start);
-    for (uint8_t i = 0; i < page->header.total_slots; i++) {
+    for (uint8_t i = 0; slot_id < page->header.total_slots && i < page->header.total_slots; i++) {
         if (entries[i].slot_id == slot_id) {
             memmove(&entries[i], &entries[i + 1], (page->header.total_slots - i - 1) * sizeof(SlotEntry));
             page->header.total_slots--;
@@ -156,11 +175,13 @@ void free_index_slot(Pager* pager, uint16_t page_id, uint8_t slot_id) {
             break;
         }
     }
+    
+    pager_unpin_page(pager, page);
 }
 
 // Initialize a new B+ tree
-PSqlStatus btree_init(Pager* pager, const char* table_name, uint8_t index_type, uint16_t* out_root_page) {
-    uint16_t root_page_id = get_free_page(pager);
+PSqlStatus btree_init(Pager* pager, const char* table_name, uint8_t index_type, uint32_t* out_root_page) {
+    uint32_t root_page_id = get_free_page(pager);
     if (root_page_id == 0) return PSQL_STATUS_OUT_OF_MEMORY;
     
     DBPage* root = init_index_leaf_page(pager, root_page_id);
@@ -176,12 +197,15 @@ PSqlStatus btree_init(Pager* pager, const char* table_name, uint8_t index_type,
         return status;
     }
     
+    // The catalog points at the root - vacuum can't move it
+    ptrmap_put(pager, root_page_id, PTRMAP_ROOT, 0, 0);
+    
     *out_root_page = root_page_id;
     return PSQL_STATUS_OK;
 }
 
 // Destroy a B+ tree
-PSqlStatus btree_destroy(Pager* pager, uint16_t root_page_id) {
+PSqlStatus btree_destroy(Pager* pager, uint32_t root_page_id) {
     DBPage* page = pager_get_page(pager, root_page_id);
     if (!page) return PSQL_STATUS_INVALID_PAGE;
     
@@ -218,7 +242,8 @@ PSqlStatus btree_destroy(Pager* pager, uint16_t root_page_id) {
 }
 
 // Search for a key in the B+ tree
-PSqlStatus btree_search(Pager* pager, uint16_t root_page_id, const uint8_t* key, size_t key_size, uint16_t* result_page_id, uint8_t* result_slot_id) {
+// Descend from the root to the leaf slot holding key
+static PSqlStatus btree_find(Pager* pager, uint32_t root_page_id, const uint8_t* key, size_t key_size, uint32_t* result_page_id, uint8_t* result_slot_id) {
     if (key_size > MAX_DATA_PER_INDEX_SLOT) return PSQL_STATUS_INVALID_ARGUMENT;
     
     DBPage* page = pager_get_page(pager, root_page_id);
@@ -254,14 +279,21 @@ PSqlStatus btree_search(Pager* pager, uint16_t root_page_id, const uint8_t* key,
     return PSQL_STATUS_NOT_FOUND;
 }
 
+// Point lookup - one root to leaf path, so the kernel shouldn't read around each page it faults in
+PSqlStatus btree_search(Pager* pager, uint32_t root_page_id, const uint8_t* key, size_t key_size, uint32_t* result_page_id, uint8_t* result_slot_id) {
+    pager_set_access_pattern(pager, PAGER_ACCESS_RANDOM);
+    return btree_find(pager, root_page_id, key, key_size, result_page_id, result_slot_id);
+}
+
 // Insert a key-value pair into the B+ tree
-PSqlStatus btree_insert(Pager* pager, uint16_t root_page_id, const uint8_t* key, size_t key_size, uint16_t data_page_id, uint8_t data_slot_id) {
+PSqlStatus btree_insert(Pager* pager, uint32_t root_page_id, const uint8_t* key, size_t key_size, uint32_t data_page_id, uint8_t data_slot_id) {
     if (key_size > MAX_DATA_PER_INDEX_SLOT) return PSQL_STATUS_INVALID_ARGUMENT;
     
     if (root_page_id == 0) {
         root_page_id = get_free_page(pager);
         if (root_page_id == 0) return PSQL_STATUS_OUT_OF_MEMORY;
         init_index_leaf_page(pager, root_page_id);
+        ptrmap_put(pager, root_page_id, PTRMAP_ROOT, 0, 0);
     }
     
     DBPage* page = pager_get_page(pager, root_page_id);
@@ -287,16 +319,17 @@ PSqlStatus btree_insert(Pager* pager, uint16_t root_page_id, const uint8_t* key,
     new_slot.next_slot_id = data_slot_id;
     
     write_index_slot(pager, page->header.page_id, &new_slot);
+    ptrmap_update_children(pager, page->header.page_id);
     
     // Check for overflow and split if needed
     if (USED_SPACE(page) > FULL_THRESHOLD) {
-        uint16_t new_page_id;
+        uint32_t new_page_id;
         PSqlStatus status = btree_split_leaf(pager, page->header.page_id, &new_page_id);
         if (status != PSQL_STATUS_OK) return status;
         
         // Update parent (simplified: assume root split for now)
         if (page->header.page_id == root_page_id) {
-            uint16_t new_root_id = get_free_page(pager);
+            uint32_t new_root_id = get_free_page(pager);
             if (new_root_id == 0) return PSQL_STATUS_OUT_OF_MEMORY;
             
             DBPage* new_root = init_index_internal_page(pager, new_root_id);
@@ -308,6 +341,10 @@ PSqlStatus btree_insert(Pager* pager, uint16_t root_page_id, const uint8_t* key,
             parent_slot.next_page_id = new_page_id;
             write_index_slot(pager, new_root_id, &parent_slot);
             
+            // The old root is a child now, the new one is what the catalog points at
+            ptrmap_update_children(pager, new_root_id);
+            ptrmap_put(pager, new_root_id, PTRMAP_ROOT, 0, 0);
+            
             // Update catalog with new root (requires catalog access)
             // For simplicity, assume root_page_id is updated externally
         }
@@ -317,7 +354,7 @@ PSqlStatus btree_insert(Pager* pager, uint16_t root_page_id, const uint8_t* key,
 }
 
 // Delete a key from the B+ tree
-PSqlStatus btree_delete(Pager* pager, uint16_t root_page_id, const uint8_t* key, size_t key_size) {
+PSqlStatus btree_delete(Pager* pager, uint32_t root_page_id, const uint8_t* key, size_t key_size) {
     if (key_size > MAX_DATA_PER_INDEX_SLOT) return PSQL_STATUS_INVALID_ARGUMENT;
     
     DBPage* page = pager_get_page(pager, root_page_id);
@@ -366,6 +403,7 @@ PSqlStatus btree_delete(Pager* pager, uint16_t root_page_id, const uint8_t* key,
             // Update parent key
             read_index_slot(pager, sibling->header.page_id, 0, &parent_slot);
             write_index_slot(pager, parent->header.page_id, &parent_slot);
+            ptrmap_update_children(pager, page->header.page_id);
         } else {
             // Merge with sibling
             for (uint8_t i = 0; i < sibling->header.total_slots; i++) {
@@ -376,6 +414,7 @@ PSqlStatus btree_delete(Pager* pager, uint16_t root_page_id, const uint8_t* key,
             page->header.right_sibling_page_id = sibling->header.right_sibling_page_id;
             free_index_slot(pager, parent->header.page_id, parent_idx);
             mark_page_free(pager, sibling->header.page_id);
+            ptrmap_update_children(pager, page->header.page_id);
         }
     }
     
@@ -383,11 +422,11 @@ PSqlStatus btree_delete(Pager* pager, uint16_t root_page_id, const uint8_t* key,
 }
 
 // Split a leaf node
-PSqlStatus btree_split_leaf(Pager* pager, uint16_t leaf_page_id, uint16_t* new_page_id) {
+PSqlStatus btree_split_leaf(Pager* pager, uint32_t leaf_page_id, uint32_t* new_page_id) {
     DBPage* leaf_page = pager_get_page(pager, leaf_page_id);
     if (!leaf_page || !IS_LEAF(leaf_page)) return PSQL_STATUS_INVALID_PAGE;
     
-    uint16_t new_leaf_id = get_free_page(pager);
+    uint32_t new_leaf_id = get_free_page(pager);
     if (new_leaf_id == 0) return PSQL_STATUS_OUT_OF_MEMORY;
     
     DBPage* new_leaf = init_index_leaf_page(pager, new_leaf_id);
@@ -416,16 +455,20 @@ PSqlStatus btree_split_leaf(Pager* pager, uint16_t leaf_page_id, uint16_t* new_p
     pager_write_page(pager, leaf_page);
     pager_write_page(pager, new_leaf);
     
+    // Rows that moved hang off the new leaf, and the chain runs through it
+    ptrmap_update_children(pager, leaf_page_id);
+    ptrmap_update_children(pager, new_leaf_id);
+    
     *new_page_id = new_leaf_id;
     return PSQL_STATUS_OK;
 }
 
 // Split an internal node
-PSqlStatus btree_split_internal(Pager* pager, uint16_t internal_page_id, uint16_t* new_page_id) {
+PSqlStatus btree_split_internal(Pager* pager, uint32_t internal_page_id, uint32_t* new_page_id) {
     DBPage* internal_page = pager_get_page(pager, internal_page_id);
     if (!internal_page || !IS_INTERNAL(internal_page)) return PSQL_STATUS_INVALID_PAGE;
     
-    uint16_t new_internal_id = get_free_page(pager);
+    uint32_t new_internal_id = get_free_page(pager);
     if (new_internal_id == 0) return PSQL_STATUS_OUT_OF_MEMORY;
     
     DBPage* new_internal = init_index_internal_page(pager, new_internal_id);
@@ -449,13 +492,14 @@ PSqlStatus btree_split_internal(Pager* pager, uint16_t internal_page_id, uint16_
     
     pager_write_page(pager, internal_page);
     pager_write_page(pager, new_internal);
+    ptrmap_update_children(pager, new_internal_id);
     
     *new_page_id = new_internal_id;
     return PSQL_STATUS_OK;
 }
 
 // Create a B+ tree iterator
-BTreeIterator* btree_iterator_create(Pager* pager, uint16_t root_page_id) {
+BTreeIterator* btree_iterator_create(Pager* pager, uint32_t root_page_id) {
     BTreeIterator* iterator = (BTreeIterator*)malloc(sizeof(BTreeIterator));
     if (!iterator) return NULL;
     
@@ -464,11 +508,24 @@ BTreeIterator* btree_iterator_create(Pager* pager, uint16_t root_page_id) {
     iterator->root_page_id = root_page_id;
     iterator->current_page_id = root_page_id;
     
+    // Scans bring their own read-ahead along the leaf chain - undo the MADV_RANDOM a point lookup may have left
+    pager_set_access_pattern(pager, PAGER_ACCESS_NORMAL);
     return iterator;
 }
 
+// ReadaheadVisit for leaves - the data pages its slots point at, in slot order
+static void prefetch_data_pages(Pager* pager, const DBPage* leaf) {
+    uint32_t data_pages[256];
+    uint8_t count = 0;
+    const SlotEntry* entry = (const SlotEntry*)(leaf->data + leaf->header.free_start);
+    for (uint8_t i = 0; i < leaf->header.total_slots; i++) {
+        data_pages[count++] = *(const uint32_t*)(leaf->data + entry[i].offset + entry[i].size);
+    }
+    readahead_pages(pager, data_pages, count);
+}
+
 // Create a B+ tree iterator with a key range
-BTreeIterator* btree_iterator_range(Pager* pager, uint16_t root_page_id, const uint8_t* start_key, const uint8_t* end_key, size_t key_size) {
+BTreeIterator* btree_iterator_range(Pager* pager, uint32_t root_page_id, const uint8_t* start_key, const uint8_t* end_key, size_t key_size) {
     BTreeIterator* iterator = btree_iterator_create(pager, root_page_id);
     if (!iterator) return NULL;
     
@@ -483,9 +540,9 @@ BTreeIterator* btree_iterator_range(Pager* pager, uint16_t root_page_id, const u
         }
         memcpy(iterator->start_key, start_key, key_size);
         
-        uint16_t page_id;
+        uint32_t page_id;
         uint8_t slot_id;
-        PSqlStatus status = btree_search(pager, root_page_id, start_key, key_size, &page_id, &slot_id);
+        PSqlStatus status = btree_find(pager, root_page_id, start_key, key_size, &page_id, &slot_id);
         if (status == PSQL_STATUS_OK) {
             iterator->current_page_id = page_id;
             iterator->current_slot_id = slot_id;
@@ -506,21 +563,27 @@ BTreeIterator* btree_iterator_range(Pager* pager, uint16_t root_page_id, const u
 }
 
 // Get the next key-value pair from the iterator
-int btree_iterator_next(BTreeIterator* iterator, uint16_t* data_page_id, uint8_t* data_slot_id) {
+int btree_iterator_next(BTreeIterator* iterator, uint32_t* data_page_id, uint8_t* data_slot_id) {
     if (!iterator || iterator->current_page_id == 0) return 0;
     
     DBPage* page = pager_get_page(iterator->pager, iterator->current_page_id);
     if (!page) return 0;
     
+    if (!iterator->readahead_started) {
+        readahead_start(iterator->pager, &iterator->readahead, iterator->current_page_id, prefetch_data_pages);
+        iterator->readahead_started = 1;
+    }
+    
     // Check if we've reached the end of the current page
     if (iterator->current_slot_id >= page->header.total_slots) {
-        uint16_t next_page_id = page->header.right_sibling_page_id;
+        uint32_t next_page_id = page->header.right_sibling_page_id;
         if (next_page_id == 0) return 0;
         
         iterator->current_page_id = next_page_id;
         iterator->current_slot_id = 0;
         page = pager_get_page(iterator->pager, next_page_id);
         if (!page) return 0;
+        readahead_advance(iterator->pager, &iterator->readahead, next_page_id);
     }
     
     // Get the current slot
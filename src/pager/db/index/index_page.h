@@ -13,48 +13,51 @@
 #define PRESEQL_PAGER_DB_INDEX_PAGE_H
 
 #include "pager/types.h"
+#include "pager/readahead.h"
 #include "status/db.h"
 
 /* BTreeIterator structure - FOr stepping through results of range search */
 typedef struct BTreeIterator {
     Pager* pager;
-    uint16_t root_page_id;
-    uint16_t current_page_id;
+    uint32_t root_page_id;
+    uint32_t current_page_id;
     uint8_t current_slot_id;
     uint8_t* start_key;
     uint8_t* end_key;
     size_t key_size;
     int has_range;
+    int readahead_started;     // The window starts on the first leaf next() reads
+    PagerReadahead readahead;  // Sibling leaves and their data pages, prefetched ahead of the scan
 } BTreeIterator;
 
 /* B+ Tree operations */
-DBPage* init_index_internal_page(Pager* pager, uint16_t page_no);
-DBPage* init_index_leaf_page(Pager* pager, uint16_t page_no);
+DBPage* init_index_internal_page(Pager* pager, uint32_t page_no);
+DBPage* init_index_leaf_page(Pager* pager, uint32_t page_no);
 
 /* Manipulating slots - Index */
-uint8_t find_empty_index_slot(Pager* pager, uint16_t page_id, uint64_t key_size);
-void read_index_slot(Pager* pager, uint16_t page_id, uint8_t slot_id, IndexSlotData *slot);
-void write_index_slot(Pager* pager, uint16_t page_id, IndexSlotData *slot);
-void free_index_slot(Pager* pager, uint16_t page_id, uint8_t slot_id);
+uint8_t find_empty_index_slot(Pager* pager, uint32_t page_id, uint64_t key_size);
+void read_index_slot(Pager* pager, uint32_t page_id, uint8_t slot_id, IndexSlotData *slot);
+void write_index_slot(Pager* pager, uint32_t page_id, IndexSlotData *slot);
+void free_index_slot(Pager* pager, uint32_t page_id, uint8_t slot_id);
 
 /* Lexicographic comparison - NULL < INT < TEXT */
 uint64_t encode_int_key(int64_t key);  // Key encoding for lexicographic comparison
 int compare_keys(const uint8_t* key1, const uint8_t* key2, size_t key_size);
 
 /* B+ Tree operations */
-PSqlStatus btree_split_leaf(Pager* pager, uint16_t leaf_page_id, uint16_t* new_page_id);
-PSqlStatus btree_split_internal(Pager* pager, uint16_t internal_page_id, uint16_t* new_page_id);
+PSqlStatus btree_split_leaf(Pager* pager, uint32_t leaf_page_id, uint32_t* new_page_id);
+PSqlStatus btree_split_internal(Pager* pager, uint32_t internal_page_id, uint32_t* new_page_id);
 
-PSqlStatus btree_insert(Pager* pager, uint16_t root_page_id, const uint8_t* key, size_t key_size, uint16_t data_page_id, uint8_t data_slot_id);
+PSqlStatus btree_insert(Pager* pager, uint32_t root_page_id, const uint8_t* key, size_t key_size, uint32_t data_page_id, uint8_t data_slot_id);
 
-void btree_search(Pager* pager, uint16_t root_page_id, const uint8_t* key, size_t key_size, uint16_t* result_page_id, uint8_t* result_slot_id);
+void btree_search(Pager* pager, uint32_t root_page_id, const uint8_t* key, size_t key_size, uint32_t* result_page_id, uint8_t* result_slot_id);
 
-PSqlStatus btree_delete(Pager* pager, uint16_t root_page_id, const uint8_t* key, size_t key_size);
+PSqlStatus btree_delete(Pager* pager, uint32_t root_page_id, const uint8_t* key, size_t key_size);
 
 /* Iterator and range search functions */
-BTreeIterator* btree_iterator_create(Pager* pager, uint16_t root_page_id);
-BTreeIterator* btree_iterator_range(Pager* pager, uint16_t root_page_id, const uint8_t* start_key, const uint8_t* end_key, size_t key_size);
-int btree_iterator_next(BTreeIterator* iterator, uint16_t* data_page_id, uint8_t* data_slot_id);
+BTreeIterator* btree_iterator_create(Pager* pager, uint32_t root_page_id);
+BTreeIterator* btree_iterator_range(Pager* pager, uint32_t root_page_id, const uint8_t* start_key, const uint8_t* end_key, size_t key_size);
+int btree_iterator_next(BTreeIterator* iterator, uint32_t* data_page_id, uint8_t* data_slot_id);
 void btree_iterator_destroy(BTreeIterator* iterator);
 
 #endif 
@@ -0,0 +1,353 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vacuum.h"
+#include "free_space.h"
+#include "pager/pager.h"
+#include "pager/pager_format.h"
+#include "algorithm/radix_tree.h"
+
+/* Pointer map pages hold a PtrmapEntry per page, pointer map page i (in chain order) covering pages
+ * i * PTRMAP_ENTRIES(pager) to (i + 1) * PTRMAP_ENTRIES(pager) - 1. The chain only grows, the page numbers are kept in
+ * pager->ptrmap so finding an entry never walks it.
+ */
+
+// Pointers inside an index slot - the layout read_index_slot() reads, after the key:
+// next_page_id (4 bytes), next_slot_id (1), overflow next_page_id (4), overflow next_chunk_id (2)
+#define SLOT_CHILD_OFFSET 0
+#define SLOT_OVERFLOW_OFFSET 5
+#define SLOT_POINTERS_SIZE 11
+
+// Called with every slot pointer on an index page - pointer may be rewritten in place
+typedef void (*SlotPointerVisit)(uint8_t* pointer, uint8_t type, void* ctx);
+
+static void visit_slot_pointers(Pager* pager, DBPage* page, SlotPointerVisit visit, void* ctx) {
+    if (!(page->header.flag & (PAGE_INDEX_INTERNAL | PAGE_INDEX_LEAF))) return;
+    uint8_t child_type = (page->header.flag & PAGE_INDEX_INTERNAL) ? PTRMAP_BTREE : PTRMAP_DATA;
+
+    size_t usable = PAGER_USABLE_SIZE(pager);
+    if (page->header.free_start + (size_t)page->header.total_slots * sizeof(SlotEntry) > usable) return;
+    const SlotEntry* entries = (const SlotEntry*)(page->data + page->header.free_start);
+    for (uint8_t i = 0; i < page->header.total_slots; i++) {
+        if (entries[i].offset + entries[i].size + SLOT_POINTERS_SIZE > usable) continue;  // Garbage - leave it alone
+        uint8_t* pointers = page->data + entries[i].offset + entries[i].size;
+        visit(pointers + SLOT_CHILD_OFFSET, child_type, ctx);
+        visit(pointers + SLOT_OVERFLOW_OFFSET, PTRMAP_OVERFLOW, ctx);
+    }
+}
+
+
+/* Pointer map */
+
+static PSqlStatus ensure_coverage(Pager* pager, uint32_t page_no);
+
+// The entry for page_no, with the pointer map page holding it pinned - NULL if the map doesn't reach that far
+static PtrmapEntry* entry_for(Pager* pager, uint32_t page_no, DBPage** ptrmap_page) {
+    uint32_t per_page = PTRMAP_ENTRIES(pager);
+    uint32_t index = page_no / per_page;
+    if (index >= pager->ptrmap.count) return NULL;
+
+    DBPage* page = pager_get_page(pager, pager->ptrmap.pages[index]);
+    if (!page) return NULL;
+    *ptrmap_page = page;
+    return (PtrmapEntry*)page->data + page_no % per_page;
+}
+
+static bool push_ptrmap_page(PointerMap* map, uint32_t page_no) {
+    if (map->count == map->capacity) {
+        uint32_t capacity = map->capacity ? map->capacity * 2 : 8;
+        uint32_t* pages = (uint32_t*)realloc(map->pages, capacity * sizeof(uint32_t));
+        if (!pages) return false;
+        map->pages = pages;
+        map->capacity = capacity;
+    }
+    map->pages[map->count++] = page_no;
+    return true;
+}
+
+// Point the chain at next from holder - the header's ptrmap_first for holder 0, right_sibling_page_id otherwise
+static PSqlStatus set_chain_link(Pager* pager, uint32_t holder, uint32_t next) {
+    if (holder == 0) {
+        pager->header.ptrmap_first = next;
+        pager->header_dirty = true;
+        return PSQL_OK;
+    }
+    DBPage* page = pager_get_page(pager, holder);
+    if (!page) return PSQL_ERROR;
+
+    page->header.right_sibling_page_id = next;
+    pager_write_page(pager, page);
+    pager_unpin_page(pager, page);
+    return PSQL_OK;
+}
+
+// Add a pointer map page to the end of the chain - it is a free page, or a new one at the end of the file
+static PSqlStatus add_ptrmap_page(Pager* pager) {
+    uint32_t page_no = get_free_page(pager);
+    if (page_no == 0) return PSQL_FULL;
+    mark_page_used(pager, page_no);
+
+    DBPage* page = pager_get_page(pager, page_no);
+    if (!page) return PSQL_ERROR;
+    uint8_t pinned = page->header.flag & PAGE_PINNED;  // Keep the pin across the wipe like allocate_page()
+    memset(page, 0, pager->db_pager.page_size);
+    page->header.page_id = page_no;
+    page->header.flag = pinned;
+    pager_write_page(pager, page);
+    pager_unpin_page(pager, page);
+
+    uint32_t prev = pager->ptrmap.count ? pager->ptrmap.pages[pager->ptrmap.count - 1] : 0;
+    if (!push_ptrmap_page(&pager->ptrmap, page_no)) return PSQL_NOMEM;
+    PSqlStatus status = set_chain_link(pager, prev, page_no);
+    if (status != PSQL_OK) return status;
+
+    // The new page may cover itself, or the map may still be short of it
+    status = ensure_coverage(pager, page_no);
+    if (status != PSQL_OK) return status;
+    return ptrmap_put(pager, page_no, PTRMAP_PTRMAP, 0, prev);
+}
+
+static PSqlStatus ensure_coverage(Pager* pager, uint32_t page_no) {
+    while (page_no / PTRMAP_ENTRIES(pager) >= pager->ptrmap.count) {
+        PSqlStatus status = add_ptrmap_page(pager);
+        if (status != PSQL_OK) return status;
+    }
+    return PSQL_OK;
+}
+
+PSqlStatus ptrmap_load(Pager* pager) {
+    pager->ptrmap.count = 0;
+    if (pager->vacuum_mode == VACUUM_NONE) return PSQL_OK;
+
+    uint32_t page_no = pager->header.ptrmap_first;
+
+    // A chain longer than the file is a loop
+    uint32_t page_count = pager->db_pager.page_count;
+    while (page_no && page_no < page_count && pager->ptrmap.count < page_count) {
+        if (!push_ptrmap_page(&pager->ptrmap, page_no)) return PSQL_NOMEM;
+        DBPage* page = pager_get_page(pager, page_no);
+        if (!page) return PSQL_ERROR;
+        page_no = page->header.right_sibling_page_id;
+        pager_unpin_page(pager, page);
+    }
+    return PSQL_OK;
+}
+
+void ptrmap_free(Pager* pager) {
+    free(pager->ptrmap.pages);
+    pager->ptrmap.pages = NULL;
+    pager->ptrmap.count = 0;
+    pager->ptrmap.capacity = 0;
+}
+
+PSqlStatus ptrmap_put(Pager* pager, uint32_t page_no, uint8_t type, uint32_t parent, uint32_t prev) {
+    if (pager->vacuum_mode == VACUUM_NONE) return PSQL_OK;
+    PSqlStatus status = ensure_coverage(pager, page_no);
+    if (status != PSQL_OK) return status;
+
+    DBPage* ptrmap_page;
+    PtrmapEntry* entry = entry_for(pager, page_no, &ptrmap_page);
+    if (!entry) return PSQL_ERROR;
+    entry->type = type;
+    entry->parent = parent;
+    entry->prev = prev;
+    pager_write_page(pager, ptrmap_page);
+    pager_unpin_page(pager, ptrmap_page);
+    return PSQL_OK;
+}
+
+// Pages past the end of the map read as PTRMAP_NONE
+PSqlStatus ptrmap_get(Pager* pager, uint32_t page_no, PtrmapEntry* entry) {
+    memset(entry, 0, sizeof(*entry));
+    if (pager->vacuum_mode == VACUUM_NONE) return PSQL_OK;
+
+    DBPage* ptrmap_page;
+    PtrmapEntry* stored = entry_for(pager, page_no, &ptrmap_page);
+    if (!stored) return PSQL_OK;
+    *entry = *stored;
+    pager_unpin_page(pager, ptrmap_page);
+    return PSQL_OK;
+}
+
+typedef struct {
+    Pager* pager;
+    uint32_t parent;
+    PSqlStatus status;
+} ChildUpdate;
+
+static void set_child_parent(uint8_t* pointer, uint8_t type, void* ctx) {
+    ChildUpdate* update = (ChildUpdate*)ctx;
+    uint32_t child;
+    memcpy(&child, pointer, sizeof(child));
+    if (child == 0 || child >= update->pager->db_pager.page_count || update->status != PSQL_OK) return;
+
+    // A root that got a parent (the old root after a root split) is just another page under it now
+    PtrmapEntry entry;
+    ptrmap_get(update->pager, child, &entry);
+    update->status = ptrmap_put(update->pager, child, type, update->parent, entry.prev);
+}
+
+PSqlStatus ptrmap_update_children(Pager* pager, uint32_t page_no) {
+    if (pager->vacuum_mode == VACUUM_NONE) return PSQL_OK;
+
+    DBPage* page = pager_get_page(pager, page_no);
+    if (!page) return PSQL_ERROR;
+
+    ChildUpdate update = { pager, page_no, PSQL_OK };
+    visit_slot_pointers(pager, page, set_child_parent, &update);
+    uint32_t sibling = page->header.right_sibling_page_id;
+    pager_unpin_page(pager, page);
+    if (update.status != PSQL_OK) return update.status;
+
+    // The right sibling keeps its type and parent
+    if (sibling == 0 || sibling >= pager->db_pager.page_count) return PSQL_OK;
+    PtrmapEntry entry;
+    ptrmap_get(pager, sibling, &entry);
+    return ptrmap_put(pager, sibling, entry.type, entry.parent, page_no);
+}
+
+
+/* Relocation */
+
+typedef struct {
+    uint32_t from;
+    uint32_t to;
+    uint32_t count;
+} PointerRewrite;
+
+static void rewrite_pointer(uint8_t* pointer, uint8_t type, void* ctx) {
+    (void)type;
+    PointerRewrite* rewrite = (PointerRewrite*)ctx;
+    uint32_t page_no;
+    memcpy(&page_no, pointer, sizeof(page_no));
+    if (page_no != rewrite->from) return;
+    memcpy(pointer, &rewrite->to, sizeof(rewrite->to));
+    rewrite->count++;
+}
+
+// Point the slot pointers (or the right sibling) on holder that point at from to to instead - how many there were
+// from == to just counts them
+static uint32_t rewrite_references(Pager* pager, uint32_t holder, uint32_t from, uint32_t to, bool sibling) {
+    if (holder >= pager->db_pager.page_count) return 0;
+    DBPage* page = pager_get_page(pager, holder);
+    if (!page) return 0;
+
+    PointerRewrite rewrite = { from, to, 0 };
+    if (sibling) {
+        if (page->header.right_sibling_page_id == from) {
+            page->header.right_sibling_page_id = to;
+            rewrite.count = 1;
+        }
+    } else {
+        visit_slot_pointers(pager, page, rewrite_pointer, &rewrite);
+    }
+    if (rewrite.count && from != to) pager_write_page(pager, page);
+    pager_unpin_page(pager, page);
+    return rewrite.count;
+}
+
+// Whether every pointer to page_no is known - a stale entry stops the vacuum rather than leave a dangling pointer
+static bool can_relocate(Pager* pager, uint32_t page_no, const PtrmapEntry* entry) {
+    switch (entry->type) {
+        case PTRMAP_PTRMAP:
+            return true;  // The directory and the chain are the only references
+        case PTRMAP_DATA: {
+            // Rows of a data page can hang off several leaves, and the map only remembers one
+            DBPage* page = pager_get_page(pager, page_no);
+            if (!page) return false;
+            bool shared = page->header.ref_counter > 1;
+            pager_unpin_page(pager, page);
+            if (shared) return false;
+            break;
+        }
+        case PTRMAP_BTREE:
+        case PTRMAP_OVERFLOW:
+            break;
+        default:
+            return false;
+    }
+    if (entry->parent == 0 || rewrite_references(pager, entry->parent, page_no, page_no, false) == 0) return false;
+    if (entry->prev && rewrite_references(pager, entry->prev, page_no, page_no, true) == 0) return false;
+    return true;
+}
+
+// Move page from into the free page to and repoint everything at it
+static PSqlStatus relocate_page(Pager* pager, uint32_t from, uint32_t to, const PtrmapEntry* entry) {
+    mark_page_used(pager, to);
+
+    DBPage* source = pager_get_page(pager, from);
+    if (!source) return PSQL_ERROR;
+    DBPage* target = pager_get_page(pager, to);
+    if (!target) {
+        pager_unpin_page(pager, source);
+        return PSQL_ERROR;
+    }
+    uint8_t pinned = target->header.flag & PAGE_PINNED;  // Both frames are pinned right now - the bit is the frame's, not the page's
+    memcpy(target, source, pager->db_pager.page_size);
+    target->header.flag = (uint8_t)((target->header.flag & ~PAGE_PINNED) | pinned);
+    target->header.page_id = to;
+    pager_write_page(pager, target);
+    pager_unpin_page(pager, target);
+    pager_unpin_page(pager, source);
+
+    PSqlStatus status = PSQL_OK;
+    if (entry->type == PTRMAP_PTRMAP) {
+        // Directory first, so the entries below land on the page in its new place
+        for (uint32_t i = 0; i < pager->ptrmap.count; i++) {
+            if (pager->ptrmap.pages[i] == from) pager->ptrmap.pages[i] = to;
+        }
+        status = set_chain_link(pager, entry->prev, to);
+    } else {
+        rewrite_references(pager, entry->parent, from, to, false);
+        if (entry->prev) rewrite_references(pager, entry->prev, from, to, true);
+    }
+    if (status != PSQL_OK) return status;
+
+    status = ptrmap_put(pager, to, entry->type, entry->parent, entry->prev);
+    if (status != PSQL_OK) return status;
+    status = ptrmap_put(pager, from, PTRMAP_NONE, 0, 0);
+    if (status != PSQL_OK) return status;
+    return ptrmap_update_children(pager, to);
+}
+
+PSqlStatus vacuum_run(Pager* pager, uint32_t max_pages, uint32_t* truncated) {
+    *truncated = 0;
+    if (pager->vacuum_mode == VACUUM_NONE || pager->read_only) return PSQL_OK;
+
+    PageTracker* map = pager->db_pager.free_page_map;
+    uint32_t removed = 0;
+    while (removed < max_pages) {
+        uint32_t last = pager->db_pager.page_count - 1;
+        if (last < DB_CATALOG_PAGES) break;
+
+        if (radix_tree_lookup(&map->tree, last)) {
+            mark_page_used(pager, last);  // Free already - it just stops being a page
+        } else {
+            // Only ever move a page down, into the lowest hole
+            uint32_t hole = radix_tree_peek_min(&map->tree);
+            if (map->num_frees == 0 || hole == 0 || hole >= last) break;
+
+            PtrmapEntry entry;
+            ptrmap_get(pager, last, &entry);
+            if (!can_relocate(pager, last, &entry)) break;
+
+            PSqlStatus status = relocate_page(pager, last, hole, &entry);
+            if (status != PSQL_OK) return status;
+            pager->io_stats.pages_relocated++;
+        }
+        pager->db_pager.page_count--;
+        removed++;
+    }
+    if (removed == 0) return PSQL_OK;
+
+    if (pager->header.highest_page >= pager->db_pager.page_count) {
+        pager->header.highest_page = pager->db_pager.page_count - 1;
+        pager->header_dirty = true;
+    }
+
+    pager->io_stats.pages_truncated += removed;
+    pager->truncate_pending = true;
+    *truncated = removed;
+    return PSQL_OK;
+}
@@ -0,0 +1,51 @@
+/* Auto-vacuum - shrinking the file by moving pages from its end into free pages lower down
+ *
+ * Moving a page means rewriting every pointer to it, so a DB created with a vacuum mode (PAGER_AUTO_VACUUM or
+ * PAGER_INCREMENTAL_VACUUM) keeps a pointer map, like SQLite's: for every page, what kind of page it is, the page that points
+ * at it (B+ Tree parent, leaf for a data page, ...) and the page whose right_sibling_page_id points at it.
+ * Pointer map pages are ordinary pages chained from the header (ptrmap_first, then right_sibling_page_id) - they can be
+ * moved like anything else, and allocating a run of pages never has to step around them.
+ *
+ * Whoever links pages together keeps the map up to date - ptrmap_put() for a new page, ptrmap_update_children() after
+ * changing the pointers on a page. A page with no known parent (a B+ Tree root, whose pointer lives in the catalog) is never
+ * moved, and vacuum stops at it - the file is cut down to the highest page it can't move.
+ */
+
+#ifndef PRESEQL_PAGER_DB_VACUUM_H
+#define PRESEQL_PAGER_DB_VACUUM_H
+
+#include <stdint.h>
+#include "pager/types.h"
+#include "status/db.h"
+
+typedef enum {
+    PTRMAP_NONE = 0,   // No entry - free, or never linked
+    PTRMAP_ROOT,       // B+ Tree root or catalog page - pointed at from outside the page tree, never moved
+    PTRMAP_BTREE,      // Index page under an internal page
+    PTRMAP_DATA,       // Data page under a leaf slot
+    PTRMAP_OVERFLOW,   // Overflow page under a slot's overflow pointer
+    PTRMAP_PTRMAP,     // Pointer map page - prev is the previous one in the chain, 0 for the header
+} PtrmapType;
+
+typedef struct {
+    uint8_t type;      // PtrmapType
+    uint8_t unused[3];
+    uint32_t parent;   // Page holding a slot pointer to this page, 0 if none
+    uint32_t prev;     // Page whose right_sibling_page_id is this page, 0 if none
+} PtrmapEntry;
+
+#define PTRMAP_ENTRIES(pager) (PAGER_USABLE_SIZE(pager) / sizeof(PtrmapEntry))  // 336 with 4KB pages
+
+/* Pointer map - all no-ops returning PSQL_OK without a vacuum mode */
+PSqlStatus ptrmap_load(Pager* pager);
+void ptrmap_free(Pager* pager);
+PSqlStatus ptrmap_put(Pager* pager, uint32_t page_no, uint8_t type, uint32_t parent, uint32_t prev);
+PSqlStatus ptrmap_get(Pager* pager, uint32_t page_no, PtrmapEntry* entry);
+// Point the entries of every page page_no links to (slot pointers, right sibling) back at page_no
+PSqlStatus ptrmap_update_children(Pager* pager, uint32_t page_no);
+
+/* Move up to max_pages pages off the end of the file and drop free pages there, lowering page_count
+ * The file itself is truncated once the commit carrying the moves is durable. *truncated is how far page_count came down */
+PSqlStatus vacuum_run(Pager* pager, uint32_t max_pages, uint32_t* truncated);
+
+#endif /* PRESEQL_PAGER_DB_VACUUM_H */
@@ -0,0 +1,421 @@
+#define _GNU_SOURCE  /* fsync under -std=c99 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "vacuum_into.h"
+#include "vacuum.h"
+#include "free_space.h"
+#include "pager/pager.h"
+#include "pager/pager_format.h"
+#include "pager/file_io.h"
+#include "algorithm/bitmap.h"
+#include "algorithm/radix_tree.h"
+
+#define IS_INDEX(flag) ((flag) & (PAGE_INDEX_INTERNAL | PAGE_INDEX_LEAF))
+#define IS_COPYABLE(flag) ((flag) & (PAGE_DATA | PAGE_OVERFLOW))
+
+// One index slot, unpacked - the layout write_index_slot() writes
+typedef struct {
+    uint8_t key[MAX_DATA_PER_INDEX_SLOT];
+    uint32_t child;           // Data page under a leaf, index page under an internal page
+    uint8_t child_slot;
+    uint32_t overflow;
+    uint16_t overflow_chunk;
+} RebuildEntry;
+
+typedef struct {
+    Pager* source;
+    Pager* dest;
+    uint32_t page_count;   // Of the source
+    uint8_t* flags;        // Page flag of every source page in use, 0 for free ones and pointer map pages
+    Bitmap referenced;     // Pointed at by an index slot - what isn't is a root, or sits where it is
+    Bitmap visited;        // Index pages walked already - a loop in a corrupt tree ends there
+    uint32_t* moved;       // Source page -> its page in dest, 0 until copied
+    RebuildEntry* entries; // Leaf slots of the tree being rebuilt, in key order
+    size_t count;
+    size_t capacity;
+} Rebuild;
+
+// Slots per node - as many as an insert fills a page with before it splits, and no more than total_slots counts
+static uint32_t node_capacity(Pager* pager) {
+    uint32_t capacity = (uint32_t)((PAGER_USABLE_SIZE(pager) * INDEX_FULL_OCCUPANCY - sizeof(DBPageHeader)) /
+                                   (INDEX_SLOT_DATA_SIZE + SLOT_ENTRY_SIZE));
+    return capacity < UINT8_MAX ? capacity : UINT8_MAX;
+}
+
+// Slots in directory (key) order - a slot that runs off the page is garbage and skipped
+static uint32_t read_slots(Pager* pager, const DBPage* page, RebuildEntry* out) {
+    size_t usable = PAGER_USABLE_SIZE(pager);
+    if (page->header.free_start + (size_t)page->header.total_slots * sizeof(SlotEntry) > usable) return 0;
+
+    const SlotEntry* directory = (const SlotEntry*)(page->data + page->header.free_start);
+    uint32_t count = 0;
+    for (uint8_t i = 0; i < page->header.total_slots; i++) {
+        if (directory[i].size > MAX_DATA_PER_INDEX_SLOT || directory[i].offset + directory[i].size + 11 > usable) continue;
+        const uint8_t* slot = page->data + directory[i].offset;
+        RebuildEntry* entry = &out[count++];
+        memset(entry, 0, sizeof(*entry));
+        memcpy(entry->key, slot, directory[i].size);
+        slot += directory[i].size;
+        memcpy(&entry->child, slot, sizeof(entry->child));
+        entry->child_slot = slot[4];
+        memcpy(&entry->overflow, slot + 5, sizeof(entry->overflow));
+        memcpy(&entry->overflow_chunk, slot + 9, sizeof(entry->overflow_chunk));
+    }
+    return count;
+}
+
+// Fill an empty index page the way write_index_slot() would, one slot after the other - the entries are already sorted
+static void write_slots(Pager* pager, DBPage* page, const RebuildEntry* entries, uint32_t count) {
+    SlotEntry* directory = (SlotEntry*)(page->data + page->header.free_start);
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t offset = page->header.free_end - INDEX_SLOT_DATA_SIZE;
+        uint8_t* slot = page->data + offset;
+        memcpy(slot, entries[i].key, MAX_DATA_PER_INDEX_SLOT);
+        memcpy(slot + MAX_DATA_PER_INDEX_SLOT, &entries[i].child, sizeof(entries[i].child));
+        slot[MAX_DATA_PER_INDEX_SLOT + 4] = entries[i].child_slot;
+        memcpy(slot + MAX_DATA_PER_INDEX_SLOT + 5, &entries[i].overflow, sizeof(entries[i].overflow));
+        memcpy(slot + MAX_DATA_PER_INDEX_SLOT + 9, &entries[i].overflow_chunk, sizeof(entries[i].overflow_chunk));
+
+        directory[i].slot_id = (uint8_t)(i + 1);  // Slot ids start at 1 like find_empty_index_slot() hands them out
+        directory[i].offset = offset;
+        directory[i].size = MAX_DATA_PER_INDEX_SLOT;
+        page->header.free_end = offset;
+        page->header.free_total -= (INDEX_SLOT_DATA_SIZE + SLOT_ENTRY_SIZE);
+    }
+    page->header.total_slots = (uint8_t)count;
+    page->header.highest_slot = (uint8_t)count;
+    pager_write_page(pager, page);
+}
+
+
+/* Analysis - which source pages are in use, and which of them something points at */
+
+// slots has room for a full page of them
+static PSqlStatus scan_source(Rebuild* rebuild, RebuildEntry* slots) {
+    Pager* source = rebuild->source;
+    PageTracker* free_map = source->db_pager.free_page_map;
+    for (uint32_t page_no = 1; page_no < rebuild->page_count; page_no++) {
+        if (radix_tree_lookup(&free_map->tree, page_no)) continue;
+        DBPage* page = pager_get_page(source, page_no);
+        if (!page) return PSQL_IOERR;
+
+        // Pointer map pages and pages handed out but never initialized carry no type - there's nothing in them to keep
+        uint8_t flag = page->header.flag & ~(PAGE_PINNED | PAGE_DIRTY);
+        if ((flag & PAGE_FREE) || !(IS_INDEX(flag) || IS_COPYABLE(flag))) flag = 0;
+        rebuild->flags[page_no] = flag;
+
+        if (IS_INDEX(flag)) {
+            uint32_t count = read_slots(source, page, slots);
+            for (uint32_t i = 0; i < count; i++) {
+                if (slots[i].child < rebuild->page_count) bitmap_set(&rebuild->referenced, slots[i].child);
+                if (slots[i].overflow < rebuild->page_count) bitmap_set(&rebuild->referenced, slots[i].overflow);
+            }
+        }
+        pager_unpin_page(source, page);
+    }
+    return PSQL_OK;
+}
+
+static bool is_ptrmap_page(const Pager* pager, uint32_t page_no) {
+    for (uint32_t i = 0; i < pager->ptrmap.count; i++) {
+        if (pager->ptrmap.pages[i] == page_no) return true;
+    }
+    return false;
+}
+
+static bool is_fixed(const Rebuild* rebuild, uint32_t page_no) {
+    return rebuild->flags[page_no] && !bitmap_test(&rebuild->referenced, page_no);
+}
+
+
+/* Copying */
+
+// Copy a source page into page dest_no of dest as is - only the page id changes
+static PSqlStatus copy_page(Rebuild* rebuild, uint32_t page_no, uint32_t dest_no) {
+    DBPage* from = pager_get_page(rebuild->source, page_no);
+    if (!from) return PSQL_IOERR;
+    DBPage* to = pager_get_page(rebuild->dest, dest_no);
+    if (!to) {
+        pager_unpin_page(rebuild->source, from);
+        return PSQL_IOERR;
+    }
+    uint8_t pinned = to->header.flag & PAGE_PINNED;  // The pin bits belong to the frames, not the pages
+    memcpy(to, from, rebuild->dest->db_pager.page_size);
+    to->header.flag = (uint8_t)((from->header.flag & ~PAGE_PINNED) | pinned);
+    to->header.page_id = dest_no;
+    pager_write_page(rebuild->dest, to);
+    pager_unpin_page(rebuild->dest, to);
+    pager_unpin_page(rebuild->source, from);
+
+    mark_page_used(rebuild->dest, dest_no);
+    rebuild->moved[page_no] = dest_no;
+    return PSQL_OK;
+}
+
+// Where a slot pointer goes in dest - a data or overflow page is copied on its first reference, right behind the pages
+// copied so far. Pointers to anything else are dropped rather than left pointing at some other page of the new file
+static PSqlStatus remap_pointer(Rebuild* rebuild, uint32_t* page_no) {
+    if (*page_no == 0 || *page_no >= rebuild->page_count || !IS_COPYABLE(rebuild->flags[*page_no])) {
+        *page_no = 0;
+        return PSQL_OK;
+    }
+    if (!rebuild->moved[*page_no]) {
+        uint32_t dest_no = get_free_page(rebuild->dest);
+        if (dest_no == 0) return PSQL_FULL;
+        PSqlStatus status = copy_page(rebuild, *page_no, dest_no);
+        if (status != PSQL_OK) return status;
+    }
+    *page_no = rebuild->moved[*page_no];
+    return PSQL_OK;
+}
+
+// In-order walk from page_no, appending the slots of every leaf under it
+static PSqlStatus collect_entries(Rebuild* rebuild, uint32_t page_no) {
+    if (page_no == 0 || page_no >= rebuild->page_count || !IS_INDEX(rebuild->flags[page_no])) return PSQL_OK;
+    if (bitmap_test(&rebuild->visited, page_no)) return PSQL_OK;
+    bitmap_set(&rebuild->visited, page_no);
+
+    DBPage* page = pager_get_page(rebuild->source, page_no);
+    if (!page) return PSQL_IOERR;
+    bool leaf = page->header.flag & PAGE_INDEX_LEAF;
+    uint8_t total_slots = page->header.total_slots;
+
+    // Leaf slots go straight onto the list, the children of an internal page are walked once the page is unpinned
+    if (rebuild->count + total_slots > rebuild->capacity) {
+        size_t capacity = rebuild->capacity ? rebuild->capacity * 2 : 1024;
+        while (capacity < rebuild->count + total_slots) capacity *= 2;
+        RebuildEntry* entries = (RebuildEntry*)realloc(rebuild->entries, capacity * sizeof(RebuildEntry));
+        if (!entries) {
+            pager_unpin_page(rebuild->source, page);
+            return PSQL_NOMEM;
+        }
+        rebuild->entries = entries;
+        rebuild->capacity = capacity;
+    }
+    uint32_t count = read_slots(rebuild->source, page, rebuild->entries + rebuild->count);
+    pager_unpin_page(rebuild->source, page);
+    if (leaf) {
+        rebuild->count += count;
+        return PSQL_OK;
+    }
+
+    uint32_t children[UINT8_MAX];
+    for (uint32_t i = 0; i < count; i++) children[i] = rebuild->entries[rebuild->count + i].child;
+    for (uint32_t i = 0; i < count; i++) {
+        PSqlStatus status = collect_entries(rebuild, children[i]);
+        if (status != PSQL_OK) return status;
+    }
+    return PSQL_OK;
+}
+
+// A fresh index page at page_no of dest filled with entries - the root keeps its PTRMAP_ROOT entry
+static PSqlStatus write_node(Rebuild* rebuild, uint32_t page_no, uint8_t flag, const RebuildEntry* entries, uint32_t count, bool root) {
+    DBPage* page = (flag & PAGE_INDEX_LEAF) ? init_index_leaf_page(rebuild->dest, page_no) : init_index_internal_page(rebuild->dest, page_no);
+    if (!page) return PSQL_IOERR;
+    write_slots(rebuild->dest, page, entries, count);
+    pager_unpin_page(rebuild->dest, page);
+    if (root && ptrmap_put(rebuild->dest, page_no, PTRMAP_ROOT, 0, 0) != PSQL_OK) return PSQL_ERROR;
+    return ptrmap_update_children(rebuild->dest, page_no);
+}
+
+static PSqlStatus set_right_sibling(Pager* pager, uint32_t page_no, uint32_t sibling) {
+    DBPage* page = pager_get_page(pager, page_no);
+    if (!page) return PSQL_IOERR;
+    page->header.right_sibling_page_id = sibling;
+    pager_write_page(pager, page);
+    pager_unpin_page(pager, page);
+    return ptrmap_update_children(pager, page_no);
+}
+
+// Rebuild the tree under root - leaves with their data pages behind them, then each level above, the top one at root
+static PSqlStatus rebuild_tree(Rebuild* rebuild, uint32_t root) {
+    rebuild->count = 0;
+    PSqlStatus status = collect_entries(rebuild, root);
+    if (status != PSQL_OK) return status;
+
+    uint8_t root_flag = rebuild->flags[root] & (PAGE_INDEX_INTERNAL | PAGE_INDEX_LEAF);
+    uint32_t per_node = node_capacity(rebuild->dest);
+    RebuildEntry* entries = rebuild->entries;
+    size_t count = rebuild->count;
+
+    // Small enough for a leaf root to stay a leaf - this is also an empty tree
+    if ((root_flag & PAGE_INDEX_LEAF) && count <= per_node) {
+        for (size_t i = 0; i < count; i++) {
+            if ((status = remap_pointer(rebuild, &entries[i].child)) != PSQL_OK) return status;
+            if ((status = remap_pointer(rebuild, &entries[i].overflow)) != PSQL_OK) return status;
+        }
+        return write_node(rebuild, root, PAGE_INDEX_LEAF, entries, (uint32_t)count, true);
+    }
+    if (count == 0) return write_node(rebuild, root, root_flag, NULL, 0, true);
+
+    // Leaves, each right in front of its data pages. The list is rewritten in place into (first key, leaf) pairs
+    // for the level above - a leaf's entry always lands at or before the first of its own slots
+    size_t nodes = 0;
+    uint32_t prev_leaf = 0;
+    for (size_t first = 0; first < count; first += per_node) {
+        uint32_t slots = count - first < per_node ? (uint32_t)(count - first) : per_node;
+        uint32_t leaf_no = get_free_page(rebuild->dest);
+        if (leaf_no == 0) return PSQL_FULL;
+        for (uint32_t i = 0; i < slots; i++) {
+            if ((status = remap_pointer(rebuild, &entries[first + i].child)) != PSQL_OK) return status;
+            if ((status = remap_pointer(rebuild, &entries[first + i].overflow)) != PSQL_OK) return status;
+        }
+        if ((status = write_node(rebuild, leaf_no, PAGE_INDEX_LEAF, entries + first, slots, false)) != PSQL_OK) return status;
+        if (prev_leaf && (status = set_right_sibling(rebuild->dest, prev_leaf, leaf_no)) != PSQL_OK) return status;
+        prev_leaf = leaf_no;
+
+        RebuildEntry* parent = &entries[nodes++];
+        memmove(parent->key, entries[first].key, MAX_DATA_PER_INDEX_SLOT);
+        parent->child = leaf_no;
+        parent->child_slot = 0;
+        parent->overflow = 0;
+        parent->overflow_chunk = 0;
+    }
+
+    // Internal levels - the same in-place trick, until one node holds the whole level
+    while (nodes > per_node) {
+        size_t parents = 0;
+        for (size_t first = 0; first < nodes; first += per_node) {
+            uint32_t slots = nodes - first < per_node ? (uint32_t)(nodes - first) : per_node;
+            uint32_t node_no = get_free_page(rebuild->dest);
+            if (node_no == 0) return PSQL_FULL;
+            if ((status = write_node(rebuild, node_no, PAGE_INDEX_INTERNAL, entries + first, slots, false)) != PSQL_OK) return status;
+
+            RebuildEntry* parent = &entries[parents++];
+            memmove(parent->key, entries[first].key, MAX_DATA_PER_INDEX_SLOT);
+            parent->child = node_no;
+        }
+        nodes = parents;
+    }
+    return write_node(rebuild, root, PAGE_INDEX_INTERNAL, entries, (uint32_t)nodes, true);
+}
+
+PSqlStatus vacuum_into_rebuild(Pager* source, Pager* dest) {
+    if (source->db_pager.page_size != dest->db_pager.page_size) return PSQL_MISUSE;
+
+    Rebuild rebuild;
+    memset(&rebuild, 0, sizeof(rebuild));
+    rebuild.source = source;
+    rebuild.dest = dest;
+    rebuild.page_count = source->db_pager.page_count;
+    rebuild.flags = (uint8_t*)calloc(rebuild.page_count, sizeof(uint8_t));
+    rebuild.moved = (uint32_t*)calloc(rebuild.page_count, sizeof(uint32_t));
+    RebuildEntry* slots = (RebuildEntry*)malloc(UINT8_MAX * sizeof(RebuildEntry));
+    PSqlStatus status = PSQL_NOMEM;
+    if (!rebuild.flags || !rebuild.moved || !slots || !bitmap_init(&rebuild.referenced, rebuild.page_count) ||
+        !bitmap_init(&rebuild.visited, rebuild.page_count)) {
+        goto done;
+    }
+
+    status = scan_source(&rebuild, slots);
+    if (status != PSQL_OK) goto done;
+
+    // Fixed pages keep their numbers, so dest has to reach the highest of them first
+    uint32_t dest_count = dest->db_pager.page_count;
+    uint32_t highest_fixed = 0;
+    for (uint32_t page_no = 1; page_no < rebuild.page_count; page_no++) {
+        if (!is_fixed(&rebuild, page_no)) continue;
+        if (is_ptrmap_page(dest, page_no)) {
+            // The source had its own pointer map page there, unless it is corrupt
+            fprintf(stderr, "VACUUM INTO: page %u can't keep its page number\n", page_no);
+            status = PSQL_CORRUPT;
+            goto done;
+        }
+        highest_fixed = page_no;
+    }
+    if (highest_fixed >= dest_count && allocate_new_db_pages(dest, highest_fixed + 1 - dest_count) == 0) {
+        status = PSQL_FULL;
+        goto done;
+    }
+
+    // Every other page number below that is a hole for the rebuilt pages to fill, lowest first - so is the page a fresh
+    // DB hands out past the catalog and never uses. The free list is a stack, so they go on highest first
+    for (uint32_t page_no = dest->db_pager.page_count - 1; page_no >= DB_CATALOG_PAGES; page_no--) {
+        bool fixed = page_no < rebuild.page_count && is_fixed(&rebuild, page_no);
+        if (!fixed && !is_ptrmap_page(dest, page_no)) mark_page_free(dest, page_no);
+    }
+
+    // Pages no index slot points at that aren't trees themselves go over as they are
+    for (uint32_t page_no = 1; page_no < rebuild.page_count && status == PSQL_OK; page_no++) {
+        if (!is_fixed(&rebuild, page_no) || IS_INDEX(rebuild.flags[page_no])) continue;
+        status = copy_page(&rebuild, page_no, page_no);
+        uint8_t type = (rebuild.flags[page_no] & PAGE_OVERFLOW) ? PTRMAP_OVERFLOW : PTRMAP_DATA;
+        if (status == PSQL_OK) status = ptrmap_put(dest, page_no, type, 0, 0);
+    }
+
+    // Then every tree, in root order
+    for (uint32_t page_no = 1; page_no < rebuild.page_count && status == PSQL_OK; page_no++) {
+        if (is_fixed(&rebuild, page_no) && IS_INDEX(rebuild.flags[page_no])) status = rebuild_tree(&rebuild, page_no);
+    }
+
+done:
+    bitmap_free(&rebuild.referenced);
+    bitmap_free(&rebuild.visited);
+    free(rebuild.entries);
+    free(rebuild.moved);
+    free(rebuild.flags);
+    free(slots);
+    return status;
+}
+
+
+/* Building the new file */
+
+// The close trims the file after its last sync - one more so the size is durable before the rename makes it visible
+static PSqlStatus sync_file(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        return PSQL_IOERR;
+    }
+    int rc = fsync(fd);
+    if (rc != 0) perror("fsync");
+    close(fd);
+    return rc == 0 ? PSQL_OK : PSQL_IOERR;
+}
+
+PSqlStatus vacuum_into(Pager* pager, const char* path) {
+    char* tmp_filename = with_extension(path, VACUUM_INTO_FILE_EXTENSION);
+    char* tmp_journal = with_extension(path, VACUUM_INTO_FILE_EXTENSION JOURNAL_FILE_EXTENSION);
+    char* wal_filename = with_extension(path, WAL_FILE_EXTENSION);
+    PSqlStatus status = PSQL_NOMEM;
+    if (!tmp_filename || !tmp_journal || !wal_filename) goto done;
+
+    // Same page size, checksums and vacuum mode as the source - only the layout changes
+    int flags = PAGER_WRITEABLE | PAGER_OVERWRITE;
+    if (pager->page_checksums) flags |= PAGER_PAGE_CHECKSUMS;
+    if (pager->vacuum_mode == VACUUM_FULL) flags |= PAGER_AUTO_VACUUM;
+    if (pager->vacuum_mode == VACUUM_INCREMENTAL) flags |= PAGER_INCREMENTAL_VACUUM;
+    Pager* dest = init_pager_with_page_size(tmp_filename, flags, pager->db_pager.page_size);
+    if (!dest) {
+        status = PSQL_IOERR;
+        goto done;
+    }
+    status = pager_init_new_db(dest);
+    if (status == PSQL_OK) status = vacuum_into_rebuild(pager, dest);
+    PSqlStatus closed = pager_close_db(dest);  // Flushes and syncs everything
+    if (status == PSQL_OK) status = closed;
+    unlink(tmp_journal);
+    if (status == PSQL_OK) status = sync_file(tmp_filename);
+    if (status != PSQL_OK) goto done;
+
+    // A WAL left over from whatever was at path would replay onto the new file
+    unlink(wal_filename);
+    if (rename(tmp_filename, path) != 0) {
+        perror("rename");
+        status = PSQL_IOERR;
+        goto done;
+    }
+    status = sync_parent_dir(path);
+
+done:
+    if (status != PSQL_OK && tmp_filename) unlink(tmp_filename);
+    free(tmp_filename);
+    free(tmp_journal);
+    free(wal_filename);
+    return status;
+}
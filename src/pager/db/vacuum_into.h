@@ -0,0 +1,31 @@
+/* VACUUM INTO - rebuild the whole database compactly into a new file
+ *
+ * vacuum_page() only compacts the slots of one page, and auto-vacuum (vacuum.h) only moves whole pages down the file.
+ * Neither undoes what splits and deletes leave behind - half-empty leaves, and data pages scattered over the file in the
+ * order they were allocated. VACUUM INTO copies every B+ Tree into a fresh file in key order instead:
+ * - leaves are bulk built, packed to INDEX_FULL_OCCUPANCY - as full as an insert would leave them before splitting
+ * - every leaf is followed by the data and overflow pages its slots point at, in slot order, so a range scan reads the
+ *   new file front to back
+ * - the internal levels are built bottom up once the leaves are done, the top one at the old root's page number
+ *
+ * Roots are the index pages no slot points at - the catalog pages and every table's root. They keep their page numbers, so
+ * whatever points at them from outside the page tree (the header, catalog rows) is still right in the new file. So do pages
+ * nothing points at that aren't index pages. Data pages are copied whole - their slots are not repacked.
+ *
+ * The new file is built under "<path>.pseql-vacuum" and only renamed to path once it is durable, so path holds either
+ * what it held before or the whole new database. The source is only read - readers carry on with it throughout.
+ */
+
+#ifndef PRESEQL_PAGER_DB_VACUUM_INTO_H
+#define PRESEQL_PAGER_DB_VACUUM_INTO_H
+
+#include "pager/types.h"
+#include "status/db.h"
+
+// Copy every tree of source into dest, a DB fresh from pager_init_new_db() with the same page size
+PSqlStatus vacuum_into_rebuild(Pager* source, Pager* dest);
+
+// Build the compacted copy of pager and rename it to path. The caller keeps writers out of pager meanwhile
+PSqlStatus vacuum_into(Pager* pager, const char* path);
+
+#endif /* PRESEQL_PAGER_DB_VACUUM_INTO_H */
@@ -0,0 +1,65 @@
+#define _GNU_SOURCE  /* pread, pwrite, strdup under -std=c99 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <libgen.h>
+
+#include "file_io.h"
+
+PSqlStatus pwrite_all(int fd, const void* buf, size_t len, off_t offset) {
+    const uint8_t* p = (const uint8_t*)buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("pwrite");
+            return PSQL_IOERR;
+        }
+        p += n;
+        len -= n;
+        offset += n;
+    }
+    return PSQL_OK;
+}
+
+ssize_t pread_all(int fd, void* buf, size_t len, off_t offset) {
+    uint8_t* p = (uint8_t*)buf;
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, p + done, len - done, offset + done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("pread");
+            return -1;
+        }
+        if (n == 0) break;
+        done += n;
+    }
+    return done;
+}
+
+PSqlStatus sync_parent_dir(const char* filename) {
+    char* path = strdup(filename);  // dirname() may modify its argument
+    if (!path) return PSQL_NOMEM;
+    int fd = open(dirname(path), O_RDONLY);
+    free(path);
+    if (fd < 0) {
+        perror("open");
+        return PSQL_IOERR;
+    }
+    int rc = fsync(fd);
+    if (rc != 0) perror("fsync");
+    close(fd);
+    return rc == 0 ? PSQL_OK : PSQL_IOERR;
+}
+
+char* with_extension(const char* filename, const char* extension) {
+    size_t len = strlen(filename) + strlen(extension) + 1;
+    char* name = (char*)malloc(len);
+    if (name) snprintf(name, len, "%s%s", filename, extension);
+    return name;
+}
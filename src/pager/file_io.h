@@ -0,0 +1,26 @@
+/* File I/O helpers shared by everything in the pager that writes a file of its own - the WAL, format upgrades,
+ * serialized memory DBs, backups and VACUUM INTO
+ *
+ * Syscall failures are reported with perror() here, callers only get the status.
+ */
+
+#ifndef PRESEQL_PAGER_FILE_IO_H
+#define PRESEQL_PAGER_FILE_IO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "status/db.h"
+
+// Write all of buf at offset, retrying short writes and EINTR
+PSqlStatus pwrite_all(int fd, const void* buf, size_t len, off_t offset);
+
+// Read up to len bytes at offset - returns the bytes read, short only at end of file, -1 on error
+ssize_t pread_all(int fd, void* buf, size_t len, off_t offset);
+
+// fsync() the directory filename is in - makes a rename() or a new file in it durable
+PSqlStatus sync_parent_dir(const char* filename);
+
+// filename with extension appended, malloc()-ed - NULL if out of memory
+char* with_extension(const char* filename, const char* extension);
+
+#endif /* PRESEQL_PAGER_FILE_IO_H */
@@ -0,0 +1,146 @@
+#define _GNU_SOURCE  /* clock_gettime under -std=c99 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "group_commit.h"
+
+struct GroupCommit {
+    GroupCommitSyncFn sync;
+    void* ctx;
+    uint32_t window_us;
+    uint32_t max_batch;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t arrived;  // Leader waits on this for more tickets
+    pthread_cond_t synced;   // Followers wait on this for the flush
+
+    uint64_t issued;         // Last ticket handed out
+    uint64_t durable;        // Every ticket up to this one is synced
+    bool failed;             // A flush failed - after a failed fsync nothing written since can be trusted to be on disk
+    uint32_t active;         // Transactions between group_commit_begin() and group_commit_end()
+    bool syncing;            // A leader is running the flush
+
+    GroupCommitStats stats;
+};
+
+GroupCommit* group_commit_create(GroupCommitSyncFn sync, void* ctx, uint32_t window_us, uint32_t max_batch) {
+    GroupCommit* group = (GroupCommit*)calloc(1, sizeof(GroupCommit));
+    if (!group) return NULL;
+
+    group->sync = sync;
+    group->ctx = ctx;
+    group_commit_configure(group, window_us, max_batch);
+    pthread_mutex_init(&group->mutex, NULL);
+    pthread_cond_init(&group->arrived, NULL);
+    pthread_cond_init(&group->synced, NULL);
+    return group;
+}
+
+void group_commit_destroy(GroupCommit* group) {
+    if (!group) return;
+    pthread_cond_destroy(&group->synced);
+    pthread_cond_destroy(&group->arrived);
+    pthread_mutex_destroy(&group->mutex);
+    free(group);
+}
+
+void group_commit_configure(GroupCommit* group, uint32_t window_us, uint32_t max_batch) {
+    group->window_us = window_us;
+    group->max_batch = max_batch ? max_batch : 1;
+}
+
+void group_commit_begin(GroupCommit* group) {
+    if (!group) return;
+    pthread_mutex_lock(&group->mutex);
+    group->active++;
+    pthread_mutex_unlock(&group->mutex);
+}
+
+void group_commit_end(GroupCommit* group) {
+    if (!group) return;
+    pthread_mutex_lock(&group->mutex);
+    if (group->active) group->active--;
+    pthread_cond_signal(&group->arrived);  // The leader might only be waiting on us
+    pthread_mutex_unlock(&group->mutex);
+}
+
+uint64_t group_commit_enter(GroupCommit* group) {
+    if (!group) return 0;
+    pthread_mutex_lock(&group->mutex);
+    uint64_t ticket = ++group->issued;
+    pthread_cond_signal(&group->arrived);
+    pthread_mutex_unlock(&group->mutex);
+    return ticket;
+}
+
+static struct timespec deadline_after(uint32_t us) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);  // pthread_cond_timedwait() goes by the realtime clock by default
+    ts.tv_sec += us / 1000000;
+    ts.tv_nsec += (long)(us % 1000000) * 1000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    return ts;
+}
+
+// Lead a flush for everything issued so far - called with the mutex held, returns with it held
+static void lead_sync(GroupCommit* group) {
+    group->syncing = true;
+
+    // Hold the door while other transactions are still coming, up to the window or a full batch
+    if (group->window_us && group->active > 0) {
+        struct timespec deadline = deadline_after(group->window_us);
+        while (group->active > 0 && group->issued - group->durable < group->max_batch) {
+            if (pthread_cond_timedwait(&group->arrived, &group->mutex, &deadline) != 0) break;
+        }
+    }
+
+    uint64_t target = group->issued;
+    pthread_mutex_unlock(&group->mutex);
+    PSqlStatus status = group->sync(group->ctx);
+    pthread_mutex_lock(&group->mutex);
+
+    uint64_t batch = target - group->durable;
+    if (status == PSQL_OK) {
+        group->durable = target;
+        group->stats.commits += batch;
+        group->stats.syncs++;
+        if (batch > group->stats.max_batch) group->stats.max_batch = batch;
+    } else {
+        // Sticky - a later fsync can succeed without the pages from this one ever reaching the disk
+        group->failed = true;
+        group->stats.failures++;
+    }
+
+    group->syncing = false;
+    pthread_cond_broadcast(&group->synced);
+}
+
+PSqlStatus group_commit_wait(GroupCommit* group, uint64_t ticket) {
+    if (!group || ticket == 0) return PSQL_OK;
+
+    pthread_mutex_lock(&group->mutex);
+    while (group->durable < ticket && !group->failed) {
+        if (group->syncing) {
+            pthread_cond_wait(&group->synced, &group->mutex);  // Ours might be in the flush running now - or need the next one
+        } else {
+            lead_sync(group);
+        }
+    }
+    PSqlStatus status = group->durable < ticket ? PSQL_IOERR : PSQL_OK;
+    pthread_mutex_unlock(&group->mutex);
+    return status;
+}
+
+GroupCommitStats group_commit_get_stats(GroupCommit* group) {
+    GroupCommitStats stats = { 0 };
+    if (!group) return stats;
+    pthread_mutex_lock(&group->mutex);
+    stats = group->stats;
+    pthread_mutex_unlock(&group->mutex);
+    return stats;
+}
@@ -0,0 +1,42 @@
+/* Group commit - lets transactions committing at about the same time share one durable flush
+ *
+ * A committer gets its writes out first (WAL frames, write back of its pages), takes a ticket and waits.
+ * The first one to wait becomes the leader: it holds the door open for up to window_us while other
+ * transactions are still on their way (or until max_batch tickets are in), then runs the flush once for
+ * everyone and wakes them up. Whoever arrives during the flush is in the next batch.
+ * A lone committer never waits for the window - nobody else is coming.
+ */
+
+#ifndef PRESEQL_PAGER_GROUP_COMMIT_H
+#define PRESEQL_PAGER_GROUP_COMMIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "status/db.h"
+
+typedef PSqlStatus (*GroupCommitSyncFn)(void* ctx);  // Make every write issued so far durable
+
+typedef struct {
+    uint64_t commits;    // Tickets that got synced
+    uint64_t syncs;      // Flushes actually run
+    uint64_t max_batch;  // Most commits covered by one flush
+    uint64_t failures;   // Flushes that failed - every commit in the batch got the error
+} GroupCommitStats;
+
+typedef struct GroupCommit GroupCommit;
+
+GroupCommit* group_commit_create(GroupCommitSyncFn sync, void* ctx, uint32_t window_us, uint32_t max_batch);
+void group_commit_destroy(GroupCommit* group);
+void group_commit_configure(GroupCommit* group, uint32_t window_us, uint32_t max_batch);
+
+/* A transaction is under way and will commit soon - the leader waits for it (within the window) */
+void group_commit_begin(GroupCommit* group);
+void group_commit_end(GroupCommit* group);
+
+/* Call once the commit's writes are issued - then wait until a flush covering the ticket is done */
+uint64_t group_commit_enter(GroupCommit* group);
+PSqlStatus group_commit_wait(GroupCommit* group, uint64_t ticket);
+
+GroupCommitStats group_commit_get_stats(GroupCommit* group);
+
+#endif /* PRESEQL_PAGER_GROUP_COMMIT_H */
@@ -1,6 +0,0 @@
-#ifndef PRESEQL_PAGER_JOURNAL_INDEX_PAGE_H
-#define PRESEQL_PAGER_JOURNAL_INDEX_PAGE_H
-
-// Journal index page operations
-
-#endif /* PRESEQL_PAGER_JOURNAL_INDEX_PAGE_H */
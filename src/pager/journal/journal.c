@@ -1,357 +1,739 @@
+#define _GNU_SOURCE  /* pwritev, pread, posix_memalign, fdatasync, flock under -std=c99 */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
-#include <sys/mman.h>
-#include <sys/stat.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/uio.h>
 #include <stddef.h>
-#include "pager/constants.h"
-#include "journal_format.h"
-#include "pager/pager_format.h"
+
+#include "journal.h"
+#include "pager/db/base/page.h"
 #include "algorithm/crc.h"
 
-// Static variables for journal state
-static int journal_fd = -1;
-static void* journal_mem = NULL;
-static size_t journal_size = 0;
-static JournalHeader* journal_header = NULL;
-static char* journal_filename = NULL;
-
-// Initialize the journal
-PSqlStatus journal_init(const char* db_filename) {
-    if (!db_filename) return PSQL_ERROR;
-    
-    // Create journal filename
-    size_t filename_len = strlen(db_filename) + strlen(JOURNAL_FILE_EXTENSION) + 1;
-    journal_filename = (char*)malloc(filename_len);
-    if (!journal_filename) return PSQL_NOMEM;
-    
-    snprintf(journal_filename, filename_len, "%s%s", db_filename, JOURNAL_FILE_EXTENSION);
-    
-    // Open or create journal file
-    journal_fd = open(journal_filename, O_RDWR | O_CREAT, 0644);
-    if (journal_fd < 0) {
-        free(journal_filename);
-        journal_filename = NULL;
-        return PSQL_IOERR;
-    }
-    
-    // Get file size - to check if Journal needs to have its header recreated
-    struct stat st;
-    if (fstat(journal_fd, &st) < 0) {
-        close(journal_fd);
-        journal_fd = -1;
-        free(journal_filename);
-        journal_filename = NULL;
-        return PSQL_IOERR;
+// Every record in the buffer is two iovecs, plus one for the header in front of the first write
+#define JOURNAL_IOVECS (1 + 2 * JOURNAL_BUFFER_PAGES)
+#define DELTA_SLOT_SIZE(page_size) ((page_size) / JOURNAL_DELTA_FRACTION)
+
+static uint8_t* pending_image(JournalPager* journal, uint32_t i) {
+    return journal->pending + (size_t)i * journal->page_size;
+}
+
+static uint8_t* pending_delta(JournalPager* journal, uint32_t i) {
+    return journal->deltas + (size_t)i * DELTA_SLOT_SIZE(journal->page_size);
+}
+
+// What goes out after record i's header - its delta, or the image
+static uint8_t* pending_payload(JournalPager* journal, uint32_t i) {
+    return journal->pending_headers[i].type == JOURNAL_RECORD_DELTA ? pending_delta(journal, i) : pending_image(journal, i);
+}
+
+static void seal_record(JournalRecordHeader* record) {
+    record->checksum = calculate_crc32c(record, offsetof(JournalRecordHeader, checksum));
+}
+
+static uint32_t new_salt(JournalPager* journal) {
+    // Doesn't need to be cryptographic, just different from the last transaction
+    uint32_t salt = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16) ^ (journal->header.salt * 2654435761u) ^ (uint32_t)clock();
+    return salt ? salt : 1;
+}
+
+static bool record_valid(JournalPager* journal, const JournalRecordHeader* record) {
+    if (record->salt != journal->header.salt || record->checksum != calculate_crc32c(record, offsetof(JournalRecordHeader, checksum))) {
+        return false;
     }
-    
-    journal_size = st.st_size;
-    
-    // Initialize or map existing file
-    if (journal_size == 0) {
-        // New journal - initialize with header
-        journal_size = sizeof(JournalHeader);
-        
-        // Extend file to header size
-        if (ftruncate(journal_fd, journal_size) < 0) {
-            close(journal_fd);
-            journal_fd = -1;
-            free(journal_filename);
-            journal_filename = NULL;
-            return PSQL_IOERR;
+    if (record->type == JOURNAL_RECORD_IMAGE) return record->length == journal->page_size;
+    return record->type == JOURNAL_RECORD_DELTA && record->length < DELTA_SLOT_SIZE(journal->page_size);
+}
+
+
+/* Deltas */
+// Before-image bytes of every range where after differs, gaps under JOURNAL_DELTA_GAP merged in. UINT32_MAX if it would
+// take limit bytes or more - the image is the better record then. An unchanged page is an empty delta
+static uint32_t delta_encode(const uint8_t* before, const uint8_t* after, uint32_t size, uint8_t* out, uint32_t limit) {
+    uint32_t length = 0;
+    uint32_t i = 0;
+    while (i < size) {
+        // Equal words are most of a page - compare 8 bytes at a time until something differs
+        uint64_t a, b;
+        while (i + 8 <= size && (memcpy(&a, before + i, 8), memcpy(&b, after + i, 8), a == b)) i += 8;
+        while (i < size && before[i] == after[i]) i++;
+        if (i == size) break;
+
+        uint32_t start = i;
+        uint32_t end = i + 1;
+        for (uint32_t j = end; j < size && j - end < JOURNAL_DELTA_GAP; j++) {
+            if (before[j] != after[j]) end = j + 1;
         }
+        JournalDeltaRange range = { (uint16_t)start, (uint16_t)(end - start) };
+        if (length + sizeof(range) + range.length >= limit) return UINT32_MAX;
+        memcpy(out + length, &range, sizeof(range));
+        memcpy(out + length + sizeof(range), before + start, range.length);
+        length += sizeof(range) + range.length;
+        i = end;
     }
-    
-    // Memory map the file
-    journal_mem = mmap(NULL, journal_size, PROT_READ | PROT_WRITE, MAP_SHARED, journal_fd, 0);
-    if (journal_mem == MAP_FAILED) {
-        close(journal_fd);
-        journal_fd = -1;
-        free(journal_filename);
-        journal_filename = NULL;
-        return PSQL_IOERR;
+    return length;
+}
+
+static PSqlStatus delta_apply(uint8_t* page, uint32_t page_size, const uint8_t* delta, uint32_t length) {
+    for (uint32_t at = 0; at < length;) {
+        JournalDeltaRange range;
+        if (length - at < sizeof(range)) return PSQL_CORRUPT;
+        memcpy(&range, delta + at, sizeof(range));
+        at += sizeof(range);
+        if (range.length > length - at || (uint32_t)range.offset + range.length > page_size) return PSQL_CORRUPT;
+        memcpy(page + range.offset, delta + at, range.length);
+        at += range.length;
     }
-    
-    // Point to journal header
-    journal_header = (JournalHeader*)journal_mem;
-    
-    // Initialize header if new journal
-    if (journal_size == sizeof(JournalHeader)) {
-        memset(journal_header, 0, sizeof(JournalHeader));
-        
-        // Set magic number
-        memcpy(journal_header->magic, MAGIC_NUMBER, MAGIC_NUMBER_SIZE);
-        
-        // Set version and page size
-        journal_header->version = 1;
-        journal_header->page_size = PAGE_SIZE;
-        journal_header->highest_txn_id = 0;
-        
-        // Calculate checksum
-        journal_header->checksum = calculate_crc32(journal_header, 
-                                                 offsetof(JournalHeader, checksum));
-        
-        // Sync to disk
-        if (msync(journal_mem, journal_size, MS_SYNC) < 0) {
-            munmap(journal_mem, journal_size);
-            journal_mem = NULL;
-            close(journal_fd);
-            journal_fd = -1;
-            free(journal_filename);
-            journal_filename = NULL;
+    return PSQL_OK;
+}
+
+// pwritev()/preadv() until all of it is done - the iovecs are advanced past whatever a short call got through
+static PSqlStatus transfer_all(int fd, struct iovec* iov, int iovcnt, off_t offset, bool write) {
+    while (iovcnt > 0) {
+        ssize_t n = write ? pwritev(fd, iov, iovcnt, offset) : preadv(fd, iov, iovcnt, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror(write ? "pwritev" : "preadv");
             return PSQL_IOERR;
         }
-    } else {
-        // Verify existing journal
-        if (memcmp(journal_header->magic, MAGIC_NUMBER, MAGIC_NUMBER_SIZE) != 0) {
-            munmap(journal_mem, journal_size);
-            journal_mem = NULL;
-            close(journal_fd);
-            journal_fd = -1;
-            free(journal_filename);
-            journal_filename = NULL;
-            return PSQL_CORRUPT;
+        if (n == 0) return PSQL_CORRUPT;  // Reading past the end - the journal is shorter than its records say
+        offset += n;
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
         }
-        
-        // Verify checksum
-        uint32_t stored_checksum = journal_header->checksum;
-        journal_header->checksum = 0;
-        uint32_t calculated_checksum = calculate_crc32(journal_header, 
-                                                     offsetof(JournalHeader, checksum));
-        journal_header->checksum = stored_checksum;
-        
-        if (stored_checksum != calculated_checksum) {
-            munmap(journal_mem, journal_size);
-            journal_mem = NULL;
-            close(journal_fd);
-            journal_fd = -1;
-            free(journal_filename);
-            journal_filename = NULL;
-            return PSQL_CORRUPT;
+        if (iovcnt > 0) {
+            iov->iov_base = (uint8_t*)iov->iov_base + n;
+            iov->iov_len -= n;
         }
     }
-    
     return PSQL_OK;
 }
 
-// Close the journal
-PSqlStatus journal_close() {
-    if (journal_fd < 0 || !journal_mem) return PSQL_OK; // Already closed
-    
-    // Sync to disk
-    if (msync(journal_mem, journal_size, MS_SYNC) < 0) {
-        return PSQL_IOERR;
+// Point the iovecs at the buffered records - header, payload, header, payload... as they go in the file
+static int record_iovecs(JournalPager* journal, struct iovec* iov, size_t* len) {
+    for (uint32_t i = 0; i < journal->pending_count; i++) {
+        iov[2 * i].iov_base = &journal->pending_headers[i];
+        iov[2 * i].iov_len = sizeof(JournalRecordHeader);
+        iov[2 * i + 1].iov_base = pending_payload(journal, i);
+        iov[2 * i + 1].iov_len = journal->pending_headers[i].length;
+        *len += sizeof(JournalRecordHeader) + journal->pending_headers[i].length;
     }
-    
-    // Unmap memory
-    if (munmap(journal_mem, journal_size) < 0) {
-        return PSQL_IOERR;
+    return 2 * (int)journal->pending_count;
+}
+
+
+/* Opening and closing */
+static PSqlStatus alloc_buffers(JournalPager* journal, uint32_t page_size) {
+    memset(journal, 0, sizeof(*journal));
+    journal->fd = -1;
+    journal->page_size = page_size;
+
+    // Page aligned like the buffer pool's frames - the images are copied in and out a page at a time
+    void* pending;
+    if (posix_memalign(&pending, page_size, (size_t)JOURNAL_BUFFER_PAGES * page_size) != 0) return PSQL_NOMEM;
+    journal->pending = (uint8_t*)pending;
+    journal->pending_headers = (JournalRecordHeader*)calloc(JOURNAL_BUFFER_PAGES, sizeof(JournalRecordHeader));
+    journal->deltas = (uint8_t*)malloc((size_t)JOURNAL_BUFFER_PAGES * DELTA_SLOT_SIZE(page_size));
+    journal->scratch = (uint8_t*)malloc(page_size);
+    if (!journal->pending_headers || !journal->deltas || !journal->scratch) {
+        journal_close(journal);
+        return PSQL_NOMEM;
     }
-    
-    // Close file
-    close(journal_fd);
-    
-    // Free resources
-    free(journal_filename);
-    
-    // Reset state
-    journal_fd = -1;
-    journal_mem = NULL;
-    journal_size = 0;
-    journal_header = NULL;
-    journal_filename = NULL;
-    
     return PSQL_OK;
 }
 
-// Begin a new transaction
-PSqlStatus journal_begin_transaction(uint32_t txn_id) {
-    if (journal_fd < 0 || !journal_mem) return PSQL_ERROR;
-    
-    // Check if transaction ID is valid (should be sequential)
-    if (txn_id != journal_header->highest_txn_id + 1) {
-        // Invalid transaction ID - clear journal and reset
-        if (ftruncate(journal_fd, sizeof(JournalHeader)) < 0) {
-            return PSQL_IOERR;
-        }
-        
-        // Update size
-        journal_size = sizeof(JournalHeader);
-        
-        // Reset header
-        journal_header->highest_txn_id = txn_id - 1;
-    }
-    
-    // Update highest transaction ID
-    journal_header->highest_txn_id = txn_id;
-    
-    // Update checksum
-    journal_header->checksum = calculate_crc32(journal_header, 
-                                             offsetof(JournalHeader, checksum));
-    
-    // Sync to disk
-    if (msync(journal_mem, sizeof(JournalHeader), MS_SYNC) < 0) {
+PSqlStatus journal_open(JournalPager* journal, const char* filename, uint32_t page_size) {
+    PSqlStatus status = alloc_buffers(journal, page_size);
+    if (status != PSQL_OK) return status;
+
+    journal->fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if (journal->fd < 0) {
+        perror("open");
+        journal_close(journal);
         return PSQL_IOERR;
     }
-    
+    // Held for as long as the pager is open - it is how journal_recover() tells a live journal from a hot one
+    if (flock(journal->fd, LOCK_EX | LOCK_NB) != 0) {
+        journal_close(journal);
+        return PSQL_BUSY;
+    }
     return PSQL_OK;
 }
 
-// Add a page to the journal
-PSqlStatus journal_add_page(uint32_t txn_id, uint32_t page_no, const uint8_t* page_data, uint16_t data_size) {
-    if (journal_fd < 0 || !journal_mem || !page_data) return PSQL_ERROR;
-    
-    // Check if transaction ID is valid
-    if (txn_id != journal_header->highest_txn_id) {
-        return PSQL_ERROR;
+void journal_close(JournalPager* journal) {
+    if (journal->fd >= 0) close(journal->fd);
+    bitmap_free(&journal->journaled);
+    bitmap_free(&journal->saved);
+    bitmap_free(&journal->saved_twice);
+    bitmap_free(&journal->unsynced);
+    free(journal->pending_headers);
+    free(journal->deltas);
+    free(journal->scratch);
+    free(journal->pending);
+    memset(journal, 0, sizeof(*journal));
+    journal->fd = -1;
+}
+
+
+/* Writing */
+// Every per-page bitmap covers the pages there were when the transaction began or the newest mark was set
+static PSqlStatus size_bitmaps(JournalPager* journal, uint32_t db_page_count) {
+    Bitmap* bitmaps[] = { &journal->journaled, &journal->saved, &journal->saved_twice, &journal->unsynced };
+    for (size_t i = 0; i < sizeof(bitmaps) / sizeof(bitmaps[0]); i++) {
+        if (bitmaps[i]->num_bits < db_page_count && !bitmap_resize(bitmaps[i], db_page_count)) return PSQL_NOMEM;
     }
-    
-    // Calculate new journal entry size
-    size_t entry_size = sizeof(RollbackJournalPage);
-    
-    // Extend journal file if needed
-    size_t new_size = journal_size + entry_size;
-    if (ftruncate(journal_fd, new_size) < 0) {
-        return PSQL_IOERR;
+    return PSQL_OK;
+}
+
+PSqlStatus journal_begin(JournalPager* journal, uint32_t db_page_count) {
+    if (journal->fd < 0) return PSQL_MISUSE;
+    if (size_bitmaps(journal, db_page_count) != PSQL_OK) return PSQL_NOMEM;
+
+    JournalHeader* header = &journal->header;
+    uint32_t salt = new_salt(journal);
+    memset(header, 0, sizeof(JournalHeader));
+    memcpy(header->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    header->version = JOURNAL_VERSION;
+    header->page_size = journal->page_size;
+    header->salt = salt;
+    header->db_page_count = db_page_count;
+    header->checksum = calculate_crc32c(header, offsetof(JournalHeader, checksum));
+
+    journal->mark_page_count = db_page_count;
+    journal->generation++;
+    journal->end = 0;
+    journal->records = 0;
+    journal->synced_records = 0;
+    journal->pending_count = 0;
+    __atomic_store_n(&journal->active, true, __ATOMIC_RELAXED);  // Read without the lock by pager_get_page()
+    return PSQL_OK;
+}
+
+bool journal_wants_page(const JournalPager* journal, uint32_t page_no) {
+    return journal->active && page_no < journal->mark_page_count && !bitmap_test(&journal->journaled, page_no);
+}
+
+bool journal_page_saved(JournalPager* journal, uint32_t page_no) {
+    if (!journal->active || page_no >= journal->mark_page_count || !bitmap_test(&journal->journaled, page_no)) return false;
+    journal->stats.skipped++;
+    journal->stats.bytes_saved += JOURNAL_RECORD_SIZE(journal->page_size);
+    return true;
+}
+
+bool journal_page_unsynced(const JournalPager* journal, uint32_t page_no) {
+    return journal->synced_records != journal->records && page_no < journal->unsynced.num_bits && bitmap_test(&journal->unsynced, page_no);
+}
+
+bool journal_buffer_full(const JournalPager* journal) {
+    return journal->pending_count == JOURNAL_BUFFER_PAGES;
+}
+
+PSqlStatus journal_add_page(JournalPager* journal, uint32_t page_no, const void* image) {
+    if (!journal->active) return PSQL_MISUSE;
+    if (journal_buffer_full(journal)) return PSQL_FULL;
+
+    JournalRecordHeader* record = &journal->pending_headers[journal->pending_count];
+    uint8_t* slot = pending_image(journal, journal->pending_count);
+    memcpy(slot, image, journal->page_size);
+    ((DBPage*)slot)->header.flag &= ~PAGE_PINNED;  // A pinned frame's copy - the flag only means something in memory
+    record->page_no = page_no;
+    record->salt = journal->header.salt;
+    record->type = JOURNAL_RECORD_IMAGE;
+    record->length = journal->page_size;
+    record->image_checksum = calculate_crc32c(slot, journal->page_size);
+    seal_record(record);
+
+    journal->pending_count++;
+    if (journal->records++ == 0) journal->stats.transactions++;
+    journal->stats.records++;
+    bitmap_set(&journal->journaled, page_no);
+    if (bitmap_test(&journal->saved, page_no)) bitmap_set(&journal->saved_twice, page_no);
+    bitmap_set(&journal->saved, page_no);
+    bitmap_set(&journal->unsynced, page_no);
+    return PSQL_OK;
+}
+
+// A buffered image is still exactly what the page was when the transaction (or the newest savepoint) began - diff it
+// against the page now. A delta only undoes the page it was taken against, or the before-image when it is the page's
+// only record. So a page with more than one record keeps them all whole: after a crash the file may still hold the page
+// as it was at BEGIN, and recovery applies the newest record first
+PSqlStatus journal_encode_deltas(JournalPager* journal, JournalReadFn read, void* ctx) {
+    uint32_t page_size = journal->page_size;
+    for (uint32_t i = 0; i < journal->pending_count; i++) {
+        JournalRecordHeader* record = &journal->pending_headers[i];
+        if (record->type != JOURNAL_RECORD_IMAGE || bitmap_test(&journal->saved_twice, record->page_no)) continue;
+        PSqlStatus status = read(ctx, record->page_no, journal->scratch);
+        if (status == PSQL_NOTFOUND) continue;
+        if (status != PSQL_OK) return status;
+        ((DBPage*)journal->scratch)->header.flag &= ~PAGE_PINNED;
+
+        uint8_t* image = pending_image(journal, i);
+        uint32_t length = delta_encode(image, journal->scratch, page_size, pending_delta(journal, i), DELTA_SLOT_SIZE(page_size));
+        if (length == UINT32_MAX) continue;  // Too big for a delta
+        record->type = JOURNAL_RECORD_DELTA;
+        record->length = length;
+        seal_record(record);
+        journal->stats.deltas++;
+        journal->stats.delta_bytes_saved += page_size - length;
     }
-    
-    // Remap with new size
-    if (munmap(journal_mem, journal_size) < 0) {
-        return PSQL_IOERR;
+    return PSQL_OK;
+}
+
+// The first write of a transaction starts at offset 0 with the header, so it is one pwritev() like every other
+PSqlStatus journal_flush(JournalPager* journal) {
+    if (journal->pending_count == 0) return PSQL_OK;
+
+    struct iovec iov[JOURNAL_IOVECS];
+    int iovcnt = 0;
+    size_t len = 0;
+    if (journal->end == 0) {
+        iov[iovcnt].iov_base = &journal->header;
+        iov[iovcnt].iov_len = JOURNAL_HEADER_SIZE;
+        iovcnt++;
+        len += JOURNAL_HEADER_SIZE;
     }
-    
-    journal_mem = mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, journal_fd, 0);
-    if (journal_mem == MAP_FAILED) {
-        journal_mem = NULL;
+    iovcnt += record_iovecs(journal, iov + iovcnt, &len);
+
+    PSqlStatus status = transfer_all(journal->fd, iov, iovcnt, (off_t)journal->end, true);
+    if (status != PSQL_OK) return status;
+
+    journal->end += len;
+    journal->pending_count = 0;
+    journal->stats.writes++;
+    journal->stats.bytes_written += len;
+    return PSQL_OK;
+}
+
+PSqlStatus journal_sync(JournalPager* journal) {
+    if (journal->synced_records == journal->records) return PSQL_OK;
+    PSqlStatus status = journal_flush(journal);
+    if (status != PSQL_OK) return status;
+    if (fdatasync(journal->fd) != 0) {
+        perror("fdatasync");
         return PSQL_IOERR;
     }
-    
-    // Update pointers
-    journal_header = (JournalHeader*)journal_mem;
-    
-    // Create journal entry
-    RollbackJournalPage* entry = (RollbackJournalPage*)((uint8_t*)journal_mem + journal_size);
-    entry->txn_id = txn_id;
-    entry->original_page = page_no;
-    entry->data_size = data_size;
-    entry->reserved = 0;
-    
-    // Copy page data
-    memcpy(entry->page_data, page_data, data_size);
-    
-    // Update journal size
-    journal_size = new_size;
-    
-    // Sync to disk
-    if (msync((uint8_t*)journal_mem + journal_size - entry_size, entry_size, MS_SYNC) < 0) {
+    journal->synced_records = journal->records;
+    bitmap_clear_all(&journal->unsynced);
+    journal->stats.syncs++;
+    return PSQL_OK;
+}
+
+// Truncating is enough to end the transaction - a journal without records has nothing to roll back
+PSqlStatus journal_reset(JournalPager* journal) {
+    if (journal->end > 0 && ftruncate(journal->fd, 0) != 0) {
+        perror("ftruncate");
         return PSQL_IOERR;
     }
-    
+    bitmap_clear_all(&journal->journaled);
+    bitmap_clear_all(&journal->saved);
+    bitmap_clear_all(&journal->saved_twice);
+    bitmap_clear_all(&journal->unsynced);
+    journal->end = 0;
+    journal->records = 0;
+    journal->synced_records = 0;
+    journal->pending_count = 0;
+    journal_stop(journal);
     return PSQL_OK;
 }
 
-// Commit a transaction
-PSqlStatus journal_commit_transaction(uint32_t txn_id) {
-    if (journal_fd < 0 || !journal_mem) return PSQL_ERROR;
-    
-    // Check if transaction ID is valid
-    if (txn_id != journal_header->highest_txn_id) {
-        return PSQL_ERROR;
+void journal_stop(JournalPager* journal) {
+    __atomic_store_n(&journal->active, false, __ATOMIC_RELAXED);
+}
+
+
+/* Rollback */
+// Reads until len bytes or the end of the file - *got says how far it got
+static PSqlStatus read_at(int fd, uint8_t* buf, size_t len, uint64_t offset, size_t* got) {
+    *got = 0;
+    while (*got < len) {
+        ssize_t n = pread(fd, buf + *got, len - *got, (off_t)(offset + *got));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("pread");
+            return PSQL_IOERR;
+        }
+        if (n == 0) break;
+        *got += (size_t)n;
     }
-    
-    // For commit, we just truncate the journal back to header size
-    if (ftruncate(journal_fd, sizeof(JournalHeader)) < 0) {
-        return PSQL_IOERR;
+    return PSQL_OK;
+}
+
+// File offset and page of every record, plus where the last one ends
+typedef struct {
+    uint64_t* offsets;
+    uint32_t* pages;
+    uint32_t count;
+    uint32_t capacity;
+} RecordIndex;
+
+static bool index_add(RecordIndex* index, uint64_t offset, uint32_t page_no) {
+    if (index->count + 1 >= index->capacity) {
+        uint32_t capacity = index->capacity ? index->capacity * 2 : 256;
+        uint64_t* offsets = (uint64_t*)realloc(index->offsets, (size_t)capacity * sizeof(uint64_t));
+        if (!offsets) return false;
+        index->offsets = offsets;
+        uint32_t* pages = (uint32_t*)realloc(index->pages, (size_t)capacity * sizeof(uint32_t));
+        if (!pages) return false;
+        index->pages = pages;
+        index->capacity = capacity;
     }
-    
-    // Remap with new size
-    if (munmap(journal_mem, journal_size) < 0) {
-        return PSQL_IOERR;
+    index->offsets[index->count] = offset;
+    index->pages[index->count++] = page_no;
+    return true;
+}
+
+static void index_free(RecordIndex* index) {
+    free(index->offsets);
+    free(index->pages);
+}
+
+// Records vary in size, so the only way to find the newest is to walk from the oldest. The walk reads a buffer's worth
+// at a time from offset and only looks at the headers. Up to limit records - fewer is PSQL_CORRUPT, unless the limit is
+// UINT32_MAX: after a crash the end of the file can be records that were never synced, and the walk just stops there
+static PSqlStatus find_records(JournalPager* journal, uint64_t offset, uint32_t limit, RecordIndex* index) {
+    size_t buffer_size = (size_t)JOURNAL_BUFFER_PAGES * journal->page_size;
+    bool torn_end_ok = limit == UINT32_MAX;
+    while (index->count < limit) {
+        size_t got;
+        PSqlStatus status = read_at(journal->fd, journal->pending, buffer_size, offset, &got);
+        if (status != PSQL_OK) return status;
+
+        size_t at = 0;
+        bool torn = false;
+        while (index->count < limit && got - at >= sizeof(JournalRecordHeader)) {
+            JournalRecordHeader record;
+            memcpy(&record, journal->pending + at, sizeof(record));  // Deltas leave headers unaligned
+            if (!record_valid(journal, &record)) {
+                torn = true;
+                break;
+            }
+            if (got - at < sizeof(record) + record.length) break;  // Runs past the buffer - the next read starts with it
+            if (!index_add(index, offset + at, record.page_no)) return PSQL_NOMEM;
+            at += sizeof(record) + record.length;
+        }
+        offset += at;
+        if (torn || at == 0) {  // A bad record, or not even one whole record left - the file ends early
+            if (!torn_end_ok) return PSQL_CORRUPT;
+            break;
+        }
     }
-    
-    journal_size = sizeof(JournalHeader);
-    journal_mem = mmap(NULL, journal_size, PROT_READ | PROT_WRITE, MAP_SHARED, journal_fd, 0);
-    if (journal_mem == MAP_FAILED) {
-        journal_mem = NULL;
-        return PSQL_IOERR;
+    if (!index_add(index, offset, 0)) return PSQL_NOMEM;
+    index->count--;  // offsets[count] is the end
+    return PSQL_OK;
+}
+
+// Turn the record at `at` back into its before-image and hand it to restore - a delta is applied on the page read gives
+// back, in scratch. Safe to run on several threads at once, each with its own scratch
+static PSqlStatus undo_record(const JournalPager* journal, const uint8_t* at, uint8_t* scratch, JournalReadFn read,
+                              JournalRestoreFn restore, void* ctx) {
+    JournalRecordHeader record;
+    memcpy(&record, at, sizeof(record));
+    const uint8_t* payload = at + sizeof(record);
+    const uint8_t* image = payload;
+
+    if (record.type == JOURNAL_RECORD_DELTA) {
+        PSqlStatus status = read(ctx, record.page_no, scratch);
+        if (status != PSQL_OK) return status == PSQL_NOTFOUND ? PSQL_CORRUPT : status;  // Nothing to apply it to
+        ((DBPage*)scratch)->header.flag &= ~PAGE_PINNED;
+        status = delta_apply(scratch, journal->page_size, payload, record.length);
+        if (status != PSQL_OK) return status;
+        image = scratch;
     }
-    
-    // Update pointers
-    journal_header = (JournalHeader*)journal_mem;
-    
-    // Update header
-    journal_header->highest_txn_id = txn_id;
-    
-    // Update checksum
-    journal_header->checksum = calculate_crc32(journal_header, 
-                                             offsetof(JournalHeader, checksum));
-    
-    // Sync to disk
-    if (msync(journal_mem, journal_size, MS_SYNC) < 0) {
-        return PSQL_IOERR;
+    if (calculate_crc32c(image, journal->page_size) != record.image_checksum) return PSQL_CORRUPT;
+    return restore(ctx, record.page_no, image);
+}
+
+// Undo the records from first on, which start at offset - everything goes to the file first, then comes back newest
+// first a buffer's worth at a time. A page with more than one record ends up with the oldest, and every delta is applied
+// on top of the page it was taken against
+static PSqlStatus undo_records(JournalPager* journal, uint32_t first_record, uint64_t offset, JournalReadFn read,
+                               JournalRestoreFn restore, void* ctx) {
+    if (journal->active) return PSQL_MISUSE;  // Pages saved meanwhile would land in the buffer the records are read into
+    PSqlStatus status = journal_flush(journal);
+    if (status != PSQL_OK || journal->records == first_record) return status;
+
+    RecordIndex index = { 0 };
+    uint32_t count = journal->records - first_record;
+    status = find_records(journal, offset, count, &index);
+    uint64_t* offsets = index.offsets;
+
+    size_t buffer_size = (size_t)JOURNAL_BUFFER_PAGES * journal->page_size;
+    for (uint32_t last = count; status == PSQL_OK && last > 0;) {
+        // As many records as fit in the buffer, ending at last - one read for all of them
+        uint32_t first = last - 1;
+        while (first > 0 && offsets[last] - offsets[first - 1] <= buffer_size) first--;
+        struct iovec iov = { journal->pending, offsets[last] - offsets[first] };
+        status = transfer_all(journal->fd, &iov, 1, (off_t)offsets[first], false);
+
+        for (uint32_t i = last; status == PSQL_OK && i > first; i--) {
+            status = undo_record(journal, journal->pending + (offsets[i - 1] - offsets[first]), journal->scratch, read, restore, ctx);
+            if (status == PSQL_OK) journal->stats.pages_restored++;
+        }
+        last = first;
     }
-    
+    index_free(&index);
+    return status;
+}
+
+PSqlStatus journal_rollback(JournalPager* journal, JournalReadFn read, JournalRestoreFn restore, void* ctx) {
+    PSqlStatus status = undo_records(journal, 0, JOURNAL_HEADER_SIZE, read, restore, ctx);
+    if (status == PSQL_OK) journal->stats.rollbacks++;
+    return status;
+}
+
+
+/* Savepoints */
+// The records before the mark stay as they are - a page fetched after it is saved again, as it is now
+PSqlStatus journal_mark(JournalPager* journal, uint32_t db_page_count, JournalMark* mark) {
+    if (journal->fd < 0) return PSQL_MISUSE;
+    if (size_bitmaps(journal, db_page_count) != PSQL_OK) return PSQL_NOMEM;
+
+    // Buffered records are all images until the transaction is done - but count them as they are
+    uint64_t offset = journal->end ? journal->end : JOURNAL_HEADER_SIZE;
+    for (uint32_t i = 0; i < journal->pending_count; i++) offset += sizeof(JournalRecordHeader) + journal->pending_headers[i].length;
+    mark->records = journal->records;
+    mark->offset = offset;
+    mark->db_page_count = db_page_count;
+    mark->generation = journal->generation;
+
+    bitmap_clear_all(&journal->journaled);  // Not saved - a page saved twice keeps its records whole
+    journal->mark_page_count = db_page_count;
+    __atomic_store_n(&journal->active, true, __ATOMIC_RELAXED);
     return PSQL_OK;
 }
 
-// Rollback a transaction - 1 transaction at a time
-// If there is multiple transaction rollbacks then call this more than once
-PSqlStatus journal_rollback_transaction(uint32_t txn_id) {
-    if (journal_fd < 0 || !journal_mem) return PSQL_ERROR;
-    
-    // Check if transaction ID is valid
-    if (txn_id != journal_header->highest_txn_id) {
-        return PSQL_ERROR;
+// The undone records stay in the file - in mmap mode a page can reach the file before its restored copy does, and
+// until then a crash still needs them
+PSqlStatus journal_rollback_to(JournalPager* journal, const JournalMark* mark, JournalReadFn read, JournalRestoreFn restore, void* ctx) {
+    if (mark->generation != journal->generation || mark->records > journal->records) return PSQL_MISUSE;
+    PSqlStatus status = undo_records(journal, mark->records, mark->offset, read, restore, ctx);
+    if (status == PSQL_OK) journal->stats.savepoint_rollbacks++;
+    return status;
+}
+
+
+/* Crash recovery */
+typedef struct {
+    const JournalPager* journal;
+    const RecordIndex* index;
+    const Bitmap* oldest;  // Records that are the oldest of their page - what the page ends up as
+    int db_fd;
+    uint32_t threads;
+    PSqlStatus status;    // First failure - every worker stops at it
+    uint32_t restored;
+    uint32_t failed;      // Pages whose oldest record didn't undo
+} Recovery;
+
+typedef struct {
+    Recovery* recovery;
+    uint32_t thread;
+    pthread_t tid;
+} RecoveryWorker;
+
+// Straight from and to the database file - nothing else has it open yet
+static PSqlStatus read_db_page(void* ctx, uint32_t page_no, void* image) {
+    Recovery* recovery = (Recovery*)ctx;
+    uint32_t page_size = recovery->journal->page_size;
+    size_t got;
+    PSqlStatus status = read_at(recovery->db_fd, (uint8_t*)image, page_size, (uint64_t)page_no * page_size, &got);
+    if (status == PSQL_OK) memset((uint8_t*)image + got, 0, page_size - got);  // Past the end of the file
+    return status;
+}
+
+static PSqlStatus write_db_page(void* ctx, uint32_t page_no, const void* image) {
+    Recovery* recovery = (Recovery*)ctx;
+    uint32_t page_size = recovery->journal->page_size;
+    struct iovec iov = { (void*)image, page_size };
+    return transfer_all(recovery->db_fd, &iov, 1, (off_t)((uint64_t)page_no * page_size), true);
+}
+
+// Every worker walks the records newest first and takes the pages that are its own - all the records of a page go
+// through one worker, in the same order as a single threaded rollback. A record that doesn't undo is skipped: an older
+// one of the same page may still put it back, and only a failed oldest record leaves the page as it is
+static void* recovery_worker(void* arg) {
+    RecoveryWorker* worker = (RecoveryWorker*)arg;
+    Recovery* recovery = worker->recovery;
+    const RecordIndex* index = recovery->index;
+    uint32_t page_size = recovery->journal->page_size;
+    uint8_t* record = (uint8_t*)malloc(JOURNAL_RECORD_SIZE(page_size));
+    uint8_t* scratch = (uint8_t*)malloc(page_size);
+    PSqlStatus status = (record && scratch) ? PSQL_OK : PSQL_NOMEM;
+
+    uint32_t restored = 0, failed = 0;
+    for (uint32_t i = index->count; status == PSQL_OK && i > 0; i--) {
+        if (index->pages[i - 1] % recovery->threads != worker->thread) continue;
+        if (__atomic_load_n(&recovery->status, __ATOMIC_RELAXED) != PSQL_OK) break;
+        struct iovec iov = { record, index->offsets[i] - index->offsets[i - 1] };
+        status = transfer_all(recovery->journal->fd, &iov, 1, (off_t)index->offsets[i - 1], false);
+        if (status == PSQL_OK) status = undo_record(recovery->journal, record, scratch, read_db_page, write_db_page, recovery);
+        if (status == PSQL_OK) restored++;
+        if (status == PSQL_CORRUPT) {
+            if (bitmap_test(recovery->oldest, i - 1)) failed++;
+            status = PSQL_OK;
+        }
     }
-    
-    // For rollback, we need to apply all journal entries in reverse order. Start from the freshest changes and then keep going back by 1 transaction
-    // TODO: This would be implemented by the caller (i.e VM), who would read each entry and restore the original page
-    
-    // After rollback, truncate the journal back to header size - effectively trhowing away entries
-    if (ftruncate(journal_fd, sizeof(JournalHeader)) < 0) {
-        return PSQL_IOERR;
+    if (status != PSQL_OK) {
+        PSqlStatus ok = PSQL_OK;
+        __atomic_compare_exchange_n(&recovery->status, &ok, status, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
     }
-    
-    // Remap with new size - prevent any oopsies with SIGBUS cos we might accidentally touch truncated areas
-    if (munmap(journal_mem, journal_size) < 0) {
-        return PSQL_IOERR;
+    __atomic_fetch_add(&recovery->restored, restored, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&recovery->failed, failed, __ATOMIC_RELAXED);
+    free(record);
+    free(scratch);
+    return NULL;
+}
+
+// The first record of every page in the index is the one a rollback leaves it with
+static PSqlStatus find_oldest(const RecordIndex* index, Bitmap* oldest) {
+    uint32_t max_page = 0;
+    for (uint32_t i = 0; i < index->count; i++) {
+        if (index->pages[i] > max_page) max_page = index->pages[i];
     }
-    
-    journal_size = sizeof(JournalHeader);
-    journal_mem = mmap(NULL, journal_size, PROT_READ | PROT_WRITE, MAP_SHARED, journal_fd, 0);  // updated mmap
-    if (journal_mem == MAP_FAILED) {
-        journal_mem = NULL;
-        return PSQL_IOERR;
+    Bitmap seen;
+    if (!bitmap_init(&seen, (size_t)max_page + 1)) return PSQL_NOMEM;
+    if (!bitmap_init(oldest, index->count)) {
+        bitmap_free(&seen);
+        return PSQL_NOMEM;
     }
-    
-    // Update pointers
-    journal_header = (JournalHeader*)journal_mem;
-    
-    // Update header
-    journal_header->highest_txn_id = txn_id - 1; // Revert to previous transaction
-    
-    // Update checksum
-    journal_header->checksum = calculate_crc32(journal_header, 
-                                             offsetof(JournalHeader, checksum));
-    
-    // Sync to disk
-    if (msync(journal_mem, journal_size, MS_SYNC) < 0) {
-        return PSQL_IOERR;
+    for (uint32_t i = 0; i < index->count; i++) {
+        if (bitmap_test(&seen, index->pages[i])) continue;
+        bitmap_set(&seen, index->pages[i]);
+        bitmap_set(oldest, i);
     }
-    
+    bitmap_free(&seen);
     return PSQL_OK;
 }
 
-// Check if a transaction is valid
-PSqlStatus journal_is_valid_transaction(uint32_t txn_id) {
-    if (journal_fd < 0 || !journal_mem) return PSQL_ERROR;
-    
-    // Check if transaction ID is valid (should be sequential)
-    if (txn_id != journal_header->highest_txn_id + 1) {
-        return PSQL_ERROR;
+// Undo every record on as many threads as the journal is worth. A worker that won't start runs on this thread instead
+static PSqlStatus restore_pages(Recovery* recovery) {
+    uint32_t threads = recovery->index->count / JOURNAL_RECOVERY_RECORDS_PER_THREAD;
+    if (threads > JOURNAL_RECOVERY_THREADS) threads = JOURNAL_RECOVERY_THREADS;
+    if (threads < 1) threads = 1;
+    recovery->threads = threads;
+
+    RecoveryWorker workers[JOURNAL_RECOVERY_THREADS];
+    bool started[JOURNAL_RECOVERY_THREADS] = { false };
+    for (uint32_t t = 1; t < threads; t++) {
+        workers[t].recovery = recovery;
+        workers[t].thread = t;
+        started[t] = pthread_create(&workers[t].tid, NULL, recovery_worker, &workers[t]) == 0;
     }
-    
-    return PSQL_OK;
+    workers[0].recovery = recovery;
+    workers[0].thread = 0;
+    recovery_worker(&workers[0]);
+    for (uint32_t t = 1; t < threads; t++) {
+        if (started[t]) pthread_join(workers[t].tid, NULL);
+        else recovery_worker(&workers[t]);
+    }
+    return recovery->status;
+}
+
+static bool header_valid(const JournalHeader* header) {
+    return memcmp(header->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) == 0 && header->version == JOURNAL_VERSION &&
+           DB_PAGE_SIZE_VALID(header->page_size) && header->checksum == calculate_crc32c(header, offsetof(JournalHeader, checksum));
+}
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Another try would fail the same way - out of the way of the next open, but still there to look at
+static PSqlStatus keep_failed_journal(const char* filename) {
+    size_t length = strlen(filename);
+    char* failed = (char*)malloc(length + sizeof(JOURNAL_FAILED_SUFFIX));
+    if (!failed) return PSQL_NOMEM;
+    memcpy(failed, filename, length);
+    memcpy(failed + length, JOURNAL_FAILED_SUFFIX, sizeof(JOURNAL_FAILED_SUFFIX));
+    PSqlStatus status = PSQL_OK;
+    if (rename(filename, failed) != 0) {
+        perror("rename");
+        status = PSQL_IOERR;
+    }
+    free(failed);
+    return status;
+}
+
+// A journal nobody holds, with at least one good record in it, is a transaction that never finished - some of its
+// pages may be in the database file already. Put the before-images back, cut the file back to its size when the
+// transaction began and sync it. Only then does the journal go
+PSqlStatus journal_recover(const char* filename, const char* db_filename, JournalRecoveryStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    int fd = open(filename, O_RDWR);
+    if (fd < 0) {
+        if (errno == ENOENT) return PSQL_OK;
+        perror("open");
+        return PSQL_IOERR;
+    }
+    // A pager has it open - its transaction isn't over yet, it's not hot
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        close(fd);
+        return PSQL_OK;
+    }
+
+    uint64_t start = now_ns();
+    JournalHeader header;
+    size_t got;
+    PSqlStatus status = read_at(fd, (uint8_t*)&header, sizeof(header), 0, &got);
+    if (status != PSQL_OK || got < sizeof(header) || !header_valid(&header)) {
+        // Empty, or the first write never made it - and nothing reaches the database before that write is synced
+        close(fd);
+        if (status == PSQL_OK) unlink(filename);
+        return status;
+    }
+
+    JournalPager journal;
+    status = alloc_buffers(&journal, header.page_size);
+    if (status != PSQL_OK) {
+        close(fd);
+        return status;
+    }
+    journal.fd = fd;
+    journal.header = header;
+    RecordIndex index = { 0 };
+    status = find_records(&journal, JOURNAL_HEADER_SIZE, UINT32_MAX, &index);
+
+    bool failed = false;
+    if (status == PSQL_OK && index.count > 0) {
+        Bitmap oldest = { 0 };
+        Recovery recovery = { &journal, &index, &oldest, open(db_filename, O_RDWR), 1, PSQL_OK, 0, 0 };
+        if (recovery.db_fd < 0) {
+            perror("open");
+            status = PSQL_IOERR;
+        }
+        if (status == PSQL_OK) status = find_oldest(&index, &oldest);
+        if (status == PSQL_OK) status = restore_pages(&recovery);
+        if (status == PSQL_OK && ftruncate(recovery.db_fd, (off_t)((uint64_t)header.db_page_count * header.page_size)) != 0) {
+            perror("ftruncate");
+            status = PSQL_IOERR;
+        }
+        if (status == PSQL_OK && fdatasync(recovery.db_fd) != 0) {
+            perror("fdatasync");
+            status = PSQL_IOERR;
+        }
+        if (recovery.db_fd >= 0) close(recovery.db_fd);
+        bitmap_free(&oldest);
+
+        failed = recovery.failed > 0;
+        stats->recovered = status == PSQL_OK;
+        stats->records = index.count;
+        stats->pages_restored = recovery.restored;
+        stats->pages_failed = recovery.failed;
+        stats->threads = recovery.threads;
+        stats->db_page_count = header.db_page_count;
+        stats->duration_ns = now_ns() - start;
+    }
+    index_free(&index);
+    journal_close(&journal);  // Closes fd too
+    if (status == PSQL_OK && failed) status = keep_failed_journal(filename);
+    else if (status == PSQL_OK) unlink(filename);  // Left alone otherwise - the next open tries again
+    return status;
 }
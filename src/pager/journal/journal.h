@@ -1,3 +1,141 @@
-#include "pager/pager_format.h"
-#include "pager/constants.h"
-#include "pager/db/base/page_format.h"
+/* Rollback journal - before-images of the pages a transaction changes (PAGER_JOURNALING_ENABLED)
+ *
+ * The pager saves a page the first time a transaction fetches it - pages are changed in place, so by pager_write_page()
+ * it would be too late. Saving a page is a memcpy into a page aligned write buffer and nothing else. A full buffer goes
+ * out as one pwritev() at the end of the file, gathering the record headers and images, so the journal is written front
+ * to back in JOURNAL_BUFFER_PAGES record chunks however scattered the pages are in the database.
+ *
+ * Once the transaction is done changing pages, journal_encode_deltas() turns the records still in the buffer into
+ * deltas against the pages as they are now - an index insert changes a few dozen bytes of a page, so that is all the
+ * record needs to hold. Records written out earlier stay whole images: the page could still change after them.
+ *
+ * journal_sync() writes out the rest and runs the one fdatasync() of the transaction, right before the first changed
+ * database page can go to the file. journal_reset() truncates the file once those pages are durable - that is what ends
+ * the transaction. journal_rollback() reads the records back and hands every image to a callback, newest first.
+ *
+ * The pager holds an flock() on the journal for as long as it is open. A journal with records that nobody holds is hot:
+ * the process writing it died mid-transaction. journal_recover() puts it back before the database is opened.
+ *
+ * All of the state is in the JournalPager, one per pager, so any number of databases can each have a journal open in
+ * the same process. Nothing here locks - the pager calls in under its own lock.
+ *
+ * journal_mark() sets a savepoint: the pages fetched after it are saved again, so a page can have a record per mark.
+ * journal_rollback_to() undoes just the records after a mark, and a full rollback still ends up with the oldest. A page
+ * with more than one record keeps them all as images - a crash can leave it in the file as it was at BEGIN.
+ */
+
+#ifndef PRESEQL_PAGER_JOURNAL_H
+#define PRESEQL_PAGER_JOURNAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "journal_format.h"
+#include "algorithm/bitmap.h"
+#include "status/db.h"
+
+typedef struct {
+    uint64_t transactions;     // Transactions that journaled anything
+    uint64_t records;          // Before-images saved
+    uint64_t skipped;          // Fetches of a page already saved in the same transaction - no second record
+    uint64_t bytes_saved;      // ...the journal bytes those records would have been
+    uint64_t deltas;           // Records written as a delta instead of the image
+    uint64_t delta_bytes_saved;  // ...bytes of images they left out
+    uint64_t writes;           // pwritev() calls
+    uint64_t bytes_written;
+    uint64_t syncs;            // fdatasync() calls - one per transaction, plus one for a flush in the middle of one
+    uint64_t rollbacks;
+    uint64_t pages_restored;   // Images handed back by journal_rollback() and journal_rollback_to()
+    uint64_t savepoint_rollbacks;  // journal_rollback_to() calls
+} JournalStats;
+
+typedef struct {
+    int fd;                    // -1 without a journal - read-only, WAL, memory DB or no PAGER_JOURNALING_ENABLED
+    uint32_t page_size;
+    bool active;               // Between journal_begin() and journal_reset()
+    uint32_t generation;       // Bumped by every journal_begin() - a mark from an earlier transaction is no good
+    JournalHeader header;      // The current transaction's - written with its first records
+    uint32_t mark_page_count;  // Pages at the newest mark - the ones past it are new, there's nothing to save
+    Bitmap journaled;          // Pages with a record since the newest mark
+    Bitmap saved;              // Pages with a record this transaction - journal_mark() leaves it alone
+    Bitmap saved_twice;        // ...and with more than one, across a mark. None of their records can be a delta
+    uint64_t end;              // File offset the next write goes to - 0 until the header is written
+    uint32_t records;          // Records in the current transaction, written or still buffered
+    uint32_t synced_records;   // ...of which fdatasync()-ed
+    Bitmap unsynced;           // Pages whose record isn't fdatasync()-ed yet - they can't be written back until it is
+
+    // Write buffer - records waiting for the next pwritev()
+    JournalRecordHeader* pending_headers;
+    uint8_t* pending;          // JOURNAL_BUFFER_PAGES page images, page aligned
+    uint8_t* deltas;           // A page_size / JOURNAL_DELTA_FRACTION slot per image, for its delta
+    uint8_t* scratch;          // One page - deltas are applied on it
+    uint32_t pending_count;
+
+    JournalStats stats;
+} JournalPager;
+
+/* Open or create the journal - the file is left empty until a transaction has something to save. PSQL_BUSY if another
+ * pager has it open */
+PSqlStatus journal_open(JournalPager* journal, const char* filename, uint32_t page_size);
+void journal_close(JournalPager* journal);
+
+/* Transactions - pages numbered db_page_count and up are new, they have no before-image to save */
+PSqlStatus journal_begin(JournalPager* journal, uint32_t db_page_count);
+bool journal_wants_page(const JournalPager* journal, uint32_t page_no);  // Active, not new, and not saved yet
+bool journal_page_saved(JournalPager* journal, uint32_t page_no);        // Saved already this transaction - counted as skipped
+bool journal_buffer_full(const JournalPager* journal);                   // journal_flush() before the next journal_add_page()
+bool journal_page_unsynced(const JournalPager* journal, uint32_t page_no);  // journal_sync() before writing the page back
+PSqlStatus journal_add_page(JournalPager* journal, uint32_t page_no, const void* image);
+/* The page as it is now, copied into image. PSQL_NOTFOUND if there is no such copy to build a delta on - the page is
+ * about to be cut off the file, say. The image record is kept then */
+typedef PSqlStatus (*JournalReadFn)(void* ctx, uint32_t page_no, void* image);
+
+// The transaction changes no more pages - buffered records that would be smaller as deltas become deltas
+PSqlStatus journal_encode_deltas(JournalPager* journal, JournalReadFn read, void* ctx);
+PSqlStatus journal_flush(JournalPager* journal);  // Write the buffer out - no fdatasync()
+PSqlStatus journal_sync(JournalPager* journal);   // Flush and fdatasync() - a no-op if every record is durable already
+PSqlStatus journal_reset(JournalPager* journal);  // Transaction over - truncate the file and forget the records
+void journal_stop(JournalPager* journal);         // Save no more pages, keep the records - for a rollback, or a commit that failed
+
+/* Hand the before-image of every record of the current transaction to restore, newest first - journal_stop() it first.
+ * Deltas are applied to the page read gives back, which has to be the page as the transaction left it or as restore
+ * left it. The file stays as it is, journal_reset() once the restored pages are durable. Stops at the first callback
+ * that doesn't return PSQL_OK */
+typedef PSqlStatus (*JournalRestoreFn)(void* ctx, uint32_t page_no, const void* image);
+PSqlStatus journal_rollback(JournalPager* journal, JournalReadFn read, JournalRestoreFn restore, void* ctx);
+
+/* Savepoints - a mark is where the journal was when it was set. Pages are saved again the first time they are fetched
+ * after a mark, so journal_rollback_to() only has to undo the records after it. journal_mark() (re)starts saving pages,
+ * pages numbered db_page_count and up have nothing to save */
+typedef struct {
+    uint32_t records;          // Records before the mark
+    uint64_t offset;           // File offset of the first record after it
+    uint32_t db_page_count;
+    uint32_t generation;       // The transaction it was set in
+} JournalMark;
+
+PSqlStatus journal_mark(JournalPager* journal, uint32_t db_page_count, JournalMark* mark);
+// Same as journal_rollback() for the records after mark - journal_stop() first, and journal_mark() again to carry on.
+// PSQL_MISUSE for a mark from another transaction
+PSqlStatus journal_rollback_to(JournalPager* journal, const JournalMark* mark, JournalReadFn read, JournalRestoreFn restore, void* ctx);
+
+/* Crash recovery - undo a hot journal left next to db_filename, on up to JOURNAL_RECOVERY_THREADS threads, then cut
+ * the database back to its size before the transaction, fdatasync() it and delete the journal. A journal with no valid
+ * records is just deleted, one a pager holds is left alone. Nothing may have the database open yet.
+ *
+ * A page whose oldest record doesn't undo to its image checksum can never be put back, however often recovery runs.
+ * The rest is still restored, and the journal is renamed with JOURNAL_FAILED_SUFFIX instead of deleted, so it doesn't
+ * stop every later open - pages_failed says how many pages were left as the file had them. An I/O error leaves the
+ * journal where it is for the next open to try again */
+typedef struct {
+    bool recovered;            // There was a hot journal, and it has been rolled back
+    uint32_t records;          // Valid records in it - a torn write at the end is ignored
+    uint32_t pages_restored;
+    uint32_t pages_failed;     // Pages none of whose records could be undone - the journal was kept as JOURNAL_FAILED_SUFFIX
+    uint32_t threads;
+    uint32_t db_page_count;    // Size the database was cut back to
+    uint64_t duration_ns;
+} JournalRecoveryStats;
+
+PSqlStatus journal_recover(const char* filename, const char* db_filename, JournalRecoveryStats* stats);
+
+#endif /* PRESEQL_PAGER_JOURNAL_H */
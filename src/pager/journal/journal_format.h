@@ -1,40 +1,63 @@
-/* Journal handles transactions - e.g when BEGIN TRANSACTION is performed
-* This is a separate file from the main db file
-* as having two dynamically growing regions in one db file 
-* is too much trouble to keep track of.
-* 
-* Journal creates a copy of pages that have been modified during transaction
-* It only clears its journal of modified pages on COMMIT
-* i.e the client is certain of changes
-* ROLLBACK can allow for copying back the original data back the pages
-*/
+/* Rollback journal file format - the `.pseql-journal` file next to the database (PAGER_JOURNALING_ENABLED)
+ *
+ * [ JournalHeader ] 32 bytes
+ * [ JournalRecordHeader | page image ] record 0
+ * [ JournalRecordHeader | delta ] record 1
+ * ...
+ *
+ * Each record is the before-image of one page, as it was when the transaction began. The log is append only -
+ * records go out in big sequential writes, the header with the first of them. It is only worth anything while
+ * it has records in it: a commit truncates the file once the database pages are durable, so a journal with
+ * records is one a transaction never finished.
+ *
+ * A record is the whole image, or a delta: the before-image bytes of just the ranges that changed, each behind a
+ * JournalDeltaRange. A delta is against the page as the transaction left it, so it only works on top of that page
+ * (or on top of the before-image itself, where the page was never written back) - records are undone newest first,
+ * and the image checksum is checked once a delta is applied.
+ *
+ * Every record carries the header's salt, which is new for every transaction. Records left in the file by an
+ * older transaction (say the truncate never reached the disk) can never pass for records of the current one.
+ * Checksums are CRC-32C - this is a newer format than the WAL's, and it's the one with an instruction for it.
+ */
 
 #ifndef PRESEQL_PAGER_JOURNAL_FORMAT_H
 #define PRESEQL_PAGER_JOURNAL_FORMAT_H
 
 #include <stdint.h>
-#include "base/page.h"
-#include "data/page.h"
-#include "index/page.h"
-
-// Note: Journal is a lil special - the data pages are always 100% filled. i.e no vaccuming nor slots. Only one Index page can make to a Data page, negating the need for a reference counter.
-// Meanwhile the index pages function the exact same as before
-//
-//TODO: A journal page should only be allowed to rollback if transaction id reported by the VM does not have any untracked transactions in between the numbers. otherwise, psql_step() should return invalid operation
-//TODO: A journal page also has transaction names in practice - this might need a new B+ table in the journal itself?
-// If Journal is implemented, on database opening:
-// 1) `mmap()` file - Create a blank journal file with only the header metadata. This serves as a blank canvas for any transactions later on.
-// 2) If transaction happens via `BEGIN TRANSACTIONS`: Create the necessary copies of the pages into Journal. This is handled by VM.
-// 3) If transaction number returned by the VM is not continguous with the highest transaction number seen by the journal - this invalidate the whole journal. Journal is cleared and reinitialized.
-
-
-// Journal operations
-PSqlStatus journal_init(const char* db_filename);
-PSqlStatus journal_close();
-PSqlStatus journal_begin_transaction(uint32_t txn_id);
-PSqlStatus journal_add_page(uint32_t txn_id, uint32_t page_no, const uint8_t* page_data, uint16_t data_size);
-PSqlStatus journal_commit_transaction(uint32_t txn_id);
-PSqlStatus journal_rollback_transaction(uint32_t txn_id);
-PSqlStatus journal_is_valid_transaction(uint32_t txn_id);
-
-#endif
+#include "pager/constants.h"
+
+#define JOURNAL_MAGIC "PSQLJNL"  /* 7 chars + null terminator fills the 8 byte magic */
+#define JOURNAL_VERSION 1
+
+typedef struct {
+    char magic[MAGIC_NUMBER_SIZE];  // JOURNAL_MAGIC
+    uint32_t version;               // JOURNAL_VERSION
+    uint32_t page_size;             // Must match the database
+    uint32_t salt;                  // Random per transaction - records with a different one are stale
+    uint32_t db_page_count;         // Database size in pages when the transaction began - rollback cuts it back to this
+    uint32_t reserved;
+    uint32_t checksum;              // CRC-32C of everything above
+} JournalHeader;
+
+#define JOURNAL_RECORD_IMAGE 1  /* The whole page */
+#define JOURNAL_RECORD_DELTA 2  /* Changed ranges only */
+
+typedef struct {
+    uint32_t page_no;          // Page this record is the before-image of
+    uint32_t salt;             // Copy of JournalHeader.salt
+    uint32_t type;             // JOURNAL_RECORD_IMAGE or JOURNAL_RECORD_DELTA
+    uint32_t length;           // Bytes after this header - page_size for an image
+    uint32_t image_checksum;   // CRC-32C of the before-image - for a delta, of the page once it is applied
+    uint32_t checksum;         // CRC-32C of everything above
+} JournalRecordHeader;
+
+// One changed range in a delta, followed by its length bytes of the before-image
+typedef struct {
+    uint16_t offset;
+    uint16_t length;
+} JournalDeltaRange;
+
+#define JOURNAL_HEADER_SIZE (sizeof(JournalHeader))
+#define JOURNAL_RECORD_SIZE(page_size) (sizeof(JournalRecordHeader) + (page_size))  /* An image record */
+
+#endif /* PRESEQL_PAGER_JOURNAL_FORMAT_H */
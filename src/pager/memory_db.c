@@ -0,0 +1,146 @@
+#define _GNU_SOURCE  /* memfd_create, fdatasync under -std=c99 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "memory_db.h"
+#include "pager/pager.h"
+#include "pager/pager_format.h"
+#include "pager/page_checksum.h"
+#include "pager/file_io.h"
+#include "algorithm/crc.h"
+
+#define UNDO_LOG_MIN_PAGES 16
+
+int memory_db_create(const char* name) {
+    int fd = memfd_create(name, MFD_CLOEXEC);
+    if (fd < 0) perror("memfd_create");
+    return fd;
+}
+
+
+/* Undo log */
+static bool grow_undo_log(UndoLog* log, uint32_t page_size) {
+    uint32_t capacity = log->capacity ? log->capacity * 2 : UNDO_LOG_MIN_PAGES;
+    uint32_t* pages = (uint32_t*)realloc(log->pages, capacity * sizeof(uint32_t));
+    if (!pages) return false;
+    log->pages = pages;
+    uint8_t* images = (uint8_t*)realloc(log->images, (size_t)capacity * page_size);
+    if (!images) return false;
+    log->images = images;
+    log->capacity = capacity;
+    return true;
+}
+
+// Readers fetch pages while a transaction is open too - whoever gets to a page first saves it, under the lock
+PSqlStatus undo_log_save(Pager* pager, uint32_t page_no) {
+    UndoLog* log = &pager->undo_log;
+    uint32_t page_size = pager->db_pager.page_size;
+    PSqlStatus status = PSQL_OK;
+
+    pthread_mutex_lock(&pager->lock);
+    if (page_no >= log->saved.num_bits && !bitmap_resize(&log->saved, pager->txn_page_count)) {
+        status = PSQL_NOMEM;
+    } else if (!bitmap_test(&log->saved, page_no)) {
+        if (log->count == log->capacity && !grow_undo_log(log, page_size)) {
+            status = PSQL_NOMEM;
+        } else {
+            memcpy(log->images + (size_t)log->count * page_size,
+                   (uint8_t*)pager->db_pager.mem_start + GET_PAGE_OFFSET(pager, page_no), page_size);
+            log->pages[log->count++] = page_no;
+            bitmap_set(&log->saved, page_no);
+            pager->io_stats.undo_pages++;
+        }
+    }
+    pthread_mutex_unlock(&pager->lock);
+    return status;
+}
+
+void undo_log_restore(Pager* pager) {
+    UndoLog* log = &pager->undo_log;
+    uint32_t page_size = pager->db_pager.page_size;
+    for (uint32_t i = 0; i < log->count; i++) {
+        memcpy((uint8_t*)pager->db_pager.mem_start + GET_PAGE_OFFSET(pager, log->pages[i]),
+               log->images + (size_t)i * page_size, page_size);
+    }
+}
+
+// Only the saved bits get cleared - a small transaction doesn't pay for a bitmap the size of the DB.
+// A log that grew for one big transaction gives its memory back instead of holding on to it
+void undo_log_clear(Pager* pager) {
+    UndoLog* log = &pager->undo_log;
+    pthread_mutex_lock(&pager->lock);
+    for (uint32_t i = 0; i < log->count; i++) bitmap_clear(&log->saved, log->pages[i]);
+    log->count = 0;
+    if (log->capacity > UNDO_LOG_KEEP_PAGES) {
+        free(log->pages);
+        free(log->images);
+        log->pages = NULL;
+        log->images = NULL;
+        log->capacity = 0;
+    }
+    pthread_mutex_unlock(&pager->lock);
+}
+
+void undo_log_free(UndoLog* log) {
+    bitmap_free(&log->saved);
+    free(log->pages);
+    free(log->images);
+    memset(log, 0, sizeof(*log));
+}
+
+
+/* Serializing to a file */
+// The header gets the checksum pager_close_db() would give it, on a copy - the DB carries on without touching page 0.
+// Everything after it goes out straight from the mapping in one write
+PSqlStatus memory_db_serialize(Pager* pager, const char* path) {
+    DatabasePager* db = &pager->db_pager;
+    char* tmp_filename = with_extension(path, SERIALIZE_FILE_EXTENSION);
+    char* wal_filename = with_extension(path, WAL_FILE_EXTENSION);
+    uint8_t* header_page = (uint8_t*)malloc(db->page_size);
+    PSqlStatus status = PSQL_NOMEM;
+    int fd = -1;
+    if (!tmp_filename || !wal_filename || !header_page) goto done;
+
+    fd = open(tmp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("open");
+        status = PSQL_IOERR;
+        goto done;
+    }
+
+    memcpy(header_page, db->mem_start, db->page_size);
+    DatabaseHeader* header = (DatabaseHeader*)((DBPage*)header_page)->data;
+    header->checksum = calculate_crc32(header, offsetof(DatabaseHeader, checksum));
+    if (pager->page_checksums) page_checksum_seal((DBPage*)header_page, db->page_size);
+
+    status = pwrite_all(fd, header_page, db->page_size, 0);
+    if (status == PSQL_OK && db->page_count > 1) {
+        status = pwrite_all(fd, (uint8_t*)db->mem_start + db->page_size, GET_PAGE_OFFSET(pager, db->page_count - 1), db->page_size);
+    }
+    if (status == PSQL_OK && fdatasync(fd) != 0) {
+        perror("fdatasync");
+        status = PSQL_IOERR;
+    }
+    close(fd);
+    if (status != PSQL_OK) goto done;
+
+    // A WAL left over from whatever was at path would replay onto the new file
+    unlink(wal_filename);
+    if (rename(tmp_filename, path) != 0) {
+        perror("rename");
+        status = PSQL_IOERR;
+        goto done;
+    }
+    status = sync_parent_dir(path);
+
+done:
+    if (status != PSQL_OK && fd >= 0) unlink(tmp_filename);
+    free(tmp_filename);
+    free(wal_filename);
+    free(header_page);
+    return status;
+}
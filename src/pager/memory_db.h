@@ -0,0 +1,41 @@
+/* In-memory database (PAGER_MEMORY_DB) - caches and test fixtures that never need to outlive the process
+ *
+ * The pages live in a memfd instead of a file on disk. Everything else about mmap mode stays the same: the memfd is
+ * mapped over the address space reservation and grows in extents like a file would, so DBPage* pointers stay put and
+ * vacuum can still truncate it. The filename passed to init_pager() is only the memfd's name - nothing is created on disk,
+ * and the pages are gone once the pager is closed.
+ *
+ * Nothing is ever synced - there is no disk for a msync()/fdatasync() to wait on, so a commit only seals checksums
+ * and clears the dirty bitmap. There is no journal or WAL either, rollback goes through an undo log instead: the first
+ * time a transaction fetches a page that existed when it began, the page is copied into the log before the caller gets
+ * to change it (pages are changed in place, pager_write_page() comes too late). pager_rollback() copies the images
+ * back, pager_commit() just forgets them. Pages the transaction allocated need no image - rollback cuts page_count back
+ * below them.
+ *
+ * pager_serialize() writes the pages out as an ordinary .pseql file, which opens like any other database.
+ */
+
+#ifndef PRESEQL_PAGER_MEMORY_DB_H
+#define PRESEQL_PAGER_MEMORY_DB_H
+
+#include <stdint.h>
+#include "pager/types.h"
+#include "status/db.h"
+
+// memfd to keep the pages in - name only shows up in /proc/<pid>/fd. -1 on failure
+int memory_db_create(const char* name);
+
+// Save the before-image of a page fetched inside a transaction, unless it has one already. Takes the pager lock
+PSqlStatus undo_log_save(Pager* pager, uint32_t page_no);
+
+// Copy every image back into the mapping - the log itself is kept until undo_log_clear()
+void undo_log_restore(Pager* pager);
+
+// The transaction is over - forget its images
+void undo_log_clear(Pager* pager);
+void undo_log_free(UndoLog* log);
+
+// Write pages [0, page_count) to "<path>.pseql-serialize", sync it and rename it to path. The caller keeps writers out
+PSqlStatus memory_db_serialize(Pager* pager, const char* path);
+
+#endif /* PRESEQL_PAGER_MEMORY_DB_H */
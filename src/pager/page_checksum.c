@@ -0,0 +1,38 @@
+#include <string.h>
+
+#include "page_checksum.h"
+#include "algorithm/crc.h"
+
+// The header goes through a copy with PAGE_PINNED cleared, the rest is summed where it is
+uint32_t page_checksum(const DBPage* page, uint32_t page_size) {
+    DBPageHeader header = page->header;
+    header.flag &= ~PAGE_PINNED;
+    uint32_t crc = crc32_update(0, &header, sizeof(header));
+    return crc32_update(crc, page->data, PAGE_CHECKSUM_OFFSET(page_size) - sizeof(DBPageHeader));
+}
+
+void page_checksum_seal(DBPage* page, uint32_t page_size) {
+    uint32_t crc = page_checksum(page, page_size);
+    memcpy((uint8_t*)page + PAGE_CHECKSUM_OFFSET(page_size), &crc, PAGE_CHECKSUM_SIZE);
+}
+
+// Never written - PAGE_PINNED aside, since a buffer pool frame is pinned while we look at it
+static bool page_is_zero(const DBPage* page, uint32_t page_size) {
+    DBPageHeader header = page->header, zero;
+    header.flag &= ~PAGE_PINNED;
+    memset(&zero, 0, sizeof(zero));
+    if (memcmp(&header, &zero, sizeof(header)) != 0) return false;
+
+    const uint64_t* words = (const uint64_t*)page->data;
+    for (size_t i = 0; i < (page_size - sizeof(DBPageHeader)) / sizeof(uint64_t); i++) {
+        if (words[i]) return false;
+    }
+    return true;
+}
+
+bool page_checksum_verify(const DBPage* page, uint32_t page_size) {
+    uint32_t stored;
+    memcpy(&stored, (const uint8_t*)page + PAGE_CHECKSUM_OFFSET(page_size), PAGE_CHECKSUM_SIZE);
+    if (stored == page_checksum(page, page_size)) return true;
+    return stored == 0 && page_is_zero(page, page_size);
+}
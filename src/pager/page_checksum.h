@@ -0,0 +1,25 @@
+/* Per-page checksums - optional, picked when the DB is created (PAGER_PAGE_CHECKSUMS, stored as DB_PAGE_CHECKSUMS)
+ *
+ * Every page carries a CRC-32 of itself in its last 4 bytes, which sit in the reserved tail (DB_PAGE_RESERVED) so the
+ * usable size doesn't change. The pager seals a page when it flushes it - only dirty pages pay for it - and checks it the
+ * first time the page is fetched in a session, so a torn or bit-rotted page is caught before anything reads it.
+ *
+ * PAGE_PINNED is masked out of the sum since it only exists in buffer pool memory.
+ * A page that was never written (all zeros - preallocated extent or a hole) passes with a zero checksum.
+ */
+
+#ifndef PRESEQL_PAGER_PAGE_CHECKSUM_H
+#define PRESEQL_PAGER_PAGE_CHECKSUM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pager/db/base/page.h"
+
+#define PAGE_CHECKSUM_SIZE sizeof(uint32_t)
+#define PAGE_CHECKSUM_OFFSET(page_size) ((page_size) - PAGE_CHECKSUM_SIZE)  // Last 4 bytes of the page
+
+uint32_t page_checksum(const DBPage* page, uint32_t page_size);
+void page_checksum_seal(DBPage* page, uint32_t page_size);
+bool page_checksum_verify(const DBPage* page, uint32_t page_size);
+
+#endif /* PRESEQL_PAGER_PAGE_CHECKSUM_H */
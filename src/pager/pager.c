@@ -1,3 +1,4 @@
+#define _GNU_SOURCE  /* fallocate, MAP_NORESERVE, strdup under -std=c99 */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,451 +6,1287 @@
 #include <unistd.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "pager.h"
 #include "pager/constants.h"
 #include "pager_format.h"
 #include "pager/db/free_space.h"
 #include "algorithm/crc.h"
+#include "pager/wal/checkpointer.h"
+#include "pager/group_commit.h"
+#include "pager/upgrade.h"
+#include "pager/page_checksum.h"
+#include "pager/db/vacuum.h"
+#include "pager/db/vacuum_into.h"
+#include "pager/memory_db.h"
+#include "pager/backup.h"
 
-void* resize_mmap(int fd, void* old_map, size_t old_size, size_t new_size) {
-    // Ensure file is big enough
-    if (ftruncate(fd, new_size) != 0) {
-        perror("ftruncate");
-        return NULL;
-    }
+static uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
-    // Unmap old region
-    if (munmap(old_map, old_size) != 0) {
-        perror("munmap");
-        return NULL;
-    }
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
-    // Map new region
-    void* new_map = mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (new_map == MAP_FAILED) {
-        perror("mmap");
-        return NULL;
-    }
 
-    return new_map;
+/* Statistics and tracing - see pager/stats.h */
+// 0 if the operation isn't being timed - the clock is only read when a histogram or the trace callback wants it
+static uint64_t stats_start(Pager* pager) {
+    return ((pager->flags & PAGER_STATS_TIMING) || pager->trace) ? now_ns() : 0;
 }
 
-// Grows the file by one page and returns a pointer to the new page - do the same for journal. Returns the page id of the page allocated
-uint16_t allocate_new_db_page(Pager* pager) {
-    DatabasePager* db = &pager->db_pager;
-
-    // Determine current mapped size
-    off_t current_size = lseek(db->fd, 0, SEEK_END);
-    if (current_size < 0) {
-        perror("lseek");
-        return 0; // Return 0 instead of NULL for uint16_t return type
+// Count an event, time it if it was started with a clock reading, and hand it to the trace callback
+static void pager_event(Pager* pager, PagerTraceType type, uint32_t page_no, uint32_t count, PageKind kind, uint64_t start_ns) {
+    PagerStats* stats = &pager->stats;
+    int op = -1;
+    switch (type) {
+        case PAGER_TRACE_GET: stats_add(&stats->kinds[kind].gets, 1); op = PAGER_OP_GET_PAGE; break;
+        case PAGER_TRACE_WRITE: stats_add(&stats->kinds[kind].writes, 1); break;
+        case PAGER_TRACE_FORMAT: stats_add(&stats->kinds[kind].formatted, 1); break;
+        case PAGER_TRACE_ALLOCATE: stats_add(&stats->pages_allocated, count); op = PAGER_OP_ALLOCATE; break;
+        case PAGER_TRACE_REMAP: stats_add(&stats->remaps, 1); break;
+        case PAGER_TRACE_SYNC:
+            stats_add(&stats->syncs, 1);
+            stats_add(&stats->pages_synced, count);
+            op = PAGER_OP_SYNC;
+            break;
+        case PAGER_TRACE_JOURNAL_WRITE:
+            stats_add(&stats->journal_writes, 1);
+            stats_add(&stats->journal_pages, count);
+            op = PAGER_OP_JOURNAL_WRITE;
+            break;
     }
 
-    // Calculate new size
-    size_t new_size = current_size + PAGE_SIZE;
-
-    // Resize and remap
-    void* new_map = resize_mmap(db->fd, db->mem_start, current_size, new_size);
-    if (!new_map) return 0; // Return 0 instead of NULL for uint16_t return type
+    uint64_t duration_ns = 0;
+    if (start_ns && op >= 0) {
+        duration_ns = now_ns() - start_ns;
+        latency_histogram_record(&stats->latency[op], duration_ns);
+    }
+    if (pager->trace) {
+        PagerTraceEvent event = { type, page_no, count, kind, duration_ns };
+        pager->trace(pager->trace_ctx, &event);
+    }
+}
 
-    db->mem_start = new_map;
+static void process_faults(uint64_t faults[2]) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        faults[0] = faults[1] = 0;
+        return;
+    }
+    faults[0] = (uint64_t)usage.ru_minflt;
+    faults[1] = (uint64_t)usage.ru_majflt;
+}
 
-    // Return the page id of the newly allocated page
-    uint16_t page_id = current_size / PAGE_SIZE;
-    return page_id;
+PagerStats pager_get_stats(Pager* pager) {
+    PagerStats stats;
+    memset(&stats, 0, sizeof(stats));
+    if (!pager) return stats;
+    stats_snapshot(&pager->stats, &stats);
+    uint64_t faults[2];
+    process_faults(faults);
+    stats.minor_faults = faults[0] - pager->faults_at_open[0];
+    stats.major_faults = faults[1] - pager->faults_at_open[1];
+    return stats;
 }
 
-// Probs more useful if you initializing DB file - you will always attempt to create multiple pages at one go. Returns the highest page id allocated.
-uint16_t allocate_new_db_pages(Pager* pager, size_t num_pages) {
-    if (num_pages == 0) return 0; // Return 0 instead of NULL for uint16_t return type
+// Faults start over too
+void pager_reset_stats(Pager* pager) {
+    if (!pager) return;
+    stats_reset(&pager->stats);
+    process_faults(pager->faults_at_open);
+}
 
-    DatabasePager* db = &pager->db_pager;
+void pager_set_trace(Pager* pager, PagerTraceFn trace, void* ctx) {
+    if (!pager) return;
+    pager->trace_ctx = ctx;
+    pager->trace = trace;
+}
 
-    // Determine current file size
-    off_t old_size = lseek(db->fd, 0, SEEK_END);
-    if (old_size < 0) {
-        perror("lseek");
-        return 0; // Return 0 instead of NULL for uint16_t return type
+// Reserve virtual address space for the whole database up front - PROT_NONE + MAP_NORESERVE costs no memory or swap
+// The file gets mapped over the start of it with MAP_FIXED and grows into the rest, so the base address never moves
+// The base is HUGE_PAGE_SIZE aligned - file offset 0 has to land on a huge page boundary for THP to back the mapping
+void* reserve_mmap(size_t reserve_size) {
+    uint8_t* raw = mmap(NULL, reserve_size + HUGE_PAGE_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
     }
+    uint8_t* base = (uint8_t*)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    if (base > raw) munmap(raw, base - raw);
+    munmap(base + reserve_size, raw + HUGE_PAGE_SIZE - base);
+    return base;
+}
 
-    size_t growth = num_pages * PAGE_SIZE;
-    size_t new_size = old_size + growth;
+// Make sure the file has blocks for [offset, offset + len) - fallocate if the filesystem supports it
+static int preallocate_file(int fd, size_t offset, size_t len) {
+#ifdef __linux__
+    if (fallocate(fd, 0, offset, len) == 0) return 0;
+    if (errno != EOPNOTSUPP && errno != ENOSYS) {
+        perror("fallocate");
+        return -1;
+    }
+#endif
+    // No fallocate (e.g tmpfs on old kernels, non-Linux) - a sparse extend is still correct, just less contiguous
+    if (ftruncate(fd, offset + len) != 0) {
+        perror("ftruncate");
+        return -1;
+    }
+    return 0;
+}
 
-    // Resize and remap
-    void* new_map = resize_mmap(db->fd, db->mem_start, old_size, new_size);
-    if (!new_map) return 0; // Return 0 instead of NULL for uint16_t return type
+// Grow the physical file by geometric extents - doubling, clamped to [DB_GROWTH_MIN_SIZE, DB_GROWTH_MAX_SIZE]
+// This way a bulk insert does a handful of fallocate()/mmap() calls instead of a remap per page
+static size_t next_extent(DatabasePager* db, size_t needed) {
+    size_t growth = db->file_size;
+    if (growth < DB_GROWTH_MIN_SIZE) growth = DB_GROWTH_MIN_SIZE;
+    if (growth > DB_GROWTH_MAX_SIZE) growth = DB_GROWTH_MAX_SIZE;
 
-    db->mem_start = new_map;
+    size_t new_size = db->file_size + growth;
+    if (new_size < needed) new_size = needed;
+    new_size = (new_size + db->page_size - 1) / db->page_size * db->page_size;
+    if (db->reserved_size && new_size > db->reserved_size) new_size = db->reserved_size;
+    return new_size;
+}
 
-    // Return the highest page id allocated
-    uint16_t start_page_id = old_size / PAGE_SIZE;
-    return start_page_id + num_pages - 1;
+// A read-only WAL pager still writes WAL images into its private mapping, which never reaches the file
+static int db_map_prot(Pager* pager) {
+    return (pager->read_only && !(pager->flags & PAGER_WAL)) ? PROT_READ : (PROT_READ | PROT_WRITE);
 }
 
+// WAL mode maps the file privately - modified pages are copy-on-write and never reach the file behind our back
+static int db_map_flags(Pager* pager) {
+    return ((pager->flags & PAGER_WAL) ? MAP_PRIVATE : MAP_SHARED) | MAP_FIXED;
+}
 
-void init_free_page_map(Pager* pager) {
-    pager->db_pager.free_page_map = malloc(sizeof(PageTracker));
-    if (!pager->db_pager.free_page_map) return;
-    
-    pager->db_pager.free_page_map->num_frees = 0;
-    pager->db_pager.free_page_map->tree = *radix_tree_create();
-    
-    // Get the database header from page 0
-    DBPage* header_page = pager_get_page(pager, 0);
-    if (!header_page) return;
-    
-    DatabaseHeader* header = (DatabaseHeader*)header_page->data;
-    
-    // Load free pages from header into radix tree
-    for (int i = 0; i < header->free_page_count; i++) {
-        uint16_t page_no = header->free_page_list[i];
-        if (page_no > 0) {
-            radix_tree_insert(&pager->db_pager.free_page_map->tree, page_no);
-            pager->db_pager.free_page_map->num_frees++;
-        }
-    }
+// PagerAccessPattern as madvise()/posix_fadvise() advice
+static int madvise_advice(int pattern) {
+    return pattern == PAGER_ACCESS_RANDOM ? MADV_RANDOM : pattern == PAGER_ACCESS_SEQUENTIAL ? MADV_SEQUENTIAL : MADV_NORMAL;
 }
 
-// Mark a page number as free
-void mark_page_free(Pager* pager, uint16_t page_no) {
-    radix_tree_insert(&pager->db_pager.free_page_map->tree, page_no);
-    pager->db_pager.free_page_map->num_frees++;
-    
-    // Get the database header from page 0
-    DBPage* header_page = pager_get_page(pager, 0);
-    if (!header_page) return;
-    
-    DatabaseHeader* header = (DatabaseHeader*)header_page->data;
-    
-    // Update header if we have space in the inline free list
-    if (header->free_page_count < FREE_PAGE_LIST_SIZE) {
-        header->free_page_list[header->free_page_count++] = page_no;
-        // Mark the header page as needing to be written back to disk
-        pager_write_page(pager, header_page);
-    }
+static int fadvise_advice(int pattern) {
+    return pattern == PAGER_ACCESS_RANDOM ? POSIX_FADV_RANDOM : pattern == PAGER_ACCESS_SEQUENTIAL ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_NORMAL;
 }
 
-// Mark a page number as allocated
-void mark_page_used(Pager* pager, uint16_t page_no) {
-    radix_tree_delete(&pager->db_pager.free_page_map->tree, page_no);
-    if (pager->db_pager.free_page_map->num_frees > 0) {
-        pager->db_pager.free_page_map->num_frees--;
+// Read-only open of a v1 file - swap in a private writable mapping, convert every page, then make it read-only again
+// (a WAL pager keeps it writable, it writes WAL images into the mapping)
+static PSqlStatus upgrade_mapping(Pager* pager) {
+    DatabasePager* db = &pager->db_pager;
+    int prot = PROT_READ | PROT_WRITE;
+    if (mmap(db->mem_start, db->file_size, prot, MAP_PRIVATE | MAP_FIXED, db->fd, 0) == MAP_FAILED) {
+        perror("mmap");
+        return PSQL_IOERR;
     }
-    
-    // Get the database header from page 0
-    DBPage* header_page = pager_get_page(pager, 0);
-    if (!header_page) return;
-    
-    DatabaseHeader* header = (DatabaseHeader*)header_page->data;
-    
-    // Update highest page if necessary
-    if (page_no > header->highest_page) {
-        header->highest_page = page_no;
-        // Mark the header page as needing to be written back to disk
-        pager_write_page(pager, header_page);
+    for (uint32_t page_no = 0; page_no < db->file_size / db->page_size; page_no++) {
+        PSqlStatus status = upgrade_page((uint8_t*)db->mem_start + GET_PAGE_OFFSET(pager, page_no), page_no);
+        if (status != PSQL_OK) return status;
     }
+    if (db_map_prot(pager) != prot && mprotect(db->mem_start, db->file_size, db_map_prot(pager)) != 0) {
+        perror("mprotect");
+        return PSQL_IOERR;
+    }
+    return PSQL_OK;
 }
 
-// Get a free page number, or return 0 if none
-uint16_t get_free_page(Pager* pager) {
-    uint16_t page_no = 0;
-    
-    // Check if we have any free pages in our tracker
-    if (pager->db_pager.free_page_map->num_frees > 0) {
-        // Get the minimum page number from the radix tree
-        page_no = radix_tree_pop_min(&pager->db_pager.free_page_map->tree);
-        
-        if (page_no > 0) {
-            pager->db_pager.free_page_map->num_frees--;
-            
-            // Get the database header from page 0
-            DBPage* header_page = pager_get_page(pager, 0);
-            if (!header_page) return 0;
-            
-            DatabaseHeader* header = (DatabaseHeader*)header_page->data;
-            
-            // Remove from inline free list
-            for (int i = 0; i < header->free_page_count; i++) {
-                if (header->free_page_list[i] == page_no) {
-                    // Shift remaining elements
-                    for (int j = i; j < header->free_page_count - 1; j++) {
-                        header->free_page_list[j] = header->free_page_list[j + 1];
-                    }
-                    header->free_page_count--;
-                    // Mark the header page as needing to be written back to disk
-                    pager_write_page(pager, header_page);
-                    break;
-                }
-            }
-            return page_no;
+// Extend the file and the mapping in place - existing DBPage* pointers stay valid
+// mremap() can't grow into our own reservation without MREMAP_MAYMOVE, so the new tail is mapped over it with MAP_FIXED
+PSqlStatus extend_mmap(Pager* pager, size_t needed) {
+    DatabasePager* db = &pager->db_pager;
+    if (needed <= db->file_size) return PSQL_OK;
+
+    size_t old_size = db->file_size;
+    size_t new_size = next_extent(db, needed);
+    if (new_size < needed) return PSQL_FULL;  // Out of reserved address space
+
+    // A memfd stays sparse - fallocate would take the whole extent out of memory up front
+    if (pager->flags & PAGER_MEMORY_DB) {
+        if (ftruncate(db->fd, (off_t)new_size) != 0) {
+            perror("ftruncate");
+            return PSQL_IOERR;
         }
+    } else if (preallocate_file(db->fd, old_size, new_size - old_size) != 0) {
+        return PSQL_IOERR;
     }
-    
-    // No free pages, allocate a new one
-    DBPage* header_page = pager_get_page(pager, 0);
-    if (!header_page) return 0;
-    
-    DatabaseHeader* header = (DatabaseHeader*)header_page->data;
-    return header->highest_page + 1;
+
+    if (!pager->buffer_pool) {
+        void* tail = mmap((uint8_t*)db->mem_start + old_size, new_size - old_size, db_map_prot(pager),
+                          db_map_flags(pager), db->fd, old_size);
+        if (tail == MAP_FAILED) {
+            perror("mmap");
+            return PSQL_IOERR;
+        }
+        // A fresh mapping starts out MADV_NORMAL without huge pages - carry the current advice over
+        int pattern = __atomic_load_n(&pager->access_pattern, __ATOMIC_RELAXED);
+        if (pattern != PAGER_ACCESS_NORMAL) madvise(tail, new_size - old_size, madvise_advice(pattern));
+        if (pager->flags & PAGER_HUGEPAGES) madvise(tail, new_size - old_size, MADV_HUGEPAGE);
+    }
+
+    db->file_size = new_size;
+    pager_event(pager, PAGER_TRACE_REMAP, 0, (uint32_t)(new_size / db->page_size), PAGE_KIND_OTHER, 0);
+    // The checkpointer clears stale bits - it can't be in the middle of that while the bitmap moves
+    pthread_mutex_lock(&pager->lock);
+    bool resized = bitmap_resize(&db->dirty_pages, new_size / db->page_size) &&
+                   bitmap_resize(&pager->wal_stale_pages, new_size / db->page_size) &&
+                   bitmap_resize(&pager->verified_pages, new_size / db->page_size);
+    pthread_mutex_unlock(&pager->lock);
+    return resized ? PSQL_OK : PSQL_NOMEM;
 }
 
-// Sync free page map with the header's free page list
-PSqlStatus sync_free_page_list(Pager* pager) {
-    // Get the database header from page 0
-    DBPage* header_page = pager_get_page(pager, 0);
-    if (!header_page) return PSQL_ERROR;
-    
-    DatabaseHeader* header = (DatabaseHeader*)header_page->data;
-    
-    // Clear current free page list
-    header->free_page_count = 0;
-    
-    // Collect up to FREE_PAGE_LIST_SIZE free pages from the radix tree
-    size_t count = 0;
-    size_t max_size = FREE_PAGE_LIST_SIZE;
-    
-    // Use radix_to_freelist to populate the header's free page list
-    count = radix_to_freelist(&pager->db_pager.free_page_map->tree, 
-                             header->free_page_list, 
-                             max_size);
-    
-    header->free_page_count = count;
-    
-    // Mark the header page as needing to be written back to disk
-    pager_write_page(pager, header_page);
-    
-    return PSQL_OK;
+// Hands out the next page past the end of the database - the file only grows when the preallocated extent runs out. Returns the page id of the page allocated
+uint32_t allocate_new_db_page(Pager* pager) {
+    DatabasePager* db = &pager->db_pager;
+    if (db->page_count >= MAX_PAGES) return 0;
+
+    uint64_t start = stats_start(pager);
+    if (extend_mmap(pager, GET_PAGE_OFFSET(pager, db->page_count + 1)) != PSQL_OK) return 0; // Return 0 instead of NULL for uint32_t return type
+
+    // Return the page id of the newly allocated page
+    uint32_t page_id = db->page_count++;
+    pager_event(pager, PAGER_TRACE_ALLOCATE, page_id, 1, PAGE_KIND_OTHER, start);
+    return page_id;
 }
 
+// Probs more useful if you initializing DB file - you will always attempt to create multiple pages at one go. Returns the highest page id allocated.
+uint32_t allocate_new_db_pages(Pager* pager, size_t num_pages) {
+    if (num_pages == 0) return 0; // Return 0 instead of NULL for uint32_t return type
+
+    DatabasePager* db = &pager->db_pager;
+    if (db->page_count + num_pages > MAX_PAGES) return 0;
+
+    uint64_t start = stats_start(pager);
+    if (extend_mmap(pager, GET_PAGE_OFFSET(pager, db->page_count + num_pages)) != PSQL_OK) return 0; // Return 0 instead of NULL for uint32_t return type
+
+    // Return the highest page id allocated
+    pager_event(pager, PAGER_TRACE_ALLOCATE, db->page_count, (uint32_t)num_pages, PAGE_KIND_OTHER, start);
+    db->page_count += num_pages;
+    return db->page_count - 1;
+}
+
+
 /* Page Allocation & Initialization */
-DBPage* allocate_page(Pager* pager, uint16_t page_no, uint8_t flag) {
-    // For memory-mapped files, get the page from the mapped region
-    DBPage* page = (DBPage*)((uint8_t*)pager->db_pager.mem_start + page_no * PAGE_SIZE);
-    memset(page, 0, sizeof(DBPage));
+// In buffer pool mode the page returned is pinned - release it with pager_unpin_page()
+DBPage* allocate_page(Pager* pager, uint32_t page_no, uint8_t flag) {
+    DBPage* page = pager_get_page(pager, page_no);
+    if (!page) return NULL;
+
+    uint8_t pinned = page->header.flag & PAGE_PINNED;  // Keep the pin across the wipe
+    memset(page, 0, pager->db_pager.page_size);
 
     page->header.page_id = page_no;
     page->header.ref_counter = 1;
-    page->header.flag = flag;
+    page->header.flag = flag | pinned;
     page->header.free_start = sizeof(DBPageHeader);
-    page->header.free_end = MAX_USABLE_PAGE_SIZE;
-    page->header.free_total = MAX_USABLE_PAGE_SIZE - sizeof(DBPageHeader);
+    page->header.free_end = PAGER_USABLE_SIZE(pager);
+    page->header.free_total = PAGER_USABLE_SIZE(pager) - sizeof(DBPageHeader);
     page->header.total_slots = 0;
     page->header.highest_slot = 0;
     page->header.free_slot_count = 0;
+    pager_write_page(pager, page);
+    pager_event(pager, PAGER_TRACE_FORMAT, page_no, 1, page_kind_of(page_no, flag), 0);
 
     // Mark the page as used
     mark_page_used(pager, page_no);
+    
+    // Nothing points at it yet - whoever links it in fills in the parent
+    uint8_t type = (flag & (PAGE_INDEX_INTERNAL | PAGE_INDEX_LEAF)) ? PTRMAP_BTREE : (flag & PAGE_OVERFLOW) ? PTRMAP_OVERFLOW : PTRMAP_DATA;
+    if (ptrmap_put(pager, page_no, type, 0, 0) != PSQL_OK) {
+        pager_unpin_page(pager, page);
+        return NULL;
+    }
     return page;
 }
 
 /* Specialized Factory methods for each type of Pages */
-DBPage* init_data_page(Pager* pager, uint16_t page_no) {
+DBPage* init_data_page(Pager* pager, uint32_t page_no) {
     return allocate_page(pager, page_no, PAGE_DATA);
 }
 
-DBPage* init_index_leaf_page(Pager* pager, uint16_t page_no) {
+DBPage* init_index_leaf_page(Pager* pager, uint32_t page_no) {
     return allocate_page(pager, page_no, PAGE_INDEX_LEAF);
 }
 
-DBPage* init_index_internal_page(Pager* pager, uint16_t page_no) {
+DBPage* init_index_internal_page(Pager* pager, uint32_t page_no) {
     return allocate_page(pager, page_no, PAGE_INDEX_INTERNAL);
 }
 
-DBPage* init_overflow_page(Pager* pager, uint16_t page_no) {
+DBPage* init_overflow_page(Pager* pager, uint32_t page_no) {
     return allocate_page(pager, page_no, PAGE_OVERFLOW);
 }
 
 
 /* Core pager functions */
+static PSqlStatus sync_db_file(void* ctx);
+static PSqlStatus sync_wal_file(void* ctx);
+static void end_transaction(Pager* pager);
+static PSqlStatus prepare_frame(void* ctx, uint32_t page_no, DBPage* page);
+
+// Options that live on the buffer pool itself - set again whenever pager_set_cache_size() swaps the pool
+static void configure_buffer_pool(Pager* pager) {
+    if (pager->page_checksums || (pager->flags & PAGER_JOURNALING_ENABLED)) buffer_pool_set_write_hook(pager->buffer_pool, prepare_frame, pager);
+    buffer_pool_set_compressed_cache(pager->buffer_pool, pager->compressed_cache);
+    if (pager->flags & PAGER_HUGEPAGES) buffer_pool_use_hugepages(pager->buffer_pool);
+}
+
+// Warm start for the buffer pool (PAGER_POPULATE) - fill the frames with the start of the file
+static void populate_buffer_pool(Pager* pager) {
+    if (!(pager->flags & PAGER_POPULATE)) return;
+    uint32_t warm = pager->db_pager.page_count < pager->cache_size ? pager->db_pager.page_count : (uint32_t)pager->cache_size;
+    pager_prefetch(pager, 0, warm);
+    for (uint32_t page_no = 0; page_no < warm; page_no++) pager_unpin_page(pager, pager_get_page(pager, page_no));
+}
+
+// Undo whatever init_pager() got through before failing
+static Pager* abort_init_pager(Pager* pager) {
+    checkpointer_stop(pager->checkpointer);
+    if (pager->wal) wal_close(pager->wal, false);
+    if (pager->buffer_pool) buffer_pool_destroy(pager->buffer_pool);
+    compressed_cache_destroy(pager->compressed_cache);
+    if (pager->db_pager.mem_start) munmap(pager->db_pager.mem_start, pager->db_pager.reserved_size);
+    if (pager->db_pager.fd >= 0) close(pager->db_pager.fd);
+    journal_close(&pager->journal_pager);
+    bitmap_free(&pager->db_pager.dirty_pages);
+    bitmap_free(&pager->wal_stale_pages);
+    bitmap_free(&pager->verified_pages);
+    ptrmap_free(pager);
+    undo_log_free(&pager->undo_log);
+    free(pager->wal_filename);
+    free(pager->journal_filename);
+    free(pager->filename);
+    group_commit_destroy(pager->group_commit);
+    pthread_mutex_destroy(&pager->writer_lock);
+    pthread_mutex_destroy(&pager->checkpoint_lock);
+    pthread_mutex_destroy(&pager->lock);
+    free(pager);
+    return NULL;
+}
+
+// Build "<filename><extension>" for the journal/WAL files
+static char* sidecar_filename(const char* filename, const char* extension) {
+    size_t len = strlen(filename) + strlen(extension) + 1;
+    char* name = (char*)malloc(len);
+    if (name) snprintf(name, len, "%s%s", filename, extension);
+    return name;
+}
+
+// Header of an existing file, for the settings it was created with (page size, checksums) - false if page 0 doesn't hold a v2 header (yet)
+static bool read_db_header(int fd, DatabaseHeader* header) {
+    uint8_t buf[sizeof(DBPageHeader) + sizeof(DatabaseHeader)];
+    if (pread(fd, buf, sizeof(buf), 0) != (ssize_t)sizeof(buf)) return false;
+
+    memcpy(header, buf + sizeof(DBPageHeader), sizeof(*header));
+    return memcmp(header->magic, MAGIC_NUMBER, MAGIC_NUMBER_SIZE) == 0 && header->db_version == DB_FORMAT_VERSION;
+}
+
+// pager->header is what allocation, the free list, vacuum and backups change - page 0 only gets a copy when a flush,
+// commit or close finds it dirty, so a commit that allocates a thousand pages writes page 0 once instead of a thousand times
+static void load_db_header(Pager* pager) {
+    DBPage* header_page = pager_get_page(pager, 0);
+    if (header_page) {
+        memcpy(&pager->header, header_page->data, sizeof(DatabaseHeader));
+        pager_unpin_page(pager, header_page);
+    } else {
+        memset(&pager->header, 0, sizeof(DatabaseHeader));  // Nothing written yet - pager_init_new_db() fills it in
+    }
+    pager->header_dirty = false;
+}
+
+// The checksum goes with every copy, so the header on disk is valid after any commit and not just after a clean close
+static PSqlStatus write_db_header(Pager* pager) {
+    if (!pager->header_dirty) return PSQL_OK;
+    DBPage* header_page = pager_get_page(pager, 0);
+    if (!header_page) return PSQL_ERROR;
+
+    pager->header.checksum = calculate_crc32(&pager->header, offsetof(DatabaseHeader, checksum));
+    memcpy(header_page->data, &pager->header, sizeof(DatabaseHeader));
+    pager->header_dirty = false;
+    PSqlStatus status = pager_write_page(pager, header_page);
+    pager_unpin_page(pager, header_page);
+    return status;
+}
+
+// Nobody else can have the file open yet, so recovery works on it directly - even for a read-only open
+static PSqlStatus recover_hot_journal(Pager* pager) {
+    PSqlStatus status = journal_recover(pager->journal_filename, pager->filename, &pager->recovery);
+    if (status != PSQL_OK) {
+        fprintf(stderr, "%s: could not roll back the hot journal\n", pager->filename);
+        return status;
+    }
+    if (pager->recovery.recovered) {
+        pager->flags |= PAGER_CRASH_RECOVERY;
+        fprintf(stderr, "%s: rolled back an unfinished transaction - %u pages restored in %.2f ms on %u threads\n",
+                pager->filename, pager->recovery.pages_restored, pager->recovery.duration_ns / 1e6, pager->recovery.threads);
+    }
+    if (pager->recovery.pages_failed) {
+        fprintf(stderr, "%s: %u pages could not be restored and are left as the file had them - the journal was kept as %s%s\n",
+                pager->filename, pager->recovery.pages_failed, pager->journal_filename, JOURNAL_FAILED_SUFFIX);
+    }
+    return PSQL_OK;
+}
+
 Pager* init_pager(const char* filename, int flags) {
+    return init_pager_with_page_size(filename, flags, DEFAULT_PAGE_SIZE);
+}
+
+Pager* init_pager_with_page_size(const char* filename, int flags, uint32_t page_size) {
+    if (!DB_PAGE_SIZE_VALID(page_size)) return NULL;
+
     Pager* pager = (Pager*)malloc(sizeof(Pager));
     if (!pager) return NULL;
     
     memset(pager, 0, sizeof(Pager));
-    
-    // Store filename
+    pager->db_pager.fd = -1;
+    pager->db_pager.page_size = page_size;
+    pager->journal_pager.fd = -1;
+    pthread_mutex_init(&pager->lock, NULL);
+    pthread_mutex_init(&pager->checkpoint_lock, NULL);
+    
+    // Error checking so a thread beginning a second transaction gets an error instead of deadlocking on itself
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+    pthread_mutex_init(&pager->writer_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    
+    // The WAL relies on a private mapping - it can't sit under the buffer pool
+    if ((flags & PAGER_WAL) && (flags & PAGER_BUFFER_POOL)) return abort_init_pager(pager);
+    if ((flags & PAGER_MLOCK_CATALOG) && (flags & (PAGER_WAL | PAGER_BUFFER_POOL))) return abort_init_pager(pager);  // See pager_lock_pages()
+    if ((flags & PAGER_COMPRESSION) && !(flags & PAGER_BUFFER_POOL)) return abort_init_pager(pager);  // Pages read in place from the mapping can't be packed
+    if ((flags & PAGER_MEMORY_DB) && (flags & (PAGER_WAL | PAGER_BUFFER_POOL | PAGER_READONLY))) return abort_init_pager(pager);  // Only ever a fresh shared mapping, see memory_db.h
+    
+    // Store filename, create journal and WAL filenames
     pager->filename = strdup(filename);
-    if (!pager->filename) {
-        free(pager);
-        return NULL;
-    }
-    
-    // Create journal filename
-    size_t journal_filename_len = strlen(filename) + strlen(JOURNAL_FILE_EXTENSION) + 1;
-    pager->journal_filename = (char*)malloc(journal_filename_len);
-    if (!pager->journal_filename) {
-        free(pager->filename);
-        free(pager);
-        return NULL;
-    }
-    snprintf(pager->journal_filename, journal_filename_len, "%s%s", filename, JOURNAL_FILE_EXTENSION);
+    pager->journal_filename = sidecar_filename(filename, JOURNAL_FILE_EXTENSION);
+    pager->wal_filename = sidecar_filename(filename, WAL_FILE_EXTENSION);
+    if (!pager->filename || !pager->journal_filename || !pager->wal_filename) return abort_init_pager(pager);
     
     // Set read-only flag
-    pager->read_only = (flags & O_RDONLY) != 0;
-    
-    // Open database file
-    int open_flags = flags;
-    if (!pager->read_only) {
-        open_flags |= O_CREAT;
+    pager->flags = flags;
+    pager->read_only = (flags & PAGER_READONLY) != 0;
+    pager->cache_size = BUFFER_POOL_DEFAULT_FRAMES;
+    pager->compressed_cache_size = COMPRESSED_CACHE_DEFAULT_SIZE;
+    pager->checkpoint_policy.mode = CHECKPOINT_PASSIVE;
+    pager->checkpoint_policy.frame_threshold = WAL_AUTOCHECKPOINT_FRAMES;
+    pager->checkpoint_policy.byte_threshold = WAL_AUTOCHECKPOINT_BYTES;
+    pager->checkpoint_policy.background = true;
+    process_faults(pager->faults_at_open);
+    
+    // Open database file - translate pager flags into open() flags
+    int open_flags = pager->read_only ? O_RDONLY : (O_RDWR | O_CREAT);
+    if (!pager->read_only && (flags & PAGER_OVERWRITE) && !(flags & PAGER_MEMORY_DB)) {
+        open_flags |= O_TRUNC;
+        unlink(pager->wal_filename);  // A WAL left over from the old file would replay onto the new one
+        unlink(pager->journal_filename);  // ...and a hot journal would roll it back
     }
     
-    pager->db_pager.fd = open(filename, open_flags, 0644);
-    if (pager->db_pager.fd < 0) {
-        free(pager->journal_filename);
-        free(pager->filename);
-        free(pager);
-        return NULL;
-    }
+    // A transaction that died half way leaves its journal behind - undo it before anything reads the file, in any mode
+    if (!(flags & PAGER_MEMORY_DB) && recover_hot_journal(pager) != PSQL_OK) return abort_init_pager(pager);
+    
+    // A memory DB starts out as an empty memfd - the filename is only its name, whatever is on disk under it is left alone
+    pager->db_pager.fd = (flags & PAGER_MEMORY_DB) ? memory_db_create(filename) : open(filename, open_flags, 0644);
+    if (pager->db_pager.fd < 0) return abort_init_pager(pager);
     
     // Get file size
     struct stat st;
-    if (fstat(pager->db_pager.fd, &st) < 0) {
-        close(pager->db_pager.fd);
-        free(pager->journal_filename);
-        free(pager->filename);
-        free(pager);
-        return NULL;
-    }
+    if (fstat(pager->db_pager.fd, &st) < 0) return abort_init_pager(pager);
     
     pager->db_pager.file_size = st.st_size;
     
+    // Older file format - a writable open rewrites the file before anything reads it,
+    // read-only converts its own private copy once the file is mapped
+    bool upgrade_in_memory = false;
+    if (pager->db_pager.file_size >= V1_PAGE_SIZE && upgrade_file_version(pager->db_pager.fd) == DB_FORMAT_VERSION_V1) {
+        pager->db_pager.page_size = V1_PAGE_SIZE;
+        if (pager->read_only) {
+            if (flags & PAGER_BUFFER_POOL) return abort_init_pager(pager);  // Frames are read on demand, there's no copy to convert
+            upgrade_in_memory = true;
+        } else {
+            close(pager->db_pager.fd);
+            pager->db_pager.fd = -1;
+            if (upgrade_db_file(filename, pager->wal_filename) != PSQL_OK) return abort_init_pager(pager);
+            pager->db_pager.fd = open(filename, open_flags, 0644);
+            if (pager->db_pager.fd < 0 || fstat(pager->db_pager.fd, &st) < 0) return abort_init_pager(pager);
+            pager->db_pager.file_size = st.st_size;
+        }
+    }
+    
+    // An existing database keeps the page size and checksum setting it was created with, whatever the caller asked for
+    // (a file whose header was never written yet goes with the requested ones - pager_verify_db() rejects it anyway)
+    // Checksums can't be switched on later - every page already on disk would fail them, and neither can vacuum - the
+    // pointer map would be missing every page from before
+    DatabaseHeader stored;
+    if (pager->db_pager.file_size > 0 && !upgrade_in_memory && read_db_header(pager->db_pager.fd, &stored)) {
+        uint32_t stored_page_size = DB_PAGE_SIZE_DECODE(stored.page_size);
+        if (!DB_PAGE_SIZE_VALID(stored_page_size)) return abort_init_pager(pager);
+        pager->db_pager.page_size = stored_page_size;
+        pager->page_checksums = (stored.flags & DB_PAGE_CHECKSUMS) != 0;
+        pager->vacuum_mode = (stored.flags & DB_AUTO_VACUUM) ? VACUUM_FULL
+                           : (stored.flags & DB_INCREMENTAL_VACUUM) ? VACUUM_INCREMENTAL : VACUUM_NONE;
+    } else if (!upgrade_in_memory) {
+        pager->page_checksums = (flags & PAGER_PAGE_CHECKSUMS) != 0;
+        pager->vacuum_mode = (flags & PAGER_AUTO_VACUUM) ? VACUUM_FULL
+                           : (flags & PAGER_INCREMENTAL_VACUUM) ? VACUUM_INCREMENTAL : VACUUM_NONE;
+    }
+    
     // Initialize or map existing file
     if (pager->db_pager.file_size == 0) {
         // New database - initialize with at least one page
-        if (pager->read_only) {
-            // Can't create a new file in read-only mode
-            close(pager->db_pager.fd);
-            free(pager->journal_filename);
-            free(pager->filename);
-            free(pager);
-            return NULL;
+        // Can't create a new file in read-only mode
+        if (pager->read_only) return abort_init_pager(pager);
+        
+        // Extend file to one page
+        if (ftruncate(pager->db_pager.fd, pager->db_pager.page_size) < 0) return abort_init_pager(pager);
+        
+        pager->db_pager.file_size = pager->db_pager.page_size;
+    }
+    
+    // Anything past page_count is preallocated extent - trimmed off again on close
+    pager->db_pager.page_count = pager->db_pager.file_size / pager->db_pager.page_size;
+    if (!bitmap_init(&pager->db_pager.dirty_pages, pager->db_pager.page_count) ||
+        !bitmap_init(&pager->wal_stale_pages, pager->db_pager.page_count) ||
+        !bitmap_init(&pager->verified_pages, pager->db_pager.page_count)) {
+        return abort_init_pager(pager);
+    }
+    
+    if (flags & PAGER_BUFFER_POOL) {
+        // Explicit page cache - nothing is mapped, frames are filled with pread() on demand
+        pager->buffer_pool = buffer_pool_create(pager->db_pager.fd, pager->cache_size, pager->db_pager.page_size);
+        if (!pager->buffer_pool) return abort_init_pager(pager);
+        if (flags & PAGER_COMPRESSION) {
+            pager->compressed_cache = compressed_cache_create(pager->compressed_cache_size, pager->db_pager.page_size);
+            if (!pager->compressed_cache) return abort_init_pager(pager);
         }
+        configure_buffer_pool(pager);
+    } else {
+        // Reserve address space for the largest possible database, then map the file over the start of it
+        // WAL mode maps privately - writes stay in memory until they are committed to the WAL
+        pager->db_pager.reserved_size = DB_MMAP_RESERVE_SIZE;
+        void* base = reserve_mmap(pager->db_pager.reserved_size);
+        if (!base) return abort_init_pager(pager);
+        pager->db_pager.mem_start = base;
         
-        // Extend file to PAGE_SIZE
-        if (ftruncate(pager->db_pager.fd, PAGE_SIZE) < 0) {
-            close(pager->db_pager.fd);
-            free(pager->journal_filename);
-            free(pager->filename);
-            free(pager);
-            return NULL;
+        // MAP_POPULATE on a private writable mapping would fault everything in for writing, copying the whole file -
+        // WAL mode reads it in with MADV_POPULATE_READ after instead
+        int populate = ((flags & PAGER_POPULATE) && !(flags & PAGER_WAL)) ? MAP_POPULATE : 0;
+        void* map = mmap(base, pager->db_pager.file_size, db_map_prot(pager), db_map_flags(pager) | populate, pager->db_pager.fd, 0);
+        if (map == MAP_FAILED) {
+            perror("mmap");
+            return abort_init_pager(pager);
+        }
+        
+        // The reservation past the file too - extents mapped into it later get the same advice
+        if ((flags & PAGER_HUGEPAGES) && madvise(base, pager->db_pager.reserved_size, MADV_HUGEPAGE) != 0) perror("madvise");
+        if ((flags & PAGER_POPULATE) && (flags & PAGER_WAL)) {
+#ifdef MADV_POPULATE_READ
+            if (madvise(base, pager->db_pager.file_size, MADV_POPULATE_READ) != 0) perror("madvise");
+#else
+            madvise(base, pager->db_pager.file_size, MADV_WILLNEED);
+#endif
         }
         
-        pager->db_pager.file_size = PAGE_SIZE;
+        if (upgrade_in_memory && upgrade_mapping(pager) != PSQL_OK) return abort_init_pager(pager);
     }
     
-    // Memory map the file
-    int prot = pager->read_only ? PROT_READ : (PROT_READ | PROT_WRITE);
-    pager->db_pager.mem_start = mmap(NULL, pager->db_pager.file_size, prot, MAP_SHARED, pager->db_pager.fd, 0);
-    
-    if (pager->db_pager.mem_start == MAP_FAILED) {
-        close(pager->db_pager.fd);
-        free(pager->journal_filename);
-        free(pager->filename);
-        free(pager);
-        return NULL;
+    if (flags & PAGER_WAL) {
+        // Index whatever a previous session committed but never checkpointed
+        pager->wal = wal_open(pager->wal_filename, pager->read_only, pager->db_pager.page_size);
+        if (!pager->wal) return abort_init_pager(pager);
+        
+        // Frames from before the format upgrade - they are already folded into the main file, unless it is
+        // a read-only open of a v1 file, which has no way to fold them in
+        if (pager->wal->frame_count && pager->wal->header.version != WAL_VERSION) {
+            if (upgrade_in_memory) return abort_init_pager(pager);
+            if (wal_reset(pager->wal) != PSQL_OK) return abort_init_pager(pager);
+        }
+        
+        if (pager->wal->db_page_count > pager->db_pager.page_count && !pager->read_only) {
+            if (extend_mmap(pager, GET_PAGE_OFFSET(pager, pager->wal->db_page_count)) != PSQL_OK) return abort_init_pager(pager);
+            pager->db_pager.page_count = pager->wal->db_page_count;
+        } else if (pager->wal->db_page_count && pager->wal->db_page_count < pager->db_pager.page_count) {
+            // A vacuum shrank the DB - the main file only catches up in the checkpoint on close
+            pager->db_pager.page_count = pager->wal->db_page_count;
+        }
+        
+        // Main file copies of these pages are stale - pager_get_page() reads them from the WAL
+        WalIndex* index = &pager->wal->index;
+        for (size_t i = 0; i < index->capacity; i++) {
+            if (index->slots[i].frame_plus_one) bitmap_set(&pager->wal_stale_pages, index->slots[i].page_no);
+        }
+        if (pager->wal->frame_count) pager->oldest_uncheckpointed_us = now_us();
+        
+        // Automatic checkpoints go to a worker thread so commits don't pay for them
+        if (!pager->read_only && pager->checkpoint_policy.background) {
+            pager->checkpointer = checkpointer_start(pager);
+            if (!pager->checkpointer) return abort_init_pager(pager);
+        }
     }
     
-    // Database header will be accessed through pager_get_page(pager, 0)
+    // Database header is kept in pager->header from here on - page 0 only gets it back on flush/commit/close
+    // A file whose header isn't written yet reads as all zeroes
+    load_db_header(pager);
     
     // Initialize or verify database will be handled by the caller
     
     // Initialize free page map
     init_free_page_map(pager);
+    if (ptrmap_load(pager) != PSQL_OK) return abort_init_pager(pager);
     
-    // Page caching will be implemented separately
+    if (pager->buffer_pool) populate_buffer_pool(pager);
+    
+    // Not fatal - it is only a latency hint, and RLIMIT_MEMLOCK may not allow it
+    if (flags & PAGER_MLOCK_CATALOG) pager_lock_pages(pager, 0, DB_CATALOG_PAGES);
     
-    // Open journal file if not in read-only mode
     if (!pager->read_only) {
-        pager->journal_pager.fd = open(pager->journal_filename, O_RDWR | O_CREAT, 0644);
-        if (pager->journal_pager.fd < 0) {
-            munmap(pager->db_pager.mem_start, pager->db_pager.file_size);
-            close(pager->db_pager.fd);
-            free(pager->journal_filename);
-            free(pager->filename);
-            free(pager);
-            return NULL;
-        }
+        pager->group_commit = group_commit_create(pager->wal ? sync_wal_file : sync_db_file, pager,
+                                                  GROUP_COMMIT_WINDOW_US, GROUP_COMMIT_MAX_BATCH);
+        if (!pager->group_commit) return abort_init_pager(pager);
+    }
+    
+    // Rollback journal - the WAL replaces it, a memory DB has its undo log instead
+    if ((flags & PAGER_JOURNALING_ENABLED) && !pager->read_only && !pager->wal && !(flags & PAGER_MEMORY_DB)) {
+        if (journal_open(&pager->journal_pager, pager->journal_filename, pager->db_pager.page_size) != PSQL_OK) return abort_init_pager(pager);
     }
     
     return pager;
 }
 
+// init_pager() has the file open and mapped already - nothing is left to do for callers that open in two steps
+PSqlStatus pager_open_db(Pager* pager) {
+    if (!pager) return PSQL_ERROR;
+    return PSQL_OK;
+}
+
 PSqlStatus pager_close_db(Pager* pager) {
     if (!pager) return PSQL_ERROR;
     
-    // Flush any dirty pages
-    PSqlStatus status = pager_flush_cache(pager);
-    if (status != PSQL_OK) return status;
+    // No more background checkpoints - the one below folds everything in
+    checkpointer_stop(pager->checkpointer);
+    pager->checkpointer = NULL;
     
-    // Sync free page list to header
-    status = sync_free_page_list(pager);
-    if (status != PSQL_OK) return status;
+    // Closing in the middle of a transaction throws it away
+    if (pager->in_transaction && (pager->wal || pager->journal_pager.fd >= 0)) pager_rollback(pager);
+    if (pager->in_transaction) end_transaction(pager);
     
-    // Get the database header from page 0
-    DBPage* header_page = pager_get_page(pager, 0);
-    if (!header_page) return PSQL_ERROR;
+    // So does closing in the middle of a backup
+    while (pager->backups) pager_backup_cancel(pager->backups);
     
-    DatabaseHeader* header = (DatabaseHeader*)header_page->data;
+    // Flush any dirty pages
+    PSqlStatus status = pager_flush_cache(pager);
+    if (status != PSQL_OK) return status;
     
-    // Update header checksum
-    header->checksum = calculate_crc32(header, offsetof(DatabaseHeader, checksum));
+    if (!pager->read_only) {
+        // Sync free page list to header
+        status = sync_free_page_list(pager);
+        if (status != PSQL_OK) return status;
+        
+        // Rewrite the header with a fresh checksum even if nothing changed - one left stale by a crash gets fixed here
+        pager->header_dirty = true;
+        status = write_db_header(pager);
+        if (status != PSQL_OK) return status;
+    }
     
-    // Sync to disk
-    if (msync(pager->db_pager.mem_start, pager->db_pager.file_size, MS_SYNC) < 0) {
-        return PSQL_IOERR;
+    if (pager->buffer_pool) {
+        // Write back every dirty frame then drop the pool
+        status = pager_flush_cache(pager);
+        if (status != PSQL_OK) return status;
+        buffer_pool_destroy(pager->buffer_pool);
+        pager->buffer_pool = NULL;
+        compressed_cache_destroy(pager->compressed_cache);
+        pager->compressed_cache = NULL;
+    } else {
+        // Sync to disk - only the header should still be dirty at this point
+        status = pager_flush_cache(pager);
+        if (status != PSQL_OK) return status;
+        
+        // Fold the WAL back into the main file - a clean close leaves no WAL behind
+        if (pager->wal) {
+            status = pager_checkpoint(pager, CHECKPOINT_FULL);
+            if (status != PSQL_OK) return status;
+            wal_close(pager->wal, true);
+            pager->wal = NULL;
+        }
+        
+        // Unmap memory - the file mapping and the rest of the reservation go together
+        if (munmap(pager->db_pager.mem_start, pager->db_pager.reserved_size) < 0) {
+            return PSQL_IOERR;
+        }
     }
     
-    // Unmap memory
-    if (munmap(pager->db_pager.mem_start, pager->db_pager.file_size) < 0) {
-        return PSQL_IOERR;
+    // Give back the unused part of the last extent - and in WAL mode, pages a vacuum dropped that the checkpoint
+    // may have just written back past where file_size says the file ends
+    struct stat st;
+    if ((pager->flags & PAGER_WAL) && fstat(pager->db_pager.fd, &st) == 0 && (size_t)st.st_size > pager->db_pager.file_size) {
+        pager->db_pager.file_size = st.st_size;
+    }
+    // (a memory DB goes with its memfd anyway)
+    if (!pager->read_only && !(pager->flags & PAGER_MEMORY_DB) && pager->db_pager.file_size > GET_PAGE_OFFSET(pager, pager->db_pager.page_count)) {
+        if (ftruncate(pager->db_pager.fd, (off_t)GET_PAGE_OFFSET(pager, pager->db_pager.page_count)) < 0) {
+            perror("ftruncate");
+        }
     }
     
     // Close files
     close(pager->db_pager.fd);
     if (pager->journal_pager.fd >= 0) {
-        close(pager->journal_pager.fd);
+        // A journal with records in it is all a failed commit or rollback left to recover from - keep it
+        if (pager->journal_pager.end == 0) unlink(pager->journal_filename);
+        journal_close(&pager->journal_pager);
     }
     
     // Free resources
-    radix_tree_destroy(&pager->db_pager.free_page_map->tree);
+    bitmap_free(&pager->db_pager.dirty_pages);
+    bitmap_free(&pager->wal_stale_pages);
+    bitmap_free(&pager->verified_pages);
+    arena_free(&pager->db_pager.free_page_map->tree.arena);  // Tree is embedded by value - only its nodes are on the heap
     free(pager->db_pager.free_page_map);
+    ptrmap_free(pager);
+    undo_log_free(&pager->undo_log);
     free(pager->filename);
     free(pager->journal_filename);
+    free(pager->wal_filename);
+    free(pager->savepoints);
+    group_commit_destroy(pager->group_commit);
+    pthread_mutex_destroy(&pager->writer_lock);
+    pthread_mutex_destroy(&pager->checkpoint_lock);
+    pthread_mutex_destroy(&pager->lock);
     free(pager);
     
     return PSQL_OK;
 }
 
 
+/* Dirty page tracking - mmap mode only, the buffer pool keeps its own dirty flags per frame */
+static uint32_t mapped_page_no(Pager* pager, DBPage* page) {
+    return ((uint8_t*)page - (uint8_t*)pager->db_pager.mem_start) / pager->db_pager.page_size;
+}
+
+
+/* Per-page checksums (DB_PAGE_CHECKSUMS) - sealed on the way to disk, verified on the first fetch of the session */
+static void seal_page(Pager* pager, DBPage* page) {
+    uint64_t start = now_ns();
+    page_checksum_seal(page, pager->db_pager.page_size);
+    pager->io_stats.pages_sealed++;
+    pager->io_stats.seal_ns += now_ns() - start;
+}
+
+static PSqlStatus sync_journal(Pager* pager);
+
+// Buffer pool write hook - frames are sealed as they are written back, whether by a flush or an eviction
+// A frame the open transaction changed can't reach the file before the before-image it would be rolled back to - one
+// sync then covers every record so far, so the frames evicted after it mostly go straight out
+static PSqlStatus prepare_frame(void* ctx, uint32_t page_no, DBPage* page) {
+    Pager* pager = (Pager*)ctx;
+    if (__atomic_load_n(&pager->journal_pager.active, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&pager->lock);
+        bool unsynced = journal_page_unsynced(&pager->journal_pager, page_no);
+        pthread_mutex_unlock(&pager->lock);
+        PSqlStatus status = unsynced ? sync_journal(pager) : PSQL_OK;
+        if (status != PSQL_OK) return status;
+    }
+    if (pager->page_checksums) seal_page(pager, page);
+    return PSQL_OK;
+}
+
+// mmap mode - only the dirty pages changed, so only they need a new checksum
+static void seal_dirty_pages(Pager* pager) {
+    if (!pager->page_checksums) return;
+    Bitmap* dirty = &pager->db_pager.dirty_pages;
+    for (size_t page_no = bitmap_next_set(dirty, 0); page_no < dirty->num_bits; page_no = bitmap_next_set(dirty, page_no + 1)) {
+        seal_page(pager, (DBPage*)((uint8_t*)pager->db_pager.mem_start + GET_PAGE_OFFSET(pager, page_no)));
+    }
+}
+
+// Check a page the first time it is fetched - the bitmap (and the counters) are shared between readers, so under lock
+static bool verify_page(Pager* pager, uint32_t page_no, DBPage* page) {
+    pthread_mutex_lock(&pager->lock);
+    bool ok = true;
+    if (!bitmap_test(&pager->verified_pages, page_no)) {
+        uint64_t start = now_ns();
+        ok = page_checksum_verify(page, pager->db_pager.page_size);
+        pager->io_stats.verify_ns += now_ns() - start;
+        pager->io_stats.pages_verified++;
+        if (ok) bitmap_set(&pager->verified_pages, page_no);
+        else {
+            pager->io_stats.checksum_failures++;
+            fprintf(stderr, "%s: page %u failed its checksum\n", pager->filename, page_no);
+        }
+    }
+    pthread_mutex_unlock(&pager->lock);
+    return ok;
+}
+
+// msync a run of pages [first, first + count)
+static PSqlStatus sync_page_range(Pager* pager, size_t first, size_t count) {
+    uint64_t start = stats_start(pager);
+    if (msync((uint8_t*)pager->db_pager.mem_start + GET_PAGE_OFFSET(pager, first), GET_PAGE_OFFSET(pager, count), MS_SYNC) < 0) {
+        perror("msync");
+        return PSQL_IOERR;
+    }
+    pager->io_stats.sync_ranges++;
+    pager->io_stats.pages_written += count;
+    pager_event(pager, PAGER_TRACE_SYNC, (uint32_t)first, (uint32_t)count, PAGE_KIND_OTHER, start);
+    return PSQL_OK;
+}
+
+// Start write back of the dirty pages, coalescing runs of adjacent dirty pages into one range each
+// So a commit costs what it changed, not the size of the whole file. The group commit fdatasync() then waits for all of it -
+// on Linux that covers pages dirtied through a shared mapping, so a commit no longer needs an msync(MS_SYNC) of its own
+static PSqlStatus start_writeback(Pager* pager) {
+    Bitmap* dirty = &pager->db_pager.dirty_pages;
+    if (dirty->count == 0) return PSQL_OK;
+
+    seal_dirty_pages(pager);
+    if (pager->flags & PAGER_MEMORY_DB) {  // No disk behind the memfd - sealed is as written as it gets
+        bitmap_clear_all(dirty);
+        pager->io_stats.flushes++;
+        return PSQL_OK;
+    }
+    PSqlStatus status = PSQL_OK;
+    for (size_t first = bitmap_next_set(dirty, 0); first < dirty->num_bits;) {
+        size_t end = bitmap_next_clear(dirty, first);
+#ifdef SYNC_FILE_RANGE_WRITE
+        // Queue every run before anyone waits, so the device sees them all at once
+        sync_file_range(pager->db_pager.fd, (off_t)GET_PAGE_OFFSET(pager, first), (off_t)GET_PAGE_OFFSET(pager, end - first), SYNC_FILE_RANGE_WRITE);
+#else
+        if (msync((uint8_t*)pager->db_pager.mem_start + GET_PAGE_OFFSET(pager, first), GET_PAGE_OFFSET(pager, end - first), MS_ASYNC) < 0) {
+            perror("msync");
+            status = PSQL_IOERR;
+        }
+#endif
+        pager->io_stats.sync_ranges++;
+        pager->io_stats.pages_written += end - first;
+        first = bitmap_next_set(dirty, end);
+    }
+
+    if (status == PSQL_OK) bitmap_clear_all(dirty);  // Keep them dirty to retry if anything failed
+    pager->io_stats.flushes++;
+    return status;
+}
+
+PagerIOStats pager_get_io_stats(Pager* pager) {
+    PagerIOStats stats = {0};
+    if (!pager) return stats;
+    stats = pager->io_stats;
+    stats.dirty_pages = pager->db_pager.dirty_pages.count;
+    return stats;
+}
+
+
+/* Write-ahead log (PAGER_WAL) - the private mapping holds uncommitted changes, the WAL holds committed ones */
+// Has the WAL gone past either checkpoint threshold - called with pager->lock held
+static bool checkpoint_due(Pager* pager) {
+    CheckpointPolicy* policy = &pager->checkpoint_policy;
+    Wal* wal = pager->wal;
+    uint32_t lag = wal->frame_count - wal->backfilled;
+    size_t wal_bytes = WAL_HEADER_SIZE + (size_t)wal->frame_count * WAL_FRAME_SIZE(wal->page_size);
+    return (policy->frame_threshold && lag >= policy->frame_threshold) ||
+           (policy->byte_threshold && wal_bytes >= policy->byte_threshold);
+}
+
+// Append every dirty page to the WAL as one transaction - one write, one fdatasync
+// The lock is held throughout so a checkpoint can't reset the WAL under the frames being written
+static PSqlStatus commit_to_wal(Pager* pager) {
+    Bitmap* dirty = &pager->db_pager.dirty_pages;
+    if (dirty->count == 0) return PSQL_OK;
+
+    uint64_t start = stats_start(pager);
+    seal_dirty_pages(pager);
+    pthread_mutex_lock(&pager->lock);
+    for (size_t page_no = bitmap_next_set(dirty, 0); page_no < dirty->num_bits; page_no = bitmap_next_set(dirty, page_no + 1)) {
+        PSqlStatus status = wal_append_frame(pager->wal, page_no, (uint8_t*)pager->db_pager.mem_start + GET_PAGE_OFFSET(pager, page_no));
+        if (status != PSQL_OK) {
+            wal_discard_pending(pager->wal);
+            pthread_mutex_unlock(&pager->lock);
+            return status;
+        }
+    }
+
+    bool was_caught_up = pager->wal->frame_count == pager->wal->backfilled;
+    PSqlStatus status = wal_commit(pager->wal, pager->db_pager.page_count);
+    if (status != PSQL_OK) {
+        pthread_mutex_unlock(&pager->lock);
+        return status;  // Pages stay dirty - the commit can be retried
+    }
+
+    if (was_caught_up) pager->oldest_uncheckpointed_us = now_us();
+    uint64_t lag = pager->wal->frame_count - pager->wal->backfilled;
+    if (lag > pager->checkpoint_stats.max_lag_frames) pager->checkpoint_stats.max_lag_frames = lag;
+    bool due = checkpoint_due(pager);
+    pthread_mutex_unlock(&pager->lock);
+    pager_event(pager, PAGER_TRACE_JOURNAL_WRITE, 0, (uint32_t)dirty->count, PAGE_KIND_OTHER, start);
+
+    pager->io_stats.pages_written += dirty->count;
+    pager->io_stats.sync_ranges++;
+    pager->io_stats.flushes++;
+    bitmap_clear_all(dirty);
+
+    if (!due) return PSQL_OK;
+    if (pager->checkpointer) {
+        checkpointer_notify(pager->checkpointer);
+        return PSQL_OK;
+    }
+    return run_checkpoint(pager, pager->checkpoint_policy.mode, true);
+}
+
+// The mapping still has the main file's copy of a page the WAL has a newer image of - read it in
+// Called with pager->lock held
+static PSqlStatus load_from_wal(Pager* pager, uint32_t page_no) {
+    uint32_t frame;
+    if (wal_find_frame(pager->wal, page_no, &frame)) {
+        PSqlStatus status = wal_read_frame(pager->wal, frame, (uint8_t*)pager->db_pager.mem_start + GET_PAGE_OFFSET(pager, page_no));
+        if (status != PSQL_OK) return status;
+        bitmap_clear(&pager->verified_pages, page_no);  // A fresh image off disk - check it again
+    }
+    bitmap_clear(&pager->wal_stale_pages, page_no);
+    return PSQL_OK;
+}
+
+
+/* Rollback journal (PAGER_JOURNALING_ENABLED) - before-images of the pages a transaction fetched, see pager/journal/journal.h */
+// Write out the buffered records - one pwritev(), timed like a WAL append. Called with pager->lock held
+static PSqlStatus flush_journal(Pager* pager) {
+    uint32_t count = pager->journal_pager.pending_count;
+    if (count == 0) return PSQL_OK;
+    uint64_t start = stats_start(pager);
+    PSqlStatus status = journal_flush(&pager->journal_pager);
+    if (status == PSQL_OK) pager_event(pager, PAGER_TRACE_JOURNAL_WRITE, 0, count, PAGE_KIND_OTHER, start);
+    return status;
+}
+
+// Same as the undo log of a memory DB - readers fetch pages while a transaction is open too, whoever gets to a page
+// first saves it, under the lock
+static PSqlStatus journal_page(Pager* pager, uint32_t page_no, const DBPage* page) {
+    JournalPager* journal = &pager->journal_pager;
+    PSqlStatus status = PSQL_OK;
+    pthread_mutex_lock(&pager->lock);
+    if (!journal_page_saved(journal, page_no) && journal_wants_page(journal, page_no)) {
+        if (journal_buffer_full(journal)) status = flush_journal(pager);
+        if (status == PSQL_OK) status = journal_add_page(journal, page_no, page);
+    }
+    pthread_mutex_unlock(&pager->lock);
+    return status;
+}
+
+// The one fdatasync() of the transaction - before any page it changed goes to the file
+static PSqlStatus sync_journal(Pager* pager) {
+    JournalPager* journal = &pager->journal_pager;
+    pthread_mutex_lock(&pager->lock);
+    PSqlStatus status = flush_journal(pager);
+    if (status == PSQL_OK && journal->synced_records != journal->records) {
+        uint64_t start = stats_start(pager);
+        status = journal_sync(journal);
+        if (status == PSQL_OK) pager_event(pager, PAGER_TRACE_SYNC, 0, 0, PAGE_KIND_OTHER, start);
+    }
+    pthread_mutex_unlock(&pager->lock);
+    return status;
+}
+
+// The page as the transaction has it, for the journal's deltas - and for applying them on rollback
+// Pages past the end are about to be cut off the file by this commit, so the journal needs their whole image
+static PSqlStatus current_page(void* ctx, uint32_t page_no, void* image) {
+    Pager* pager = (Pager*)ctx;
+    if (page_no >= pager->db_pager.page_count) return PSQL_NOTFOUND;
+    if (pager->buffer_pool) return buffer_pool_copy_page(pager->buffer_pool, page_no, image);
+    memcpy(image, (uint8_t*)pager->db_pager.mem_start + GET_PAGE_OFFSET(pager, page_no), pager->db_pager.page_size);
+    return PSQL_OK;
+}
+
+// Nothing changes pages after this - the records still buffered can go out as deltas, then the journal is synced.
+// A delta only undoes the page it was taken against, so the file must not have anything else in it: in mmap mode the
+// kernel writes pages back whenever it likes, half way through the transaction too - unless every write syncs the
+// journal first (and so sends its records out whole)
+static PSqlStatus finish_journal(Pager* pager) {
+    bool deltas = pager->buffer_pool || (pager->flags & PAGER_SYNC_ON_WRITE);
+    pthread_mutex_lock(&pager->lock);
+    PSqlStatus status = deltas ? journal_encode_deltas(&pager->journal_pager, current_page, pager) : PSQL_OK;
+    pthread_mutex_unlock(&pager->lock);
+    return status == PSQL_OK ? sync_journal(pager) : status;
+}
+
+// The pages the journal covers are durable - truncate it, which is what makes the commit (or rollback) stick
+static PSqlStatus reset_journal(Pager* pager) {
+    pthread_mutex_lock(&pager->lock);
+    PSqlStatus status = journal_reset(&pager->journal_pager);
+    pthread_mutex_unlock(&pager->lock);
+    return status;
+}
+
+static void stop_journal(Pager* pager) {
+    pthread_mutex_lock(&pager->lock);
+    journal_stop(&pager->journal_pager);
+    pthread_mutex_unlock(&pager->lock);
+}
+
+// Put a before-image back - dirty again, so the flush after the rollback writes it back
+static PSqlStatus restore_page(void* ctx, uint32_t page_no, const void* image) {
+    Pager* pager = (Pager*)ctx;
+    uint32_t page_size = pager->db_pager.page_size;
+    if (pager->buffer_pool) {
+        DBPage* page = buffer_pool_fetch(pager->buffer_pool, page_no);
+        if (!page) return PSQL_IOERR;
+        memcpy(page, image, page_size);
+        page->header.flag |= PAGE_PINNED;  // Still ours until the unpin
+        buffer_pool_mark_dirty(pager->buffer_pool, page);
+        buffer_pool_unpin(pager->buffer_pool, page);
+    } else {
+        memcpy((uint8_t*)pager->db_pager.mem_start + GET_PAGE_OFFSET(pager, page_no), image, page_size);
+        if (bitmap_set(&pager->db_pager.dirty_pages, page_no)) pager->io_stats.pages_dirtied++;
+    }
+    return PSQL_OK;
+}
+
+
+/* Group commit - the flush one leader runs for a whole batch of commits */
+static PSqlStatus sync_db_file(void* ctx) {
+    Pager* pager = (Pager*)ctx;
+    uint64_t start = stats_start(pager);
+    if (fdatasync(pager->db_pager.fd) != 0) {
+        perror("fdatasync");
+        return PSQL_IOERR;
+    }
+    pager_event(pager, PAGER_TRACE_SYNC, 0, 0, PAGE_KIND_OTHER, start);
+    return PSQL_OK;
+}
+
+// The WAL's bookkeeping is under pager->lock, the fsync itself isn't - commits keep writing frames meanwhile
+static PSqlStatus sync_wal_file(void* ctx) {
+    Pager* pager = (Pager*)ctx;
+    pthread_mutex_lock(&pager->lock);
+    uint32_t checkpoint_seq = pager->wal->header.checkpoint_seq;
+    uint32_t frame_count = pager->wal->frame_count;
+    pthread_mutex_unlock(&pager->lock);
+
+    uint64_t start = stats_start(pager);
+    PSqlStatus status = wal_sync(pager->wal);
+    if (status == PSQL_OK) pager_event(pager, PAGER_TRACE_SYNC, 0, 0, PAGE_KIND_OTHER, start);
+
+    pthread_mutex_lock(&pager->lock);
+    if (status == PSQL_OK) wal_mark_synced(pager->wal, checkpoint_seq, frame_count);
+    pthread_mutex_unlock(&pager->lock);
+    return status;
+}
+
+// Pages a vacuum cut off - nothing to write back for them
+static void drop_truncated_pages(Pager* pager) {
+    if (pager->buffer_pool) {
+        buffer_pool_truncate(pager->buffer_pool, pager->db_pager.page_count);
+        return;
+    }
+    Bitmap* dirty = &pager->db_pager.dirty_pages;
+    for (size_t page_no = bitmap_next_set(dirty, pager->db_pager.page_count); page_no < dirty->num_bits; page_no = bitmap_next_set(dirty, page_no + 1)) {
+        bitmap_clear(dirty, page_no);
+    }
+}
+
+// Second half of a vacuum - cut the file down to page_count once the commit that moved the pages is durable
+// The tail of the mapping goes back to being reservation, so a stray pointer into it faults instead of SIGBUS-ing
+// In WAL mode the main file only changes in a checkpoint - page_count travels in the commit frame, close truncates
+static PSqlStatus truncate_db_file(Pager* pager) {
+    pager->truncate_pending = false;
+    DatabasePager* db = &pager->db_pager;
+    size_t new_size = GET_PAGE_OFFSET(pager, db->page_count);
+    if (pager->wal || new_size >= db->file_size) return PSQL_OK;
+    
+    if (!pager->buffer_pool && mmap((uint8_t*)db->mem_start + new_size, db->file_size - new_size, PROT_NONE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED) {
+        perror("mmap");
+        return PSQL_IOERR;
+    }
+    if (ftruncate(db->fd, (off_t)new_size) < 0) {
+        perror("ftruncate");
+        return PSQL_IOERR;
+    }
+    db->file_size = new_size;
+    return PSQL_OK;
+}
+
+// First half of a commit - get the changed pages on their way to disk, the group commit flush makes them durable
+// *wrote says whether there is anything for the flush to cover
+static PSqlStatus write_commit(Pager* pager, bool* wrote) {
+    // Full auto-vacuum - whatever can come off the end of the file goes in this commit too
+    PSqlStatus status = PSQL_OK;
+    if (pager->vacuum_mode == VACUUM_FULL) {
+        uint32_t truncated;
+        status = vacuum_run(pager, UINT32_MAX, &truncated);
+        if (status != PSQL_OK) return status;
+    }
+    
+    // Pages freed or reused since the last commit - the free list goes out with them, and the header with both
+    status = sync_free_page_list(pager);
+    if (status == PSQL_OK) status = write_db_header(pager);
+    // Every page vacuum and the header touched is in it by now - unless this is a pager_flush_cache() in the middle of
+    // the transaction, when pages can still change after their records go out and those have to stay whole images
+    if (status == PSQL_OK && pager->journal_pager.active) status = pager->in_transaction ? sync_journal(pager) : finish_journal(pager);
+    if (status != PSQL_OK) return status;
+    if (pager->truncate_pending) drop_truncated_pages(pager);
+    
+    if (pager->buffer_pool) {
+        *wrote = true;
+        return buffer_pool_flush(pager->buffer_pool);
+    }
+    *wrote = pager->db_pager.dirty_pages.count > 0 && !(pager->flags & PAGER_MEMORY_DB);  // A memory DB has nothing to fdatasync
+    return pager->wal ? commit_to_wal(pager) : start_writeback(pager);
+}
+
+
 /* Page access functions */
-DBPage* pager_get_page(Pager* pager, uint16_t page_no) {
-    if (!pager || page_no >= MAX_PAGES) return NULL;
+static DBPage* fetch_page(Pager* pager, uint32_t page_no) {
+    if (page_no >= MAX_PAGES) return NULL;
+    
+    if (pager->buffer_pool) {
+        DBPage* page = buffer_pool_fetch(pager->buffer_pool, page_no);
+        if (page && pager->page_checksums && !verify_page(pager, page_no, page)) {
+            buffer_pool_unpin(pager->buffer_pool, page);
+            return NULL;
+        }
+        if (page && __atomic_load_n(&pager->journal_pager.active, __ATOMIC_RELAXED) && journal_page(pager, page_no, page) != PSQL_OK) {
+            buffer_pool_unpin(pager->buffer_pool, page);
+            return NULL;
+        }
+        return page;
+    }
+    
+    // Get page from memory-mapped region - the reservation is smaller than MAX_PAGES, see DB_MMAP_RESERVE_SIZE
+    if (GET_PAGE_OFFSET(pager, page_no) >= pager->db_pager.reserved_size) return NULL;
+    DBPage* page = (DBPage*)((uint8_t*)pager->db_pager.mem_start + GET_PAGE_OFFSET(pager, page_no));
+    
+    // WAL mode - the newest committed image might not be in the main file yet
+    // Only the checkpointer touches stale bits behind our back and it only clears them, so a clear bit can be trusted without the lock
+    if (pager->wal && bitmap_test(&pager->wal_stale_pages, page_no)) {
+        pthread_mutex_lock(&pager->lock);
+        PSqlStatus status = bitmap_test(&pager->wal_stale_pages, page_no) ? load_from_wal(pager, page_no) : PSQL_OK;
+        pthread_mutex_unlock(&pager->lock);
+        if (status != PSQL_OK) return NULL;
+    }
+    
+    if (pager->page_checksums && !verify_page(pager, page_no, page)) return NULL;
     
-    // Get page from memory-mapped region
-    DBPage* page = (DBPage*)((uint8_t*)pager->db_pager.mem_start + page_no * PAGE_SIZE);
+    // Memory DB - the caller may be about to change the page in place, keep what the transaction started from
+    if ((pager->flags & PAGER_MEMORY_DB) && pager->in_transaction && page_no < pager->txn_page_count &&
+        undo_log_save(pager, page_no) != PSQL_OK) {
+        return NULL;
+    }
     
+    // Rollback journal - the same, into the journal file
+    if (__atomic_load_n(&pager->journal_pager.active, __ATOMIC_RELAXED) && journal_page(pager, page_no, page) != PSQL_OK) return NULL;
+    return page;
+}
+
+// In buffer pool mode the page is pinned until pager_unpin_page() - with mmap it is just a pointer into the mapping
+DBPage* pager_get_page(Pager* pager, uint32_t page_no) {
+    if (!pager) return NULL;
+    uint64_t start = stats_start(pager);
+    DBPage* page = fetch_page(pager, page_no);
+    if (page) pager_event(pager, PAGER_TRACE_GET, page_no, 1, page_kind_of(page_no, page->header.flag), start);
     return page;
 }
 
+void pager_unpin_page(Pager* pager, DBPage* page) {
+    if (!pager || !page || !pager->buffer_pool) return;
+    buffer_pool_unpin(pager->buffer_pool, page);
+}
+
+// Ask for pages ahead of time - MADV_WILLNEED pulls them into the page cache behind the mapping,
+// POSIX_FADV_WILLNEED does the same for the buffer pool so the pread() that fills the frame doesn't wait on the disk
+void pager_prefetch(Pager* pager, uint32_t first_page, uint32_t count) {
+    if (!pager || count == 0) return;
+    size_t offset = GET_PAGE_OFFSET(pager, first_page);
+    size_t file_size = pager->db_pager.file_size;
+    if (offset >= file_size) return;  // Nothing on disk to read yet
+    size_t len = GET_PAGE_OFFSET(pager, count);
+    if (len > file_size - offset) len = file_size - offset;
+
+    if (pager->buffer_pool) {
+        int err = posix_fadvise(pager->db_pager.fd, (off_t)offset, (off_t)len, POSIX_FADV_WILLNEED);
+        if (err != 0) {
+            errno = err;
+            perror("posix_fadvise");
+            return;
+        }
+    } else if (madvise((uint8_t*)pager->db_pager.mem_start + offset, len, MADV_WILLNEED) != 0) {
+        perror("madvise");
+        return;
+    }
+    pager->io_stats.prefetch_calls++;
+    pager->io_stats.pages_prefetched += len / pager->db_pager.page_size;
+}
+
+// The advice covers the whole file - lookups and scans take turns, so only a change costs a syscall
+void pager_set_access_pattern(Pager* pager, PagerAccessPattern pattern) {
+    if (!pager) return;
+    if (__atomic_exchange_n(&pager->access_pattern, (int)pattern, __ATOMIC_RELAXED) == (int)pattern) return;
+
+    if (pager->buffer_pool) {
+        int err = posix_fadvise(pager->db_pager.fd, 0, 0, fadvise_advice(pattern));  // 0 length - up to the end, however far that gets
+        if (err != 0) {
+            errno = err;
+            perror("posix_fadvise");
+        }
+    } else if (madvise(pager->db_pager.mem_start, pager->db_pager.file_size, madvise_advice(pattern)) != 0) {
+        perror("madvise");
+    }
+}
+
+// mlock/munlock the mapping over [first_page, first_page + count) - pages not in the file yet are left out
+static PSqlStatus lock_pages(Pager* pager, uint32_t first_page, uint32_t count, bool lock) {
+    if (!pager) return PSQL_ERROR;
+    if (pager->buffer_pool || pager->wal) return PSQL_MISUSE;
+    size_t offset = GET_PAGE_OFFSET(pager, first_page);
+    if (count == 0 || offset >= pager->db_pager.file_size) return PSQL_OK;
+    size_t len = GET_PAGE_OFFSET(pager, count);
+    if (len > pager->db_pager.file_size - offset) len = pager->db_pager.file_size - offset;
+
+    uint8_t* start = (uint8_t*)pager->db_pager.mem_start + offset;
+    if ((lock ? mlock(start, len) : munlock(start, len)) != 0) {
+        perror(lock ? "mlock" : "munlock");
+        return PSQL_NOMEM;
+    }
+    return PSQL_OK;
+}
+
+PSqlStatus pager_lock_pages(Pager* pager, uint32_t first_page, uint32_t count) {
+    return lock_pages(pager, first_page, count, true);
+}
+
+PSqlStatus pager_unlock_pages(Pager* pager, uint32_t first_page, uint32_t count) {
+    return lock_pages(pager, first_page, count, false);
+}
+
 PSqlStatus pager_write_page(Pager* pager, DBPage* page) {
     if (!pager || !page) return PSQL_ERROR;
     if (pager->flags & PAGER_READONLY) return PSQL_READONLY;
     
-    // For memory-mapped files, we don't need to do anything special
-    // The changes are already in the mapped memory
-    
-    // If journaling is enabled, we would add the page to the journal here
-    if (pager->flags & PAGER_JOURNALING_ENABLED) {
-        // Journal implementation would go here
+    // For memory-mapped files the changes are already in the mapped memory - just remember which page to sync
+    // The buffer pool only needs to know the frame has to be written back before it gets evicted
+    uint32_t page_no;
+    if (pager->buffer_pool) {
+        page_no = buffer_pool_page_no(pager->buffer_pool, page);
+        buffer_pool_mark_dirty(pager->buffer_pool, page);
+    } else {
+        page_no = mapped_page_no(pager, page);
+        if (bitmap_set(&pager->db_pager.dirty_pages, page_no)) pager->io_stats.pages_dirtied++;
     }
+    backup_page_written(pager, page, page_no);  // Change stamp for incremental backups, and a recopy for any running now
+    if (page_no == 0) pager->io_stats.header_writes++;
+    pager_event(pager, PAGER_TRACE_WRITE, page_no, 1, page_kind_of(page_no, page->header.flag), 0);
     
     // If sync-on-write is enabled, sync to disk immediately
-    if (pager->flags & PAGER_SYNC_ON_WRITE) {
-        if (msync(pager->db_pager.mem_start, pager->db_pager.file_size, MS_SYNC) < 0) {
-            return PSQL_IOERR;
-        }
+    if ((pager->flags & PAGER_SYNC_ON_WRITE) && pager->buffer_pool) {
+        return pager_flush_cache(pager);
+    }
+    if ((pager->flags & PAGER_SYNC_ON_WRITE) && !pager->wal && !(pager->flags & PAGER_MEMORY_DB)) {  // WAL pages only become durable on commit
+        if (pager->journal_pager.active && sync_journal(pager) != PSQL_OK) return PSQL_IOERR;
+        if (pager->page_checksums) seal_page(pager, page);
+        if (sync_page_range(pager, page_no, 1) != PSQL_OK) return PSQL_IOERR;
+        bitmap_clear(&pager->db_pager.dirty_pages, page_no);
     }
     
     return PSQL_OK;
@@ -460,48 +1297,516 @@ PSqlStatus pager_flush_cache(Pager* pager) {
     if (!pager) return PSQL_ERROR;
     if (pager->read_only) return PSQL_OK; // Nothing to flush in read-only mode
     
-    // For memory-mapped files, we just need to sync the entire mapped region
-    if (msync(pager->db_pager.mem_start, pager->db_pager.file_size, MS_SYNC) < 0) {
-        return PSQL_IOERR;
+    // WAL mode - flushing is committing, unless a transaction is open in which case it waits for pager_commit()
+    if (pager->wal && pager->in_transaction) return PSQL_OK;
+    
+    bool wrote;
+    PSqlStatus status = write_commit(pager, &wrote);
+    if (status != PSQL_OK) return status;
+    if (wrote) status = group_commit_wait(pager->group_commit, group_commit_enter(pager->group_commit));
+    if (status == PSQL_OK && pager->truncate_pending) status = truncate_db_file(pager);
+    return status;
+}
+
+
+/* Transactions */
+// One writer at a time - other threads queue up here, and count as on their way for a group commit leader to wait for.
+// Without journal the transaction only keeps writers out while it reads - it has to end with end_transaction(), since
+// there are no records to commit or roll back
+static PSqlStatus begin_transaction(Pager* pager, bool journal) {
+    group_commit_begin(pager->group_commit);
+    if (pthread_mutex_lock(&pager->writer_lock) != 0) {  // EDEADLK - this thread has a transaction open already
+        group_commit_end(pager->group_commit);
+        return PSQL_MISUSE;
     }
     
+    pager->in_transaction = true;
+    pager->txn_page_count = pager->db_pager.page_count;
+    if (journal && pager->journal_pager.fd >= 0) {
+        pthread_mutex_lock(&pager->lock);
+        PSqlStatus status = journal_begin(&pager->journal_pager, pager->txn_page_count);
+        pthread_mutex_unlock(&pager->lock);
+        if (status != PSQL_OK) {
+            end_transaction(pager);
+            return status;
+        }
+    }
     return PSQL_OK;
 }
 
+PSqlStatus pager_begin_transaction(Pager* pager) {
+    if (!pager) return PSQL_ERROR;
+    if (pager->read_only) return PSQL_READONLY;
+    return begin_transaction(pager, true);
+}
+
+// Savepoints from keep on are gone - released, rolled back past, or their transaction is over
+static void drop_savepoints(Pager* pager, uint32_t keep) {
+    while (pager->savepoint_count > keep) free(pager->savepoints[--pager->savepoint_count].name);
+}
+
+static void end_transaction(Pager* pager) {
+    drop_savepoints(pager, 0);
+    pager->in_transaction = false;
+    if (pager->flags & PAGER_MEMORY_DB) undo_log_clear(pager);
+    group_commit_end(pager->group_commit);
+    pthread_mutex_unlock(&pager->writer_lock);
+}
+
+// With a rollback journal the journal can only go once the pages it covers are durable, and the next transaction needs it -
+// so the writer lock is held through the flush. The group commit stops counting this transaction first, or the leader
+// would hold the door open for writers that can't get in until it is done
+static PSqlStatus finish_journaled_commit(Pager* pager, PSqlStatus status, uint64_t ticket) {
+    group_commit_end(pager->group_commit);
+    if (status == PSQL_OK) status = group_commit_wait(pager->group_commit, ticket);
+    if (status == PSQL_OK && pager->truncate_pending) status = truncate_db_file(pager);
+    if (status == PSQL_OK) status = reset_journal(pager);
+    else stop_journal(pager);  // The journal stays behind for recovery
+    pthread_mutex_unlock(&pager->writer_lock);
+    return status;
+}
+
+// The next writer gets going while this one waits on the flush - which it may well end up sharing
+PSqlStatus pager_commit(Pager* pager) {
+    if (!pager) return PSQL_ERROR;
+    if (!pager->in_transaction) return PSQL_MISUSE;
+    if (pager->journal_pager.fd >= 0 && !pager->journal_pager.active) return PSQL_MISUSE;  // A rollback to a savepoint failed - roll it all back
+    
+    drop_savepoints(pager, 0);  // The journaled path below never gets to end_transaction()
+    pager->in_transaction = false;
+    bool wrote;
+    PSqlStatus status = write_commit(pager, &wrote);
+    uint64_t ticket = (status == PSQL_OK && wrote) ? group_commit_enter(pager->group_commit) : 0;
+    if (pager->journal_pager.active) return finish_journaled_commit(pager, status, ticket);
+    
+    // A commit that shrinks the file waits for its flush before letting the next writer in - the next writer could
+    // grow the file again while it gets truncated
+    if (status == PSQL_OK && pager->truncate_pending) {
+        status = group_commit_wait(pager->group_commit, ticket);
+        if (status == PSQL_OK) status = truncate_db_file(pager);
+        end_transaction(pager);
+        return status;
+    }
+    end_transaction(pager);
+    
+    if (status != PSQL_OK) return status;
+    return group_commit_wait(pager->group_commit, ticket);
+}
+
+PSqlStatus pager_set_group_commit(Pager* pager, uint32_t window_us, uint32_t max_batch) {
+    if (!pager) return PSQL_ERROR;
+    if (!pager->group_commit) return PSQL_READONLY;
+    group_commit_configure(pager->group_commit, window_us, max_batch);
+    return PSQL_OK;
+}
+
+GroupCommitStats pager_group_commit_stats(Pager* pager) {
+    return group_commit_get_stats(pager ? pager->group_commit : NULL);
+}
+
+JournalStats pager_journal_stats(Pager* pager) {
+    JournalStats stats = { 0 };
+    if (!pager) return stats;
+    pthread_mutex_lock(&pager->lock);
+    stats = pager->journal_pager.stats;
+    pthread_mutex_unlock(&pager->lock);
+    return stats;
+}
+
+JournalRecoveryStats pager_recovery_stats(Pager* pager) {
+    JournalRecoveryStats stats = { 0 };
+    return pager ? pager->recovery : stats;
+}
+
+// Reload the in-memory header from the (rolled back) page 0, then the free page tree and pointer map chain it points to
+static void reload_free_page_map(Pager* pager) {
+    load_db_header(pager);
+    arena_free(&pager->db_pager.free_page_map->tree.arena);
+    free(pager->db_pager.free_page_map);
+    init_free_page_map(pager);
+    ptrmap_load(pager);
+}
+
+// Copy every before-image in the journal back, write them back and only then truncate the journal - in mmap mode the
+// kernel may have written changed pages to the file already, and the buffer pool may have evicted some
+// The journal is made durable and stopped first, so whatever gets written back meanwhile is covered
+static PSqlStatus rollback_journal(Pager* pager) {
+    PSqlStatus status = finish_journal(pager);
+    if (status != PSQL_OK) return status;
+    stop_journal(pager);
+    status = journal_rollback(&pager->journal_pager, current_page, restore_page, pager);
+    if (status != PSQL_OK) return status;
+    
+    pager->db_pager.page_count = pager->txn_page_count;
+    pager->truncate_pending = false;
+    drop_truncated_pages(pager);
+    if (pager->journal_pager.records > 0) {
+        status = pager->buffer_pool ? buffer_pool_flush(pager->buffer_pool) : start_writeback(pager);
+        if (status == PSQL_OK) status = sync_db_file(pager);
+        if (status != PSQL_OK) return status;
+    }
+    status = reset_journal(pager);
+    reload_free_page_map(pager);  // Reads the restored page 0
+    end_transaction(pager);
+    return status;
+}
+
+// WAL mode rollback is cheap - uncommitted changes only ever lived in private copy-on-write pages
+// Dropping them with MADV_DONTNEED brings back the main file's copy, and the WAL's copy if it has a newer one
+// A memory DB copies the before-images in its undo log back instead, and a rollback journal the ones in the journal file
+PSqlStatus pager_rollback(Pager* pager) {
+    if (!pager) return PSQL_ERROR;
+    if (!pager->in_transaction) return PSQL_MISUSE;
+    drop_savepoints(pager, 0);  // Even if the rollback fails half way - only another pager_rollback() is left to call
+    if (pager->journal_pager.fd >= 0) return rollback_journal(pager);  // Stopped already if a rollback to a savepoint failed
+    if (!pager->wal && !(pager->flags & PAGER_MEMORY_DB)) return PSQL_MISUSE;  // Needs before-images - open with PAGER_JOURNALING_ENABLED
+    
+    Bitmap* dirty = &pager->db_pager.dirty_pages;
+    if (pager->flags & PAGER_MEMORY_DB) {
+        undo_log_restore(pager);
+        bitmap_clear_all(dirty);
+        pager->db_pager.page_count = pager->txn_page_count;
+        pager->truncate_pending = false;
+        reload_free_page_map(pager);  // Reads the restored page 0
+        end_transaction(pager);
+        return PSQL_OK;
+    }
+    
+    uint32_t frame;
+    pthread_mutex_lock(&pager->lock);
+    for (size_t page_no = bitmap_next_set(dirty, 0); page_no < dirty->num_bits; page_no = bitmap_next_set(dirty, page_no + 1)) {
+        if (madvise((uint8_t*)pager->db_pager.mem_start + GET_PAGE_OFFSET(pager, page_no), pager->db_pager.page_size, MADV_DONTNEED) != 0) {
+            perror("madvise");
+            pthread_mutex_unlock(&pager->lock);
+            return PSQL_IOERR;
+        }
+        if (wal_find_frame(pager->wal, page_no, &frame)) bitmap_set(&pager->wal_stale_pages, page_no);
+    }
+    pthread_mutex_unlock(&pager->lock);
+    bitmap_clear_all(dirty);
+    
+    pager->db_pager.page_count = pager->txn_page_count;
+    pager->truncate_pending = false;
+    reload_free_page_map(pager);
+    end_transaction(pager);
+    return PSQL_OK;
+}
+
+
+/* Savepoints - marks in the rollback journal, see journal_mark() */
+// Newest first, so a name used twice finds the inner one - UINT32_MAX if there is none
+static uint32_t find_savepoint(Pager* pager, const char* name) {
+    for (uint32_t i = pager->savepoint_count; i > 0; i--) {
+        if (strcmp(pager->savepoints[i - 1].name, name) == 0) return i - 1;
+    }
+    return UINT32_MAX;
+}
+
+PSqlStatus pager_savepoint(Pager* pager, const char* name) {
+    if (!pager || !name) return PSQL_ERROR;
+    if (pager->journal_pager.fd < 0) return PSQL_MISUSE;  // No journal to mark - open with PAGER_JOURNALING_ENABLED
+    if (pager->savepoint_count == pager->savepoint_capacity) {
+        uint32_t capacity = pager->savepoint_capacity ? pager->savepoint_capacity * 2 : 4;
+        PagerSavepoint* savepoints = (PagerSavepoint*)realloc(pager->savepoints, capacity * sizeof(PagerSavepoint));
+        if (!savepoints) return PSQL_NOMEM;
+        pager->savepoints = savepoints;
+        pager->savepoint_capacity = capacity;
+    }
+    
+    bool began = !pager->in_transaction;
+    PSqlStatus status = began ? pager_begin_transaction(pager) : PSQL_OK;
+    if (status != PSQL_OK) return status;
+    
+    // The free list and the header only live in memory until the commit - they go to their pages first, so a rollback
+    // to here finds them there
+    PagerSavepoint* savepoint = &pager->savepoints[pager->savepoint_count];
+    status = sync_free_page_list(pager);
+    if (status == PSQL_OK) status = write_db_header(pager);
+    if (status == PSQL_OK) {
+        pthread_mutex_lock(&pager->lock);
+        status = journal_mark(&pager->journal_pager, pager->db_pager.page_count, &savepoint->mark);
+        pthread_mutex_unlock(&pager->lock);
+    }
+    if (status == PSQL_OK && !(savepoint->name = strdup(name))) status = PSQL_NOMEM;
+    if (status != PSQL_OK) {
+        if (began) pager_rollback(pager);
+        return status;
+    }
+    savepoint->truncate_pending = pager->truncate_pending;
+    savepoint->began_transaction = began;
+    pager->savepoint_count++;
+    return PSQL_OK;
+}
+
+// The changes since stay part of the transaction - and their records in the journal, for a rollback of it
+PSqlStatus pager_release_savepoint(Pager* pager, const char* name) {
+    if (!pager || !name) return PSQL_ERROR;
+    if (!pager->in_transaction) return PSQL_MISUSE;  // Savepoints end with their transaction
+    uint32_t i = find_savepoint(pager, name);
+    if (i == UINT32_MAX) return PSQL_NOTFOUND;
+    bool commit = pager->savepoints[i].began_transaction;
+    drop_savepoints(pager, i);
+    return commit ? pager_commit(pager) : PSQL_OK;
+}
+
+// Like rollback_journal(), only from the mark - the restored pages are just dirty again, the commit writes them back
+// Pages allocated after the mark are dropped, and the header and free list are reloaded from the pages they were
+// written to when the savepoint was set. The savepoint is marked again, so the pages changed next are journaled again
+PSqlStatus pager_rollback_to_savepoint(Pager* pager, const char* name) {
+    if (!pager || !name) return PSQL_ERROR;
+    if (!pager->in_transaction) return PSQL_MISUSE;  // Savepoints end with their transaction
+    uint32_t i = find_savepoint(pager, name);
+    if (i == UINT32_MAX) return PSQL_NOTFOUND;
+    drop_savepoints(pager, i + 1);
+    
+    PagerSavepoint* savepoint = &pager->savepoints[i];
+    pthread_mutex_lock(&pager->lock);
+    PSqlStatus status = flush_journal(pager);
+    pthread_mutex_unlock(&pager->lock);
+    if (status != PSQL_OK) return status;
+    stop_journal(pager);
+    status = journal_rollback_to(&pager->journal_pager, &savepoint->mark, current_page, restore_page, pager);
+    if (status != PSQL_OK) return status;  // The journal stays stopped - only pager_rollback() is left
+    
+    pager->db_pager.page_count = savepoint->mark.db_page_count;
+    pager->truncate_pending = savepoint->truncate_pending;
+    drop_truncated_pages(pager);
+    reload_free_page_map(pager);
+    pthread_mutex_lock(&pager->lock);
+    status = journal_mark(&pager->journal_pager, pager->db_pager.page_count, &savepoint->mark);
+    pthread_mutex_unlock(&pager->lock);
+    return status;
+}
+
+// Copy committed WAL frames back into the main file, in page order so the writes are sequential
+// PASSIVE lets go of the lock for the copy so commits carry on, FULL/TRUNCATE hold it throughout so the WAL always gets reset
+// Dropping the private copies of checkpointed pages is only safe on the thread that owns the pages
+PSqlStatus run_checkpoint(Pager* pager, CheckpointMode mode, bool drop_private_copies) {
+    if (!pager->wal || pager->read_only) return PSQL_OK;
+    
+    pthread_mutex_lock(&pager->checkpoint_lock);
+    pthread_mutex_lock(&pager->lock);
+    
+    CheckpointStats* stats = &pager->checkpoint_stats;
+    uint64_t start = now_us();
+    if (pager->oldest_uncheckpointed_us) {
+        stats->last_lag_us = start - pager->oldest_uncheckpointed_us;
+        if (stats->last_lag_us > stats->max_lag_us) stats->max_lag_us = stats->last_lag_us;
+    }
+    
+    // Frames still waiting on a group commit flush have to be durable before they go anywhere near the main file
+    PSqlStatus status = PSQL_OK;
+    if (pager->wal->synced_frames < pager->wal->frame_count) {
+        uint32_t checkpoint_seq = pager->wal->header.checkpoint_seq;
+        uint32_t frame_count = pager->wal->frame_count;
+        status = wal_sync(pager->wal);
+        if (status == PSQL_OK) wal_mark_synced(pager->wal, checkpoint_seq, frame_count);
+    }
+    
+    WalCheckpointPlan plan;
+    if (status == PSQL_OK) status = wal_checkpoint_plan(pager->wal, &plan);
+    else memset(&plan, 0, sizeof(plan));
+    if (status == PSQL_OK && plan.count > 0) {
+        if (mode == CHECKPOINT_PASSIVE) pthread_mutex_unlock(&pager->lock);
+        status = wal_checkpoint_copy(pager->wal, pager->db_pager.fd, &plan);
+        if (mode == CHECKPOINT_PASSIVE) pthread_mutex_lock(&pager->lock);
+    }
+    
+    bool reset = false;
+    if (status == PSQL_OK) status = wal_checkpoint_finish(pager->wal, &plan, mode == CHECKPOINT_TRUNCATE, &reset);
+    if (status == PSQL_OK) {
+        // The main file is current for these pages now, unless a commit during the copy replaced them again
+        for (uint32_t i = 0; i < plan.count; i++) {
+            uint32_t page_no = plan.entries[i].page_no;
+            uint32_t newest;
+            if (!reset && (!wal_find_frame(pager->wal, page_no, &newest) || newest != plan.entries[i].frame)) continue;
+            
+            bitmap_clear(&pager->wal_stale_pages, page_no);
+            // Pages without uncommitted changes can go back to sharing the page cache
+            if (drop_private_copies && !bitmap_test(&pager->db_pager.dirty_pages, page_no)) {
+                madvise((uint8_t*)pager->db_pager.mem_start + GET_PAGE_OFFSET(pager, page_no), pager->db_pager.page_size, MADV_DONTNEED);
+            }
+        }
+        // Whatever is left was committed after the plan was made
+        pager->oldest_uncheckpointed_us = pager->wal->frame_count > pager->wal->backfilled ? start : 0;
+        
+        stats->checkpoints++;
+        stats->pages_written += plan.count;
+        if (reset) stats->resets++;
+    } else {
+        stats->failures++;
+    }
+    
+    stats->last_duration_us = now_us() - start;
+    stats->total_duration_us += stats->last_duration_us;
+    if (stats->last_duration_us > stats->max_duration_us) stats->max_duration_us = stats->last_duration_us;
+    
+    pthread_mutex_unlock(&pager->lock);
+    pthread_mutex_unlock(&pager->checkpoint_lock);
+    wal_checkpoint_plan_free(&plan);
+    return status;
+}
+
+PSqlStatus pager_checkpoint(Pager* pager, CheckpointMode mode) {
+    if (!pager) return PSQL_ERROR;
+    return run_checkpoint(pager, mode, true);
+}
+
+PSqlStatus pager_incremental_vacuum(Pager* pager, uint32_t max_pages) {
+    if (!pager) return PSQL_ERROR;
+    if (pager->read_only) return PSQL_READONLY;
+    if (pager->vacuum_mode == VACUUM_NONE) return PSQL_MISUSE;
+    uint32_t truncated;
+    return vacuum_run(pager, max_pages, &truncated);
+}
+
+// Readers carry on while the copy is built - only writers wait, so the copy is one consistent state of the DB.
+// path can't be the DB itself: this pager would go on writing to the file the rename just unlinked
+PSqlStatus pager_vacuum_into(Pager* pager, const char* path) {
+    if (!pager || !path) return PSQL_ERROR;
+    
+    struct stat current, target;
+    if (fstat(pager->db_pager.fd, &current) == 0 && stat(path, &target) == 0 &&
+        current.st_dev == target.st_dev && current.st_ino == target.st_ino) {
+        return PSQL_MISUSE;
+    }
+    
+    // A read-only pager has no writers to keep out
+    if (pager->read_only) return vacuum_into(pager, path);
+    
+    // Only reads - a journal started here would be left active after it, and the next autocommit flush would write its
+    // records out as a transaction that never ends
+    PSqlStatus status = begin_transaction(pager, false);  // PSQL_MISUSE inside a transaction - the copy would miss its writes
+    if (status != PSQL_OK) return status;
+    status = vacuum_into(pager, path);
+    end_transaction(pager);  // Nothing was written to commit
+    return status;
+}
+
+// Same as VACUUM INTO - writers wait so the file is one committed state of the DB. Pages written outside a transaction
+// go in too, the commit below seals them and brings the free list in the header up to date
+PSqlStatus pager_serialize(Pager* pager, const char* path) {
+    if (!pager || !path) return PSQL_ERROR;
+    if (!(pager->flags & PAGER_MEMORY_DB)) return PSQL_MISUSE;  // A file-backed DB already is one - VACUUM INTO copies it
+    
+    // A memory DB has no journal to start, and the bare end_transaction() below wouldn't end one
+    PSqlStatus status = begin_transaction(pager, false);  // PSQL_MISUSE inside a transaction - its changes aren't committed
+    if (status != PSQL_OK) return status;
+    bool wrote;
+    status = write_commit(pager, &wrote);
+    if (status == PSQL_OK && pager->truncate_pending) status = truncate_db_file(pager);
+    if (status == PSQL_OK) status = memory_db_serialize(pager, path);
+    end_transaction(pager);
+    return status;
+}
+
+// Swapping the policy restarts the checkpointer so it never sees a half-updated one
+// The stats start over too - numbers from the old policy would only muddy the comparison
+PSqlStatus pager_set_checkpoint_policy(Pager* pager, CheckpointPolicy policy) {
+    if (!pager) return PSQL_ERROR;
+    
+    checkpointer_stop(pager->checkpointer);
+    pager->checkpointer = NULL;
+    pager->checkpoint_policy = policy;
+    memset(&pager->checkpoint_stats, 0, sizeof(CheckpointStats));
+    
+    if (pager->wal && !pager->read_only && policy.background) {
+        pager->checkpointer = checkpointer_start(pager);
+        if (!pager->checkpointer) return PSQL_ERROR;
+    }
+    return PSQL_OK;
+}
+
+CheckpointStats pager_checkpoint_stats(Pager* pager) {
+    CheckpointStats stats;
+    memset(&stats, 0, sizeof(stats));
+    if (!pager) return stats;
+    
+    pthread_mutex_lock(&pager->lock);
+    stats = pager->checkpoint_stats;
+    if (pager->wal) stats.lag_frames = pager->wal->frame_count - pager->wal->backfilled;
+    pthread_mutex_unlock(&pager->lock);
+    return stats;
+}
+
+// Resize the buffer pool - dirty frames are written back first, and nothing can be pinned while the pool is swapped
+PSqlStatus pager_set_cache_size(Pager* pager, size_t num_frames) {
+    if (!pager) return PSQL_ERROR;
+    if (num_frames < BUFFER_POOL_MIN_FRAMES) num_frames = BUFFER_POOL_MIN_FRAMES;
+
+    pager->cache_size = num_frames;
+    if (!pager->buffer_pool) return PSQL_OK;  // mmap mode, or picked up when the pool is created
+    if (buffer_pool_capacity(pager->buffer_pool) == num_frames) return PSQL_OK;
+    if (buffer_pool_pinned_count(pager->buffer_pool) > 0) return PSQL_BUSY;
+
+    PSqlStatus status = buffer_pool_flush(pager->buffer_pool);
+    if (status != PSQL_OK) return status;
+
+    BufferPool* resized = buffer_pool_create(pager->db_pager.fd, num_frames, pager->db_pager.page_size);
+    if (!resized) return PSQL_NOMEM;
+
+    buffer_pool_destroy(pager->buffer_pool);
+    pager->buffer_pool = resized;
+    configure_buffer_pool(pager);
+    populate_buffer_pool(pager);
+    return PSQL_OK;
+}
+
+BufferPoolStats pager_cache_stats(Pager* pager) {
+    return buffer_pool_get_stats(pager ? pager->buffer_pool : NULL);
+}
+
+// Swap in an empty cache of the new size - images are only copies of clean pages, nothing needs writing back
+PSqlStatus pager_set_compressed_cache_size(Pager* pager, size_t bytes) {
+    if (!pager) return PSQL_ERROR;
+
+    pager->compressed_cache_size = bytes;
+    if (!pager->compressed_cache) return PSQL_OK;  // No PAGER_COMPRESSION, or picked up when the pool is created
+
+    CompressedCache* resized = compressed_cache_create(bytes, pager->db_pager.page_size);
+    if (!resized) return PSQL_NOMEM;
+
+    compressed_cache_destroy(pager->compressed_cache);
+    pager->compressed_cache = resized;
+    buffer_pool_set_compressed_cache(pager->buffer_pool, resized);
+    return PSQL_OK;
+}
+
+CompressedCacheStats pager_compression_stats(Pager* pager) {
+    return compressed_cache_get_stats(pager ? pager->compressed_cache : NULL);
+}
+
 /* Database initialization */
 PSqlStatus pager_init_new_db(Pager* pager) {
     if (!pager || (pager->flags & PAGER_READONLY)) return PSQL_READONLY;
     
     // Allocate space for at least 4 pages (header + 3 catalog pages)
-    uint16_t highest_page = allocate_new_db_pages(pager, 4);
+    uint32_t highest_page = allocate_new_db_pages(pager, 4);
     if (highest_page < 3) return PSQL_NOMEM;
     
-    // Get the header page
-    DBPage* header_page = pager_get_page(pager, 0);
-    if (!header_page) return PSQL_ERROR;
-    
-    // Initialize header
-    DatabaseHeader* header = (DatabaseHeader*)header_page->data;
+    // Initialize header - the copy in page 0 is written below
+    DatabaseHeader* header = &pager->header;
     memset(header, 0, sizeof(DatabaseHeader));
     
     // Set magic number
     memcpy(header->magic, MAGIC_NUMBER, MAGIC_NUMBER_SIZE);
     
     // Set basic header fields
-    header->page_size = PAGE_SIZE;
-    header->db_version = 1;
+    header->page_size = DB_PAGE_SIZE_ENCODE(pager->db_pager.page_size);
+    header->db_version = DB_FORMAT_VERSION;
     header->root_table_catalog = 1;  // Page 1
     header->root_column_catalog = 2; // Page 2
     header->root_fk_catalog = 3;     // Page 3
     header->free_page_count = 0;
     header->highest_page = 3;        // First 4 pages are reserved
     header->transaction_state = 0;
-    header->flags = 0;
+    header->flags = pager->page_checksums ? DB_PAGE_CHECKSUMS : 0;
+    if (pager->vacuum_mode == VACUUM_FULL) header->flags |= DB_AUTO_VACUUM;
+    if (pager->vacuum_mode == VACUUM_INCREMENTAL) header->flags |= DB_INCREMENTAL_VACUUM;
+    pager->header_dirty = true;
     
-    // Calculate checksum
-    header->checksum = calculate_crc32(header, offsetof(DatabaseHeader, checksum));
-    
-    // Initialize catalog pages
+    // Initialize catalog pages - the header was just wiped, so is any pointer map chain it had
+    pager->ptrmap.count = 0;
     DBPage* table_catalog = init_index_internal_page(pager, 1);
     DBPage* column_catalog = init_index_internal_page(pager, 2);
     DBPage* fk_catalog = init_index_internal_page(pager, 3);
@@ -510,12 +1815,24 @@ PSqlStatus pager_init_new_db(Pager* pager) {
         return PSQL_ERROR;
     }
     
-    // Write the pages to disk
-    pager_write_page(pager, header_page);
+    // The catalog roots are found through the header - they never move
+    for (uint32_t page_no = 1; page_no < DB_CATALOG_PAGES; page_no++) {
+        if (ptrmap_put(pager, page_no, PTRMAP_ROOT, 0, 0) != PSQL_OK) return PSQL_ERROR;
+    }
+    
+    // Write the pages to disk - write_db_header() calculates the checksum
+    if (write_db_header(pager) != PSQL_OK) return PSQL_ERROR;
     pager_write_page(pager, table_catalog);
     pager_write_page(pager, column_catalog);
     pager_write_page(pager, fk_catalog);
     
+    pager_unpin_page(pager, table_catalog);
+    pager_unpin_page(pager, column_catalog);
+    pager_unpin_page(pager, fk_catalog);
+    
+    // The catalog pages only exist now - init_pager() could only lock the header
+    if (pager->flags & PAGER_MLOCK_CATALOG) pager_lock_pages(pager, 0, DB_CATALOG_PAGES);
+    
     return PSQL_OK;
 }
 
@@ -532,17 +1849,19 @@ PSqlStatus pager_verify_db(Pager* pager) {
     
     DatabaseHeader* header = (DatabaseHeader*)header_page->data;
     
-    // Check magic number
-    if (memcmp(header->magic, MAGIC_NUMBER, MAGIC_NUMBER_SIZE) != 0) {
+    // Check magic number - older format versions were upgraded by init_pager()
+    if (memcmp(header->magic, MAGIC_NUMBER, MAGIC_NUMBER_SIZE) != 0 || header->db_version != DB_FORMAT_VERSION ||
+        DB_PAGE_SIZE_DECODE(header->page_size) != pager->db_pager.page_size) {
+        pager_unpin_page(pager, header_page);
         return PSQL_CORRUPT;
     }
     
     // Verify checksum
+    // Covers everything before the checksum field, so no need to zero it first - a read-only mapping can't be written
     uint32_t stored_checksum = header->checksum;
-    header->checksum = 0;
     uint32_t calculated_checksum = calculate_crc32(header, 
                                                   offsetof(DatabaseHeader, checksum));
-    header->checksum = stored_checksum;
+    pager_unpin_page(pager, header_page);
     
     if (stored_checksum != calculated_checksum) {
         return PSQL_CORRUPT;
@@ -552,12 +1871,12 @@ PSqlStatus pager_verify_db(Pager* pager) {
 }
 
 // Vaccum fragmented chunks in Page
-void vacuum_page(DBPage* page) {
+void vacuum_page(Pager* pager, DBPage* page) {
     // Get the page header
     uint8_t* base = page->data;
 
     // Temporary buffer to store the compacted chunk data
-    uint8_t compacted[PAGE_SIZE];
+    uint8_t compacted[MAX_PAGE_SIZE];
 
     // Start writing data just after the header
     size_t header_size = sizeof(DBPageHeader);
@@ -604,7 +1923,7 @@ void vacuum_page(DBPage* page) {
     // Update header metadata
     page->header.free_start = header_size + new_slot_count * sizeof(SlotEntry);
     page->header.free_end = new_offset;
-    page->header.free_total = MAX_USABLE_PAGE_SIZE - (new_offset - header_size) - (new_slot_count * sizeof(SlotEntry));
+    page->header.free_total = PAGER_USABLE_SIZE(pager) - (new_offset - header_size) - (new_slot_count * sizeof(SlotEntry));
     page->header.total_slots = new_slot_count;
 }
 
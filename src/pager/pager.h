@@ -30,30 +30,109 @@
 #include "types.h"
 #include "status/db.h"
 
-#define GET_PAGE_OFFSET(page_id) (PAGE_SIZE * page_id)
+#define GET_PAGE_OFFSET(pager, page_id) ((size_t)(pager)->db_pager.page_size * (page_id))  // size_t - 32-bit page numbers overflow a 32-bit offset
+#define PAGER_USABLE_SIZE(pager) USABLE_PAGE_SIZE((pager)->db_pager.page_size)
 
 /* Pager flags */
 #define PAGER_READONLY           0x01  // Open DB in read-only mode
 #define PAGER_WRITEABLE          0x02  // Opens DB as writeable (default)
 #define PAGER_OVERWRITE          0x04  // Allow overwrite mode if file already exists
-#define PAGER_JOURNALING_ENABLED 0x08  // Create a journal file
+#define PAGER_JOURNALING_ENABLED 0x08  // Rollback journal - before-images of the pages each transaction touches, see pager/journal/journal.h. Ignored with PAGER_WAL or PAGER_MEMORY_DB
 #define PAGER_DIRTY              0x10  // Pages in memory have been modified
 #define PAGER_SYNC_ON_WRITE      0x20  // Call msync or fsync after every page write
-#define PAGER_MEMORY_DB          0x40  // Memory-only database
-#define PAGER_CRASH_RECOVERY     0x80  // Pager in recovery mode after a crash
+#define PAGER_MEMORY_DB          0x40  // Memory-only database in a memfd - never synced, rollback from an undo log, see pager/memory_db.h. Not with PAGER_WAL, PAGER_BUFFER_POOL or PAGER_READONLY
+#define PAGER_CRASH_RECOVERY     0x80  // Set by init_pager() when it rolled back a hot journal - see pager_recovery_stats()
+#define PAGER_BUFFER_POOL        0x100 // Cache pages in an explicit buffer pool (pread/pwrite) instead of mmap-ing the file
+#define PAGER_WAL                0x200 // Write-ahead log instead of the rollback journal - mmap mode only
+#define PAGER_PAGE_CHECKSUMS     0x400 // Create the DB with per-page checksums - an existing DB goes by its header instead
+#define PAGER_HUGEPAGES          0x800 // MADV_HUGEPAGE on the mapping (or the buffer pool frames) - fewer TLB misses on large hot DBs
+#define PAGER_POPULATE           0x1000 // Pre-fault the whole file on open (MAP_POPULATE) - a warm start instead of a fault per first touch
+#define PAGER_MLOCK_CATALOG      0x2000 // mlock the header and catalog pages - mmap mode without PAGER_WAL only, see pager_lock_pages()
+#define PAGER_AUTO_VACUUM        0x4000 // Create the DB with full auto-vacuum - the file shrinks on every commit that frees pages
+#define PAGER_INCREMENTAL_VACUUM 0x8000 // Create the DB with incremental vacuum - the file shrinks on pager_incremental_vacuum()
+#define PAGER_COMPRESSION        0x10000 // Keep evicted data and overflow pages LZ-compressed in memory behind the buffer pool - PAGER_BUFFER_POOL only
+#define PAGER_STATS_TIMING       0x20000 // Time page fetches, allocations, syncs and journal writes into latency histograms - see pager/stats.h
 
 /* Core pager functions */
 Pager* init_pager(const char* filename, int flags);
-PSqlStatus pager_open_db(Pager* pager);
+Pager* init_pager_with_page_size(const char* filename, int flags, uint32_t page_size);  // page_size only applies when the file is created - an existing DB keeps its own
+PSqlStatus pager_open_db(Pager* pager);  // A no-op - init_pager() opens the file
 PSqlStatus pager_close_db(Pager* pager);
 PSqlStatus pager_open_journal(Pager* pager);
 PSqlStatus pager_close_journal(Pager* pager);
 void free_pager(Pager* pager);
 
 /* Page access functions */
-DBPage* pager_get_page(Pager* pager, uint16_t page_no);
+DBPage* pager_get_page(Pager* pager, uint32_t page_no);
 PSqlStatus pager_write_page(Pager* pager, DBPage* page);
 PSqlStatus pager_flush_cache(Pager* pager);
+void pager_unpin_page(Pager* pager, DBPage* page);  // Every pager_get_page() needs one in buffer pool mode - no-op with mmap
+PagerIOStats pager_get_io_stats(Pager* pager);
+
+/* Statistics and tracing - counters always, latency histograms with PAGER_STATS_TIMING, see pager/stats.h
+ * Set the trace callback before other threads use the pager - NULL turns it off */
+PagerStats pager_get_stats(Pager* pager);
+void pager_reset_stats(Pager* pager);
+void pager_set_trace(Pager* pager, PagerTraceFn trace, void* ctx);
+
+/* Read-ahead hints - only advice, nothing waits for the pages to arrive */
+void pager_prefetch(Pager* pager, uint32_t first_page, uint32_t count);  // Start reading [first_page, first_page + count) in the background
+void pager_set_access_pattern(Pager* pager, PagerAccessPattern pattern);  // Cheap to call per operation - the kernel is only told when it changes
+
+/* Keep pages resident with mlock - e.g B+ Tree roots every lookup goes through. mmap mode without PAGER_WAL only:
+ * frames in the buffer pool move between pages, and WAL mode drops private copies with MADV_DONTNEED, which locked pages refuse.
+ * Limited by RLIMIT_MEMLOCK - PSQL_NOMEM past it */
+PSqlStatus pager_lock_pages(Pager* pager, uint32_t first_page, uint32_t count);
+PSqlStatus pager_unlock_pages(Pager* pager, uint32_t first_page, uint32_t count);
+
+/* Transactions - without PAGER_WAL or PAGER_MEMORY_DB, commit is a flush and rollback needs PAGER_JOURNALING_ENABLED
+ * Several threads can write through one pager as long as they do it inside transactions - begin waits
+ * for the transaction before to commit, and commits that land together share one fsync (group commit).
+ * With a rollback journal a commit holds the next one off until its flush is done, so they never share one */
+PSqlStatus pager_begin_transaction(Pager* pager);
+PSqlStatus pager_commit(Pager* pager);
+PSqlStatus pager_rollback(Pager* pager);
+PSqlStatus pager_set_group_commit(Pager* pager, uint32_t window_us, uint32_t max_batch);
+GroupCommitStats pager_group_commit_stats(Pager* pager);
+JournalStats pager_journal_stats(Pager* pager);  // Zeroes without a rollback journal
+JournalRecoveryStats pager_recovery_stats(Pager* pager);  // What opening did about a hot journal - recovered is false if there was none
+
+/* Savepoints - nested marks inside a transaction, PAGER_JOURNALING_ENABLED only (PSQL_MISUSE otherwise). A savepoint
+ * outside a transaction begins one, and releasing it commits. Rolling back to a savepoint undoes only the pages journaled
+ * after it and keeps it open, releasing one forgets it - newer savepoints go either way. Names are looked up newest
+ * first, PSQL_NOTFOUND if there is none. A commit or rollback drops them all, and releasing or rolling back to one with
+ * no transaction open is PSQL_MISUSE. Pages pinned before the savepoint have to be fetched again before changing them */
+PSqlStatus pager_savepoint(Pager* pager, const char* name);
+PSqlStatus pager_release_savepoint(Pager* pager, const char* name);
+PSqlStatus pager_rollback_to_savepoint(Pager* pager, const char* name);
+
+/* WAL checkpointing - no-ops without PAGER_WAL */
+PSqlStatus pager_checkpoint(Pager* pager, CheckpointMode mode);  // Copy WAL frames back into the main file now
+PSqlStatus pager_set_checkpoint_policy(Pager* pager, CheckpointPolicy policy);  // Thresholds and mode for automatic checkpoints
+CheckpointStats pager_checkpoint_stats(Pager* pager);
+
+/* Vacuum - a DB created with PAGER_INCREMENTAL_VACUUM only shrinks when asked to. Moves up to max_pages pages off the end
+ * of the file (free ones are just dropped), the next flush or commit makes that durable and truncates the file.
+ * PSQL_MISUSE on a DB created without a vacuum mode - it has no pointer map to find the pointers with */
+PSqlStatus pager_incremental_vacuum(Pager* pager, uint32_t max_pages);
+
+/* VACUUM INTO - write a compacted copy of the DB to path, B+ Trees rebuilt in key order with their data pages behind the
+ * leaves, see pager/db/vacuum_into.h. path is replaced in one rename once the copy is durable - a DB already there is only
+ * gone for pagers that open it afterwards. PSQL_MISUSE if path is this DB, or inside a transaction */
+PSqlStatus pager_vacuum_into(Pager* pager, const char* path);
+
+/* Write a PAGER_MEMORY_DB database out to path as an ordinary .pseql file - committed changes only, replaced in one rename
+ * like VACUUM INTO. The memory DB carries on as it was. PSQL_MISUSE on any other pager, or inside a transaction */
+PSqlStatus pager_serialize(Pager* pager, const char* path);
+
+/* Buffer pool - only meaningful with PAGER_BUFFER_POOL */
+PSqlStatus pager_set_cache_size(Pager* pager, size_t num_frames);
+BufferPoolStats pager_cache_stats(Pager* pager);
+
+/* Compressed pages - only meaningful with PAGER_COMPRESSION, see pager/cache/compressed_cache.h
+ * Resizing drops every image held. The stats give the compression ratio and decode cost per page type */
+PSqlStatus pager_set_compressed_cache_size(Pager* pager, size_t bytes);
+CompressedCacheStats pager_compression_stats(Pager* pager);
 
 /* Database initialization */
 PSqlStatus pager_init_new_db(Pager* pager);
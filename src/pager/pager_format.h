@@ -5,19 +5,24 @@
 #include <stdlib.h>
 #include "constants.h"
 #include "types.h"
+#include "status/db.h"
 
 /* Page initialization functions */
-DBPage* init_index_internal_page(Pager* pager, uint16_t page_no);
-DBPage* init_index_leaf_page(Pager* pager, uint16_t page_no);
-DBPage* init_overflow_page(Pager* pager, uint16_t page_no);
-DBPage* init_data_page(Pager* pager, uint16_t page_no);
+DBPage* init_index_internal_page(Pager* pager, uint32_t page_no);
+DBPage* init_index_leaf_page(Pager* pager, uint32_t page_no);
+DBPage* init_overflow_page(Pager* pager, uint32_t page_no);
+DBPage* init_data_page(Pager* pager, uint32_t page_no);
 
 /* Memory mapping functions */
-void* resize_mmap(int fd, void* old_map, size_t old_size, size_t new_size);
-uint16_t allocate_new_db_page(Pager* pager);
-uint16_t allocate_new_db_pages(Pager* pager, size_t num_pages);
-uint16_t allocate_new_journal_page(Pager* pager);
-uint16_t allocate_new_journal_pages(Pager* pager, size_t num_pages);
+void* reserve_mmap(size_t reserve_size);
+PSqlStatus extend_mmap(Pager* pager, size_t needed);
+uint32_t allocate_new_db_page(Pager* pager);
+uint32_t allocate_new_db_pages(Pager* pager, size_t num_pages);
+uint32_t allocate_new_journal_page(Pager* pager);
+uint32_t allocate_new_journal_pages(Pager* pager, size_t num_pages);
+
+/* WAL checkpointing - shared with the checkpointer thread */
+PSqlStatus run_checkpoint(Pager* pager, CheckpointMode mode, bool drop_private_copies);
 
 #endif /* PRESEQL_PAGER_FORMAT_H */
 
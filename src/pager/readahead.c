@@ -0,0 +1,62 @@
+#include "readahead.h"
+#include "pager.h"
+
+void readahead_pages(Pager* pager, const uint32_t* page_ids, size_t count) {
+    uint32_t first = 0, run = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t page_id = page_ids[i];
+        if (page_id == 0) continue;  // No page - 0 is the header, never a target
+        if (run && page_id >= first && page_id <= first + run) {
+            if (page_id == first + run) run++;
+            continue;
+        }
+        pager_prefetch(pager, first, run);
+        first = page_id;
+        run = 1;
+    }
+    pager_prefetch(pager, first, run);
+}
+
+// Read the tail leaf's sibling pointer and send the sibling on its way, up to READAHEAD_STEPS_PER_LEAF times
+// Adjacent siblings (a freshly bulk loaded tree) go out as one call
+static void extend_window(Pager* pager, PagerReadahead* readahead) {
+    uint32_t first = 0, run = 0;
+    for (int step = 0; step < READAHEAD_STEPS_PER_LEAF && readahead->tail_page_id && readahead->ahead < READAHEAD_WINDOW_LEAVES; step++) {
+        DBPage* tail = pager_get_page(pager, readahead->tail_page_id);
+        if (!tail) {
+            readahead->tail_page_id = 0;
+            break;
+        }
+        if (readahead->visit) readahead->visit(pager, tail);
+        uint32_t next = tail->header.right_sibling_page_id;
+        pager_unpin_page(pager, tail);
+
+        readahead->tail_page_id = next;
+        if (!next) break;
+        readahead->ahead++;
+        if (run && next == first + run) {
+            run++;
+        } else {
+            pager_prefetch(pager, first, run);
+            first = next;
+            run = 1;
+        }
+    }
+    pager_prefetch(pager, first, run);
+}
+
+void readahead_start(Pager* pager, PagerReadahead* readahead, uint32_t leaf_page_id, ReadaheadVisit visit) {
+    readahead->tail_page_id = leaf_page_id;
+    readahead->ahead = 0;
+    readahead->visit = visit;
+    extend_window(pager, readahead);
+}
+
+void readahead_advance(Pager* pager, PagerReadahead* readahead, uint32_t leaf_page_id) {
+    if (readahead->ahead > 0) {
+        readahead->ahead--;
+    } else if (readahead->tail_page_id) {
+        readahead->tail_page_id = leaf_page_id;  // Scan caught up with the window - carry on from where it is
+    }
+    extend_window(pager, readahead);
+}
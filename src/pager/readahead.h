@@ -0,0 +1,35 @@
+/* Read-ahead along a B+ Tree leaf chain
+ *
+ * Leaves are linked through right_sibling_page_id, but after a few splits they sit all over the file, so the
+ * kernel's own readahead - which guesses from the file offset of each fault - reads pages nobody asked for and a
+ * cold scan ends up faulting in one page at a time.
+ *
+ * A PagerReadahead walks the chain ahead of a scan and keeps the next READAHEAD_WINDOW_LEAVES leaves on their way
+ * in with pager_prefetch(). Finding the leaf after next means reading a sibling pointer out of a leaf that was only
+ * prefetched, so the window moves READAHEAD_STEPS_PER_LEAF leaves per leaf the scan takes - the leaf it reads was
+ * asked for a few leaves back and is normally in by then. Every leaf the window reads is handed to `visit`, which
+ * can prefetch whatever that leaf points at (e.g the data pages behind its slots) just as far ahead.
+ */
+
+#ifndef PRESEQL_PAGER_READAHEAD_H
+#define PRESEQL_PAGER_READAHEAD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "pager/types.h"
+
+typedef void (*ReadaheadVisit)(Pager* pager, const DBPage* leaf);
+
+typedef struct {
+    uint32_t tail_page_id;  // Furthest leaf read so far - 0 once the end of the chain is reached
+    uint32_t ahead;         // Leaves between the scan and tail_page_id
+    ReadaheadVisit visit;   // NULL if leaves don't point anywhere worth prefetching
+} PagerReadahead;
+
+void readahead_start(Pager* pager, PagerReadahead* readahead, uint32_t leaf_page_id, ReadaheadVisit visit);  // The scan is on this leaf
+void readahead_advance(Pager* pager, PagerReadahead* readahead, uint32_t leaf_page_id);  // The scan moved on to this leaf - its right sibling
+
+// Prefetch a list of pages - runs of adjacent ids go out as one call, repeats of the previous run are dropped
+void readahead_pages(Pager* pager, const uint32_t* page_ids, size_t count);
+
+#endif /* PRESEQL_PAGER_READAHEAD_H */
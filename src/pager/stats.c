@@ -0,0 +1,131 @@
+#include <string.h>
+
+#include "stats.h"
+#include "pager/constants.h"
+
+/* Recording */
+PageKind page_kind_of(uint32_t page_no, uint8_t flag) {
+    if (page_no == 0) return PAGE_KIND_HEADER;
+    if (flag & PAGE_INDEX_INTERNAL) return PAGE_KIND_INDEX_INTERNAL;
+    if (flag & PAGE_INDEX_LEAF) return PAGE_KIND_INDEX_LEAF;
+    if (flag & PAGE_DATA) return PAGE_KIND_DATA;
+    if (flag & PAGE_OVERFLOW) return PAGE_KIND_OVERFLOW;
+    if (flag & PAGE_FREE) return PAGE_KIND_FREE;
+    return PAGE_KIND_OTHER;
+}
+
+void stats_add(uint64_t* counter, uint64_t n) {
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+static uint32_t bucket_of(uint64_t ns) {
+    uint32_t bucket = ns ? 63 - (uint32_t)__builtin_clzll(ns) : 0;
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+void latency_histogram_record(LatencyHistogram* histogram, uint64_t ns) {
+    stats_add(&histogram->count, 1);
+    stats_add(&histogram->total_ns, ns);
+    stats_add(&histogram->buckets[bucket_of(ns)], 1);
+    uint64_t max = __atomic_load_n(&histogram->max_ns, __ATOMIC_RELAXED);
+    while (ns > max && !__atomic_compare_exchange_n(&histogram->max_ns, &max, ns, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+// PagerStats is nothing but uint64_t counters - walk it as an array of them
+#define STATS_WORDS (sizeof(PagerStats) / sizeof(uint64_t))
+
+void stats_snapshot(const PagerStats* stats, PagerStats* out) {
+    const uint64_t* from = (const uint64_t*)stats;
+    uint64_t* to = (uint64_t*)out;
+    for (size_t i = 0; i < STATS_WORDS; i++) to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+}
+
+void stats_reset(PagerStats* stats) {
+    uint64_t* words = (uint64_t*)stats;
+    for (size_t i = 0; i < STATS_WORDS; i++) __atomic_store_n(&words[i], 0, __ATOMIC_RELAXED);
+}
+
+
+/* Reading */
+uint64_t latency_histogram_percentile(const LatencyHistogram* histogram, double p) {
+    if (histogram->count == 0) return 0;
+    uint64_t rank = (uint64_t)(histogram->count * p / 100.0);
+    if (rank >= histogram->count) rank = histogram->count - 1;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen > rank) {
+            uint64_t upper = (2ULL << i) - 1;
+            return upper < histogram->max_ns ? upper : histogram->max_ns;  // The top bucket's bound can be way off
+        }
+    }
+    return histogram->max_ns;
+}
+
+static const char* const kind_names[PAGE_KIND_COUNT] = {
+    [PAGE_KIND_HEADER] = "header",
+    [PAGE_KIND_INDEX_INTERNAL] = "index_internal",
+    [PAGE_KIND_INDEX_LEAF] = "index_leaf",
+    [PAGE_KIND_DATA] = "data",
+    [PAGE_KIND_OVERFLOW] = "overflow",
+    [PAGE_KIND_FREE] = "free",
+    [PAGE_KIND_OTHER] = "other",
+};
+
+const char* pager_page_kind_name(PageKind kind) {
+    return kind < PAGE_KIND_COUNT ? kind_names[kind] : "unknown";
+}
+
+static const char* const op_names[PAGER_OP_COUNT] = {
+    [PAGER_OP_GET_PAGE] = "get_page",
+    [PAGER_OP_ALLOCATE] = "allocate",
+    [PAGER_OP_SYNC] = "sync",
+    [PAGER_OP_JOURNAL_WRITE] = "journal_write",
+};
+
+const char* pager_op_name(PagerOp op) {
+    return op < PAGER_OP_COUNT ? op_names[op] : "unknown";
+}
+
+// The memset table - top level counters first, then four rows per histogram
+static const struct {
+    const char* name;
+    size_t offset;
+} counter_rows[] = {
+    { "pages_allocated", offsetof(PagerStats, pages_allocated) },
+    { "remaps", offsetof(PagerStats, remaps) },
+    { "syncs", offsetof(PagerStats, syncs) },
+    { "pages_synced", offsetof(PagerStats, pages_synced) },
+    { "journal_writes", offsetof(PagerStats, journal_writes) },
+    { "journal_pages", offsetof(PagerStats, journal_pages) },
+    { "minor_faults", offsetof(PagerStats, minor_faults) },
+    { "major_faults", offsetof(PagerStats, major_faults) },
+};
+#define COUNTER_ROWS (sizeof(counter_rows) / sizeof(counter_rows[0]))
+
+static const char* const histogram_rows[PAGER_OP_COUNT][4] = {
+    [PAGER_OP_GET_PAGE] = { "get_page_count", "get_page_p50_ns", "get_page_p99_ns", "get_page_max_ns" },
+    [PAGER_OP_ALLOCATE] = { "allocate_count", "allocate_p50_ns", "allocate_p99_ns", "allocate_max_ns" },
+    [PAGER_OP_SYNC] = { "sync_count", "sync_p50_ns", "sync_p99_ns", "sync_max_ns" },
+    [PAGER_OP_JOURNAL_WRITE] = { "journal_write_count", "journal_write_p50_ns", "journal_write_p99_ns", "journal_write_max_ns" },
+};
+
+bool pager_stats_row(const PagerStats* stats, size_t i, PagerStatRow* row) {
+    if (i < COUNTER_ROWS) {
+        row->name = counter_rows[i].name;
+        memcpy(&row->value, (const uint8_t*)stats + counter_rows[i].offset, sizeof(uint64_t));
+        return true;
+    }
+    i -= COUNTER_ROWS;
+    if (i >= (size_t)PAGER_OP_COUNT * 4) return false;
+
+    const LatencyHistogram* histogram = &stats->latency[i / 4];
+    row->name = histogram_rows[i / 4][i % 4];
+    switch (i % 4) {
+        case 0: row->value = histogram->count; break;
+        case 1: row->value = latency_histogram_percentile(histogram, 50); break;
+        case 2: row->value = latency_histogram_percentile(histogram, 99); break;
+        default: row->value = histogram->max_ns; break;
+    }
+    return true;
+}
@@ -0,0 +1,114 @@
+/* Pager statistics and tracing - what the pager did, split by page type, and how long it took
+ *
+ * Counters are always kept. Latency histograms cost a clock_gettime() on either side of every page fetch, so they are
+ * only filled in with PAGER_STATS_TIMING (or while a trace callback is set - events carry their duration).
+ * Histograms have log2 buckets: bucket i counts operations that took [2^i, 2^(i+1)) ns, bucket 0 also takes 0 ns.
+ *
+ * Everything is updated with relaxed atomics - pages are fetched from any thread, and syncs run on whichever committer
+ * leads the group commit. The trace callback is called on those same threads, sometimes with a pager lock held, so it
+ * must not call back into the pager.
+ *
+ * PagerStats is flat uint64_t counters so a snapshot can be taken field by field - see pager_get_stats(). The memset and
+ * dbpage virtual tables read it through pager_stats_row() and pager_page_kind_name().
+ */
+
+#ifndef PRESEQL_PAGER_STATS_H
+#define PRESEQL_PAGER_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Page types by the flag in their DBPageHeader - page 0 is always the header
+typedef enum {
+    PAGE_KIND_HEADER,
+    PAGE_KIND_INDEX_INTERNAL,
+    PAGE_KIND_INDEX_LEAF,
+    PAGE_KIND_DATA,
+    PAGE_KIND_OVERFLOW,
+    PAGE_KIND_FREE,       // Free list trunks - other free pages are never fetched
+    PAGE_KIND_OTHER,      // Pointer map pages, and pages nothing has formatted yet
+    PAGE_KIND_COUNT
+} PageKind;
+
+// Operations with a latency histogram
+typedef enum {
+    PAGER_OP_GET_PAGE,       // pager_get_page() - a pointer into the mapping, or a buffer pool fetch that may read
+    PAGER_OP_ALLOCATE,       // allocate_new_db_page(s) - includes growing the file and the mapping when the extent runs out
+    PAGER_OP_SYNC,           // msync(MS_SYNC), the group commit fdatasync() of the DB or WAL file, and the journal's fdatasync()
+    PAGER_OP_JOURNAL_WRITE,  // Appending a commit to the WAL, or a buffer of before-images to the rollback journal
+    PAGER_OP_COUNT
+} PagerOp;
+
+#define LATENCY_BUCKETS 40  // Up to 2^40 ns - about 18 minutes
+
+typedef struct {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[LATENCY_BUCKETS];
+} LatencyHistogram;
+
+typedef struct {
+    uint64_t gets;         // pager_get_page() calls that returned a page of this kind
+    uint64_t writes;       // pager_write_page() calls
+    uint64_t formatted;    // Pages allocate_page() set up as this kind
+} PageKindStats;
+
+typedef struct {
+    uint64_t pages_allocated;   // Pages handed out past the end of the DB by allocate_new_db_page(s)
+    uint64_t remaps;            // Times the file (and the mapping, in mmap mode) grew by an extent
+    uint64_t syncs;             // Waits for the disk - msync(MS_SYNC), fdatasync()
+    uint64_t pages_synced;      // ...pages covered by msync(MS_SYNC) - an fdatasync() covers whatever was written
+    uint64_t journal_writes;    // Commits appended to the WAL, pwritev()s to the rollback journal
+    uint64_t journal_pages;     // ...frames or before-images in them
+    uint64_t minor_faults;      // Page faults since the pager was opened - process wide, from getrusage(), only filled in
+    uint64_t major_faults;      // by pager_get_stats()
+    PageKindStats kinds[PAGE_KIND_COUNT];
+    LatencyHistogram latency[PAGER_OP_COUNT];
+} PagerStats;
+
+/* Trace callback - one call per event */
+typedef enum {
+    PAGER_TRACE_GET,            // page_no fetched
+    PAGER_TRACE_WRITE,          // page_no marked written
+    PAGER_TRACE_FORMAT,         // page_no set up as kind
+    PAGER_TRACE_ALLOCATE,       // count pages from page_no added past the end of the DB
+    PAGER_TRACE_REMAP,          // The file grew to hold count pages
+    PAGER_TRACE_SYNC,           // count pages from page_no synced - count 0 for an fdatasync() of the whole file
+    PAGER_TRACE_JOURNAL_WRITE,  // count frames appended to the WAL, or before-images to the rollback journal
+} PagerTraceType;
+
+typedef struct {
+    PagerTraceType type;
+    uint32_t page_no;
+    uint32_t count;
+    PageKind kind;          // PAGE_KIND_OTHER where the event isn't about one page
+    uint64_t duration_ns;   // 0 for events that aren't timed (WRITE, FORMAT, REMAP)
+} PagerTraceEvent;
+
+typedef void (*PagerTraceFn)(void* ctx, const PagerTraceEvent* event);
+
+/* Recording - called by the pager */
+PageKind page_kind_of(uint32_t page_no, uint8_t flag);
+void latency_histogram_record(LatencyHistogram* histogram, uint64_t ns);
+void stats_add(uint64_t* counter, uint64_t n);
+
+/* Snapshot and reset - every counter is read/written atomically, the snapshot as a whole is not one instant */
+void stats_snapshot(const PagerStats* stats, PagerStats* out);
+void stats_reset(PagerStats* stats);
+
+/* Reading */
+// Upper bound of the bucket the p-th percentile (0-100) falls in - 0 if nothing was recorded
+uint64_t latency_histogram_percentile(const LatencyHistogram* histogram, double p);
+const char* pager_page_kind_name(PageKind kind);
+const char* pager_op_name(PagerOp op);
+
+// Row i of the memset virtual table - name/value pairs for every counter and histogram summary. false past the last row
+typedef struct {
+    const char* name;
+    uint64_t value;
+} PagerStatRow;
+bool pager_stats_row(const PagerStats* stats, size_t i, PagerStatRow* row);
+
+#endif /* PRESEQL_PAGER_STATS_H */
@@ -3,18 +3,27 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include "constants.h"
 #include "algorithm/radix_tree.h"
+#include "algorithm/bitmap.h"
 #include "pager/db/base/page.h"
+#include "pager/cache/buffer_pool.h"
+#include "pager/wal/wal.h"
+#include "pager/journal/journal.h"
+#include "pager/group_commit.h"
+#include "pager/stats.h"
 
 /* Pager structure forward declaration same to avoid recursive imports */
 typedef struct Pager Pager;
+typedef struct Checkpointer Checkpointer;  // Background checkpoint thread - pager/wal/checkpointer.h
+typedef struct PagerBackup PagerBackup;    // Online backup in progress - pager/backup.h
 
 /* Free space management structures */
 typedef enum {
-    BUCKET_FULL,         // 0-25% free out of MAX_USABLE_PAGE_SIZE
-    BUCKET_MOSTLY_FULL,  // 25-50% free out of MAX_USABLE_PAGE_SIZE
-    BUCKET_MOSTLY_EMPTY, // 50-75% free out of MAX_USABLE_PAGE_SIZE
+    BUCKET_FULL,         // 0-25% free out of USABLE_PAGE_SIZE()
+    BUCKET_MOSTLY_FULL,  // 25-50% free out of USABLE_PAGE_SIZE()
+    BUCKET_MOSTLY_EMPTY, // 50-75% free out of USABLE_PAGE_SIZE()
     // BUCKET_EMPTY is redundant - page would be marked as freed
 } FreeSpaceBucket;
 
@@ -30,36 +39,173 @@ typedef struct {
 } FreeSpaceTracker;
 
 typedef struct {
-    uint8_t num_frees;
+    uint32_t num_frees;
+    bool rebuild;  // The list on disk no longer matches the tree - sync_free_page_list() rewrites all of it
     RadixTree tree;
 } PageTracker;
 
 /* Pager structures */
 typedef struct {
     int fd;            // File descriptor for the database file
-    void* mem_start;   // Start of memory-mapped region for database file
-    size_t file_size;  // Size of the memory-mapped region
+    void* mem_start;   // Start of memory-mapped region for database file - stays put as the file grows
+    uint32_t page_size;  // Fixed when the DB is created and read back from its header - DEFAULT_PAGE_SIZE unless picked otherwise
+    size_t file_size;  // Size of the file (and the file mapping) - runs ahead of page_count by the preallocated extent
+    size_t reserved_size;  // Virtual address space reserved for the mapping to grow into
+    uint32_t page_count;   // Pages actually handed out
+    Bitmap dirty_pages;    // Pages written since the last flush - mmap mode only
     PageTracker* free_page_map;   // Tracks free pages in a Radix Tree
     FreeSpaceTracker* free_data_page_slots;  // Variable size slots in Data Page
     FreeSpaceTracker* overflow_data_page_slots;  // Variable sized chunks/slots in Overflow
     // Index Pages doesn't need radix trees - searching free_slot_list[] enough
 } DatabasePager;
 
+/* I/O counters - to check a flush only touches what changed */
 typedef struct {
-    int fd;             // File descriptor for the journal file
-    void* mem_start;    // Start of memory-mapped region for journal file
-    size_t file_size;   // Size of the memory-mapped region
-    PageTracker* free_page_map;   // Tracks free pages in a Radix Tree
-} JournalPager;
+    uint64_t dirty_pages;     // Pages currently waiting for a flush
+    uint64_t pages_dirtied;   // Pages newly marked dirty (a page written twice before a flush counts once)
+    uint64_t pages_written;   // Pages synced to disk
+    uint64_t sync_ranges;     // msync calls - each covers a run of adjacent dirty pages
+    uint64_t flushes;         // Flushes that had something to sync
+
+    // Per-page checksums (DB_PAGE_CHECKSUMS) - what they cost
+    uint64_t pages_sealed;        // Checksums computed on the way to disk
+    uint64_t seal_ns;
+    uint64_t pages_verified;      // Pages checked on their first access this session
+    uint64_t verify_ns;
+    uint64_t checksum_failures;   // Pages that didn't match - pager_get_page() returned NULL for them
+
+    // Read-ahead hints (pager_prefetch)
+    uint64_t prefetch_calls;      // madvise/posix_fadvise calls - each covers a run of adjacent pages
+    uint64_t pages_prefetched;
+
+    // Auto-vacuum (DB_AUTO_VACUUM / DB_INCREMENTAL_VACUUM)
+    uint64_t pages_relocated;     // Pages moved from the end of the file into a free page
+    uint64_t pages_truncated;     // Pages cut off the end of the file
+
+    // In-memory database (PAGER_MEMORY_DB)
+    uint64_t undo_pages;          // Before-images saved for rollback
+
+    uint64_t header_writes;       // pager_write_page() calls on page 0 - once per commit that changed pager->header
+} PagerIOStats;
+
+/* Vacuum mode - picked when the DB is created, stored in the header flags */
+typedef enum {
+    VACUUM_NONE = 0,
+    VACUUM_FULL,         // DB_AUTO_VACUUM
+    VACUUM_INCREMENTAL,  // DB_INCREMENTAL_VACUUM
+} VacuumMode;
+
+/* Pointer map directory - page numbers of the pointer map pages in chain order, pointer map page i covers pages
+ * i * PTRMAP_ENTRIES(pager) and up. Only kept with a vacuum mode, see pager/db/vacuum.h */
+typedef struct {
+    uint32_t* pages;
+    uint32_t count;
+    uint32_t capacity;
+} PointerMap;
+
+/* Undo log of an in-memory database (PAGER_MEMORY_DB) - the before-image of every page the open transaction touched,
+ * copied back by pager_rollback(). See pager/memory_db.h */
+typedef struct {
+    Bitmap saved;       // Pages with an image in the log - under the pager lock, readers can add to it too
+    uint32_t* pages;    // Page number of each image, in the order they were saved
+    uint8_t* images;    // count page images back to back
+    uint32_t count;
+    uint32_t capacity;  // Images there is room for
+} UndoLog;
+
+/* A savepoint of the open transaction (PAGER_JOURNALING_ENABLED) - see pager_savepoint() */
+typedef struct {
+    char* name;
+    JournalMark mark;           // Where the journal was - rolling back to it undoes the records after
+    bool truncate_pending;      // As it was at the mark
+    bool began_transaction;     // Set outside a transaction, so it began one - releasing it commits
+} PagerSavepoint;
+
+/* How pages are about to be read - passed on to the kernel as madvise (mmap) or posix_fadvise (buffer pool) advice */
+typedef enum {
+    PAGER_ACCESS_NORMAL,      // Default readahead around each fault
+    PAGER_ACCESS_RANDOM,      // Point lookups - only read the page asked for
+    PAGER_ACCESS_SEQUENTIAL,  // Scans in file order - read ahead aggressively
+} PagerAccessPattern;
+
+/* WAL checkpointing */
+typedef enum {
+    CHECKPOINT_PASSIVE,   // Copy what it can without holding up commits - only resets the WAL if nothing got committed meanwhile
+    CHECKPOINT_FULL,      // Hold up commits until every frame is in the main file, then reset the WAL
+    CHECKPOINT_TRUNCATE,  // FULL, and shrink the WAL file back to just its header
+} CheckpointMode;
+
+typedef struct {
+    CheckpointMode mode;       // Mode for automatic checkpoints
+    uint32_t frame_threshold;  // Checkpoint once this many committed frames aren't in the main file yet - 0 turns it off
+    size_t byte_threshold;     // ...or once the WAL file grows past this - 0 turns it off
+    bool background;           // Automatic checkpoints run on the checkpointer thread instead of the committing one
+} CheckpointPolicy;
+
+typedef struct {
+    uint64_t checkpoints;        // Checkpoints run, automatic or not
+    uint64_t resets;             // ...that emptied the WAL
+    uint64_t failures;
+    uint64_t pages_written;      // Pages copied into the main file
+    uint64_t lag_frames;         // Committed frames not in the main file yet
+    uint64_t max_lag_frames;
+    uint64_t last_lag_us;        // How long the oldest un-checkpointed commit had waited when the last checkpoint started
+    uint64_t max_lag_us;
+    uint64_t last_duration_us;
+    uint64_t max_duration_us;
+    uint64_t total_duration_us;
+} CheckpointStats;
 
 /* Pager structure definition */
 struct Pager {
     char* filename;             // Database filename
     char* journal_filename;     // Journal filename
     DatabasePager db_pager;
-    JournalPager journal_pager;
-    uint8_t flags;              // Pager flags
+    JournalPager journal_pager;  // PAGER_JOURNALING_ENABLED - before-images for rollback, see pager/journal/journal.h
+    JournalRecoveryStats recovery;  // The hot journal init_pager() rolled back, if there was one
+    DatabaseHeader header;      // Page 0's header - changed here, copied into page 0 on flush/commit/close if header_dirty
+    bool header_dirty;
+    uint32_t flags;             // Pager flags
     bool read_only;             // Whether the database is opened in read-only mode
+    BufferPool* buffer_pool;    // Only set with PAGER_BUFFER_POOL - NULL means pages come straight from the mmap
+    size_t cache_size;          // Buffer pool size in frames
+    CompressedCache* compressed_cache;  // PAGER_COMPRESSION - LZ images of data/overflow pages evicted from the buffer pool
+    size_t compressed_cache_size;       // In bytes
+    PagerIOStats io_stats;
+    PagerStats stats;           // Per operation and page type, see pager/stats.h - atomics, read with pager_get_stats()
+    PagerTraceFn trace;         // Called for every page I/O event - NULL for none
+    void* trace_ctx;
+    uint64_t faults_at_open[2]; // Minor and major faults of the process when the pager was opened
+    bool page_checksums;        // DB_PAGE_CHECKSUMS is set in the header
+    Bitmap verified_pages;      // Pages whose checksum was checked this session - under lock
+    int access_pattern;         // PagerAccessPattern last handed to the kernel - swapped atomically, lookups and scans flip it from any thread
+    VacuumMode vacuum_mode;     // From the header flags - VACUUM_NONE means no pointer map
+    PointerMap ptrmap;
+    bool truncate_pending;      // Vacuum moved page_count down - the file follows once the commit is durable
+    UndoLog undo_log;           // PAGER_MEMORY_DB - before-images for rollback, there is no journal or WAL to undo from
+    PagerBackup* backups;       // Backups in progress - told about every page written, under writer_lock
+    PagerSavepoint* savepoints; // Open savepoints, oldest first - under writer_lock, dropped when the transaction ends
+    uint32_t savepoint_count;
+    uint32_t savepoint_capacity;
+
+    // Write-ahead log mode (PAGER_WAL) - the mapping is MAP_PRIVATE so changes only reach the main file through a checkpoint
+    char* wal_filename;
+    Wal* wal;
+    Bitmap wal_stale_pages;     // Pages whose newest committed image is in the WAL, not the main file - loaded on next access
+    bool in_transaction;
+    uint32_t txn_page_count;    // page_count when the transaction began - restored on rollback
+
+    // Checkpointing - the WAL index, frame counts and wal_stale_pages are shared with the checkpointer thread under lock
+    pthread_mutex_t lock;
+    pthread_mutex_t checkpoint_lock;  // One checkpoint at a time - taken before lock
+    CheckpointPolicy checkpoint_policy;
+    CheckpointStats checkpoint_stats;
+    uint64_t oldest_uncheckpointed_us;  // When the oldest commit not in the main file yet happened - 0 if there is none
+    Checkpointer* checkpointer;         // NULL if automatic checkpoints run inline on commit
+
+    // Concurrent writers - one transaction at a time holds writer_lock, commits share fsyncs through the group commit
+    pthread_mutex_t writer_lock;
+    GroupCommit* group_commit;          // NULL when read-only
 };
 
 /* Database handle structure */
@@ -78,14 +224,14 @@ typedef struct {
 } SlotEntry;
 
 typedef struct {
-    uint16_t next_page_id;  // Page of overflow page
+    uint32_t next_page_id;  // Page of overflow page
     uint16_t next_chunk_id;  // Page of chunk in overflow page that contains more data
 } OverflowPointer;
 
 /* Index page structures */
 typedef struct {
     uint8_t key[MAX_DATA_PER_INDEX_SLOT];   // Up to MAX_DATA_PER_INDEX_SLOT bytes of key
-    uint16_t next_page_id;  // Pointer to next Index page
+    uint32_t next_page_id;  // Pointer to next Index page
     uint8_t next_slot_id;   // Pointer to slot in next Index Page
     OverflowPointer overflow;  // Overflow pointer - null if no overflow
 } IndexSlotData;
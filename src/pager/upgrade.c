@@ -0,0 +1,223 @@
+#define _GNU_SOURCE  /* pread, pwrite, fsync under -std=c99 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "pager/upgrade.h"
+#include "pager/constants.h"
+#include "pager/db/base/page.h"
+#include "pager/wal/wal.h"
+#include "pager/file_io.h"
+#include "algorithm/crc.h"
+
+/* v1 layouts - frozen, only the upgrade reads them. v1 pages were always V1_PAGE_SIZE */
+#define V1_FREE_SLOT_LIST_SIZE 16
+
+typedef struct {
+    char magic[MAGIC_NUMBER_SIZE];
+    uint16_t page_size;
+    uint16_t db_version;
+    uint16_t root_table_catalog;
+    uint16_t root_column_catalog;
+    uint16_t root_fk_catalog;
+    uint16_t free_page_list[FREE_PAGE_LIST_SIZE];
+    uint16_t free_page_count;
+    uint16_t highest_page;
+    uint16_t transaction_state;
+    uint16_t flags;
+    uint32_t checksum;
+} DatabaseHeaderV1;
+
+typedef struct {
+    uint16_t page_id;
+    uint16_t ref_counter;
+    uint8_t flag;
+    uint16_t free_start;
+    uint16_t free_end;
+    uint16_t free_total;
+    uint8_t total_slots;
+    uint8_t highest_slot;
+    uint8_t free_slot_count;
+    uint8_t free_slot_list[V1_FREE_SLOT_LIST_SIZE];
+    uint16_t right_sibling_page_id;
+} DBPageHeaderV1;  // 34 bytes
+
+
+// The database header sits right after the page header of page 0, which is where the two versions differ
+uint16_t upgrade_detect_version(const uint8_t* page0) {
+    DatabaseHeader header;
+    memcpy(&header, page0 + sizeof(DBPageHeader), sizeof(header));
+    if (memcmp(header.magic, MAGIC_NUMBER, MAGIC_NUMBER_SIZE) == 0) return header.db_version;
+
+    DatabaseHeaderV1 v1;  // Copied out - at offset 34 its checksum isn't 4 byte aligned
+    memcpy(&v1, page0 + sizeof(DBPageHeaderV1), sizeof(v1));
+    if (memcmp(v1.magic, MAGIC_NUMBER, MAGIC_NUMBER_SIZE) == 0) return DB_FORMAT_VERSION_V1;
+    return 0;
+}
+
+static ssize_t pread_page(int fd, uint8_t* buf, uint32_t page_no) {
+    size_t done = 0;
+    while (done < V1_PAGE_SIZE) {
+        ssize_t n = pread(fd, buf + done, V1_PAGE_SIZE - done, (off_t)page_no * V1_PAGE_SIZE + done);
+        if (n < 0) {
+            perror("pread");
+            return -1;
+        }
+        if (n == 0) break;  // Past the end of the file
+        done += n;
+    }
+    memset(buf + done, 0, V1_PAGE_SIZE - done);
+    return done;
+}
+
+static PSqlStatus pwrite_page(int fd, const uint8_t* buf, uint32_t page_no) {
+    size_t done = 0;
+    while (done < V1_PAGE_SIZE) {
+        ssize_t n = pwrite(fd, buf + done, V1_PAGE_SIZE - done, (off_t)page_no * V1_PAGE_SIZE + done);
+        if (n < 0) {
+            perror("pwrite");
+            return PSQL_IOERR;
+        }
+        done += n;
+    }
+    return PSQL_OK;
+}
+
+uint16_t upgrade_file_version(int fd) {
+    uint8_t page0[V1_PAGE_SIZE];
+    if (pread_page(fd, page0, 0) != V1_PAGE_SIZE) return 0;
+    return upgrade_detect_version(page0);
+}
+
+PSqlStatus upgrade_page(uint8_t* page, uint32_t page_no) {
+    DBPageHeaderV1 old;
+    memcpy(&old, page, sizeof(old));
+
+    // Slot payloads hold page numbers too (IndexSlotData, DataSlotData and Chunk overflow pointers) and
+    // nothing in v1 wrote them, so there's no known layout to convert - refuse rather than misread them
+    if (page_no != 0 && old.total_slots > 0) {
+        fprintf(stderr, "upgrade: page %u has %u slots in use, can't convert it from v1\n", page_no, old.total_slots);
+        return PSQL_CORRUPT;
+    }
+
+    DatabaseHeaderV1 old_header;
+    if (page_no == 0) memcpy(&old_header, page + sizeof(DBPageHeaderV1), sizeof(old_header));
+
+    DBPageHeader header;
+    memset(&header, 0, sizeof(header));
+    header.page_id = old.page_id;
+    header.right_sibling_page_id = old.right_sibling_page_id;
+    header.ref_counter = old.ref_counter;
+    header.free_start = old.free_start;
+    header.free_end = old.free_end;
+    header.free_total = old.free_total;
+    header.flag = old.flag;
+    header.total_slots = old.total_slots;
+    header.highest_slot = old.highest_slot;
+    // The free slot list got shorter - slots that don't fit are no longer reused, but highest_slot still accounts for them
+    header.free_slot_count = old.free_slot_count < FREE_SLOT_LIST_SIZE ? old.free_slot_count : FREE_SLOT_LIST_SIZE;
+    memcpy(header.free_slot_list, old.free_slot_list, header.free_slot_count);
+
+    // Data area moves 2 bytes down, and the journal reserved area behind it is new
+    memmove(page + sizeof(DBPageHeader), page + sizeof(DBPageHeaderV1), USABLE_PAGE_SIZE(V1_PAGE_SIZE));
+    memset(page + sizeof(DBPageHeader) + USABLE_PAGE_SIZE(V1_PAGE_SIZE), 0, MAX_JOURNAL_HEADER_SIZE);
+    memcpy(page, &header, sizeof(header));
+
+    if (page_no == 0) {
+        DatabaseHeader* db = (DatabaseHeader*)(page + sizeof(DBPageHeader));
+        memset(db, 0, sizeof(DatabaseHeader));
+        memcpy(db->magic, old_header.magic, MAGIC_NUMBER_SIZE);
+        db->page_size = old_header.page_size;
+        db->db_version = DB_FORMAT_VERSION;
+        db->root_table_catalog = old_header.root_table_catalog;
+        db->root_column_catalog = old_header.root_column_catalog;
+        db->root_fk_catalog = old_header.root_fk_catalog;
+        for (int i = 0; i < FREE_PAGE_LIST_SIZE; i++) db->free_page_list[i] = old_header.free_page_list[i];
+        db->free_page_count = old_header.free_page_count;
+        db->highest_page = old_header.highest_page;
+        db->transaction_state = old_header.transaction_state;
+        db->flags = old_header.flags;
+        db->checksum = calculate_crc32(db, offsetof(DatabaseHeader, checksum));
+    }
+    return PSQL_OK;
+}
+
+PSqlStatus upgrade_db_file(const char* filename, const char* wal_filename) {
+    char* tmp_filename = with_extension(filename, UPGRADE_FILE_EXTENSION);
+    uint8_t* page = (uint8_t*)malloc(V1_PAGE_SIZE);
+    if (!tmp_filename || !page) {
+        free(tmp_filename);
+        free(page);
+        return PSQL_NOMEM;
+    }
+    PSqlStatus status = PSQL_IOERR;
+    int out = -1;
+    Wal* wal = NULL;
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror("open");
+        goto done;
+    }
+
+    // Opened read-only it only indexes the committed frames - a missing WAL is just an empty one
+    wal = wal_open(wal_filename, true, V1_PAGE_SIZE);
+    if (!wal) goto done;
+    if (wal->frame_count && wal->header.version != WAL_VERSION_V1) {
+        fprintf(stderr, "upgrade: %s is newer than the v1 database it belongs to\n", wal_filename);
+        status = PSQL_CORRUPT;
+        goto done;
+    }
+
+    uint32_t page_count = st.st_size / V1_PAGE_SIZE;
+    if (wal->db_page_count > page_count) page_count = wal->db_page_count;
+
+    out = open(tmp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        perror("open");
+        goto done;
+    }
+
+    for (uint32_t page_no = 0; page_no < page_count; page_no++) {
+        uint32_t frame;
+        if (wal_find_frame(wal, page_no, &frame)) {
+            status = wal_read_frame(wal, frame, page);
+            if (status != PSQL_OK) goto done;
+        } else if (pread_page(fd, page, page_no) < 0) {
+            status = PSQL_IOERR;
+            goto done;
+        }
+
+        status = upgrade_page(page, page_no);
+        if (status != PSQL_OK) goto done;
+        status = pwrite_page(out, page, page_no);
+        if (status != PSQL_OK) goto done;
+    }
+
+    status = PSQL_IOERR;
+    if (fsync(out) != 0) {
+        perror("fsync");
+        goto done;
+    }
+    if (rename(tmp_filename, filename) != 0) {
+        perror("rename");
+        goto done;
+    }
+    status = sync_parent_dir(filename);
+
+    // The frames are in the new file now. If we crash before this unlink, the v1 WAL left behind gets reset on the next open
+    if (status == PSQL_OK) unlink(wal_filename);
+
+done:
+    if (out >= 0) close(out);
+    if (status != PSQL_OK) unlink(tmp_filename);
+    if (fd >= 0) close(fd);
+    wal_close(wal, false);
+    free(tmp_filename);
+    free(page);
+    return status;
+}
@@ -0,0 +1,29 @@
+/* File format upgrades - a database written by an older format version is converted when it is opened
+ *
+ * v1 -> v2: page numbers went from 16 to 32 bits. That widens the DatabaseHeader roots and free list,
+ * and DBPageHeader page_id/right_sibling_page_id - the page header stays 32 bytes by giving up 4 entries
+ * of the free slot list (v1 was 34 bytes and pushed DBPage 2 bytes past its 4KB page).
+ * The data area keeps its contents, it just starts 2 bytes earlier - slot offsets are relative to it.
+ *
+ * A writable open rewrites the file into "<filename>.pseql-upgrade" and renames it over the original,
+ * so a crash leaves either the old file or the new one. Committed frames of a v1 WAL get folded in on the way.
+ * A read-only open converts a private copy of the mapping instead and leaves the file alone.
+ */
+
+#ifndef PRESEQL_PAGER_UPGRADE_H
+#define PRESEQL_PAGER_UPGRADE_H
+
+#include <stdint.h>
+#include "status/db.h"
+
+// Format version of a page 0 image - DB_FORMAT_VERSION, DB_FORMAT_VERSION_V1, or 0 if it isn't a database
+uint16_t upgrade_detect_version(const uint8_t* page0);
+uint16_t upgrade_file_version(int fd);
+
+// Convert one v1 page image in place
+PSqlStatus upgrade_page(uint8_t* page, uint32_t page_no);
+
+// Rewrite a v1 database file as v2, folding in any committed frames of its WAL - the WAL is deleted afterwards
+PSqlStatus upgrade_db_file(const char* filename, const char* wal_filename);
+
+#endif /* PRESEQL_PAGER_UPGRADE_H */
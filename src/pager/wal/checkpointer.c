@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "checkpointer.h"
+#include "pager/pager_format.h"
+
+struct Checkpointer {
+    Pager* pager;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    bool requested;  // Pokes while a checkpoint is running fold into one more run
+    bool stopping;
+};
+
+static void* checkpointer_main(void* arg) {
+    Checkpointer* checkpointer = (Checkpointer*)arg;
+    Pager* pager = checkpointer->pager;
+
+    pthread_mutex_lock(&checkpointer->mutex);
+    for (;;) {
+        while (!checkpointer->requested && !checkpointer->stopping) {
+            pthread_cond_wait(&checkpointer->wake, &checkpointer->mutex);
+        }
+        if (checkpointer->stopping) break;
+        checkpointer->requested = false;
+        pthread_mutex_unlock(&checkpointer->mutex);
+
+        // Failures are counted in the checkpoint stats - the WAL keeps the frames, the next poke retries
+        // The pages belong to the foreground thread, so its private copies are left alone
+        run_checkpoint(pager, pager->checkpoint_policy.mode, false);
+
+        pthread_mutex_lock(&checkpointer->mutex);
+    }
+    pthread_mutex_unlock(&checkpointer->mutex);
+    return NULL;
+}
+
+Checkpointer* checkpointer_start(Pager* pager) {
+    Checkpointer* checkpointer = (Checkpointer*)calloc(1, sizeof(Checkpointer));
+    if (!checkpointer) return NULL;
+
+    checkpointer->pager = pager;
+    pthread_mutex_init(&checkpointer->mutex, NULL);
+    pthread_cond_init(&checkpointer->wake, NULL);
+
+    if (pthread_create(&checkpointer->thread, NULL, checkpointer_main, checkpointer) != 0) {
+        perror("pthread_create");
+        pthread_cond_destroy(&checkpointer->wake);
+        pthread_mutex_destroy(&checkpointer->mutex);
+        free(checkpointer);
+        return NULL;
+    }
+    return checkpointer;
+}
+
+void checkpointer_stop(Checkpointer* checkpointer) {
+    if (!checkpointer) return;
+
+    pthread_mutex_lock(&checkpointer->mutex);
+    checkpointer->stopping = true;
+    pthread_cond_signal(&checkpointer->wake);
+    pthread_mutex_unlock(&checkpointer->mutex);
+    pthread_join(checkpointer->thread, NULL);
+
+    pthread_cond_destroy(&checkpointer->wake);
+    pthread_mutex_destroy(&checkpointer->mutex);
+    free(checkpointer);
+}
+
+void checkpointer_notify(Checkpointer* checkpointer) {
+    if (!checkpointer) return;
+
+    pthread_mutex_lock(&checkpointer->mutex);
+    checkpointer->requested = true;
+    pthread_cond_signal(&checkpointer->wake);
+    pthread_mutex_unlock(&checkpointer->mutex);
+}
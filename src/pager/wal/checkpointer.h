@@ -0,0 +1,15 @@
+/* Background checkpointer - a worker thread owned by the Pager that runs the automatic WAL checkpoints,
+ * so copying pages back into the main file doesn't land on whoever happened to commit.
+ * Commits that push the WAL past the checkpoint policy thresholds just wake it up.
+ */
+
+#ifndef PRESEQL_PAGER_WAL_CHECKPOINTER_H
+#define PRESEQL_PAGER_WAL_CHECKPOINTER_H
+
+#include "pager/types.h"
+
+Checkpointer* checkpointer_start(Pager* pager);
+void checkpointer_stop(Checkpointer* checkpointer);  // Waits for a running checkpoint to finish
+void checkpointer_notify(Checkpointer* checkpointer);
+
+#endif /* PRESEQL_PAGER_WAL_CHECKPOINTER_H */
@@ -0,0 +1,429 @@
+#define _GNU_SOURCE  /* pread, pwrite, fdatasync, strdup under -std=c99 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "wal.h"
+#include "pager/file_io.h"
+#include "algorithm/crc.h"
+
+#define WAL_INDEX_MIN_CAPACITY 256
+#define WAL_CHECKPOINT_BATCH 32  // Adjacent pages written back with one pwrite
+
+
+/* WAL index */
+static size_t index_slot(WalIndex* index, uint32_t page_no) {
+    return (page_no * 2654435761u) & (index->capacity - 1);
+}
+
+static bool index_init(WalIndex* index, size_t capacity) {
+    index->slots = (WalIndexEntry*)calloc(capacity, sizeof(WalIndexEntry));
+    index->capacity = capacity;
+    index->count = 0;
+    return index->slots != NULL;
+}
+
+static bool index_put(WalIndex* index, uint32_t page_no, uint32_t frame);
+
+// Keep the load factor under 1/2 so probe chains stay short
+static bool index_grow(WalIndex* index) {
+    WalIndex bigger;
+    if (!index_init(&bigger, index->capacity * 2)) return false;
+    for (size_t i = 0; i < index->capacity; i++) {
+        if (index->slots[i].frame_plus_one) {
+            index_put(&bigger, index->slots[i].page_no, index->slots[i].frame_plus_one - 1);
+        }
+    }
+    free(index->slots);
+    *index = bigger;
+    return true;
+}
+
+static bool index_put(WalIndex* index, uint32_t page_no, uint32_t frame) {
+    if ((index->count + 1) * 2 > index->capacity && !index_grow(index)) return false;
+
+    size_t slot = index_slot(index, page_no);
+    while (index->slots[slot].frame_plus_one && index->slots[slot].page_no != page_no) {
+        slot = (slot + 1) & (index->capacity - 1);
+    }
+    if (!index->slots[slot].frame_plus_one) index->count++;
+    index->slots[slot].page_no = page_no;
+    index->slots[slot].frame_plus_one = frame + 1;  // Newer frames always win
+    return true;
+}
+
+static void index_clear(WalIndex* index) {
+    memset(index->slots, 0, index->capacity * sizeof(WalIndexEntry));
+    index->count = 0;
+}
+
+bool wal_find_frame(Wal* wal, uint32_t page_no, uint32_t* frame) {
+    WalIndex* index = &wal->index;
+    if (index->count == 0) return false;
+
+    size_t slot = index_slot(index, page_no);
+    while (index->slots[slot].frame_plus_one) {
+        if (index->slots[slot].page_no == page_no) {
+            *frame = index->slots[slot].frame_plus_one - 1;
+            return true;
+        }
+        slot = (slot + 1) & (index->capacity - 1);
+    }
+    return false;
+}
+
+
+/* File I/O helpers */
+static off_t frame_offset(Wal* wal, uint32_t frame) {
+    return (off_t)WAL_HEADER_SIZE + (off_t)frame * WAL_FRAME_SIZE(wal->page_size);
+}
+
+static uint32_t new_salt(Wal* wal) {
+    // Doesn't need to be cryptographic, just different from the last generation
+    uint32_t salt = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16) ^ (wal->header.salt * 2654435761u) ^ (uint32_t)clock();
+    return salt ? salt : 1;
+}
+
+static void frame_seal(Wal* wal, WalFrameHeader* frame, const void* page_data) {
+    frame->data_checksum = calculate_crc32(page_data, wal->page_size);
+    frame->checksum = calculate_crc32(frame, offsetof(WalFrameHeader, checksum));
+}
+
+static bool frame_valid(Wal* wal, const WalFrameHeader* frame, const void* page_data) {
+    return frame->salt == wal->header.salt &&
+           frame->checksum == calculate_crc32(frame, offsetof(WalFrameHeader, checksum)) &&
+           frame->data_checksum == calculate_crc32(page_data, wal->page_size);
+}
+
+// Write a fresh header for a new generation and drop every frame
+// Without truncate the old frames stay in the file but carry the old salt, so they can never be mistaken for new ones
+static PSqlStatus write_new_header(Wal* wal, bool truncate) {
+    WalHeader* header = &wal->header;
+    uint32_t seq = header->checkpoint_seq;
+    uint32_t salt = new_salt(wal);
+
+    memset(header, 0, sizeof(WalHeader));
+    memcpy(header->magic, WAL_MAGIC, sizeof(WAL_MAGIC));
+    header->version = WAL_VERSION;
+    header->page_size = wal->page_size;
+    header->checkpoint_seq = seq + 1;
+    header->salt = salt;
+    header->checksum = calculate_crc32(header, offsetof(WalHeader, checksum));
+
+    if (pwrite_all(wal->fd, header, sizeof(WalHeader), 0) != PSQL_OK) return PSQL_IOERR;
+    if (truncate && ftruncate(wal->fd, WAL_HEADER_SIZE) != 0) {
+        perror("ftruncate");
+        return PSQL_IOERR;
+    }
+    if (fdatasync(wal->fd) != 0) {
+        perror("fdatasync");
+        return PSQL_IOERR;
+    }
+    wal->stats.syncs++;
+
+    wal->frame_count = 0;
+    wal->backfilled = 0;
+    wal->synced_frames = 0;
+    wal->db_page_count = 0;
+    index_clear(&wal->index);
+    return PSQL_OK;
+}
+
+// Scan an existing WAL and index every frame up to the last valid commit marker
+static PSqlStatus recover(Wal* wal) {
+    ssize_t n = pread_all(wal->fd, &wal->header, sizeof(WalHeader), 0);
+    if (n < 0) return PSQL_IOERR;
+
+    WalHeader* header = &wal->header;
+    bool header_ok = n == (ssize_t)sizeof(WalHeader) &&
+                     memcmp(header->magic, WAL_MAGIC, sizeof(WAL_MAGIC)) == 0 &&
+                     header->version >= WAL_VERSION_V1 && header->version <= WAL_VERSION &&
+                     header->page_size == wal->page_size &&
+                     header->checksum == calculate_crc32(header, offsetof(WalHeader, checksum));
+    if (!header_ok) {
+        // Empty or garbage - nothing to recover, start a new generation
+        if (wal->read_only) {
+            memset(header, 0, sizeof(WalHeader));
+            return PSQL_OK;
+        }
+        return write_new_header(wal, true);
+    }
+
+    uint8_t* buf = (uint8_t*)malloc(WAL_FRAME_SIZE(wal->page_size));
+    if (!buf) return PSQL_NOMEM;
+    WalFrameHeader* frame = (WalFrameHeader*)buf;
+    uint8_t* data = buf + sizeof(WalFrameHeader);
+
+    // Frames of a transaction only go into the index once its commit frame is seen
+    uint32_t txn_start = 0;
+    for (uint32_t i = 0;; i++) {
+        n = pread_all(wal->fd, buf, WAL_FRAME_SIZE(wal->page_size), frame_offset(wal, i));
+        if (n != (ssize_t)WAL_FRAME_SIZE(wal->page_size) || !frame_valid(wal, frame, data)) break;
+
+        if (frame->db_page_count) {
+            for (uint32_t j = txn_start; j <= i; j++) {
+                WalFrameHeader committed;
+                if (pread_all(wal->fd, &committed, sizeof(committed), frame_offset(wal, j)) != (ssize_t)sizeof(committed) ||
+                    !index_put(&wal->index, committed.page_no, j)) {
+                    free(buf);
+                    return PSQL_IOERR;
+                }
+            }
+            wal->frame_count = i + 1;
+            wal->db_page_count = frame->db_page_count;
+            txn_start = i + 1;
+        }
+    }
+
+    free(buf);
+    wal->synced_frames = wal->frame_count;
+    wal->stats.recovered_frames = wal->frame_count;
+    return PSQL_OK;
+}
+
+
+/* Public API */
+Wal* wal_open(const char* filename, bool read_only, uint32_t page_size) {
+    Wal* wal = (Wal*)calloc(1, sizeof(Wal));
+    if (!wal) return NULL;
+
+    wal->fd = -1;
+    wal->read_only = read_only;
+    wal->page_size = page_size;
+    wal->filename = strdup(filename);
+    if (!wal->filename || !index_init(&wal->index, WAL_INDEX_MIN_CAPACITY)) {
+        wal_close(wal, false);
+        return NULL;
+    }
+
+    wal->fd = open(filename, read_only ? O_RDONLY : (O_RDWR | O_CREAT), 0644);
+    if (wal->fd < 0) {
+        if (read_only && errno == ENOENT) return wal;  // No WAL to read - the main file is all there is
+        perror("open");
+        wal_close(wal, false);
+        return NULL;
+    }
+
+    if (recover(wal) != PSQL_OK) {
+        wal_close(wal, false);
+        return NULL;
+    }
+    return wal;
+}
+
+void wal_close(Wal* wal, bool delete_file) {
+    if (!wal) return;
+    if (wal->fd >= 0) close(wal->fd);
+    if (delete_file && wal->filename && !wal->read_only) unlink(wal->filename);
+    free(wal->index.slots);
+    free(wal->pending);
+    free(wal->filename);
+    free(wal);
+}
+
+PSqlStatus wal_append_frame(Wal* wal, uint32_t page_no, const void* page_data) {
+    if (!wal || wal->read_only) return PSQL_READONLY;
+
+    if (wal->pending_count == wal->pending_capacity) {
+        uint32_t capacity = wal->pending_capacity ? wal->pending_capacity * 2 : 16;
+        uint8_t* pending = (uint8_t*)realloc(wal->pending, (size_t)capacity * WAL_FRAME_SIZE(wal->page_size));
+        if (!pending) return PSQL_NOMEM;
+        wal->pending = pending;
+        wal->pending_capacity = capacity;
+    }
+
+    uint8_t* slot = wal->pending + (size_t)wal->pending_count * WAL_FRAME_SIZE(wal->page_size);
+    WalFrameHeader* frame = (WalFrameHeader*)slot;
+    memset(frame, 0, sizeof(WalFrameHeader));
+    frame->page_no = page_no;
+    frame->salt = wal->header.salt;
+    memcpy(slot + sizeof(WalFrameHeader), page_data, wal->page_size);
+    wal->pending_count++;
+    return PSQL_OK;
+}
+
+void wal_discard_pending(Wal* wal) {
+    if (wal) wal->pending_count = 0;
+}
+
+// The last staged frame becomes the commit frame, everything goes out in one write
+// Not durable until wal_sync() - readers in this process can see it already, a checkpoint can't copy it yet
+PSqlStatus wal_commit(Wal* wal, uint32_t db_page_count) {
+    if (!wal || wal->read_only) return PSQL_READONLY;
+    if (wal->pending_count == 0) return PSQL_OK;
+    if (db_page_count == 0) return PSQL_MISUSE;
+
+    for (uint32_t i = 0; i < wal->pending_count; i++) {
+        uint8_t* slot = wal->pending + (size_t)i * WAL_FRAME_SIZE(wal->page_size);
+        WalFrameHeader* frame = (WalFrameHeader*)slot;
+        if (i == wal->pending_count - 1) frame->db_page_count = db_page_count;
+        frame_seal(wal, frame, slot + sizeof(WalFrameHeader));
+    }
+
+    size_t len = (size_t)wal->pending_count * WAL_FRAME_SIZE(wal->page_size);
+    if (pwrite_all(wal->fd, wal->pending, len, frame_offset(wal, wal->frame_count)) != PSQL_OK) {
+        wal_discard_pending(wal);
+        return PSQL_IOERR;
+    }
+
+    // Written in full - only now can readers see the new frames
+    for (uint32_t i = 0; i < wal->pending_count; i++) {
+        WalFrameHeader* frame = (WalFrameHeader*)(wal->pending + (size_t)i * WAL_FRAME_SIZE(wal->page_size));
+        if (!index_put(&wal->index, frame->page_no, wal->frame_count + i)) return PSQL_NOMEM;
+    }
+
+    wal->frame_count += wal->pending_count;
+    wal->db_page_count = db_page_count;
+    wal->stats.frames_written += wal->pending_count;
+    wal->stats.commits++;
+    wal->pending_count = 0;
+    return PSQL_OK;
+}
+
+PSqlStatus wal_sync(Wal* wal) {
+    if (!wal || wal->read_only) return PSQL_READONLY;
+    if (fdatasync(wal->fd) != 0) {
+        perror("fdatasync");
+        return PSQL_IOERR;
+    }
+    return PSQL_OK;
+}
+
+void wal_mark_synced(Wal* wal, uint32_t checkpoint_seq, uint32_t frame_count) {
+    wal->stats.syncs++;
+    // A checkpoint reset the WAL in the meantime - it synced everything itself before copying
+    if (wal->header.checkpoint_seq != checkpoint_seq) return;
+    if (frame_count > wal->synced_frames) wal->synced_frames = frame_count;
+}
+
+PSqlStatus wal_read_frame(Wal* wal, uint32_t frame, void* page_data) {
+    if (!wal || wal->fd < 0 || frame >= wal->frame_count) return PSQL_NOTFOUND;
+    off_t offset = frame_offset(wal, frame) + sizeof(WalFrameHeader);
+    if (pread_all(wal->fd, page_data, wal->page_size, offset) != (ssize_t)wal->page_size) return PSQL_IOERR;
+    return PSQL_OK;
+}
+
+PSqlStatus wal_reset(Wal* wal) {
+    if (!wal) return PSQL_ERROR;
+    if (wal->read_only) {
+        // Can't rewrite the file - just stop seeing its frames
+        wal->frame_count = 0;
+        wal->backfilled = 0;
+        wal->synced_frames = 0;
+        wal->db_page_count = 0;
+        index_clear(&wal->index);
+        return PSQL_OK;
+    }
+    return write_new_header(wal, true);
+}
+
+static int compare_checkpoint_entries(const void* a, const void* b) {
+    uint32_t x = ((const WalCheckpointEntry*)a)->page_no;
+    uint32_t y = ((const WalCheckpointEntry*)b)->page_no;
+    return (x > y) - (x < y);
+}
+
+// Every page whose newest frame isn't in the main file yet - the index only holds the newest, so superseded frames drop out
+PSqlStatus wal_checkpoint_plan(Wal* wal, WalCheckpointPlan* plan) {
+    memset(plan, 0, sizeof(WalCheckpointPlan));
+    if (!wal || wal->read_only) return PSQL_READONLY;
+    plan->max_frame = wal->frame_count;
+    if (wal->frame_count == wal->backfilled) return PSQL_OK;
+
+    plan->entries = (WalCheckpointEntry*)malloc((wal->index.count + 1) * sizeof(WalCheckpointEntry));
+    if (!plan->entries) return PSQL_NOMEM;
+
+    for (size_t i = 0; i < wal->index.capacity; i++) {
+        WalIndexEntry* slot = &wal->index.slots[i];
+        if (!slot->frame_plus_one || slot->frame_plus_one - 1 < wal->backfilled) continue;
+        plan->entries[plan->count].page_no = slot->page_no;
+        plan->entries[plan->count].frame = slot->frame_plus_one - 1;
+        plan->count++;
+    }
+
+    // Page order - the main file gets written front to back instead of in commit order
+    qsort(plan->entries, plan->count, sizeof(WalCheckpointEntry), compare_checkpoint_entries);
+    return PSQL_OK;
+}
+
+static PSqlStatus write_batch(Wal* wal, int db_fd, const uint8_t* pages, uint32_t count, uint32_t first_page) {
+    return pwrite_all(db_fd, pages, (size_t)count * wal->page_size, (off_t)first_page * wal->page_size);
+}
+
+// Runs of adjacent pages are gathered and written with one pwrite - frames are immutable until the next reset
+PSqlStatus wal_checkpoint_copy(Wal* wal, int db_fd, const WalCheckpointPlan* plan) {
+    if (!wal || wal->read_only) return PSQL_READONLY;
+    if (plan->count == 0) return PSQL_OK;
+
+    uint8_t* batch = (uint8_t*)malloc((size_t)WAL_CHECKPOINT_BATCH * wal->page_size);
+    if (!batch) return PSQL_NOMEM;
+
+    uint32_t batch_count = 0;
+    uint32_t batch_start = 0;
+    for (uint32_t i = 0; i < plan->count; i++) {
+        const WalCheckpointEntry* entry = &plan->entries[i];
+        bool adjacent = batch_count > 0 && entry->page_no == batch_start + batch_count;
+        if (batch_count > 0 && (!adjacent || batch_count == WAL_CHECKPOINT_BATCH)) {
+            if (write_batch(wal, db_fd, batch, batch_count, batch_start) != PSQL_OK) {
+                free(batch);
+                return PSQL_IOERR;
+            }
+            batch_count = 0;
+        }
+        if (batch_count == 0) batch_start = entry->page_no;
+
+        off_t offset = frame_offset(wal, entry->frame) + sizeof(WalFrameHeader);
+        if (pread_all(wal->fd, batch + (size_t)batch_count * wal->page_size, wal->page_size, offset) != (ssize_t)wal->page_size) {
+            free(batch);
+            return PSQL_IOERR;
+        }
+        batch_count++;
+    }
+    PSqlStatus status = write_batch(wal, db_fd, batch, batch_count, batch_start);
+    free(batch);
+    if (status != PSQL_OK) return status;
+
+    // The main file has to be durable before the frames can go away
+    if (fsync(db_fd) != 0) {
+        perror("fsync");
+        return PSQL_IOERR;
+    }
+    return PSQL_OK;
+}
+
+PSqlStatus wal_checkpoint_finish(Wal* wal, const WalCheckpointPlan* plan, bool truncate, bool* reset) {
+    *reset = false;
+    if (!wal || wal->read_only) return PSQL_READONLY;
+
+    if (wal->frame_count == 0) {
+        // Nothing to checkpoint - a truncate still drops frames a non-truncating reset left behind
+        if (truncate && ftruncate(wal->fd, WAL_HEADER_SIZE) != 0) {
+            perror("ftruncate");
+            return PSQL_IOERR;
+        }
+        return PSQL_OK;
+    }
+
+    if (plan->max_frame > wal->backfilled) wal->backfilled = plan->max_frame;
+    wal->stats.frames_checkpointed += plan->count;
+    wal->stats.checkpoints++;
+
+    // Commits that came in during the copy aren't in the main file - the WAL has to keep them
+    if (wal->backfilled < wal->frame_count) return PSQL_OK;
+
+    PSqlStatus status = write_new_header(wal, truncate);
+    if (status == PSQL_OK) *reset = true;
+    return status;
+}
+
+void wal_checkpoint_plan_free(WalCheckpointPlan* plan) {
+    free(plan->entries);
+    plan->entries = NULL;
+    plan->count = 0;
+}
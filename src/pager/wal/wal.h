@@ -0,0 +1,102 @@
+/* Write-ahead log - redo log alternative to the rollback journal (PAGER_WAL)
+ *
+ * Commits append the new image of every page they changed to the WAL with a single write,
+ * the main database file is left alone. The fsync is separate so commits can share one (see pager/group_commit.h). The WAL index maps page number -> newest committed
+ * frame, so a reader can tell whether the main file copy of a page is stale.
+ * A checkpoint copies the newest frame of each page back into the main file and resets the WAL.
+ * It comes in three steps so the copy can run while other commits carry on - see wal_checkpoint_plan().
+ */
+
+#ifndef PRESEQL_PAGER_WAL_H
+#define PRESEQL_PAGER_WAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "wal_format.h"
+#include "status/db.h"
+
+// Page number -> newest committed frame, open addressing with linear probing
+typedef struct {
+    uint32_t page_no;
+    uint32_t frame_plus_one;  // 0 means the slot is empty
+} WalIndexEntry;
+
+typedef struct {
+    WalIndexEntry* slots;
+    size_t capacity;  // Power of 2
+    size_t count;
+} WalIndex;
+
+typedef struct {
+    uint64_t commits;              // Transactions committed to the WAL
+    uint64_t frames_written;       // Frames appended (committed)
+    uint64_t syncs;                // fsyncs of the WAL file - one per group of commits
+    uint64_t checkpoints;          // Completed checkpoints
+    uint64_t frames_checkpointed;  // Pages copied back into the main file
+    uint64_t recovered_frames;     // Committed frames found when the WAL was opened
+} WalStats;
+
+typedef struct {
+    int fd;
+    char* filename;
+    bool read_only;
+    uint32_t page_size;        // Page size of the database - every frame holds one page image
+    WalHeader header;
+    uint32_t frame_count;      // Committed frames in the file
+    uint32_t backfilled;       // Frames below this are already in the main file
+    uint32_t synced_frames;    // Frames below this are durable - the rest are written but waiting on an fsync
+    uint32_t db_page_count;    // Database size as of the last commit (0 if the WAL is empty)
+    WalIndex index;
+
+    // Frames staged by wal_append_frame() - written out together by wal_commit()
+    uint8_t* pending;
+    uint32_t pending_count;
+    uint32_t pending_capacity;
+
+    WalStats stats;
+} Wal;
+
+// One page to copy back into the main file
+typedef struct {
+    uint32_t page_no;
+    uint32_t frame;
+} WalCheckpointEntry;
+
+typedef struct {
+    WalCheckpointEntry* entries;  // Newest frame of each page, sorted by page number so the main file is written sequentially
+    uint32_t count;
+    uint32_t max_frame;           // Frames below this are covered
+} WalCheckpointPlan;
+
+/* Open or create the WAL - an existing WAL is scanned and its committed frames indexed */
+Wal* wal_open(const char* filename, bool read_only, uint32_t page_size);  // A WAL written for another page size is treated as garbage
+void wal_close(Wal* wal, bool delete_file);
+
+/* Writing - stage page images, commit them with one write, then make them durable
+ * wal_sync() only touches the file so it can run without whatever lock guards the Wal,
+ * wal_mark_synced() records what it covered - frame_count and checkpoint_seq as they were before the sync
+ */
+PSqlStatus wal_append_frame(Wal* wal, uint32_t page_no, const void* page_data);
+PSqlStatus wal_commit(Wal* wal, uint32_t db_page_count);
+void wal_discard_pending(Wal* wal);
+PSqlStatus wal_sync(Wal* wal);
+void wal_mark_synced(Wal* wal, uint32_t checkpoint_seq, uint32_t frame_count);
+
+/* Reading */
+bool wal_find_frame(Wal* wal, uint32_t page_no, uint32_t* frame);
+PSqlStatus wal_read_frame(Wal* wal, uint32_t frame, void* page_data);
+
+/* Checkpoint
+ * plan   - pick the newest frame of every page committed since the last checkpoint (needs the index to hold still)
+ * copy   - write them into db_fd and fsync it (the frames have to be synced already), only reads frames below plan->max_frame so commits can go on meanwhile
+ * finish - mark them backfilled, and reset the WAL if nothing was committed since the plan (needs the index to hold still)
+ * A reset that truncates shrinks the file back to its header, otherwise the next frames overwrite the old ones in place
+ */
+PSqlStatus wal_checkpoint_plan(Wal* wal, WalCheckpointPlan* plan);
+PSqlStatus wal_checkpoint_copy(Wal* wal, int db_fd, const WalCheckpointPlan* plan);
+PSqlStatus wal_checkpoint_finish(Wal* wal, const WalCheckpointPlan* plan, bool truncate, bool* reset);
+void wal_checkpoint_plan_free(WalCheckpointPlan* plan);
+PSqlStatus wal_reset(Wal* wal);  // Drop every frame - read-only just forgets them
+
+#endif /* PRESEQL_PAGER_WAL_H */
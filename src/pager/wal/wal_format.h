@@ -0,0 +1,48 @@
+/* Write-ahead log (WAL) file format - the `.pseql-wal` file next to the database
+ *
+ * [ WalHeader ] 32 bytes
+ * [ WalFrameHeader | page image ] frame 0
+ * [ WalFrameHeader | page image ] frame 1
+ * ...
+ *
+ * Each frame is the redo image of one page after a transaction. The last frame of a transaction
+ * has db_page_count set (0 on every other frame) - that is the commit marker. On open only the
+ * frames up to the last commit marker count, anything after it is a torn or uncommitted write.
+ *
+ * Every frame carries the header's salt. After a checkpoint the WAL is reset with a new salt,
+ * so stale frames left in the file from before the reset can never pass validation.
+ */
+
+#ifndef PRESEQL_PAGER_WAL_FORMAT_H
+#define PRESEQL_PAGER_WAL_FORMAT_H
+
+#include <stdint.h>
+#include "pager/constants.h"
+
+#define WAL_MAGIC "PSQLWAL"  /* 7 chars + null terminator fills the 8 byte magic */
+#define WAL_VERSION 2  /* Frames hold DB format v2 pages */
+#define WAL_VERSION_V1 1  /* Frames hold DB format v1 pages - still readable so an upgrade can fold them in, see pager/upgrade.h */
+
+typedef struct {
+    char magic[MAGIC_NUMBER_SIZE];  // WAL_MAGIC
+    uint32_t version;               // WAL_VERSION, or WAL_VERSION_V1 for a WAL written before the format upgrade
+    uint32_t page_size;             // Must match the database
+    uint32_t checkpoint_seq;        // Bumped every reset - handy for debugging which generation a WAL is
+    uint32_t salt;                  // Random per generation - frames with a different salt are stale
+    uint32_t reserved;
+    uint32_t checksum;              // CRC-32 of everything above
+} WalHeader;
+
+typedef struct {
+    uint32_t page_no;          // Page this frame is an image of
+    uint32_t db_page_count;    // Database size in pages after the commit - only set on commit frames
+    uint32_t salt;             // Copy of WalHeader.salt
+    uint32_t data_checksum;    // CRC-32 of the page image
+    uint32_t reserved;
+    uint32_t checksum;         // CRC-32 of everything above
+} WalFrameHeader;
+
+#define WAL_HEADER_SIZE (sizeof(WalHeader))
+#define WAL_FRAME_SIZE(page_size) (sizeof(WalFrameHeader) + (page_size))
+
+#endif /* PRESEQL_PAGER_WAL_FORMAT_H */
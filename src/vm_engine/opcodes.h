@@ -33,6 +33,9 @@ typedef enum {
     OP_BEGIN_TXN,  /* Start a transaction */
     OP_COMMIT,  /* Commit all changes - also flushes to disk */
     OP_ROLLBACK,  /* Undo changes */
+    OP_SAVEPOINT,  /* Set a savepoint named by the string operand - begins a transaction outside one */
+    OP_RELEASE,  /* Forget the savepoint named by the string operand and the ones after it - commits if it began the transaction */
+    OP_ROLLBACK_TO,  /* Undo the changes since the savepoint named by the string operand, which stays open */
 
     /* Join operations for doing primary key-foreign key table relations */
     OP_OUTER_JOIN,  /* Join between two tables on column 1 to column 2, can either be a left join or a right join */
@@ -48,13 +51,17 @@ typedef enum {
     OP_GET_SCHEMA,
     OP_GET_LOGS,
     OP_GET_BTREEINFO,
-    OP_GET_DBPAGE,
-    OP_GET_MEMSET
+    OP_GET_DBPAGE,  /* Row b of the dbpage table - pager counters for one page type, see pager/stats.h */
+    OP_GET_MEMSET,  /* Row b of the memset table - one pager counter or latency summary per row */
+
+    /* Maintenance */
+    OP_VACUUM_INTO  /* Rebuild the DB compactly into the file named by the string operand - pager_vacuum_into() */
 } PSqlOpcode;
 
 typedef struct {
     PSqlOpcode opcode;
     int a, b, c;
+    char *string_param;  /* Savepoint or file name - NULL for opcodes without a string operand */
 } PSqlInstruction;
 
 
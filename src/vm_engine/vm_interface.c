@@ -1,5 +1,7 @@
 /* Implementation of VM backend entry points */
 
+#include <string.h>
+
 #include "vm.h"
 #include "preseql.h"
 #include "status/step.h"
@@ -91,6 +93,100 @@ void psql_op_halt(PSqlStatement *vm, int a, int b, int c) {
     vm->result_code = a;  // Set result code to a
 }
 
+/* Pager calls - a failed one stops the statement with message as its error */
+// The handlers don't get the string operand - it is on the instruction psql_step() just moved past
+static const char *string_operand(PSqlStatement *vm) {
+    return vm->program[vm->pc - 1].string_param;
+}
+
+// For a status the call has no message of its own for
+static const char *status_message(PSqlStatus status) {
+    switch (status) {
+        case PSQL_OK:       return "not an error";
+        case PSQL_BUSY:     return "database is locked";
+        case PSQL_NOMEM:    return "out of memory";
+        case PSQL_READONLY: return "attempt to write a readonly database";
+        case PSQL_IOERR:    return "disk I/O error";
+        case PSQL_CORRUPT:  return "database disk image is malformed";
+        case PSQL_NOTFOUND: return "not found";
+        case PSQL_FULL:     return "database or disk is full";
+        case PSQL_MISUSE:   return "called out of sequence";
+        case PSQL_INTERNAL: return "internal error";
+        default:            return "error";
+    }
+}
+
+static void pager_call_status(PSqlStatement *vm, PSqlStatus status, const char *message) {
+    if (status == PSQL_OK) return;
+    vm->result_code = status == PSQL_BUSY ? PSQL_STEP_BUSY : PSQL_STEP_ERROR;
+    size_t length = strlen(message) + 1;  // psql_finalize() frees it - no strdup() under -std=c99
+    vm->error_msg = malloc(length);
+    if (vm->error_msg) memcpy(vm->error_msg, message, length);
+}
+
+void psql_op_vacuum_into(PSqlStatement *vm, int a, int b, int c) {
+    const char *path = string_operand(vm);
+    if (!path) {
+        pager_call_status(vm, PSQL_ERROR, "VACUUM INTO needs a file name");
+        return;
+    }
+    pager_call_status(vm, pager_vacuum_into((Pager*)vm->db->pager, path), "VACUUM INTO failed - it can't run inside a transaction, or over the database itself");
+}
+
+/* Transactions and savepoints - see pager_savepoint() */
+void psql_op_begin_txn(PSqlStatement *vm, int a, int b, int c) {
+    pager_call_status(vm, pager_begin_transaction((Pager*)vm->db->pager), "cannot begin a transaction");
+}
+
+void psql_op_commit(PSqlStatement *vm, int a, int b, int c) {
+    pager_call_status(vm, pager_commit((Pager*)vm->db->pager), "cannot commit - no transaction is active");
+}
+
+void psql_op_rollback(PSqlStatement *vm, int a, int b, int c) {
+    pager_call_status(vm, pager_rollback((Pager*)vm->db->pager), "cannot roll back - no transaction is active");
+}
+
+void psql_op_savepoint(PSqlStatement *vm, int a, int b, int c) {
+    pager_call_status(vm, pager_savepoint((Pager*)vm->db->pager, string_operand(vm)), "cannot set a savepoint without the rollback journal");
+}
+
+// Only PSQL_NOTFOUND is an unknown name - anything else is reported as what it is
+static void savepoint_status(PSqlStatement *vm, PSqlStatus status) {
+    if (status == PSQL_NOTFOUND) pager_call_status(vm, status, "no such savepoint");
+    else if (status == PSQL_MISUSE) pager_call_status(vm, status, "no transaction is active");
+    else pager_call_status(vm, status, status_message(status));
+}
+
+void psql_op_release(PSqlStatement *vm, int a, int b, int c) {
+    savepoint_status(vm, pager_release_savepoint((Pager*)vm->db->pager, string_operand(vm)));
+}
+
+void psql_op_rollback_to(PSqlStatement *vm, int a, int b, int c) {
+    savepoint_status(vm, pager_rollback_to_savepoint((Pager*)vm->db->pager, string_operand(vm)));
+}
+
+/* Virtual tables - pager statistics, see pager/stats.h */
+void psql_op_get_memset(PSqlStatement *vm, int a, int b, int c) {
+    // a = first register of the row (name, value)
+    // b = row number - one per counter and histogram summary
+    PagerStats stats = pager_get_stats((Pager*)vm->db->pager);
+    PagerStatRow row;
+    vm->has_row = pager_stats_row(&stats, (size_t)b, &row);
+    if (vm->has_row) printf("memset row %d into register %d: %s = %llu\n", b, a, row.name, (unsigned long long)row.value);
+}
+
+void psql_op_get_dbpage(PSqlStatement *vm, int a, int b, int c) {
+    // a = first register of the row (page type, gets, writes, formatted)
+    // b = row number - one per PageKind
+    PagerStats stats = pager_get_stats((Pager*)vm->db->pager);
+    vm->has_row = b >= 0 && b < PAGE_KIND_COUNT;
+    if (vm->has_row) {
+        PageKindStats* kind = &stats.kinds[b];
+        printf("dbpage row %d into register %d: %s gets %llu writes %llu formatted %llu\n", b, a, pager_page_kind_name((PageKind)b),
+               (unsigned long long)kind->gets, (unsigned long long)kind->writes, (unsigned long long)kind->formatted);
+    }
+}
+
 /* Jump table */
 /* Abuses Designated initializer - assign to the index directly  - so its an OPCode to function ptr map */
 PSqlOpFunc psql_jump_table[MAX_OPCODES] = {
@@ -103,6 +199,15 @@ PSqlOpFunc psql_jump_table[MAX_OPCODES] = {
     [OP_COMPARE] = psql_op_compare,
     [OP_JUMP_IF_FALSE] = psql_op_jump_if_false,
     [OP_HALT] = psql_op_halt,
+    [OP_BEGIN_TXN] = psql_op_begin_txn,
+    [OP_COMMIT] = psql_op_commit,
+    [OP_ROLLBACK] = psql_op_rollback,
+    [OP_SAVEPOINT] = psql_op_savepoint,
+    [OP_RELEASE] = psql_op_release,
+    [OP_ROLLBACK_TO] = psql_op_rollback_to,
+    [OP_VACUUM_INTO] = psql_op_vacuum_into,
+    [OP_GET_MEMSET] = psql_op_get_memset,
+    [OP_GET_DBPAGE] = psql_op_get_dbpage,
     // TODO: Bind more ops to the jump table
 };
 
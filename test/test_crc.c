@@ -0,0 +1,109 @@
+/* Test program for CRC-32 / CRC-32C - known check values, every table entry, the accelerated paths against the
+ * table-only ones at every length and alignment, and combining */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "algorithm/crc.h"
+#include "algorithm/crc_table.h"
+
+#define CRC32_POLY 0xEDB88320u
+#define CRC32C_POLY 0x82F63B78u
+
+// The definition, one bit at a time - everything else is checked against this
+static uint32_t crc_bitwise(uint32_t poly, const uint8_t* buf, size_t length) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= buf[i];
+        for (int j = 0; j < 8; j++) crc = (crc & 1) ? (crc >> 1) ^ poly : crc >> 1;
+    }
+    return ~crc;
+}
+
+int main() {
+    printf("CRC-32 accelerated: %s, CRC-32C accelerated: %s\n",
+           crc32_accelerated() ? "yes (PCLMULQDQ)" : "no (slice-by-8)", crc32c_accelerated() ? "yes (SSE4.2)" : "no (slice-by-8)");
+
+    printf("\nCheck values:\n");
+    const char* check = "123456789";
+    assert(calculate_crc32(check, 9) == 0xCBF43926);
+    assert(calculate_crc32c(check, 9) == 0xE3069283);
+    assert(calculate_crc32("", 0) == 0);
+    assert(calculate_crc32c("", 0) == 0);
+    printf("CRC-32 \"123456789\" = %08X, CRC-32C = %08X\n", calculate_crc32(check, 9), calculate_crc32c(check, 9));
+
+    // table[k][i] is byte i run through the register, then k zero bytes - 8 * (k + 1) single bit steps
+    printf("\nTables against the bitwise definition:\n");
+    for (int k = 0; k < 8; k++) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c32 = i, c32c = i;
+            for (int bit = 0; bit < 8 * (k + 1); bit++) {
+                c32 = (c32 & 1) ? (c32 >> 1) ^ CRC32_POLY : c32 >> 1;
+                c32c = (c32c & 1) ? (c32c >> 1) ^ CRC32C_POLY : c32c >> 1;
+            }
+            assert(crc32_slice8[k][i] == c32);
+            assert(crc32c_slice8[k][i] == c32c);
+        }
+    }
+    printf("ok\n");
+
+    size_t size = 3 * 4096 + 64;
+    uint8_t* buf = (uint8_t*)malloc(size);
+    srand(1234);
+    for (size_t i = 0; i < size; i++) buf[i] = (uint8_t)rand();
+
+    // Every length up to a few folding rounds past 64, at every alignment - catches tail and head handling
+    printf("\nDispatch against slice-by-8 against bitwise, lengths 0-300 at offsets 0-15:\n");
+    for (size_t offset = 0; offset < 16; offset++) {
+        for (size_t length = 0; length <= 300; length++) {
+            uint32_t expect32 = crc_bitwise(CRC32_POLY, buf + offset, length);
+            uint32_t expect32c = crc_bitwise(CRC32C_POLY, buf + offset, length);
+            assert(calculate_crc32(buf + offset, length) == expect32);
+            assert(crc32_update_slice8(0, buf + offset, length) == expect32);
+            assert(calculate_crc32c(buf + offset, length) == expect32c);
+            assert(crc32c_update_slice8(0, buf + offset, length) == expect32c);
+        }
+    }
+    printf("ok\n");
+
+    printf("\nWhole pages:\n");
+    for (size_t length = 4096; length <= size; length += 4096) {
+        assert(calculate_crc32(buf, length) == crc_bitwise(CRC32_POLY, buf, length));
+        assert(calculate_crc32c(buf, length) == crc_bitwise(CRC32C_POLY, buf, length));
+    }
+    printf("ok\n");
+
+    printf("\nIncremental updates:\n");
+    uint32_t crc = 0, crcc = 0;
+    for (size_t done = 0; done < size;) {
+        size_t step = 1 + (size_t)rand() % 700;
+        if (step > size - done) step = size - done;
+        crc = crc32_update(crc, buf + done, step);
+        crcc = crc32c_update(crcc, buf + done, step);
+        done += step;
+    }
+    assert(crc == calculate_crc32(buf, size));
+    assert(crcc == calculate_crc32c(buf, size));
+    printf("ok\n");
+
+    printf("\nCombine:\n");
+    size_t splits[] = {0, 1, 7, 64, 100, 4096, 5000, size};
+    for (size_t i = 0; i < sizeof(splits) / sizeof(splits[0]); i++) {
+        size_t a = splits[i], b = size - a;
+        assert(crc32_combine(calculate_crc32(buf, a), calculate_crc32(buf + a, b), b) == calculate_crc32(buf, size));
+        assert(crc32c_combine(calculate_crc32c(buf, a), calculate_crc32c(buf + a, b), b) == calculate_crc32c(buf, size));
+    }
+
+    // Pages checksummed on their own, then stitched together - what a parallel checksum of a region does
+    uint32_t stitched = calculate_crc32(buf, 4096);
+    for (size_t page = 1; page < 3; page++) {
+        stitched = crc32_combine(stitched, calculate_crc32(buf + page * 4096, 4096), 4096);
+    }
+    assert(stitched == calculate_crc32(buf, 3 * 4096));
+    printf("ok\n");
+
+    free(buf);
+    printf("\nCRC test completed successfully\n");
+    return 0;
+}
@@ -0,0 +1,105 @@
+/* Test program for the LZ codec - round trips on page-like inputs, capacity limits, and decoding garbage without
+ * going out of bounds */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "algorithm/lz.h"
+
+#define PAGE 4096
+
+// Compress and decompress - returns the compressed size
+static size_t round_trip(const uint8_t* buf, size_t length) {
+    size_t bound = LZ_COMPRESS_BOUND(length);
+    uint8_t* packed = (uint8_t*)malloc(bound);
+    uint8_t* unpacked = (uint8_t*)malloc(length + 1);
+    size_t size = lz_compress(buf, length, packed, bound);
+    assert(size > 0 && size <= bound);
+    assert(lz_decompress(packed, size, unpacked, length));
+    assert(memcmp(buf, unpacked, length) == 0);
+
+    // The size has to be known - one byte more or less doesn't decode
+    if (length > 0) assert(!lz_decompress(packed, size, unpacked, length - 1));
+    assert(!lz_decompress(packed, size, unpacked, length + 1));
+    free(packed);
+    free(unpacked);
+    return size;
+}
+
+// A data page with rows of repetitive text and a zeroed gap, like the slot layout leaves it
+static void fill_text_page(uint8_t* page, size_t length) {
+    static const char* words[] = {"alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel"};
+    memset(page, 0, length);
+    size_t at = 32;
+    for (int row = 0; at + 64 < length / 2; row++) {
+        at += (size_t)snprintf((char*)page + at, 64, "%d|%s %s|%s@example.com;", row, words[row % 8], words[(row * 3) % 8], words[(row * 5) % 8]);
+    }
+}
+
+int main() {
+    uint8_t* buf = (uint8_t*)malloc(LZ_MAX_INPUT);
+    srand(1234);
+
+    printf("Small inputs, every length 0-300:\n");
+    for (size_t length = 0; length <= 300; length++) {
+        for (size_t i = 0; i < length; i++) buf[i] = (uint8_t)(i % 7 == 0 ? (size_t)rand() : 'a' + i % 3);
+        round_trip(buf, length);
+    }
+    printf("ok\n");
+
+    printf("\nPages:\n");
+    memset(buf, 0, PAGE);
+    size_t zeros = round_trip(buf, PAGE);
+    fill_text_page(buf, PAGE);
+    size_t text = round_trip(buf, PAGE);
+    for (size_t i = 0; i < PAGE; i++) buf[i] = (uint8_t)rand();
+    size_t random = round_trip(buf, PAGE);
+    printf("zeroed %zu, text %zu, random %zu bytes out of %d\n", zeros, text, random, PAGE);
+    assert(zeros < 64);
+    assert(text < PAGE / 2);
+    assert(random <= LZ_COMPRESS_BOUND(PAGE));
+    printf("ok\n");
+
+    // Runs longer than 255 after the nibble, overlapping copies at every short offset, offsets at the 16-bit limit
+    printf("\nLong runs and far matches:\n");
+    for (size_t period = 1; period <= 16; period++) {
+        for (size_t i = 0; i < PAGE; i++) buf[i] = (uint8_t)(i % period);
+        round_trip(buf, PAGE);
+    }
+    memset(buf, 0, LZ_MAX_INPUT);
+    for (size_t i = 0; i < 1000; i++) buf[10 + i] = (uint8_t)rand();
+    memcpy(buf + LZ_MAX_INPUT - 1000, buf + 10, 1000);  // Offset 64526
+    size_t far = round_trip(buf, LZ_MAX_INPUT);
+    assert(far < 1000 + 600);
+    printf("ok\n");
+
+    printf("\nCapacity:\n");
+    uint8_t packed[LZ_COMPRESS_BOUND(PAGE)];
+    fill_text_page(buf, PAGE);
+    assert(lz_compress(buf, PAGE, packed, text) == text);
+    assert(lz_compress(buf, PAGE, packed, text - 1) == 0);
+    assert(lz_compress(buf, LZ_MAX_INPUT + 1, packed, sizeof(packed)) == 0);
+    printf("ok\n");
+
+    // Truncated and corrupted streams have to fail cleanly - ASan catches any stray access
+    printf("\nCorrupt input:\n");
+    uint8_t out[PAGE];
+    for (size_t cut = 0; cut < text; cut++) assert(!lz_decompress(packed, cut, out, PAGE));
+    for (int trial = 0; trial < 20000; trial++) {
+        uint8_t garbage[64];
+        for (size_t i = 0; i < sizeof(garbage); i++) garbage[i] = (uint8_t)rand();
+        lz_decompress(garbage, 1 + (size_t)rand() % sizeof(garbage), out, 1 + (size_t)rand() % PAGE);
+    }
+    for (int trial = 0; trial < 2000; trial++) {
+        uint8_t flipped[LZ_COMPRESS_BOUND(PAGE)];
+        memcpy(flipped, packed, text);
+        flipped[(size_t)rand() % text] ^= (uint8_t)(1 + rand() % 255);
+        lz_decompress(flipped, text, out, PAGE);
+    }
+    printf("ok\n");
+
+    free(buf);
+    printf("\nLZ test completed successfully\n");
+    return 0;
+}
@@ -6,7 +6,7 @@
 #include "algorithm/radix_tree.h"
 
 // Shh, no unused warnings, I can't change my callback structure
-void print_page(uint16_t page, void* user_data __attribute__((unused))) {
+void print_page(uint32_t page, void* user_data __attribute__((unused))) {
     printf("Free page: %u\n", page);
 }
 
@@ -53,7 +53,7 @@ int main() {
     
     // Get free pages in order (smallest first)
     printf("\nGetting free pages in order:\n");
-    uint16_t page;
+    uint32_t page;
     while ((page = radix_tree_pop_min(tree)) != 0) {
         printf("Got free page: %u\n", page);
     }
@@ -62,9 +62,21 @@ int main() {
     printf("\nVerifying tree is empty:\n");
     radix_tree_walk(tree, print_page, NULL);
     
+    // Page numbers past the old 16-bit limit, spread across leaves and top-level nodes
+    printf("\nLarge page numbers (70000, 4096, 4095, 3000000000):\n");
+    radix_tree_insert(tree, 70000);
+    radix_tree_insert(tree, 4096);
+    radix_tree_insert(tree, 4095);
+    radix_tree_insert(tree, 3000000000u);
+    printf("Page 70000: %s\n", radix_tree_lookup(tree, 70000) ? "free" : "not free");
+    printf("Page 70001: %s\n", radix_tree_lookup(tree, 70001) ? "free" : "not free");
+    while ((page = radix_tree_pop_min(tree)) != 0) {
+        printf("Got free page: %u\n", page);
+    }
+
     // Test freelist conversion
     printf("\nTesting freelist conversion:\n");
-    uint16_t freelist[] = {666, 1337, 69, 420, 44100};
+    uint32_t freelist[] = {666, 1337, 69, 420, 44100};
     size_t count = sizeof(freelist) / sizeof(freelist[0]);
     
     freelist_to_radix(tree, freelist, count);
@@ -74,7 +86,7 @@ int main() {
     radix_tree_walk(tree, print_page, NULL);
     
     // Convert back to freelist
-    uint16_t output_freelist[10];
+    uint32_t output_freelist[10];
     size_t output_count = radix_to_freelist(tree, output_freelist, 10);
     
     printf("\nConverted back to freelist, got %zu items:\n", output_count);